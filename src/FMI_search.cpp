@@ -42,6 +42,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include "sais.h"
+#include "psa.h"
 #include "FMI_search.h"
 #include "memcpy_bwamem.h"
 #include "profiling.h"
@@ -226,6 +227,10 @@ last_smem_t *FMI_search::build_last_smem_table(int len) {
 	return table;
 }
 
+void fmi_load_smem_tables(int on) {
+	building_smem_table = !on;
+}
+
 int build_smem_tables(char *prefix) {
 	char all_smem_fn[PATH_MAX];
 	char last_smem_fn[PATH_MAX];
@@ -393,9 +398,10 @@ int _load_smem_table(const char *prefix,
 
 void FMI_search::load_smem_table() {
 #ifdef MEMSCALE
+	// no shm info when the shm is disabled: both tables come from the files
 	_load_smem_table(file_name,
-						bwa_shm_info->smem_all_on ? &all_smem_table : NULL,
-						bwa_shm_info->smem_last_on ? &last_smem_table : NULL);
+						!bwa_shm_info || bwa_shm_info->smem_all_on ? &all_smem_table : NULL,
+						!bwa_shm_info || bwa_shm_info->smem_last_on ? &last_smem_table : NULL);
 #else
 	//fprintf(stderr, "[DEBUG] %s all: %p last: %p\n", __func__, all_smem_table, last_smem_table);
 	_load_smem_table(file_name, &all_smem_table, &last_smem_table);
@@ -612,24 +618,9 @@ int FMI_search::build_fm_index(const char *ref_file_name, char *binary_seq, int6
     printf("ref_seq_len = %ld\n", ref_seq_len);
     fflush(stdout);
 
-    char outname[PATH_MAX];
-
-    strcpy_s(outname, PATH_MAX, ref_file_name);
-    strcat_s(outname, PATH_MAX, CP_FILENAME_SUFFIX);
-    //sprintf(outname, "%s.bwt.2bit.%d", ref_file_name, CP_BLOCK_SIZE);
-
-    std::fstream outstream (outname, std::ios::out | std::ios::binary);
-    outstream.seekg(0);	
-
-    printf("count = %ld, %ld, %ld, %ld, %ld\n", count[0], count[1], count[2], count[3], count[4]);
-    fflush(stdout);
-
     uint8_t *bwt;
 
     ref_seq_len++;
-    outstream.write((char *)(&ref_seq_len), 1 * sizeof(int64_t));
-    outstream.write((char*)count, 5 * sizeof(int64_t));
-
     int64_t i;
     int64_t ref_seq_len_aligned = ((ref_seq_len + CP_BLOCK_SIZE - 1) / CP_BLOCK_SIZE) * CP_BLOCK_SIZE;
     int64_t size = ref_seq_len_aligned * sizeof(uint8_t);
@@ -667,6 +658,165 @@ int FMI_search::build_fm_index(const char *ref_file_name, char *binary_seq, int6
     for(i = ref_seq_len; i < ref_seq_len_aligned; i++)
         bwt[i] = DUMMY_CHAR;
 
+    #if SA_COMPRESSION  
+
+    size = ((ref_seq_len >> SA_COMPX)+ 1)  * sizeof(uint32_t);
+    uint32_t *sa_ls_word = (uint32_t *)_mm_malloc(size, 64);
+    assert_not_null(sa_ls_word, size, index_alloc);
+    size = ((ref_seq_len >> SA_COMPX) + 1) * sizeof(int8_t);
+    int8_t *sa_ms_byte = (int8_t *)_mm_malloc(size, 64);
+    assert_not_null(sa_ms_byte, size, index_alloc);
+    int64_t pos = 0;
+    for(i = 0; i < ref_seq_len; i++)
+    {
+        if ((i & SA_COMPX_MASK) == 0)
+        {
+            sa_ls_word[pos] = sa_bwt[i] & 0xffffffff;
+            sa_ms_byte[pos] = (sa_bwt[i] >> 32) & 0xff;
+            pos++;
+        }
+    }
+    fprintf(stderr, "pos: %ld, ref_seq_len__: %ld\n", pos, ref_seq_len >> SA_COMPX);
+    
+    #else
+    
+    size = ref_seq_len * sizeof(uint32_t);
+    uint32_t *sa_ls_word = (uint32_t *)_mm_malloc(size, 64);
+    assert_not_null(sa_ls_word, size, index_alloc);
+    size = ref_seq_len * sizeof(int8_t);
+    int8_t *sa_ms_byte = (int8_t *)_mm_malloc(size, 64);
+    assert_not_null(sa_ms_byte, size, index_alloc);
+    for(i = 0; i < ref_seq_len; i++)
+    {
+        sa_ls_word[i] = sa_bwt[i] & 0xffffffff;
+        sa_ms_byte[i] = (sa_bwt[i] >> 32) & 0xff;
+    }
+    
+    #endif
+
+    return write_fm_index(ref_file_name, bwt, ref_seq_len, count, sa_ms_byte, sa_ls_word, sentinel_index);
+}
+
+/* The rows of the SA as psa_sort() hands them over, kept only as BWT and
+ * as the 40-bit SA entries (ms byte + ls word) the index stores. */
+typedef struct {
+    const char *binary_seq;
+    uint8_t *bwt;
+    int8_t *sa_ms_byte;
+    uint32_t *sa_ls_word;
+    int64_t sentinel_index;
+    int64_t row0, n;
+    const int64_t *sa;
+} fm_pass_t;
+
+#define FM_PASS_CHUNK (1<<16)
+
+static void fm_pass_fill(void *data, int64_t k, int tid)
+{
+    fm_pass_t *p = (fm_pass_t *)data;
+    int64_t j, e = (k + 1) * FM_PASS_CHUNK < p->n? (k + 1) * FM_PASS_CHUNK : p->n;
+    for(j = k * FM_PASS_CHUNK; j < e; j++)
+    {
+        int64_t i = p->row0 + 1 + j, sa = p->sa[j]; // row 0 is the empty suffix
+        if(sa == 0)
+        {
+            p->bwt[i] = 4;
+            p->sentinel_index = i;
+        }
+        else p->bwt[i] = p->binary_seq[sa - 1];
+    #if SA_COMPRESSION
+        if ((i & SA_COMPX_MASK) == 0)
+        {
+            p->sa_ls_word[i >> SA_COMPX] = sa & 0xffffffff;
+            p->sa_ms_byte[i >> SA_COMPX] = (sa >> 32) & 0xff;
+        }
+    #else
+        p->sa_ls_word[i] = sa & 0xffffffff;
+        p->sa_ms_byte[i] = (sa >> 32) & 0xff;
+    #endif
+    }
+}
+
+typedef struct {
+    fm_pass_t *p;
+    int nthreads;
+} fm_pass_arg_t;
+
+static void fm_pass(void *data, int64_t row0, const int64_t *sa, int64_t n)
+{
+    fm_pass_arg_t *a = (fm_pass_arg_t *)data;
+    a->p->row0 = row0, a->p->sa = sa, a->p->n = n;
+    psa_for(a->nthreads, fm_pass_fill, a->p, (n + FM_PASS_CHUNK - 1) / FM_PASS_CHUNK);
+}
+
+/* build_fm_index() without the int64_t SA: the suffixes are sorted by
+ * psa_sort() in passes, each filling its rows of BWT and SA samples. */
+int FMI_search::build_fm_index_mt(const char *ref_file_name, char *binary_seq, int64_t ref_seq_len, int64_t *count, int nthreads) {
+    printf("ref_seq_len = %ld\n", ref_seq_len);
+    fflush(stdout);
+
+    int64_t n = ref_seq_len;
+    ref_seq_len++;
+    int64_t i;
+    int64_t ref_seq_len_aligned = ((ref_seq_len + CP_BLOCK_SIZE - 1) / CP_BLOCK_SIZE) * CP_BLOCK_SIZE;
+    int64_t size = ref_seq_len_aligned * sizeof(uint8_t);
+    uint8_t *bwt = (uint8_t *)_mm_malloc(size, 64);
+    index_alloc += size;
+    assert_not_null(bwt, size, index_alloc);
+    for(i = ref_seq_len; i < ref_seq_len_aligned; i++)
+        bwt[i] = DUMMY_CHAR;
+
+    #if SA_COMPRESSION
+    int64_t n_sa = (ref_seq_len >> SA_COMPX) + 1;
+    #else
+    int64_t n_sa = ref_seq_len;
+    #endif
+    size = n_sa * sizeof(uint32_t);
+    uint32_t *sa_ls_word = (uint32_t *)_mm_malloc(size, 64);
+    index_alloc += size;
+    assert_not_null(sa_ls_word, size, index_alloc);
+    size = n_sa * sizeof(int8_t);
+    int8_t *sa_ms_byte = (int8_t *)_mm_malloc(size, 64);
+    index_alloc += size;
+    assert_not_null(sa_ms_byte, size, index_alloc);
+
+    // row 0: the empty suffix, preceded by the last base
+    bwt[0] = binary_seq[n - 1];
+    sa_ls_word[0] = n & 0xffffffff;
+    sa_ms_byte[0] = (n >> 32) & 0xff;
+
+    fm_pass_t p;
+    memset(&p, 0, sizeof(p));
+    p.binary_seq = binary_seq, p.bwt = bwt, p.sentinel_index = -1;
+    p.sa_ms_byte = sa_ms_byte, p.sa_ls_word = sa_ls_word;
+    fm_pass_arg_t a = { &p, nthreads };
+    if (psa_sort((const uint8_t *)binary_seq, n, nthreads, fm_pass, &a) != 0) {
+        fprintf(stderr, "[E::%s] fail to sort the suffixes\n", __func__);
+        exit(EXIT_FAILURE);
+    }
+    printf("BWT[%ld] = 4\n", p.sentinel_index);
+
+    return write_fm_index(ref_file_name, bwt, ref_seq_len, count, sa_ms_byte, sa_ls_word, p.sentinel_index);
+}
+
+// writes .bwt.2bit.64 and frees bwt and the SA arrays
+int FMI_search::write_fm_index(const char *ref_file_name, uint8_t *bwt, int64_t ref_seq_len, int64_t *count, int8_t *sa_ms_byte, uint32_t *sa_ls_word, int64_t sentinel_index) {
+    char outname[PATH_MAX];
+
+    strcpy_s(outname, PATH_MAX, ref_file_name);
+    strcat_s(outname, PATH_MAX, CP_FILENAME_SUFFIX);
+    //sprintf(outname, "%s.bwt.2bit.%d", ref_file_name, CP_BLOCK_SIZE);
+
+    std::fstream outstream (outname, std::ios::out | std::ios::binary);
+    outstream.seekg(0);	
+
+    printf("count = %ld, %ld, %ld, %ld, %ld\n", count[0], count[1], count[2], count[3], count[4]);
+    fflush(stdout);
+
+    outstream.write((char *)(&ref_seq_len), 1 * sizeof(int64_t));
+    outstream.write((char*)count, 5 * sizeof(int64_t));
+
+    int64_t i, size;
 
     printf("CP_SHIFT = %d, CP_MASK = %d\n", CP_SHIFT, CP_MASK);
     printf("sizeof CP_OCC = %ld\n", sizeof(CP_OCC));
@@ -721,43 +871,11 @@ int FMI_search::build_fm_index(const char *ref_file_name, char *binary_seq, int6
     _mm_free(bwt);
 
     #if SA_COMPRESSION  
-
-    size = ((ref_seq_len >> SA_COMPX)+ 1)  * sizeof(uint32_t);
-    uint32_t *sa_ls_word = (uint32_t *)_mm_malloc(size, 64);
-    assert_not_null(sa_ls_word, size, index_alloc);
-    size = ((ref_seq_len >> SA_COMPX) + 1) * sizeof(int8_t);
-    int8_t *sa_ms_byte = (int8_t *)_mm_malloc(size, 64);
-    assert_not_null(sa_ms_byte, size, index_alloc);
-    int64_t pos = 0;
-    for(i = 0; i < ref_seq_len; i++)
-    {
-        if ((i & SA_COMPX_MASK) == 0)
-        {
-            sa_ls_word[pos] = sa_bwt[i] & 0xffffffff;
-            sa_ms_byte[pos] = (sa_bwt[i] >> 32) & 0xff;
-            pos++;
-        }
-    }
-    fprintf(stderr, "pos: %ld, ref_seq_len__: %ld\n", pos, ref_seq_len >> SA_COMPX);
     outstream.write((char*)sa_ms_byte, ((ref_seq_len >> SA_COMPX) + 1) * sizeof(int8_t));
     outstream.write((char*)sa_ls_word, ((ref_seq_len >> SA_COMPX) + 1) * sizeof(uint32_t));
-    
     #else
-    
-    size = ref_seq_len * sizeof(uint32_t);
-    uint32_t *sa_ls_word = (uint32_t *)_mm_malloc(size, 64);
-    assert_not_null(sa_ls_word, size, index_alloc);
-    size = ref_seq_len * sizeof(int8_t);
-    int8_t *sa_ms_byte = (int8_t *)_mm_malloc(size, 64);
-    assert_not_null(sa_ms_byte, size, index_alloc);
-    for(i = 0; i < ref_seq_len; i++)
-    {
-        sa_ls_word[i] = sa_bwt[i] & 0xffffffff;
-        sa_ms_byte[i] = (sa_bwt[i] >> 32) & 0xff;
-    }
     outstream.write((char*)sa_ms_byte, ref_seq_len * sizeof(int8_t));
     outstream.write((char*)sa_ls_word, ref_seq_len * sizeof(uint32_t));
-    
     #endif
 
     outstream.write((char *)(&sentinel_index), 1 * sizeof(int64_t));
@@ -770,7 +888,7 @@ int FMI_search::build_fm_index(const char *ref_file_name, char *binary_seq, int6
     return 0;
 }
 
-int FMI_search::build_index() {
+int FMI_search::build_index(int psa_threads) {
 
     char *prefix = file_name;
     unsigned long long startTick;
@@ -830,6 +948,14 @@ int FMI_search::build_index() {
     fprintf(stderr, "binary seq ticks = %llu\n", __rdtsc() - startTick);
     startTick = __rdtsc();
 
+    if (psa_threads > 0) {
+        std::string().swap(reference_seq);
+        build_fm_index_mt(prefix, binary_ref_seq, pac_len, count, psa_threads);
+        fprintf(stderr, "build suffix-array and fm-index ticks = %llu\n", __rdtsc() - startTick);
+        _mm_free(binary_ref_seq);
+        return 0;
+    }
+
     size = (pac_len + 2) * sizeof(int64_t);
     int64_t *suffix_array=(int64_t *)_mm_malloc(size, 64);
     index_alloc += size;
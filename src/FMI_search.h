@@ -135,6 +135,9 @@ typedef struct __attribute__ ((__packed__)) {
 #define __combine_ms_ls(ms, ls) ((((int64_t) (ms)) << 32) | ((int64_t) ls))
 
 int build_smem_tables(char *prefix);
+/* load_index() skips the smem tables after fmi_load_smem_tables(0);
+ * only the MEMSCALE kernels search without them */
+void fmi_load_smem_tables(int on);
 
 #endif /* SMEM_ACCEL */
 
@@ -149,7 +152,7 @@ class FMI_search: public indexEle
     ~FMI_search();
     //int64_t beCalls;
     
-    int build_index();
+    int build_index(int psa_threads = 0); // psa_threads > 0: psa_sort() instead of SA-IS
     void load_index();
     void load_index_other_elements(int which);
 #ifdef SMEM_ACCEL
@@ -264,6 +267,18 @@ private:
                                int64_t ref_seq_len,
                                int64_t *sa_bwt,
                                int64_t *count);
+        int build_fm_index_mt(const char *ref_file_name,
+                              char *binary_seq,
+                              int64_t ref_seq_len,
+                              int64_t *count,
+                              int nthreads);
+        int write_fm_index(const char *ref_file_name,
+                           uint8_t *bwt,
+                           int64_t ref_seq_len,
+                           int64_t *count,
+                           int8_t *sa_ms_byte,
+                           uint32_t *sa_ls_word,
+                           int64_t sentinel_index);
         SMEM backwardExt(SMEM smem, uint8_t a);
 
 #ifdef SMEM_ACCEL
@@ -0,0 +1,150 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM-SCALE (Memory-Scalable Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2022 Electronics and Telecommunications Research Institute (ETRI), Changdae Kim.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   Contacts: Changdae Kim <cdkim@etri.re.kr>
+
+** This software builds upon BWA-MEM2, and includes several performance optimization techniques.
+   For BWA-MEM2, refer to the follows.
+
+   BWA-MEM2 (Sequence alignment using Burrows-Wheeler Transform)
+   Copyright ⓒ 2019 Intel Corporation, Heng Li
+   The MIT License
+   Website: https://github.com/bwa-mem2/bwa-mem2
+
+*****************************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "arena.h"
+
+#define MEM_ARENA_ALIGN 16
+
+__thread mem_arena_t *mem_arena_cur = 0;
+
+static mem_arena_blk_t *mem_arena_new_blk(mem_arena_t *ar, size_t size)
+{
+	mem_arena_blk_t *b = (mem_arena_blk_t*) malloc(sizeof(mem_arena_blk_t) + size);
+	if (b == NULL) {
+		fprintf(stderr, "[E::%s] out of memory allocating a %ld byte arena block\n", __func__, (long) size);
+		exit(EXIT_FAILURE);
+	}
+	b->size = size, b->used = 0;
+	b->next = ar->head;
+	ar->head = b;
+	ar->cap += size;
+	ar->n_blk++;
+	return b;
+}
+
+static inline uint8_t *mem_arena_base(mem_arena_blk_t *b)
+{
+	return (uint8_t*) b + ((sizeof(mem_arena_blk_t) + MEM_ARENA_ALIGN - 1) & ~(size_t)(MEM_ARENA_ALIGN - 1));
+}
+
+void mem_arena_init(mem_arena_t *ar, size_t size)
+{
+	memset(ar, 0, sizeof(mem_arena_t));
+	mem_arena_new_blk(ar, size + MEM_ARENA_ALIGN);
+}
+
+void mem_arena_destroy(mem_arena_t *ar)
+{
+	mem_arena_blk_t *b, *t;
+	for (b = ar->head; b; b = t) {
+		t = b->next;
+		free(b);
+	}
+	ar->head = 0, ar->last = 0;
+	ar->used = ar->cap = 0;
+}
+
+// keeps the newest block; a chunk that spilled over into several blocks
+// leaves one block large enough for all of them
+void mem_arena_reset(mem_arena_t *ar)
+{
+	if (ar->head && ar->head->next) {
+		size_t cap = ar->cap;
+		mem_arena_destroy(ar);
+		mem_arena_new_blk(ar, cap);
+	}
+	if (ar->head) ar->head->used = 0;
+	ar->last = 0;
+	ar->used = 0;
+}
+
+void *mem_arena_alloc(mem_arena_t *ar, size_t size)
+{
+	mem_arena_blk_t *b;
+	void *p;
+
+	if (ar == 0) return malloc(size);
+	size = (size + MEM_ARENA_ALIGN - 1) & ~(size_t)(MEM_ARENA_ALIGN - 1);
+	b = ar->head;
+	if (b == 0 || b->used + size + MEM_ARENA_ALIGN > b->size) {
+		size_t bsize = b? b->size << 1 : MEM_ARENA_BLK_SIZE;
+		if (bsize < size + MEM_ARENA_ALIGN) bsize = size + MEM_ARENA_ALIGN;
+		b = mem_arena_new_blk(ar, bsize);
+	}
+	p = mem_arena_base(b) + b->used;
+	b->used += size;
+	ar->used += size;
+	if (ar->used > ar->hwm) ar->hwm = ar->used;
+	ar->last = p;
+	return p;
+}
+
+void *mem_arena_calloc(mem_arena_t *ar, size_t n, size_t size)
+{
+	void *p;
+	if (ar == 0) return calloc(n, size);
+	p = mem_arena_alloc(ar, n * size);
+	memset(p, 0, n * size);
+	return p;
+}
+
+void *mem_arena_realloc(mem_arena_t *ar, void *p, size_t old_size, size_t size)
+{
+	void *q;
+
+	if (ar == 0) return realloc(p, size);
+	if (p && p == ar->last) { // the newest allocation grows in place if the block has room
+		mem_arena_blk_t *b = ar->head;
+		size_t off = (uint8_t*) p - mem_arena_base(b);
+		size_t old_r = b->used - off;
+		size_t new_r = (size + MEM_ARENA_ALIGN - 1) & ~(size_t)(MEM_ARENA_ALIGN - 1);
+		if (new_r <= old_r || off + new_r + MEM_ARENA_ALIGN <= b->size) {
+			if (new_r > old_r) {
+				b->used = off + new_r;
+				ar->used += new_r - old_r;
+				if (ar->used > ar->hwm) ar->hwm = ar->used;
+			}
+			return p;
+		}
+	}
+	q = mem_arena_alloc(ar, size);
+	if (p) memcpy(q, p, old_size < size? old_size : size);
+	return q;
+}
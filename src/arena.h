@@ -0,0 +1,99 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM-SCALE (Memory-Scalable Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2022 Electronics and Telecommunications Research Institute (ETRI), Changdae Kim.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   Contacts: Changdae Kim <cdkim@etri.re.kr>
+
+** This software builds upon BWA-MEM2, and includes several performance optimization techniques.
+   For BWA-MEM2, refer to the follows.
+
+   BWA-MEM2 (Sequence alignment using Burrows-Wheeler Transform)
+   Copyright ⓒ 2019 Intel Corporation, Heng Li
+   The MIT License
+   Website: https://github.com/bwa-mem2/bwa-mem2
+
+*****************************************************************************************/
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/*
+ * Per-thread bump allocator for objects that live as long as one chunk of
+ * reads: the alignment regions of worker_aln (regs[].a, grown by the mate
+ * rescue) and the seeds of chains that outgrow SEEDS_PER_CHAIN.
+ * Nothing is freed individually; mem_process_seqs() resets all arenas once
+ * worker_sam has consumed the regions. Blocks are kept across resets, so
+ * after the first chunks the allocations no longer reach malloc at all.
+ * Allocating from a NULL arena falls back to malloc/realloc and
+ * mem_arena_free() to free(), so the same code serves mem_align1() callers.
+ */
+
+typedef struct mem_arena_blk_s {
+	struct mem_arena_blk_s *next;  // older blocks
+	size_t size, used;
+} mem_arena_blk_t;
+
+typedef struct {
+	mem_arena_blk_t *head;  // block allocations are carved from
+	void *last;             // most recent allocation; grows in place
+	size_t used;            // bytes handed out since the last reset
+	size_t cap;             // bytes held by all blocks
+	size_t hwm;             // high-water mark of used
+	int64_t n_blk;          // blocks malloc'ed over the run
+} mem_arena_t;
+
+#define MEM_ARENA_BLK_SIZE (1<<20)
+
+void mem_arena_init(mem_arena_t *ar, size_t size);
+void mem_arena_destroy(mem_arena_t *ar);
+void mem_arena_reset(mem_arena_t *ar);
+void *mem_arena_alloc(mem_arena_t *ar, size_t size);
+void *mem_arena_calloc(mem_arena_t *ar, size_t n, size_t size);
+void *mem_arena_realloc(mem_arena_t *ar, void *p, size_t old_size, size_t size);
+
+static inline void mem_arena_free(mem_arena_t *ar, void *p)
+{
+	if (ar == 0) free(p);
+}
+
+// arena of the worker running on this thread; set by mem_arena_bind()
+extern __thread mem_arena_t *mem_arena_cur;
+static inline void mem_arena_bind(mem_arena_t *ar) { mem_arena_cur = ar; }
+
+// kv_push() on a kvec whose array comes from the arena
+#define ka_push(ar, type, v, x) do {									\
+		if ((v).n == (v).m) {											\
+			size_t m_ = (v).m? (v).m<<1 : 2;							\
+			(v).a = (type*) mem_arena_realloc(ar, (v).a, sizeof(type) * (v).m, sizeof(type) * m_); \
+			(v).m = m_;													\
+		}																\
+		(v).a[(v).n++] = (x);											\
+	} while (0)
+
+#endif
@@ -27,7 +27,11 @@
 Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@intel.com>;
 *****************************************************************************************/
 
+#include <string.h>
 #include "bandedSWA.h"
+#ifdef SIMD_DISPATCH
+#include "simd_dispatch.h"
+#endif
 #ifdef VTUNE_ANALYSIS
 #include <ittnotify.h> 
 #endif
@@ -68,12 +72,15 @@ BandedPairWiseSW::BandedPairWiseSW(const int o_del, const int e_del, const int o
     this->w_ambig    = DEFAULT_AMBIG;
     this->swTicks = 0;
     this->SW_cells = 0;
+    this->wfa_pairs = this->wfa_dp = this->wfa_diff = 0;
     setupTicks = 0;
     sort1Ticks = 0;
     swTicks = 0;
     sort2Ticks = 0;
     this->F8_ = this->H8_  = this->H8__ = NULL;
     this->F16_ = this->H16_  = this->H16__ = NULL;
+    this->wf_ = NULL, this->wf_buf_ = NULL;
+    this->wf_m_ = this->wf_buf_m_ = 0;
     
     F8_ = H8_ = H8__ = NULL;
     F8_ = (int8_t *)_mm_malloc(MAX_SEQ_LEN8 * SIMD_WIDTH8 * numThreads * sizeof(int8_t), 64);
@@ -91,12 +98,38 @@ BandedPairWiseSW::BandedPairWiseSW(const int o_del, const int e_del, const int o
     if (F16_ == NULL || H16_ == NULL || H16__ == NULL) {
         printf("BSW16 Memory not alloacted!!!\n"); exit(EXIT_FAILURE);
     }       
+
+    // getScores32() grows these for queries past MAX_SEQ_LEN16
+    sw32_m_ = MAX_SEQ_LEN16 + 2;
+    H32_ = (int32_t *)_mm_malloc(sw32_m_ * SIMD_WIDTH32 * sizeof(int32_t), 64);
+    E32_ = (int32_t *)_mm_malloc(sw32_m_ * SIMD_WIDTH32 * sizeof(int32_t), 64);
+    Q32_ = (int32_t *)_mm_malloc(sw32_m_ * SIMD_WIDTH32 * sizeof(int32_t), 64);
+    ord32_m_ = MAX_SEQ_LEN8;
+    ord32_ = (int64_t *)malloc(ord32_m_ * sizeof(int64_t));
+    if (H32_ == NULL || E32_ == NULL || Q32_ == NULL || ord32_ == NULL) {
+        printf("BSW32 Memory not alloacted!!!\n"); exit(EXIT_FAILURE);
+    }
+
+#ifdef SIMD_DISPATCH
+    isaOps = NULL; isaImpl = NULL;
+#ifndef SIMD_DISPATCH_SUFFIX
+    isaOps = bsw_dispatch_ops();
+    if (isaOps)
+        isaImpl = isaOps->create(o_del, e_del, o_ins, e_ins, zdrop, end_bonus,
+                                 mat_, w_match, w_mismatch, numThreads);
+#endif
+#endif
 }
 
 // destructor 
 BandedPairWiseSW::~BandedPairWiseSW() {
     _mm_free(F8_); _mm_free(H8_); _mm_free(H8__);
     _mm_free(F16_);_mm_free(H16_); _mm_free(H16__);
+    free(wf_); free(wf_buf_);
+    _mm_free(H32_); _mm_free(E32_); _mm_free(Q32_); free(ord32_);
+#ifdef SIMD_DISPATCH
+    if (isaImpl) isaOps->destroy(isaImpl);
+#endif
 }
 
 int64_t BandedPairWiseSW::getTicks()
@@ -260,6 +293,265 @@ void BandedPairWiseSW::scalarBandedSWAWrapper(SeqPair *seqPairArray,
 }
 
 
+// ------------------------------------------------------------------------------------
+// Banded SWA - 32-bit lanes
+// ------------------------------------------------------------------------------------
+#if (__AVX512BW__ || __AVX2__ || __SSE2__)
+/* Pairs the 16-bit kernels cannot take (a length or score of MAX_SEQ_LEN16 or more) and
+ * their band retries: scalarBandedSWA() on SIMD_WIDTH32 pairs at once, one per lane, with
+ * the same results. The eh rows and queries are lane-interleaved and sized per batch, so
+ * there is no length limit. */
+#if __AVX512BW__
+#define V32             __m512i
+#define M32             __mmask16
+#define V32_LOAD(p)     _mm512_load_si512((const void *)(p))
+#define V32_STORE(p, a) _mm512_store_si512((void *)(p), a)
+#define V32_SET1        _mm512_set1_epi32
+#define V32_ADD         _mm512_add_epi32
+#define V32_SUB         _mm512_sub_epi32
+#define V32_MAX         _mm512_max_epi32
+#define V32_OR          _mm512_or_si512
+#define V32_EQ          _mm512_cmpeq_epi32_mask
+#define V32_GT          _mm512_cmpgt_epi32_mask
+#define V32_BLEND(a, b, m)  _mm512_mask_blend_epi32(m, a, b)  // b where m
+#define M32_AND(x, y)       ((M32)((x) & (y)))
+#define M32_ANDNOT(x, y)    ((M32)(~(x) & (y)))
+#elif __AVX2__
+#define V32             __m256i
+#define M32             __m256i
+#define V32_LOAD(p)     _mm256_load_si256((const __m256i *)(p))
+#define V32_STORE(p, a) _mm256_store_si256((__m256i *)(p), a)
+#define V32_SET1        _mm256_set1_epi32
+#define V32_ADD         _mm256_add_epi32
+#define V32_SUB         _mm256_sub_epi32
+#define V32_MAX         _mm256_max_epi32
+#define V32_OR          _mm256_or_si256
+#define V32_EQ          _mm256_cmpeq_epi32
+#define V32_GT          _mm256_cmpgt_epi32
+#define V32_BLEND(a, b, m)  _mm256_blendv_epi8(a, b, m)
+#define M32_AND             _mm256_and_si256
+#define M32_ANDNOT          _mm256_andnot_si256
+#else
+#define V32             __m128i
+#define M32             __m128i
+#define V32_LOAD(p)     _mm_load_si128((const __m128i *)(p))
+#define V32_STORE(p, a) _mm_store_si128((__m128i *)(p), a)
+#define V32_SET1        _mm_set1_epi32
+#define V32_ADD         _mm_add_epi32
+#define V32_SUB         _mm_sub_epi32
+#define V32_MAX         _mm_max_epi32
+#define V32_OR          _mm_or_si128
+#define V32_EQ          _mm_cmpeq_epi32
+#define V32_GT          _mm_cmpgt_epi32
+#define V32_BLEND(a, b, m)  _mm_blendv_epi8(a, b, m)
+#define M32_AND             _mm_and_si128
+#define M32_ANDNOT          _mm_andnot_si128
+#endif
+
+static int bsw_len32_cmp(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+    return x < y ? 1 : x > y ? -1 : 0;  // longest first
+}
+
+void BandedPairWiseSW::getScores32(SeqPair *pairArray,
+                                   uint8_t *seqBufRef,
+                                   uint8_t *seqBufQer,
+                                   int32_t numPairs,
+                                   uint16_t numThreads,
+                                   int32_t w)
+{
+#ifdef SIMD_DISPATCH
+    if (isaImpl) {
+        isaOps->getScores32(isaImpl, pairArray, seqBufRef, seqBufQer, numPairs, numThreads, w);
+        return;
+    }
+#endif
+    if (numPairs <= 0) return;
+
+    // lanes of a batch get pairs of similar target length
+    if (numPairs > ord32_m_) {
+        ord32_m_ = numPairs + (numPairs >> 1);
+        ord32_ = (int64_t *) realloc(ord32_, ord32_m_ * sizeof(int64_t));
+        assert(ord32_ != NULL);
+    }
+    int64_t *ord = ord32_;
+    int32_t qmax = 0;
+    for (int i = 0; i < numPairs; i++) {
+        ord[i] = ((int64_t) pairArray[i].len1 << 32) | i;
+        qmax = max_(qmax, pairArray[i].len2);
+    }
+    qsort(ord, numPairs, sizeof(int64_t), bsw_len32_cmp);
+
+    if (qmax + 2 > sw32_m_) { // contents need not be kept
+        sw32_m_ = qmax + 2;
+        _mm_free(H32_); _mm_free(E32_); _mm_free(Q32_);
+        H32_ = (int32_t *) _mm_malloc(sw32_m_ * SIMD_WIDTH32 * sizeof(int32_t), 64);
+        E32_ = (int32_t *) _mm_malloc(sw32_m_ * SIMD_WIDTH32 * sizeof(int32_t), 64);
+        Q32_ = (int32_t *) _mm_malloc(sw32_m_ * SIMD_WIDTH32 * sizeof(int32_t), 64);
+        if (H32_ == NULL || E32_ == NULL || Q32_ == NULL) {
+            fprintf(stderr, "[E::%s] BSW32 memory not allocated (%d bp)\n", __func__, qmax);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (int i = 0; i < numPairs; i += SIMD_WIDTH32)
+    {
+        SeqPair *p[SIMD_WIDTH32];
+        int n = min_(SIMD_WIDTH32, numPairs - i);
+        for (int l = 0; l < n; l++)
+            p[l] = pairArray + (int32_t) ord[i + l];
+        smithWaterman32(p, n, seqBufRef, seqBufQer, w, H32_, E32_, Q32_);
+    }
+}
+
+void BandedPairWiseSW::smithWaterman32(SeqPair *p[],
+                                       int32_t n,
+                                       uint8_t *seqBufRef,
+                                       uint8_t *seqBufQer,
+                                       int32_t w,
+                                       int32_t *H,
+                                       int32_t *E,
+                                       int32_t *Q)
+{
+    const int W = SIMD_WIDTH32;
+    int oe_del = o_del + e_del, oe_ins = o_ins + e_ins;
+    int32_t tlen[W], qlen[W], h0[W], wl[W];
+    int32_t live[W] __attribute((aligned(64))), beg[W] __attribute((aligned(64)));
+    int32_t end[W] __attribute((aligned(64))), tch[W] __attribute((aligned(64)));
+    int32_t h1[W] __attribute((aligned(64))), f[W] __attribute((aligned(64)));
+    int32_t m[W] __attribute((aligned(64))), mj[W] __attribute((aligned(64)));
+    int32_t mx[W], max_i[W], max_j[W], max_ie[W], gscore[W], max_off[W];
+    const uint8_t *ref[W];
+    int32_t qmax = 0, l, i, j;
+
+    int k = this->m * this->m, maxsc = 0;
+    for (i = 0; i < k; ++i)
+        maxsc = maxsc > mat[i]? maxsc : mat[i];
+
+    for (l = 0; l < W; l++) {
+        SeqPair *sp = p[l < n ? l : 0];
+        live[l] = l < n;
+        tlen[l] = l < n ? sp->len1 : 0;
+        qlen[l] = l < n ? sp->len2 : 0;
+        h0[l] = sp->h0;
+        ref[l] = seqBufRef + sp->idr;
+        qmax = max_(qmax, qlen[l]);
+        // band as adjusted by scalarBandedSWA()
+        int max_ins = (int)((double)(qlen[l] * maxsc + end_bonus - o_ins) / e_ins + 1.);
+        max_ins = max_ins > 1? max_ins : 1;
+        int max_del = (int)((double)(qlen[l] * maxsc + end_bonus - o_del) / e_del + 1.);
+        max_del = max_del > 1? max_del : 1;
+        wl[l] = min_(w, min_(max_ins, max_del));
+        mx[l] = h0[l]; max_i[l] = max_j[l] = max_ie[l] = gscore[l] = -1;
+        max_off[l] = 0;
+        beg[l] = 0; end[l] = qlen[l];
+    }
+
+    // queries and the first row
+    memset(H, 0, (int64_t)(qmax + 2) * W * sizeof(int32_t));
+    memset(E, 0, (int64_t)(qmax + 2) * W * sizeof(int32_t));
+    for (l = 0; l < n; l++) {
+        const uint8_t *q = seqBufQer + p[l]->idq;
+        for (j = 0; j < qlen[l]; j++) Q[j * W + l] = q[j];
+        for (; j <= qmax; j++) Q[j * W + l] = DUMMY2;
+        H[l] = h0[l]; H[W + l] = h0[l] > oe_ins? h0[l] - oe_ins : 0;
+        for (j = 2; j <= qlen[l] && H[(j-1) * W + l] > e_ins; ++j)
+            H[j * W + l] = H[(j-1) * W + l] - e_ins;
+    }
+
+    V32 zero = V32_SET1(0), three = V32_SET1(3);
+    V32 match = V32_SET1(w_match), mismatch = V32_SET1(w_mismatch), ambig = V32_SET1(w_ambig);
+    V32 oe_del_v = V32_SET1(oe_del), e_del_v = V32_SET1(e_del);
+    V32 oe_ins_v = V32_SET1(oe_ins), e_ins_v = V32_SET1(e_ins);
+
+    for (i = 0; ; ++i)
+    {
+        int jb = qmax, je = 0, nlive = 0;
+        for (l = 0; l < W; l++) {
+            if (i >= tlen[l]) live[l] = 0;
+            if (!live[l]) continue;
+            nlive++;
+            tch[l] = ref[l][i];
+            if (beg[l] < i - wl[l]) beg[l] = i - wl[l];
+            if (end[l] > i + wl[l] + 1) end[l] = i + wl[l] + 1;
+            if (end[l] > qlen[l]) end[l] = qlen[l];
+            if (beg[l] == 0) {
+                h1[l] = h0[l] - (o_del + e_del * (i + 1));
+                if (h1[l] < 0) h1[l] = 0;
+            } else h1[l] = 0;
+            f[l] = 0; m[l] = 0; mj[l] = -1;
+            jb = min_(jb, beg[l]); je = max_(je, end[l]);
+        }
+        if (nlive == 0) break;
+
+        // cells of the union of the lane bands, written back only inside a lane's band
+        V32 beg_v = V32_LOAD(beg), end_v = V32_LOAD(end), t_v = V32_LOAD(tch);
+        V32 h1_v = V32_LOAD(h1), f_v = V32_LOAD(f), m_v = V32_LOAD(m), mj_v = V32_LOAD(mj);
+        M32 live_m = V32_GT(V32_LOAD(live), zero);
+        for (j = jb; j < je; ++j)
+        {
+            V32 j_v = V32_SET1(j);
+            M32 in = M32_ANDNOT(V32_GT(beg_v, j_v), M32_AND(live_m, V32_GT(end_v, j_v)));
+            V32 hp = V32_LOAD(H + j * W), ep = V32_LOAD(E + j * W), q = V32_LOAD(Q + j * W);
+            V32 s = V32_BLEND(mismatch, match, V32_EQ(t_v, q));
+            s = V32_BLEND(s, ambig, V32_GT(V32_OR(t_v, q), three));
+            V32 M = V32_BLEND(V32_ADD(hp, s), zero, V32_EQ(hp, zero));
+            V32 h = V32_MAX(V32_MAX(M, ep), f_v);
+            V32 e = V32_MAX(V32_SUB(ep, e_del_v), V32_MAX(V32_SUB(M, oe_del_v), zero));
+            V32 fn = V32_MAX(V32_SUB(f_v, e_ins_v), V32_MAX(V32_SUB(M, oe_ins_v), zero));
+            V32_STORE(H + j * W, V32_BLEND(hp, h1_v, in));
+            V32_STORE(E + j * W, V32_BLEND(ep, e, in));
+            mj_v = V32_BLEND(mj_v, j_v, M32_ANDNOT(V32_GT(m_v, h), in));
+            m_v = V32_BLEND(m_v, V32_MAX(m_v, h), in);
+            h1_v = V32_BLEND(h1_v, h, in);
+            f_v = V32_BLEND(f_v, fn, in);
+        }
+        V32_STORE(h1, h1_v); V32_STORE(m, m_v); V32_STORE(mj, mj_v);
+
+        for (l = 0; l < W; l++)
+        {
+            if (!live[l]) continue;
+            H[end[l] * W + l] = h1[l]; E[end[l] * W + l] = 0;
+            if ((beg[l] < end[l]? end[l] : beg[l]) == qlen[l]) {
+                max_ie[l] = gscore[l] > h1[l]? max_ie[l] : i;
+                gscore[l] = gscore[l] > h1[l]? gscore[l] : h1[l];
+            }
+            if (m[l] == 0) { live[l] = 0; continue; }
+            if (m[l] > mx[l]) {
+                mx[l] = m[l], max_i[l] = i, max_j[l] = mj[l];
+                max_off[l] = max_off[l] > abs(mj[l] - i)? max_off[l] : abs(mj[l] - i);
+            } else if (zdrop > 0) {
+                if (i - max_i[l] > mj[l] - max_j[l]) {
+                    if (mx[l] - m[l] - ((i - max_i[l]) - (mj[l] - max_j[l])) * e_del > zdrop) {
+                        live[l] = 0; continue;
+                    }
+                } else {
+                    if (mx[l] - m[l] - ((mj[l] - max_j[l]) - (i - max_i[l])) * e_ins > zdrop) {
+                        live[l] = 0; continue;
+                    }
+                }
+            }
+            // update beg and end for the next round
+            for (j = beg[l]; j < end[l] && H[j * W + l] == 0 && E[j * W + l] == 0; ++j);
+            beg[l] = j;
+            for (j = end[l]; j >= beg[l] && H[j * W + l] == 0 && E[j * W + l] == 0; --j);
+            end[l] = j + 2 < qlen[l]? j + 2 : qlen[l];
+        }
+    }
+
+    for (l = 0; l < n; l++)
+    {
+        p[l]->score = mx[l];
+        p[l]->qle = max_j[l] + 1;
+        p[l]->tle = max_i[l] + 1;
+        p[l]->gtle = max_ie[l] + 1;
+        p[l]->gscore = gscore[l];
+        p[l]->max_off = max_off[l];
+    }
+}
+#endif
+
 #if ((!__AVX512BW__) & (__AVX2__))
 
 //------------------------------------------------------------------------------
@@ -3452,6 +3744,13 @@ void BandedPairWiseSW::getScores16(SeqPair *pairArray,
                                    uint16_t numThreads,
                                    int32_t w)
 {
+#ifdef SIMD_DISPATCH
+    if (isaImpl) {
+        isaOps->getScores16(isaImpl, pairArray, seqBufRef, seqBufQer,
+                            numPairs, numThreads, w);
+        return;
+    }
+#endif
     smithWatermanBatchWrapper16(pairArray, seqBufRef,
                                 seqBufQer, numPairs,
                                 numThreads, w);
@@ -4176,6 +4475,13 @@ void BandedPairWiseSW::getScores8(SeqPair *pairArray,
                                   uint16_t numThreads,
                                   int32_t w)
 {
+#ifdef SIMD_DISPATCH
+    if (isaImpl) {
+        isaOps->getScores8(isaImpl, pairArray, seqBufRef, seqBufQer,
+                           numPairs, numThreads, w);
+        return;
+    }
+#endif
     assert(SIMD_WIDTH8 == 16 && SIMD_WIDTH16 == 8);
     smithWatermanBatchWrapper8(pairArray, seqBufRef, seqBufQer, numPairs, numThreads, w);
 
@@ -4837,3 +5143,54 @@ void BandedPairWiseSW::smithWaterman128_8(uint8_t seq1SoA[],
 }
 
 #endif
+
+#ifdef SIMD_DISPATCH_SUFFIX
+/************************************************************************************/
+// Entry points of this ISA copy, picked up by the baseline BandedPairWiseSW
+static void *bsw_create(int o_del, int e_del, int o_ins, int e_ins, int zdrop,
+                        int end_bonus, const int8_t *mat, int8_t w_match,
+                        int8_t w_mismatch, int numThreads)
+{
+    return new BandedPairWiseSW(o_del, e_del, o_ins, e_ins, zdrop, end_bonus,
+                                mat, w_match, w_mismatch, numThreads);
+}
+
+static void bsw_destroy(void *bsw)
+{
+    delete (BandedPairWiseSW *) bsw;
+}
+
+static void bsw_getScores8(void *bsw, SeqPair *pairArray, uint8_t *seqBufRef,
+                           uint8_t *seqBufQer, int32_t numPairs,
+                           uint16_t numThreads, int32_t w)
+{
+    ((BandedPairWiseSW *) bsw)->getScores8(pairArray, seqBufRef, seqBufQer,
+                                           numPairs, numThreads, w);
+}
+
+static void bsw_getScores16(void *bsw, SeqPair *pairArray, uint8_t *seqBufRef,
+                            uint8_t *seqBufQer, int32_t numPairs,
+                            uint16_t numThreads, int32_t w)
+{
+    ((BandedPairWiseSW *) bsw)->getScores16(pairArray, seqBufRef, seqBufQer,
+                                            numPairs, numThreads, w);
+}
+
+static void bsw_getScores32(void *bsw, SeqPair *pairArray, uint8_t *seqBufRef,
+                            uint8_t *seqBufQer, int32_t numPairs,
+                            uint16_t numThreads, int32_t w)
+{
+    ((BandedPairWiseSW *) bsw)->getScores32(pairArray, seqBufRef, seqBufQer,
+                                            numPairs, numThreads, w);
+}
+
+extern const bsw_ops_t SIMD_PASTE(bsw_ops_, SIMD_DISPATCH_SUFFIX);
+const bsw_ops_t SIMD_PASTE(bsw_ops_, SIMD_DISPATCH_SUFFIX) = {
+#if __AVX512BW__
+    SIMD_ISA_AVX512BW,
+#else
+    SIMD_ISA_AVX2,
+#endif
+    bsw_create, bsw_destroy, bsw_getScores8, bsw_getScores16, bsw_getScores32
+};
+#endif
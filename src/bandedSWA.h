@@ -53,29 +53,45 @@ Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@i
 // used in BSW and SAM-SW
 #define DEFAULT_AMBIG -1
 
+// arch=dispatch: per-ISA copies of the kernels get their own class names
+#ifdef SIMD_DISPATCH_SUFFIX
+#define BandedPairWiseSW SIMD_PASTE(BandedPairWiseSW_, SIMD_DISPATCH_SUFFIX)
+#endif
+
 
 // SIMD_WIDTH in bits
 // AVX2
 #if ((!__AVX512BW__) & (__AVX2__))
 #define SIMD_WIDTH8 32
 #define SIMD_WIDTH16 16
+#define SIMD_WIDTH32 8
 #endif
 
 // AVX512
 #if __AVX512BW__
 #define SIMD_WIDTH8 64
 #define SIMD_WIDTH16 32
+#define SIMD_WIDTH32 16
 #endif
 
 #if ((!__AVX512BW__) & (!__AVX2__) & (__SSE2__))
 #define SIMD_WIDTH8 16
 #define SIMD_WIDTH16 8
+#define SIMD_WIDTH32 4
 #endif
 
 // Scalar
 #if ((!__AVX512BW__) & (!__AVX2__) & (!__SSE2__))
 #define SIMD_WIDTH8 1
 #define SIMD_WIDTH16 1
+#define SIMD_WIDTH32 1
+#endif
+
+// widest lane count of any kernel linked in, for buffers handed to the kernels
+#ifdef SIMD_DISPATCH
+#define SIMD_WIDTH8_MAX 64
+#else
+#define SIMD_WIDTH8_MAX SIMD_WIDTH8
 #endif
 
 #define MAX_LINE_LEN 256
@@ -114,6 +130,7 @@ class BandedPairWiseSW {
     
 public:
     uint64_t SW_cells;
+    uint64_t wfa_pairs, wfa_dp, wfa_diff; // wavefront extensions, DP fallbacks, check mismatches
 
     BandedPairWiseSW(const int o_del, const int e_del, const int o_ins,
                      const int e_ins, const int zdrop,
@@ -134,6 +151,40 @@ public:
                                 int nthreads,
                                 int32_t w);
 
+    // Wavefront counterpart of scalarBandedSWA(), -1 if the pair is left to DP (wavefrontSWA.cpp)
+    int wavefrontSWA(int qlen, const uint8_t *query, int tlen,
+                     const uint8_t *target, int32_t w,
+                     int h0, int *_qle, int *_tle,
+                     int *_gtle, int *_gscore,
+                     int *_max_off);
+
+    int wavefrontSWAWrapper(SeqPair *seqPairArray,
+                            uint8_t *seqBufRef,
+                            uint8_t *seqBufQer,
+                            int numPairs,
+                            int nthreads,
+                            int32_t w,
+                            int check);
+
+#if (__AVX512BW__ || __AVX2__ || __SSE2__)
+    // scalarBandedSWA() in 32-bit lanes, any length and score: pairs past the 16-bit kernels
+    void getScores32(SeqPair *pairArray,
+                     uint8_t *seqBufRef,
+                     uint8_t *seqBufQer,
+                     int32_t numPairs,
+                     uint16_t numThreads,
+                     int32_t w);
+
+    void smithWaterman32(SeqPair *p[],
+                         int32_t n,
+                         uint8_t *seqBufRef,
+                         uint8_t *seqBufQer,
+                         int32_t w,
+                         int32_t *H,
+                         int32_t *E,
+                         int32_t *Q);
+#endif
+
 #if ((!__AVX512BW__) & (!__AVX2__) & (__SSE2__))
     // AVX256 is not updated for banding and separate ins/del in the inner loop.
     // 8 bit vector code section    
@@ -329,10 +380,26 @@ private:
     int16_t *F16_;
     int16_t *H16_, *H16__;
 
+    // wavefrontSWA() scratch, grown when the band or the target needs more
+    struct wavefront_s *wf_;
+    int32_t *wf_buf_;
+    int64_t wf_m_, wf_buf_m_;
+
+    // getScores32() scratch: H, E and the queries for sw32_m_ query positions, and the pair order
+    int32_t *H32_, *E32_, *Q32_;
+    int64_t *ord32_;
+    int64_t sw32_m_, ord32_m_;
+
     int64_t sort1Ticks;
     int64_t setupTicks;
     int64_t swTicks;
     int64_t sort2Ticks;
+
+#ifdef SIMD_DISPATCH
+    // kernels of the runtime-selected ISA, NULL if the ones compiled here are used
+    const struct bsw_ops_s *isaOps;
+    void *isaImpl;
+#endif
 };
 
 
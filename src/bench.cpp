@@ -0,0 +1,1122 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM-SCALE (Memory-Scalable Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2022 Electronics and Telecommunications Research Institute (ETRI), Changdae Kim.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   Contacts: Changdae Kim <cdkim@etri.re.kr>
+
+** This software builds upon BWA-MEM2, and includes several performance optimization techniques.
+   For BWA-MEM2, refer to the follows.
+
+   BWA-MEM2 (Sequence alignment using Burrows-Wheeler Transform)
+   Copyright ⓒ 2019 Intel Corporation, Heng Li
+   The MIT License
+   Website: https://github.com/bwa-mem2/bwa-mem2
+
+*****************************************************************************************/
+
+/* Kernel micro-benchmarks (make bench).
+ * The kernels of mem run on their own, single-threaded, over inputs prepared
+ * as mem prepares them: reads sampled from a small synthetic reference
+ * indexed on the fly, or recorded reads (-q) against an existing index (-i).
+ * Each kernel is timed -r times and the fastest pass is reported in ns per
+ * operation and, for the DP kernels, cells per second; the vector DP kernels
+ * are run once per ISA the binary can dispatch to. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <zlib.h>
+#include "main.h"
+#include "FMI_search.h"
+#include "kswv.h"
+#include "perfect.h"
+#include "capture.h"
+#ifdef USE_SHM
+#include "bwa_shm.h"
+#endif
+
+uint64_t proc_freq, tprof[LIM_R][LIM_C], prof[LIM_R];
+
+#ifdef PERFECT_MATCH
+int perfect_build_index(const char *prefix, int seed_len, double slack);
+int load_perfect_table(const char *prefix, int len,
+					   uint8_t **reference, FMI_search *fmi);
+int find_perfect_match_entry(perfect_table_t *pt, bseq1_t *seq, int len);
+#endif
+SMEM *mem_collect_smem(FMI_search *fmi, const mem_opt_t *opt, const bseq1_t *seq_, int nseq,
+					   SMEM *matchArray, int32_t *min_intv_ar, int16_t *query_pos_ar,
+					   uint8_t *enc_qdb, int32_t *rid, int64_t &tot_smem);
+
+enum { BK_SMEM, BK_SAL, BK_ERT, BK_EMF, BK_BSW, BK_KSWV, BK_CIGAR, BK_N };
+static const char *bench_kernel_names[BK_N] = {
+	"smem", "sal", "ert", "emf", "bsw", "kswv", "cigar"
+};
+
+typedef kvec_t(SeqPair) pair_v;
+
+typedef struct {
+	const mem_opt_t *opt;
+	FMI_search *fmi;
+	uint8_t *ref_string;
+	int64_t l_pac;
+	int reps;
+
+	int n_seqs, max_len;
+	bseq1_t *seqs;      // reads in nt4, id = index
+	int32_t *cum_len;   // offset of each read in enc
+	uint8_t *enc;
+
+	// reseeding positions of each BATCH_SIZE batch, as mem_collect_smem() derives them
+	int n_batch;
+	int64_t *pos_off;   // [n_batch+1]
+	int16_t *qpos;
+	int32_t *pos_intv, *pos_rid;
+
+	// SMEMs of all reads, sorted by read, rid global
+	SMEM *smem;
+	int64_t n_smem, max_group;
+
+	// longest SMEM of each read with its first hit, rbeg < 0 if none
+	int64_t *rbeg;
+	int32_t *qbeg, *slen;
+
+	// extension (bsw) and rescue (kswv) pairs
+	pair_v ext[2], res;
+	u8v ext_ref, ext_qer, res_ref, res_qer;
+	int32_t res_max_ref, res_max_qer;
+} bench_t;
+
+static void usage(const mem_opt_t *opt)
+{
+	fprintf(stderr, "Usage: bwa-mem2.bench [options]\n");
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "  -i STR   index prefix to use instead of the synthetic reference\n");
+	fprintf(stderr, "  -q STR   recorded reads (FASTA/FASTQ) instead of reads sampled from the reference\n");
+	fprintf(stderr, "  -g INT   length of the synthetic reference [1000000]\n");
+	fprintf(stderr, "  -n INT   number of reads [20000]\n");
+	fprintf(stderr, "  -l INT   length of the sampled reads [150]\n");
+	fprintf(stderr, "  -e FLOAT per-base error rate of the sampled reads, one in ten an indel [0.01]\n");
+	fprintf(stderr, "  -r INT   timed passes per kernel, the fastest is reported [3]\n");
+	fprintf(stderr, "  -s INT   random seed [11]\n");
+	fprintf(stderr, "  -w INT   band width of bsw and cigar [%d]\n", opt->w);
+	fprintf(stderr, "  -k STR   comma-separated kernels [smem,sal,ert,emf,bsw,kswv,cigar]\n");
+	fprintf(stderr, "  -R FILE  replay the smem and bsw calls captured by 'mem --capture FILE' and check\n");
+	fprintf(stderr, "           their outputs; -i for another copy of the captured run's index\n");
+	fprintf(stderr, "  -h       print this help and exit\n");
+	fprintf(stderr, "\nKernels:\n");
+	fprintf(stderr, "  smem     getSMEMsAllPosOneThread (per read) and getSMEMsOnePosOneThread (per position)\n");
+	fprintf(stderr, "  sal      get_sa_entries_prefetch, per SA entry\n");
+	fprintf(stderr, "  ert      get_seeds_prefix, per read; needs -i with an ERT index\n");
+	fprintf(stderr, "  emf      find_perfect_match_entry, per read; needs a perfect table of the read length\n");
+	fprintf(stderr, "  bsw      BandedPairWiseSW::getScores8/16 on seed extensions, per pair\n");
+	fprintf(stderr, "  kswv     kswv::getScores8/16 on rescue windows, per pair\n");
+	fprintf(stderr, "  cigar    bwa_gen_cigar2, per alignment\n");
+}
+
+static inline int bench_max_gap(const mem_opt_t *opt, int qlen)
+{ // cal_max_gap() of bwamem.cpp
+	int l_del = (int)((double)(qlen * opt->a - opt->o_del) / opt->e_del + 1.);
+	int l_ins = (int)((double)(qlen * opt->a - opt->o_ins) / opt->e_ins + 1.);
+	int l = l_del > l_ins? l_del : l_ins;
+	l = l > 1? l : 1;
+	return l < opt->w<<1? l : opt->w<<1;
+}
+
+static void bench_report(const char *kernel, int isa, int64_t n_op, uint64_t cyc,
+						 double cells, const char *note)
+{
+	double sec = (double) cyc / proc_freq;
+	char cps[32];
+
+	if (cells > 0 && sec > 0) snprintf(cps, sizeof(cps), "%.1f", cells / sec * 1e-6);
+	else strcpy(cps, "-");
+	printf("%-10s %-9s %10ld %10.1f %12s  %s\n", kernel, simd_isa_name(isa), (long) n_op,
+		   n_op > 0? sec * 1e9 / n_op : 0., cps, note);
+	fflush(stdout);
+}
+
+/*****************************
+ * Synthetic reference/reads *
+ *****************************/
+
+// random sequence with interspersed repeat families and tandem repeats
+static char *bench_gen_ref(int64_t len)
+{
+	const int n_fam = 16, l_fam = 300;
+	char *s = (char *) malloc(len + 1), fam[16][300];
+	int64_t i, k;
+	int j;
+
+	for (i = 0; i < len; ++i) s[i] = "ACGT"[lrand48() & 3];
+	for (j = 0; j < n_fam; ++j)
+		for (k = 0; k < l_fam; ++k) fam[j][k] = "ACGT"[lrand48() & 3];
+	for (k = 0; k < len / 10 / l_fam && len > l_fam; ++k) { // ~10% in copies 2% diverged
+		int f = lrand48() % n_fam;
+		int64_t p = lrand48() % (len - l_fam);
+		for (j = 0; j < l_fam; ++j)
+			s[p + j] = drand48() < .02? "ACGT"[lrand48() & 3] : fam[f][j];
+	}
+	for (k = 0; k < len / 100 / 150 && len > 300; ++k) { // ~1% in tandem repeats
+		int per = 2 + lrand48() % 5, l = 50 + lrand48() % 250;
+		int64_t p = lrand48() % (len - l);
+		for (j = per; j < l; ++j) s[p + j] = s[p + j - per];
+	}
+	s[len] = 0;
+	return s;
+}
+
+static void bench_write_ref(const char *fn, const char *s, int64_t len)
+{ // two contigs, to have a boundary
+	FILE *fp = xopen(fn, "w");
+	int64_t half = len / 2, i;
+	int c;
+
+	for (c = 0; c < 2; ++c) {
+		int64_t beg = c? half : 0, end = c? len : half;
+		fprintf(fp, ">syn%d\n", c + 1);
+		for (i = beg; i < end; i += 60)
+			fprintf(fp, "%.*s\n", (int)(end - i < 60? end - i : 60), s + i);
+	}
+	err_fclose(fp);
+}
+
+static void bench_rmdir(const char *dir)
+{
+	char fn[PATH_MAX];
+	struct dirent *de;
+	DIR *d = opendir(dir);
+
+	if (d == NULL) return;
+	while ((de = readdir(d)) != NULL) {
+		if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+		snprintf(fn, sizeof(fn), "%s/%s", dir, de->d_name);
+		unlink(fn);
+	}
+	closedir(d);
+	rmdir(dir);
+}
+
+// reads of length l from both strands of the doubled reference, in nt4
+static bseq1_t *bench_sample_reads(const uint8_t *ref, int64_t l_pac, int n, int l, double err)
+{
+	bseq1_t *seqs = (bseq1_t *) calloc(n, sizeof(bseq1_t));
+	char name[32];
+	int i, j;
+
+	for (i = 0; i < n; ++i) {
+		bseq1_t *s = &seqs[i];
+		int64_t p;
+		do p = (int64_t)(drand48() * (2 * l_pac - 2 * l)); // room for deletions
+		while (p < l_pac && p + 2 * l > l_pac);
+		s->seq = (char *) malloc(l);
+		for (j = 0; j < l; ++p) {
+			double r = drand48();
+			if (r < err * .05) continue;                                // deletion
+			if (r < err * .1) s->seq[j++] = lrand48() & 3, --p;         // insertion
+			else if (r < err) s->seq[j++] = (ref[p] + 1 + lrand48() % 3) & 3;
+			else s->seq[j++] = ref[p];
+		}
+		snprintf(name, sizeof(name), "syn%d", i);
+		s->name = strdup(name);
+		s->l_seq = l, s->id = i;
+	}
+	return seqs;
+}
+
+static bseq1_t *bench_load_reads(const char *fn, int *n_)
+{
+	bseq1_t *seqs = NULL, *b;
+	gzFile fp = gzopen(fn, "r");
+	int64_t size = 0;
+	int n = 0, m, m_all, i, j;
+
+	if (fp == NULL) {
+		fprintf(stderr, "[E::%s] fail to open file `%s'.\n", __func__, fn);
+		exit(EXIT_FAILURE);
+	}
+	b = bseq_read_one_fasta_file((int64_t) *n_ * 1024, &m_all, fp, &size);
+	gzclose(fp);
+	m = m_all < *n_? m_all : *n_;
+	seqs = (bseq1_t *) calloc(m > 0? m : 1, sizeof(bseq1_t));
+	for (i = 0; i < m; ++i) {
+		if (b[i].l_seq >= 32768) continue; // int16_t query positions
+		bseq1_t *s = &seqs[n];
+		s->name = strdup(b[i].name);
+		s->seq = (char *) malloc(b[i].l_seq > 0? b[i].l_seq : 1);
+		for (j = 0; j < b[i].l_seq; ++j) s->seq[j] = nst_nt4_table[(int) b[i].seq[j]];
+		s->l_seq = b[i].l_seq, s->id = n++;
+	}
+	for (i = 0; i < m_all; ++i) {
+#ifdef OPT_RW
+		free(b[i].strbuf);
+#else
+		free(b[i].name); free(b[i].comment); free(b[i].seq); free(b[i].qual);
+#endif
+	}
+	free(b);
+	*n_ = n;
+	return seqs;
+}
+
+/*********************
+ * Input preparation *
+ *********************/
+
+static void bench_prep_smem(bench_t *b)
+{
+	const mem_opt_t *opt = b->opt;
+	int split_len = (int)(opt->min_seed_len * opt->split_factor + .499);
+	int64_t tot = 0, n_pos = 0, m_smem = 0, i;
+	int32_t min_intv[BATCH_SIZE], rid[BATCH_SIZE];
+	SMEM *a;
+	int k;
+
+	b->cum_len = (int32_t *) malloc(b->n_seqs * sizeof(int32_t));
+	b->max_len = 0;
+	for (k = 0; k < b->n_seqs; ++k) {
+		b->cum_len[k] = tot, tot += b->seqs[k].l_seq;
+		if (b->max_len < b->seqs[k].l_seq) b->max_len = b->seqs[k].l_seq;
+	}
+	b->enc = (uint8_t *) malloc(tot + 1);
+	for (k = 0; k < b->n_seqs; ++k)
+		memcpy(b->enc + b->cum_len[k], b->seqs[k].seq, b->seqs[k].l_seq);
+
+	b->n_batch = (b->n_seqs + BATCH_SIZE - 1) / BATCH_SIZE;
+	b->pos_off = (int64_t *) calloc(b->n_batch + 1, sizeof(int64_t));
+	b->qpos = (int16_t *) malloc((tot + 1) * sizeof(int16_t));
+	b->pos_intv = (int32_t *) malloc((tot + 1) * sizeof(int32_t));
+	b->pos_rid = (int32_t *) malloc((tot + 1) * sizeof(int32_t));
+	a = (SMEM *) _mm_malloc((tot * 2 + 64) * sizeof(SMEM), 64);
+	b->smem = NULL, b->n_smem = 0;
+
+	for (k = 0; k < b->n_batch; ++k) {
+		int b0 = k * BATCH_SIZE, nb = b->n_seqs - b0 < BATCH_SIZE? b->n_seqs - b0 : BATCH_SIZE;
+		int64_t n1 = 0, n2, p0 = n_pos;
+		for (i = 0; i < nb; ++i) min_intv[i] = 1, rid[i] = i; // compacted by the call
+		b->fmi->getSMEMsAllPosOneThread(b->enc, min_intv, rid, nb, nb, b->seqs + b0, b->cum_len + b0,
+										b->max_len, opt->min_seed_len, a, &n1);
+		for (i = 0; i < n1; ++i) {
+			SMEM *p = &a[i];
+			int start = p->m, end = p->n + 1;
+			if (end - start < split_len || p->s > opt->split_width) continue;
+			b->pos_rid[n_pos] = p->rid;
+			b->qpos[n_pos] = (start + end) >> 1;
+			b->pos_intv[n_pos++] = p->s + 1;
+		}
+		b->pos_off[k + 1] = n_pos;
+		n2 = n1;
+		b->fmi->getSMEMsOnePosOneThread(b->enc, b->qpos + p0, b->pos_intv + p0, b->pos_rid + p0,
+										n_pos - p0, n_pos - p0, b->seqs + b0, b->cum_len + b0,
+										b->max_len, opt->min_seed_len, a, &n2);
+		b->fmi->sortSMEMs(a, &n2, nb, b->seqs[b0].l_seq, 1);
+		if (b->n_smem + n2 > m_smem) {
+			m_smem = (b->n_smem + n2) * 2;
+			b->smem = (SMEM *) realloc(b->smem, m_smem * sizeof(SMEM));
+		}
+		for (i = 0; i < n2; ++i) {
+			b->smem[b->n_smem] = a[i];
+			b->smem[b->n_smem++].rid += b0;
+		}
+	}
+	_mm_free(a);
+}
+
+// longest SMEM of each read under max_occ, with its first reference hit
+static void bench_prep_seeds(bench_t *b)
+{
+	int64_t i, j;
+
+	b->rbeg = (int64_t *) malloc(b->n_seqs * sizeof(int64_t));
+	b->qbeg = (int32_t *) calloc(b->n_seqs, sizeof(int32_t));
+	b->slen = (int32_t *) calloc(b->n_seqs, sizeof(int32_t));
+	for (i = 0; i < b->n_seqs; ++i) b->rbeg[i] = -1;
+	b->max_group = 1;
+	for (i = 0; i < b->n_smem; i = j) {
+		int r = b->smem[i].rid, best = -1;
+		for (j = i; j < b->n_smem && b->smem[j].rid == r; ++j) {
+			SMEM *p = &b->smem[j];
+			if (p->s > 0 && p->s <= b->opt->max_occ && (best < 0 || p->n - p->m > b->smem[best].n - b->smem[best].m))
+				best = j;
+		}
+		if (j - i > b->max_group) b->max_group = j - i;
+		if (best >= 0) {
+			SMEM *p = &b->smem[best];
+			int len = p->n + 1 - p->m;
+#if SA_COMPRESSION
+			int64_t rb = b->fmi->get_sa_entry_compressed(p->k);
+#else
+			int64_t rb = b->fmi->get_sa_entry(p->k);
+#endif
+			if (rb < b->l_pac && rb + len > b->l_pac) continue; // bridging the strands
+			b->rbeg[r] = rb, b->qbeg[r] = p->m, b->slen[r] = len;
+		}
+	}
+}
+
+static inline void bench_push_pair(pair_v *v, u8v *ref, u8v *qer, const uint8_t *rs, int tlen,
+								   const uint8_t *qs, int qlen, int h0, int rev)
+{
+	SeqPair *sp = kv_pushp(SeqPair, *v);
+	int i;
+
+	memset(sp, 0, sizeof(*sp));
+	sp->idr = ref->n, sp->idq = qer->n;
+	sp->len1 = tlen, sp->len2 = qlen, sp->h0 = h0;
+	for (i = 0; i < tlen; ++i) kv_push(uint8_t, *ref, rev? rs[tlen - 1 - i] : rs[i]);
+	for (i = 0; i < qlen; ++i) kv_push(uint8_t, *qer, rev? qs[qlen - 1 - i] : qs[i]);
+}
+
+static int bench_cmp_len1(const void *a, const void *b)
+{ // the order sortPairsLen() gives
+	return ((const SeqPair *) a)->len1 - ((const SeqPair *) b)->len1;
+}
+
+/* Seed extensions as mem_kernel2_core() sets them up, split into the 8- and
+ * 16-bit kernels' pairs, and rescue windows as mem_sam_pe_batch() scores them. */
+static void bench_prep_pairs(bench_t *b)
+{
+	const mem_opt_t *opt = b->opt;
+	const bntseq_t *bns = b->fmi->idx->bns;
+	const uint8_t *pac = b->fmi->idx->pac;
+	int i, c, rid;
+
+	memset(b->ext, 0, sizeof(b->ext)), memset(&b->res, 0, sizeof(b->res));
+	memset(&b->ext_ref, 0, sizeof(u8v)), memset(&b->ext_qer, 0, sizeof(u8v));
+	memset(&b->res_ref, 0, sizeof(u8v)), memset(&b->res_qer, 0, sizeof(u8v));
+	b->res_max_ref = b->res_max_qer = 0;
+	for (i = 0; i < b->n_seqs; ++i) {
+		const uint8_t *q = (const uint8_t *) b->seqs[i].seq;
+		int l = b->seqs[i].l_seq, qb = b->qbeg[i], qe = qb + b->slen[i];
+		int64_t s = b->rbeg[i], rb, re;
+		uint8_t *rseq;
+		if (s < 0) continue;
+
+		rb = s - qb - bench_max_gap(opt, qb), re = s + b->slen[i] + (l - qe) + bench_max_gap(opt, l - qe);
+		rb = rb > 0? rb : 0, re = re < b->l_pac<<1? re : b->l_pac<<1;
+		rseq = bns_fetch_seq(bns, pac, &rb, s, &re, &rid);
+		for (c = 0; c < 2; ++c) {
+			int qlen = c? l - qe : qb, tlen = c? re - s - b->slen[i] : s - rb;
+			const uint8_t *qs = c? q + qe : q, *rs = c? rseq + (s + b->slen[i] - rb) : rseq;
+			int h0 = b->slen[i] * opt->a, minval = h0 + (qlen < tlen? qlen : tlen) * opt->a;
+			if (qlen <= 0 || tlen <= 0) continue;
+			int is8 = tlen < MAX_SEQ_LEN8 && qlen < MAX_SEQ_LEN8 && minval < MAX_SEQ_LEN8;
+			if (!is8 && (tlen >= MAX_SEQ_LEN16 || qlen >= MAX_SEQ_LEN16 || minval >= MAX_SEQ_LEN16))
+				continue;
+			bench_push_pair(&b->ext[!is8], &b->ext_ref, &b->ext_qer, rs, tlen, qs, qlen, h0, !c);
+		}
+		free(rseq);
+
+		rb = s - qb - 250, re = s - qb + l + 250; // a mate rescue window
+		rb = rb > 0? rb : 0, re = re < b->l_pac<<1? re : b->l_pac<<1;
+		rseq = bns_fetch_seq(bns, pac, &rb, s, &re, &rid);
+		if (re - rb >= opt->min_seed_len) {
+			int xtra = KSW_XSUBO | KSW_XSTART | (l * opt->a < 250? KSW_XBYTE : 0) | (opt->min_seed_len * opt->a);
+			bench_push_pair(&b->res, &b->res_ref, &b->res_qer, rseq, re - rb, q, l, xtra, 0);
+			if (b->res_max_ref < re - rb) b->res_max_ref = re - rb;
+			if (b->res_max_qer < l) b->res_max_qer = l;
+		}
+		free(rseq);
+	}
+	for (c = 0; c < 2; ++c) {
+		qsort(b->ext[c].a, b->ext[c].n, sizeof(SeqPair), bench_cmp_len1);
+		for (i = 0; i < (int) b->ext[c].n; ++i) b->ext[c].a[i].id = i;
+	}
+	for (i = 0; i < (int) b->res.n; ++i) b->res.a[i].regid = b->res.a[i].id = i;
+	// the kernels read past the last sequence
+	for (i = 0; i < MAX_LINE_LEN; ++i) {
+		kv_push(uint8_t, b->ext_ref, 0); kv_push(uint8_t, b->ext_qer, 0);
+		kv_push(uint8_t, b->res_ref, 0); kv_push(uint8_t, b->res_qer, 0);
+	}
+}
+
+/***********
+ * Kernels *
+ ***********/
+
+#define bench_min(a, b) ((a) < (b)? (a) : (b))
+
+static void bench_smem(bench_t *b)
+{
+	const mem_opt_t *opt = b->opt;
+	int32_t min_intv[BATCH_SIZE], rid[BATCH_SIZE];
+	uint64_t best1 = UINT64_MAX, best2 = UINT64_MAX;
+	int64_t n1_tot = 0, n2_tot = 0, max_tot = 0;
+	int k, r;
+	char note[64];
+	SMEM *a;
+
+	for (k = 0; k < b->n_batch; ++k) {
+		int b0 = k * BATCH_SIZE, b1 = bench_min(b->n_seqs, b0 + BATCH_SIZE);
+		int64_t tot = b->cum_len[b1 - 1] + b->seqs[b1 - 1].l_seq - b->cum_len[b0];
+		if (max_tot < tot) max_tot = tot;
+	}
+	a = (SMEM *) _mm_malloc((max_tot * 2 + 64) * sizeof(SMEM), 64);
+	for (r = 0; r < b->reps; ++r) {
+		uint64_t t1 = 0, t2 = 0, tim;
+		n1_tot = n2_tot = 0;
+		for (k = 0; k < b->n_batch; ++k) {
+			int b0 = k * BATCH_SIZE, nb = bench_min(b->n_seqs - b0, BATCH_SIZE);
+			int64_t n1 = 0, n2 = 0, p0 = b->pos_off[k], np = b->pos_off[k + 1] - p0;
+			for (int j = 0; j < nb; ++j) min_intv[j] = 1, rid[j] = j;
+			tim = __rdtsc();
+			b->fmi->getSMEMsAllPosOneThread(b->enc, min_intv, rid, nb, nb, b->seqs + b0, b->cum_len + b0,
+											b->max_len, opt->min_seed_len, a, &n1);
+			t1 += __rdtsc() - tim;
+			tim = __rdtsc();
+			b->fmi->getSMEMsOnePosOneThread(b->enc, b->qpos + p0, b->pos_intv + p0, b->pos_rid + p0,
+											np, np, b->seqs + b0, b->cum_len + b0,
+											b->max_len, opt->min_seed_len, a, &n2);
+			t2 += __rdtsc() - tim;
+			n1_tot += n1, n2_tot += n2;
+		}
+		best1 = bench_min(best1, t1), best2 = bench_min(best2, t2);
+	}
+	_mm_free(a);
+	snprintf(note, sizeof(note), "getSMEMsAllPosOneThread, %ld SMEMs", (long) n1_tot);
+	bench_report("smem_all", simd_isa_compiled(), b->n_seqs, best1, 0, note);
+	snprintf(note, sizeof(note), "getSMEMsOnePosOneThread, %ld SMEMs", (long) n2_tot);
+	bench_report("smem_one", simd_isa_compiled(), b->pos_off[b->n_batch], best2, 0, note);
+}
+
+static void bench_sal(bench_t *b)
+{
+	int64_t *coord = (int64_t *) malloc(b->max_group * b->opt->max_occ * sizeof(int64_t));
+	uint64_t best = UINT64_MAX;
+	int64_t n_coord = 0, i, j;
+	int r;
+	char note[64];
+
+	for (r = 0; r < b->reps; ++r) {
+		uint64_t tim = __rdtsc();
+		n_coord = 0;
+		for (i = 0; i < b->n_smem; i = j) {
+			for (j = i + 1; j < b->n_smem && b->smem[j].rid == b->smem[i].rid; ++j);
+#if SA_COMPRESSION
+			int64_t cnt = 0, id = 0;
+			b->fmi->get_sa_entries_prefetch(&b->smem[i], coord, &cnt, j - i, b->opt->max_occ, 0, id);
+#else
+			int32_t cnt = 0;
+			b->fmi->get_sa_entries(&b->smem[i], coord, &cnt, j - i, b->opt->max_occ);
+#endif
+			n_coord += cnt;
+		}
+		best = bench_min(best, __rdtsc() - tim);
+	}
+	free(coord);
+	snprintf(note, sizeof(note), "get_sa_entries_prefetch, %ld SMEMs", (long) b->n_smem);
+	bench_report("sal", simd_isa_compiled(), n_coord, best, 0, note);
+}
+
+static void bench_ert(bench_t *b)
+{
+	index_aux_t iaux;
+	read_aux_t raux;
+	mem_v smems;
+	u64v hits;
+	uint8_t rc[READ_LEN];
+	uint64_t best = UINT64_MAX;
+	int64_t n_smem = 0, n_hit = 0;
+	int i, j, r, n = 0;
+	char note[64];
+
+	iaux.kmer_offsets = b->fmi->kmer_offsets;
+	iaux.mlt_table = b->fmi->mlt_table;
+	iaux.bwt = NULL;
+	iaux.bns = b->fmi->idx->bns;
+	iaux.pac = b->fmi->idx->pac;
+	iaux.ref_string = b->ref_string;
+	kv_init(smems); kv_init(hits);
+	for (r = 0; r < b->reps; ++r) {
+		uint64_t t = 0;
+		n = 0, n_smem = n_hit = 0;
+		for (i = 0; i < b->n_seqs; ++i) {
+			const uint8_t *seq = (const uint8_t *) b->seqs[i].seq;
+			int len = b->seqs[i].l_seq, hasN = 0;
+			if (len > READ_LEN) continue;
+			for (j = 0; j < len; ++j) {
+				hasN = seq[j] < 4? hasN : 1;
+				rc[len - j - 1] = seq[j] < 4? 3 - seq[j] : 4;
+			}
+			memset(&raux, 0, sizeof(raux));
+			raux.min_seed_len = b->opt->min_seed_len;
+			raux.l_seq = len;
+			raux.read_name = b->seqs[i].name;
+			raux.unpacked_queue_buf = (uint8_t *) seq;
+			raux.unpacked_rc_queue_buf = rc;
+			smems.n = hits.n = 0;
+			uint64_t tim = __rdtsc();
+			if (hasN) get_seeds(&iaux, &raux, &smems, &hits);
+			else get_seeds_prefix(&iaux, &raux, &smems, &hits);
+			t += __rdtsc() - tim;
+			n_smem += smems.n, n_hit += hits.n, ++n;
+		}
+		best = bench_min(best, t);
+	}
+	kv_destroy(smems); kv_destroy(hits);
+	snprintf(note, sizeof(note), "get_seeds_prefix, %ld SMEMs, %ld hits", (long) n_smem, (long) n_hit);
+	bench_report("ert", simd_isa_compiled(), n, best, 0, note);
+}
+
+#ifdef PERFECT_MATCH
+static void bench_emf(bench_t *b)
+{
+	perfect_table_t *pt = b->fmi->perfect_table;
+	uint64_t best = UINT64_MAX;
+	int i, r, n_pm = 0;
+	char note[64];
+
+	for (r = 0; r < b->reps; ++r) {
+		for (i = 0; i < b->n_seqs; ++i)
+			memset(&b->seqs[i].perfect, 0, sizeof(bseq1_perfect_t));
+		uint64_t tim = __rdtsc();
+		n_pm = 0;
+		for (i = 0; i < b->n_seqs; ++i) {
+			int ret = find_perfect_match_entry(pt, &b->seqs[i], b->seqs[i].l_seq);
+			n_pm += ret == FIND_PERFECT_FW_MATCHED || ret == FIND_PERFECT_RC_MATCHED;
+		}
+		best = bench_min(best, __rdtsc() - tim);
+	}
+	for (i = 0; i < b->n_seqs; ++i)
+		memset(&b->seqs[i].perfect, 0, sizeof(bseq1_perfect_t));
+	snprintf(note, sizeof(note), "find_perfect_match_entry, %d matched", n_pm);
+	bench_report("emf", simd_isa_compiled(), b->n_seqs, best, 0, note);
+}
+#endif
+
+static void bench_bsw(bench_t *b, int isa)
+{
+	const mem_opt_t *opt = b->opt;
+	BandedPairWiseSW bsw(opt->o_del, opt->e_del, opt->o_ins, opt->e_ins, opt->zdrop,
+						 opt->pen_clip5, opt->mat, opt->a, opt->b, 1);
+	int c, r;
+	size_t i;
+
+	for (c = 0; c < 2; ++c) {
+		pair_v *v = &b->ext[c];
+		SeqPair *work = (SeqPair *) malloc((v->n + MAX_LINE_LEN) * sizeof(SeqPair));
+		uint64_t best = UINT64_MAX;
+		double cells = 0., tlen = 0., qlen = 0.;
+		char note[64];
+
+		if (v->n == 0) { free(work); continue; }
+		for (i = 0; i < v->n; ++i) {
+			cells += (double) v->a[i].len2 * bench_min(v->a[i].len1, 2 * opt->w + 1);
+			tlen += v->a[i].len1, qlen += v->a[i].len2;
+		}
+		for (r = 0; r < b->reps; ++r) {
+			memcpy(work, v->a, v->n * sizeof(SeqPair));
+			uint64_t tim = __rdtsc();
+			if (c == 0) bsw.getScores8(work, b->ext_ref.a, b->ext_qer.a, v->n, 1, opt->w);
+			else bsw.getScores16(work, b->ext_ref.a, b->ext_qer.a, v->n, 1, opt->w);
+			best = bench_min(best, __rdtsc() - tim);
+		}
+		free(work);
+		snprintf(note, sizeof(note), "getScores%d, w=%d, %.0fx%.0f", c? 16 : 8, opt->w,
+				 tlen / v->n, qlen / v->n);
+		bench_report(c? "bsw16" : "bsw8", isa, v->n, best, cells, note);
+	}
+}
+
+static void bench_kswv(bench_t *b, int isa)
+{
+	const mem_opt_t *opt = b->opt;
+	pair_v *v = &b->res;
+	kswv ksw(opt->o_del, opt->e_del, opt->o_ins, opt->e_ins, opt->a, -1 * opt->b, 1,
+			 b->res_max_ref, b->res_max_qer);
+	SeqPair *sel = (SeqPair *) malloc((v->n + 1) * sizeof(SeqPair));
+	SeqPair *work = (SeqPair *) malloc((v->n + MAX_LINE_LEN) * sizeof(SeqPair));
+	kswr_t *aln = (kswr_t *) malloc((v->n + MAX_LINE_LEN) * sizeof(kswr_t));
+	size_t i;
+	int c, r;
+
+	for (c = 0; c < 2; ++c) { // 8-bit on the pairs flagged KSW_XBYTE, 16-bit on all
+		uint64_t best = UINT64_MAX;
+		double cells = 0., tlen = 0., qlen = 0.;
+		int64_t n = 0;
+		char note[64];
+
+		for (i = 0; i < v->n; ++i) {
+			if (c == 0 && !(v->a[i].h0 & KSW_XBYTE)) continue;
+			sel[n++] = v->a[i];
+			cells += (double) v->a[i].len1 * v->a[i].len2;
+			tlen += v->a[i].len1, qlen += v->a[i].len2;
+		}
+		if (n == 0) continue;
+		for (r = 0; r < b->reps; ++r) {
+			memcpy(work, sel, n * sizeof(SeqPair));
+			for (i = 0; i < v->n; ++i) aln[i] = g_defr, aln[i].tb = aln[i].qb = -1;
+			uint64_t tim = __rdtsc();
+			if (c == 0) ksw.getScores8(work, b->res_ref.a, b->res_qer.a, aln, n, 1, 0);
+			else ksw.getScores16(work, b->res_ref.a, b->res_qer.a, aln, n, 1, 0);
+			best = bench_min(best, __rdtsc() - tim);
+		}
+		snprintf(note, sizeof(note), "getScores%d, %.0fx%.0f", c? 16 : 8, tlen / n, qlen / n);
+		bench_report(c? "kswv16" : "kswv8", isa, n, best, cells, note);
+	}
+	free(sel); free(work); free(aln);
+}
+
+static void bench_cigar(bench_t *b)
+{
+	const mem_opt_t *opt = b->opt;
+	uint64_t best = UINT64_MAX;
+	int64_t nm = 0;
+	int i, r, n = 0;
+	char note[64];
+
+	for (r = 0; r < b->reps; ++r) {
+		uint64_t tim = __rdtsc();
+		n = 0, nm = 0;
+		for (i = 0; i < b->n_seqs; ++i) {
+			int l = b->seqs[i].l_seq, score, n_cigar, NM;
+			int64_t rb = b->rbeg[i] - b->qbeg[i], re = rb + l;
+			uint32_t *cigar;
+			if (b->rbeg[i] < 0 || rb < 0 || re > b->l_pac<<1 || (rb < b->l_pac && re > b->l_pac))
+				continue;
+			cigar = bwa_gen_cigar2(opt->mat, opt->o_del, opt->e_del, opt->o_ins, opt->e_ins, opt->w,
+								   b->l_pac, b->fmi->idx->pac, l, (uint8_t *) b->seqs[i].seq,
+								   rb, re, &score, &n_cigar, &NM);
+			free(cigar);
+			nm += NM, ++n;
+		}
+		best = bench_min(best, __rdtsc() - tim);
+	}
+	snprintf(note, sizeof(note), "bwa_gen_cigar2, w=%d, %.2f NM", opt->w, n? (double) nm / n : 0.);
+	bench_report("cigar", simd_isa_compiled(), n, best, 0, note);
+}
+
+/********
+ * Main *
+ ********/
+
+static int bench_has_file(const char *prefix, const char *postfix)
+{
+	char fn[PATH_MAX];
+	snprintf(fn, sizeof(fn), "%s%s", prefix, postfix);
+	return access(fn, R_OK) == 0;
+}
+
+// FM index of prefix, with the smem tables of the builds that take them
+static FMI_search *bench_load_fmi(const char *prefix, const char *tmp_dir)
+{
+	FMI_search *fmi;
+#ifdef SMEM_ACCEL
+	if (!bench_has_file(prefix, ".all_smem.11") || !bench_has_file(prefix, ".last_smem.13")) {
+#ifdef MEMSCALE
+		fmi_load_smem_tables(0);
+		fprintf(stderr, "[W::%s] no smem tables for %s, smem runs without them\n", __func__, prefix);
+#else
+		fprintf(stderr, "[E::%s] this build needs the smem tables of %s (smem-table)\n",
+				__func__, prefix);
+		if (tmp_dir && *tmp_dir) bench_rmdir(tmp_dir);
+		exit(EXIT_FAILURE);
+#endif
+	}
+#endif
+	fmi = new FMI_search(prefix);
+	fmi->load_index();
+	return fmi;
+}
+
+static int bench_parse_kernels(const char *s)
+{
+	int mask = 0, k;
+	while (*s) {
+		const char *e = strchr(s, ',');
+		int l = e? e - s : strlen(s);
+		for (k = 0; k < BK_N; ++k)
+			if ((int) strlen(bench_kernel_names[k]) == l && strncmp(s, bench_kernel_names[k], l) == 0) break;
+		if (k == BK_N) {
+			fprintf(stderr, "[E::%s] unknown kernel '%.*s'\n", __func__, l, s);
+			exit(EXIT_FAILURE);
+		}
+		mask |= 1<<k;
+		s += l + (e != NULL);
+	}
+	return mask;
+}
+
+typedef kvec_t(capture_rec_t) rec_v;
+
+#define BENCH_MAX_DIFF 5 // mismatches reported in full per kernel
+
+static int bench_smem_eq(const SMEM *a, const SMEM *b)
+{
+	return a->rid == b->rid && a->m == b->m && a->n == b->n && a->k == b->k && a->l == b->l && a->s == b->s;
+}
+
+/* mem_collect_smem() on the captured batches, the SMEMs compared to the capture */
+static int64_t bench_replay_smem(FMI_search *fmi, const mem_opt_t *opt, const rec_v *recs, int reps)
+{
+	uint64_t best = UINT64_MAX;
+	int64_t n_diff = 0, n_smem = 0, n_reads = 0, max_tot = 0;
+	int n_batch = 0, max_nseq = 0, r, l;
+	size_t k;
+	char note[64];
+
+	for (k = 0; k < recs->n; ++k) {
+		const capture_rec_t *c = &recs->a[k];
+		int64_t tot = 0;
+		if (c->type != CAP_SMEM) continue;
+		for (l = 0; l < c->nseq; ++l) tot += c->l_seq[l];
+		if (max_tot < tot + c->n_smem) max_tot = tot + c->n_smem;
+		if (max_nseq < c->nseq) max_nseq = c->nseq;
+	}
+	bseq1_t *seqs = (bseq1_t *) calloc(max_nseq, sizeof(bseq1_t));
+	SMEM *a = (SMEM *) _mm_malloc((max_tot * 2 + 64) * sizeof(SMEM), 64);
+	int32_t *min_intv = (int32_t *) malloc((max_tot * 2 + 64) * sizeof(int32_t));
+	int32_t *rid = (int32_t *) malloc((max_tot * 2 + 64) * sizeof(int32_t));
+	int16_t *qpos = (int16_t *) malloc((max_tot * 2 + 64) * sizeof(int16_t));
+	uint8_t *enc = (uint8_t *) malloc(max_tot + 64);
+	assert(seqs && a && min_intv && rid && qpos && enc);
+
+	for (r = 0; r < reps; ++r) {
+		uint64_t t = 0;
+		n_batch = 0, n_smem = n_reads = 0;
+		for (k = 0; k < recs->n; ++k) {
+			const capture_rec_t *c = &recs->a[k];
+			int64_t n = 0, off = 0, i;
+			if (c->type != CAP_SMEM) continue;
+#ifndef PERFECT_MATCH
+			for (l = 0; l < c->nseq && !c->perfect[l]; ++l);
+			if (l < c->nseq) continue; // left out: this build would search the perfect matches too
+#endif
+			for (l = 0; l < c->nseq; ++l) {
+				seqs[l].l_seq = c->l_seq[l], seqs[l].id = l;
+				seqs[l].seq = (char *) c->seq + off;
+#ifdef PERFECT_MATCH
+				seqs[l].perfect.exist = c->perfect[l];
+#endif
+				off += c->l_seq[l];
+				n_reads += !c->perfect[l];
+			}
+			uint64_t tim = __rdtsc();
+			mem_collect_smem(fmi, opt, seqs, c->nseq, a, min_intv, qpos, enc, rid, n);
+			t += __rdtsc() - tim;
+			++n_batch, n_smem += n;
+			if (r) continue;
+			for (i = 0; i < n && i < c->n_smem && bench_smem_eq(&a[i], &c->smem[i]); ++i);
+			if (i < n || i < c->n_smem) {
+				if (n_diff++ < BENCH_MAX_DIFF)
+					fprintf(stderr, "[W::%s] batch %ld: %ld SMEMs, %ld captured; first difference at %ld\n",
+							__func__, (long) k, (long) n, (long) c->n_smem, (long) i);
+			}
+		}
+		best = bench_min(best, t);
+	}
+	free(seqs); _mm_free(a); free(min_intv); free(rid); free(qpos); free(enc);
+	if (n_batch == 0) {
+		fprintf(stderr, "[W::%s] smem skipped: all batches have perfect matches, which this build searches\n", __func__);
+		return 0;
+	}
+	snprintf(note, sizeof(note), "%d batches, %ld SMEMs, %ld differ", n_batch, (long) n_smem, (long) n_diff);
+	bench_report("smem", simd_isa_compiled(), n_reads, best, 0, note);
+	return n_diff;
+}
+
+/* The captured banded DP calls of each kernel, the scores compared to the capture */
+static int64_t bench_replay_bsw(const capture_hdr_t *h, const mem_opt_t *opt, const rec_v *recs,
+								int reps, int isa)
+{
+	BandedPairWiseSW bsw0(opt->o_del, opt->e_del, opt->o_ins, opt->e_ins, opt->zdrop,
+						  opt->pen_clip5, opt->mat, opt->a, opt->b, 1);
+	BandedPairWiseSW bsw1(opt->o_del, opt->e_del, opt->o_ins, opt->e_ins, opt->zdrop,
+						  opt->pen_clip3, opt->mat, opt->a, opt->b, 1);
+	static const int bits[3] = { 8, 16, 32 };
+	int64_t n_diff_tot = 0;
+	int c, r, max_n = 0;
+	size_t k;
+
+	for (k = 0; k < recs->n; ++k)
+		if (recs->a[k].type == CAP_BSW && max_n < recs->a[k].n) max_n = recs->a[k].n;
+	SeqPair *work = (SeqPair *) malloc((max_n + MAX_LINE_LEN) * sizeof(SeqPair));
+	assert(work != NULL);
+	for (c = 0; c < 3; ++c) {
+		uint64_t best = UINT64_MAX;
+		int64_t n_pair = 0, n_diff = 0;
+		int n_call = 0;
+		double cells = 0.;
+		char kernel[16], note[64];
+
+		for (r = 0; r < reps; ++r) {
+			uint64_t t = 0;
+			n_call = 0, n_pair = 0, cells = 0.;
+			for (k = 0; k < recs->n; ++k) {
+				const capture_rec_t *p = &recs->a[k];
+				BandedPairWiseSW *bsw = p->side == CAP_LEFT? &bsw0 : &bsw1;
+				int i;
+				if (p->type != CAP_BSW || p->bits != bits[c]) continue;
+				memcpy(work, p->pairs, p->n * sizeof(SeqPair));
+				uint64_t tim = __rdtsc();
+				if (c == 0) bsw->getScores8(work, p->ref, p->qer, p->n, 1, p->w);
+				else if (c == 1) bsw->getScores16(work, p->ref, p->qer, p->n, 1, p->w);
+#if ((!__AVX512BW__) && (!__AVX2__) && (!__SSE2__))
+				else bsw->scalarBandedSWAWrapper(work, p->ref, p->qer, p->n, 1, p->w);
+#else
+				else bsw->getScores32(work, p->ref, p->qer, p->n, 1, p->w);
+#endif
+				t += __rdtsc() - tim;
+				++n_call, n_pair += p->n;
+				for (i = 0; i < p->n; ++i)
+					cells += (double) p->pairs[i].len2 * bench_min(p->pairs[i].len1, 2 * p->w + 1);
+				if (r) continue;
+				for (i = 0; i < p->n; ++i) {
+					const SeqPair *x = &work[i], *y = &p->pairs[i];
+					if (x->score == y->score && x->tle == y->tle && x->gtle == y->gtle && x->qle == y->qle
+						&& x->gscore == y->gscore && x->max_off == y->max_off)
+						continue;
+					if (n_diff++ < BENCH_MAX_DIFF)
+						fprintf(stderr, "[W::%s] bsw%d call %ld pair %d (%dx%d, h0=%d): score/tle/qle/gscore %d/%d/%d/%d, captured %d/%d/%d/%d\n",
+								__func__, bits[c], (long) k, i, y->len1, y->len2, y->h0, x->score, x->tle,
+								x->qle, x->gscore, y->score, y->tle, y->qle, y->gscore);
+				}
+			}
+			best = bench_min(best, t);
+		}
+		if (n_call == 0) continue;
+		snprintf(kernel, sizeof(kernel), "bsw%d", bits[c]);
+		snprintf(note, sizeof(note), "%d calls, %ld differ", n_call, (long) n_diff);
+		bench_report(kernel, isa, n_pair, best, cells, note);
+		n_diff_tot += n_diff;
+	}
+	free(work);
+	return n_diff_tot;
+}
+
+static int bench_replay(const char *fn, const char *prefix, int reps, int kmask)
+{
+	capture_hdr_t h;
+	capture_rec_t rec;
+	rec_v recs = {0, 0, 0};
+	mem_opt_t *opt;
+	gzFile fp;
+	int64_t n_diff = 0, n_rec[2] = {0, 0};
+	int ret, isa, top;
+	size_t k;
+
+	if ((fp = capture_open(fn, &h)) == NULL) return 1;
+	while ((ret = capture_read(fp, &rec)) > 0) {
+		kv_push(capture_rec_t, recs, rec);
+		++n_rec[rec.type == CAP_BSW];
+	}
+	gzclose(fp);
+	if (ret < 0) {
+		for (k = 0; k < recs.n; ++k) capture_rec_free(&recs.a[k]);
+		kv_destroy(recs), free(h.prefix);
+		return 1;
+	}
+	opt = mem_opt_init();
+	opt->a = h.a, opt->b = h.b, opt->o_del = h.o_del, opt->e_del = h.e_del;
+	opt->o_ins = h.o_ins, opt->e_ins = h.e_ins, opt->zdrop = h.zdrop;
+	opt->pen_clip5 = h.pen_clip5, opt->pen_clip3 = h.pen_clip3, opt->w = h.w;
+	opt->min_seed_len = h.min_seed_len, opt->split_factor = h.split_factor;
+	opt->split_width = h.split_width, opt->max_occ = h.max_occ, opt->max_mem_intv = h.max_mem_intv;
+	bwa_fill_scmat(opt->a, opt->b, opt->mat);
+	if (prefix == NULL) prefix = h.prefix;
+	fprintf(stderr, "[M::%s] %ld SMEM batches and %ld banded DP calls captured on %s; best of %d passes\n",
+			__func__, (long) n_rec[0], (long) n_rec[1], h.prefix, reps);
+#ifndef PERFECT_MATCH
+	if (h.perfect)
+		fprintf(stderr, "[W::%s] captured with PERFECT_MATCH: batches with perfect matches are left out\n", __func__);
+#endif
+
+	printf("%-10s %-9s %10s %10s %12s  %s\n", "kernel", "isa", "ops", "ns/op", "Mcells/s", "note");
+	if (n_rec[0] && (kmask & 1<<BK_SMEM)) {
+		FMI_search *fmi = bench_load_fmi(prefix, NULL);
+		n_diff += bench_replay_smem(fmi, opt, &recs, reps);
+		delete fmi;
+	}
+#ifdef SIMD_DISPATCH
+	top = simd_dispatch_init(getenv(SIMD_DISPATCH_ENV));
+	for (isa = simd_isa_compiled(); isa <= top; ++isa) {
+		simd_dispatch_init(simd_isa_name(isa));
+#else
+	for (isa = top = simd_isa_compiled(); isa <= top; ++isa) {
+#endif
+		if (n_rec[1] && (kmask & 1<<BK_BSW)) n_diff += bench_replay_bsw(&h, opt, &recs, reps, isa);
+	}
+
+	for (k = 0; k < recs.n; ++k) capture_rec_free(&recs.a[k]);
+	kv_destroy(recs);
+	free(h.prefix);
+	free(opt);
+	if (n_diff) {
+		fprintf(stderr, "[E::%s] %ld replayed outputs differ from the capture\n", __func__, (long) n_diff);
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	mem_opt_t *opt = mem_opt_init();
+	const char *reads_fn = NULL, *replay_fn = NULL;
+	char *prefix = NULL, tmp_dir[PATH_MAX] = "", buf[PATH_MAX];
+	int64_t g_len = 1000000;
+	int n_reads = 20000, l_read = 150, kmask = (1<<BK_N) - 1, c, i, isa, top;
+	long seed = 11;
+	double err = .01;
+	bench_t b;
+
+	memset(&b, 0, sizeof(b));
+	b.reps = 3;
+	while ((c = getopt(argc, argv, "i:q:g:n:l:e:r:s:w:k:R:h")) >= 0) {
+		if (c == 'i') prefix = optarg;
+		else if (c == 'q') reads_fn = optarg;
+		else if (c == 'g') g_len = atol(optarg);
+		else if (c == 'n') n_reads = atoi(optarg);
+		else if (c == 'l') l_read = atoi(optarg);
+		else if (c == 'e') err = atof(optarg);
+		else if (c == 'r') b.reps = atoi(optarg);
+		else if (c == 's') seed = atol(optarg);
+		else if (c == 'w') opt->w = atoi(optarg);
+		else if (c == 'k') kmask = bench_parse_kernels(optarg);
+		else if (c == 'R') replay_fn = optarg;
+		else if (c == 'h') { usage(opt); free(opt); return 0; }
+		else { usage(opt); free(opt); return 1; }
+	}
+	if (optind != argc || g_len < 10000 || n_reads <= 0 || l_read < opt->min_seed_len
+		|| l_read >= 32768 || b.reps <= 0 || opt->w <= 0) {
+		usage(opt);
+		free(opt);
+		return 1;
+	}
+	bwa_fill_scmat(opt->a, opt->b, opt->mat);
+	srand48(seed);
+
+	uint64_t tim = __rdtsc();
+	sleep(1);
+	proc_freq = __rdtsc() - tim;
+	if (replay_fn) {
+		free(opt);
+		return bench_replay(replay_fn, prefix, b.reps, kmask);
+	}
+
+	if (prefix == NULL) { // synthetic reference, indexed in a scratch directory
+		const char *t = getenv("TMPDIR");
+		char *ref;
+		snprintf(tmp_dir, sizeof(tmp_dir), "%s/bwa-bench.XXXXXX", t && *t? t : "/tmp");
+		if (mkdtemp(tmp_dir) == NULL) {
+			fprintf(stderr, "[E::%s] fail to create a directory in %s\n", __func__, t && *t? t : "/tmp");
+			exit(EXIT_FAILURE);
+		}
+		snprintf(buf, sizeof(buf), "%s/syn.fa", tmp_dir);
+		ref = bench_gen_ref(g_len);
+		bench_write_ref(buf, ref, g_len);
+		free(ref);
+		prefix = (char *) malloc(PATH_MAX);
+		snprintf(prefix, PATH_MAX, "%s/syn", tmp_dir);
+		fprintf(stderr, "[M::%s] indexing a %ld bp synthetic reference in %s\n", __func__, (long) g_len, tmp_dir);
+		bwa_idx_build_mem2(buf, prefix, 0);
+	}
+
+	b.opt = opt;
+	b.fmi = bench_load_fmi(prefix, tmp_dir);
+	if ((kmask & 1<<BK_ERT) && bench_has_file(prefix, ".kmer_table") && bench_has_file(prefix, ".mlt_table"))
+		b.fmi->load_ert_index();
+	else b.fmi->useErt = 0;
+	load_ref_string(prefix, &b.ref_string);
+	b.l_pac = b.fmi->idx->bns->l_pac;
+
+	if (reads_fn) {
+		b.n_seqs = n_reads;
+		b.seqs = bench_load_reads(reads_fn, &b.n_seqs);
+		if (b.n_seqs == 0) {
+			fprintf(stderr, "[E::%s] no reads in %s\n", __func__, reads_fn);
+			exit(EXIT_FAILURE);
+		}
+	} else {
+		b.n_seqs = n_reads;
+		b.seqs = bench_sample_reads(b.ref_string, b.l_pac, n_reads, l_read, err);
+	}
+#ifdef PERFECT_MATCH
+	if (kmask & 1<<BK_EMF) {
+		snprintf(buf, sizeof(buf), ".perfect.%d", b.seqs[0].l_seq);
+		if (*tmp_dir && !bench_has_file(prefix, buf))
+			perfect_build_index(prefix, b.seqs[0].l_seq, 1.1);
+		if (bench_has_file(prefix, buf))
+			load_perfect_table(prefix, b.seqs[0].l_seq, &b.ref_string, b.fmi);
+	}
+#endif
+
+	bench_prep_smem(&b);
+	bench_prep_seeds(&b);
+	bench_prep_pairs(&b);
+	fprintf(stderr, "[M::%s] %d reads, %ld SMEMs, %ld+%ld extension and %ld rescue pairs; best of %d passes\n",
+			__func__, b.n_seqs, (long) b.n_smem, (long) b.ext[0].n, (long) b.ext[1].n, (long) b.res.n, b.reps);
+
+	printf("%-10s %-9s %10s %10s %12s  %s\n", "kernel", "isa", "ops", "ns/op", "Mcells/s", "note");
+	if (kmask & 1<<BK_SMEM) bench_smem(&b);
+	if (kmask & 1<<BK_SAL) bench_sal(&b);
+	if (kmask & 1<<BK_ERT) {
+		if (b.fmi->useErt) bench_ert(&b);
+		else fprintf(stderr, "[W::%s] ert skipped: no ERT index for %s\n", __func__, prefix);
+	}
+	if (kmask & 1<<BK_EMF) {
+#ifdef PERFECT_MATCH
+		if (b.fmi->perfect_table) bench_emf(&b);
+		else fprintf(stderr, "[W::%s] emf skipped: no %s.perfect.%d\n", __func__, prefix, b.seqs[0].l_seq);
+#else
+		fprintf(stderr, "[W::%s] emf skipped: built without PERFECT_MATCH\n", __func__);
+#endif
+	}
+	// the vector DP kernels of each ISA the binary runs on
+#ifdef SIMD_DISPATCH
+	top = simd_dispatch_init(getenv(SIMD_DISPATCH_ENV));
+	for (isa = simd_isa_compiled(); isa <= top; ++isa) {
+		simd_dispatch_init(simd_isa_name(isa));
+#else
+	for (isa = top = simd_isa_compiled(); isa <= top; ++isa) {
+#endif
+		if (kmask & 1<<BK_BSW) bench_bsw(&b, isa);
+		if (kmask & 1<<BK_KSWV) bench_kswv(&b, isa);
+	}
+	if (kmask & 1<<BK_CIGAR) bench_cigar(&b);
+
+	for (i = 0; i < b.n_seqs; ++i) free(b.seqs[i].name), free(b.seqs[i].seq);
+	free(b.seqs); free(b.cum_len); free(b.enc);
+	free(b.pos_off); free(b.qpos); free(b.pos_intv); free(b.pos_rid);
+	free(b.smem); free(b.rbeg); free(b.qbeg); free(b.slen);
+	for (c = 0; c < 2; ++c) kv_destroy(b.ext[c]);
+	kv_destroy(b.res);
+	kv_destroy(b.ext_ref); kv_destroy(b.ext_qer); kv_destroy(b.res_ref); kv_destroy(b.res_qer);
+#ifdef USE_SHM
+	if (bwa_shm_unmap(BWA_SHM_REF))
+#endif
+		_mm_free(b.ref_string);
+	delete b.fmi;
+#ifdef PERFECT_MATCH
+	free_perfect_table();
+#endif
+	if (*tmp_dir) {
+		bench_rmdir(tmp_dir);
+		free(prefix);
+	}
+	free(opt);
+	return 0;
+}
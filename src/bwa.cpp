@@ -43,6 +43,7 @@
 #include "bntseq.h"
 #include "bwa.h"
 #include "ksw.h"
+#include "kswg.h"
 #include "utils.h"
 #include "kstring.h"
 #include "kvec.h"
@@ -278,7 +279,7 @@ bseq1_t *bseq_read_orig(int64_t chunk_size, int *n_, void *ks1_, void *ks2_, int
             fprintf(stderr, "[W::%s] the 2nd file has fewer sequences.\n", __func__);
             break;
         }
-        if (n >= m) {
+        if (n + (ks2 != 0) >= m) { // room for both mates
 #ifdef USE_SHM
 			if (ks2)
 				m = m ? m + 256 : chunk_size / (hint_readLen * 2) + 10;
@@ -319,6 +320,12 @@ bseq1_t *bseq_read_orig(int64_t chunk_size, int *n_, void *ks1_, void *ks2_, int
             kseq2bseq1(ks2, &seqs[n]);
 #endif
             seqs[n].id = n;
+#ifdef OPT_RW
+            seqs[n].sam = NULL;
+#endif
+#ifdef PERFECT_MATCH
+            seqs[n].perfect.exist = 0;
+#endif
             size += seqs[n++].l_seq;
         }
         if (size >= chunk_size && (n&1) == 0) break;
@@ -376,37 +383,30 @@ void bwa_fill_scmat(int a, int b, int8_t mat[25])
     for (j = 0; j < 5; ++j) mat[k++] = -1;   // DEFAULT AMBIG
 }
 
-// Generate CIGAR when the alignment end points are known
-uint32_t *bwa_gen_cigar2(const int8_t mat[25], int o_del, int e_del, int o_ins, int e_ins, int w_, int64_t l_pac, const uint8_t *pac, int l_query, uint8_t *query, int64_t rb, int64_t re, int *score, int *n_cigar, int *NM)
+// Fetch the reference of [rb,re) and set up the global alignment of bwa_gen_cigar2();
+// *w is -1 if no DP is needed. Returns NULL if the interval is rejected.
+static uint8_t *gen_cigar_prep(const int8_t mat[25], int o_del, int e_del, int o_ins, int e_ins, int w_, int64_t l_pac, const uint8_t *pac, int l_query, uint8_t *query, int64_t rb, int64_t re, int64_t *rlen_, int *w_out)
 {
-    uint32_t *cigar = 0;
     uint8_t tmp, *rseq;
     int i;
     int64_t rlen;
-    kstring_t str;
-    const char *int2base;
 
-    if (n_cigar) *n_cigar = 0;
-    if (NM) *NM = -1;
     if (l_query <= 0 || rb >= re || (rb < l_pac && re > l_pac)) return 0; // reject if negative length or bridging the forward and reverse strand
     rseq = bns_get_seq(l_pac, pac, rb, re, &rlen);
-    if (re - rb != rlen) goto ret_gen_cigar; // possible if out of range
+    if (re - rb != rlen) { // possible if out of range
+        free(rseq);
+        return 0;
+    }
     if (rb >= l_pac) { // then reverse both query and rseq; this is to ensure indels to be placed at the leftmost position
         for (i = 0; i < l_query>>1; ++i)
             tmp = query[i], query[i] = query[l_query - 1 - i], query[l_query - 1 - i] = tmp;
         for (i = 0; i < rlen>>1; ++i)
             tmp = rseq[i], rseq[i] = rseq[rlen - 1 - i], rseq[rlen - 1 - i] = tmp;
     }
+    *rlen_ = rlen;
     if (l_query == re - rb && w_ == 0) { // no gap; no need to do DP
         // UPDATE: we come to this block now... FIXME: due to an issue in mem_reg2aln(), we never come to this block. This does not affect accuracy, but it hurts performance.
-        if (n_cigar) {
-            cigar = (uint32_t*) malloc(4);
-            assert(cigar != NULL);
-            cigar[0] = l_query<<4 | 0;
-            *n_cigar = 1;
-        }
-        for (i = 0, *score = 0; i < l_query; ++i)
-            *score += mat[rseq[i]*5 + query[i]];
+        *w_out = -1;
     } else {
         int w, max_gap, max_ins, max_del, min_w;
         // set the band-width
@@ -418,14 +418,40 @@ uint32_t *bwa_gen_cigar2(const int8_t mat[25], int o_del, int e_del, int o_ins,
         w = w < w_? w : w_;
         min_w = abs(rlen - l_query) + 3;
         w = w > min_w? w : min_w;
-        // NW alignment
+        *w_out = w;
         if (bwa_verbose >= 4) {
             fprintf(stderr, "* Global bandwidth: %d\n", w);
             fprintf(stderr, "* Global ref:   "); for (i = 0; i < rlen; ++i) fputc("ACGTN"[(int)rseq[i]], stderr); fputc('\n', stderr);
             fprintf(stderr, "* Global query: "); for (i = 0; i < l_query; ++i) fputc("ACGTN"[(int)query[i]], stderr); fputc('\n', stderr);
         }
-        *score = ksw_global2(l_query, query, rlen, rseq, 5, mat, o_del, e_del, o_ins, e_ins, w, n_cigar, &cigar);
     }
+    return rseq;
+}
+
+// Score and CIGAR of the gap-free alignment
+static uint32_t *gen_cigar_nogap(const int8_t mat[25], int l_query, const uint8_t *query, const uint8_t *rseq, int *score, int *n_cigar)
+{
+    uint32_t *cigar = 0;
+    int i;
+    if (n_cigar) {
+        cigar = (uint32_t*) malloc(4);
+        assert(cigar != NULL);
+        cigar[0] = l_query<<4 | 0;
+        *n_cigar = 1;
+    }
+    for (i = 0, *score = 0; i < l_query; ++i)
+        *score += mat[rseq[i]*5 + query[i]];
+    return cigar;
+}
+
+// Append MD to the CIGAR, compute NM and restore the query reversed by gen_cigar_prep()
+static uint32_t *gen_cigar_md(uint32_t *cigar, int64_t l_pac, int l_query, uint8_t *query, const uint8_t *rseq, int64_t rb, int *n_cigar, int *NM)
+{
+    uint8_t tmp;
+    int i;
+    kstring_t str;
+    const char *int2base;
+
     if (NM && n_cigar) {// compute NM and MD
         int k, x, y, u, n_mm = 0, n_gap = 0;
         str.l = str.m = *n_cigar * 4; str.s = (char*)cigar; // append MD to CIGAR
@@ -460,12 +486,68 @@ uint32_t *bwa_gen_cigar2(const int8_t mat[25], int o_del, int e_del, int o_ins,
     if (rb >= l_pac) // reverse back query
         for (i = 0; i < l_query>>1; ++i)
             tmp = query[i], query[i] = query[l_query - 1 - i], query[l_query - 1 - i] = tmp;
+    return cigar;
+}
 
-ret_gen_cigar:
+// Generate CIGAR when the alignment end points are known
+uint32_t *bwa_gen_cigar2(const int8_t mat[25], int o_del, int e_del, int o_ins, int e_ins, int w_, int64_t l_pac, const uint8_t *pac, int l_query, uint8_t *query, int64_t rb, int64_t re, int *score, int *n_cigar, int *NM)
+{
+    uint32_t *cigar = 0;
+    uint8_t *rseq;
+    int64_t rlen;
+    int w;
+
+    if (n_cigar) *n_cigar = 0;
+    if (NM) *NM = -1;
+    rseq = gen_cigar_prep(mat, o_del, e_del, o_ins, e_ins, w_, l_pac, pac, l_query, query, rb, re, &rlen, &w);
+    if (rseq == 0) return 0;
+    if (w < 0) cigar = gen_cigar_nogap(mat, l_query, query, rseq, score, n_cigar);
+    else *score = ksw_global2(l_query, query, rlen, rseq, 5, mat, o_del, e_del, o_ins, e_ins, w, n_cigar, &cigar);
+    cigar = gen_cigar_md(cigar, l_pac, l_query, query, rseq, rb, n_cigar, NM);
     free(rseq);
     return cigar;
 }
 
+void bwa_gen_cigar2_batch(const int8_t mat[25], int o_del, int e_del, int o_ins, int e_ins, int64_t l_pac, const uint8_t *pac, int n, bwa_cigar_t *a)
+{
+    uint8_t **rseq;
+    kswg_job_t *job;
+    int *jid, i, n_job = 0;
+
+    rseq = (uint8_t**) malloc(n * sizeof(uint8_t*));
+    job = (kswg_job_t*) malloc(n * sizeof(kswg_job_t));
+    jid = (int*) malloc(n * sizeof(int));
+    assert(rseq != NULL && job != NULL && jid != NULL);
+    for (i = 0; i < n; ++i) {
+        bwa_cigar_t *p = &a[i];
+        int64_t rlen;
+        int w;
+        p->cigar = 0; p->n_cigar = 0; p->NM = -1;
+        rseq[i] = gen_cigar_prep(mat, o_del, e_del, o_ins, e_ins, p->w, l_pac, pac, p->l_query, p->query, p->rb, p->re, &rlen, &w);
+        if (rseq[i] == 0) continue;
+        if (w < 0) {
+            p->cigar = gen_cigar_nogap(mat, p->l_query, p->query, rseq[i], &p->score, &p->n_cigar);
+            continue;
+        }
+        job[n_job].qlen = p->l_query; job[n_job].query = p->query;
+        job[n_job].tlen = rlen; job[n_job].target = rseq[i];
+        job[n_job].w = w;
+        jid[n_job++] = i;
+    }
+    ksw_global2_batch(n_job, job, 5, mat, o_del, e_del, o_ins, e_ins);
+    for (i = 0; i < n_job; ++i) {
+        bwa_cigar_t *p = &a[jid[i]];
+        p->score = job[i].score, p->n_cigar = job[i].n_cigar, p->cigar = job[i].cigar;
+    }
+    for (i = 0; i < n; ++i) {
+        bwa_cigar_t *p = &a[i];
+        if (rseq[i] == 0) continue;
+        p->cigar = gen_cigar_md(p->cigar, l_pac, p->l_query, p->query, rseq[i], p->rb, &p->n_cigar, &p->NM);
+        free(rseq[i]);
+    }
+    free(rseq); free(job); free(jid);
+}
+
 uint32_t *bwa_gen_cigar(const int8_t mat[25], int q, int r, int w_, int64_t l_pac, const uint8_t *pac, int l_query, uint8_t *query, int64_t rb, int64_t re, int *score, int *n_cigar, int *NM)
 {
     return bwa_gen_cigar2(mat, q, r, q, r, w_, l_pac, pac, l_query, query, rb, re, score, n_cigar, NM);
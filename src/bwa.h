@@ -61,6 +61,7 @@
 #define BWTALGO_IS    3
 #define BWTALGO_MEM2  4
 #define BWTALGO_MLTS  5
+#define BWTALGO_PSA   6  // mem2 index, suffixes sorted by psa_sort() on -t threads
 
 typedef struct {
 	// bwt2_t   *bwt2;
@@ -85,6 +86,14 @@ typedef struct {
 #endif
 } bseq1_t;
 
+typedef struct { // one bwa_gen_cigar2() call of bwa_gen_cigar2_batch()
+	int l_query, w;     // in: query length and band width
+	uint8_t *query;     // in: query in nt4; reversed and restored in place
+	int64_t rb, re;     // in: reference interval
+	int score, n_cigar, NM;
+	uint32_t *cigar;    // out: CIGAR with MD appended; NULL if rejected
+} bwa_cigar_t;
+
 extern int bwa_verbose;
 extern char bwa_rg_id[256];
 
@@ -114,8 +123,13 @@ extern "C" {
 							 int64_t rb, int64_t re, int *score,
 							 int *n_cigar, int *NM);
 
+	// bwa_gen_cigar2() of n intervals, with the DP done by ksw_global2_batch()
+	void bwa_gen_cigar2_batch(const int8_t mat[25], int o_del, int e_del,
+							  int o_ins, int e_ins, int64_t l_pac,
+							  const uint8_t *pac, int n, bwa_cigar_t *a);
+
 	int bwa_idx_build(const char *fa, const char *prefix, int algo_type, int block_size);
-	int bwa_idx_build_mem2(const char *fa, const char *prefix);
+	int bwa_idx_build_mem2(const char *fa, const char *prefix, int psa_threads);
 
 	char *bwa_idx_infer_prefix(const char *hint);
 	bwt_t *bwa_idx_load_bwt(const char *hint);
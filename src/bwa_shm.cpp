@@ -945,6 +945,17 @@ void bwa_shm_complete(enum bwa_shm_init_mode mode) {
 	}
 }
 
+/* the index components, and which of them this process maps from shm (for --stats-json) */
+int bwa_shm_components(const char **name, int *on, int max) {
+	int m, n = 0;
+
+	for (m = BWA_SHM_INFO + 1; m < NUM_BWA_SHM && n < max; m++, n++) {
+		name[n] = bwa_shm_type_str[m];
+		on[n] = shm_ptr[m] != NULL;
+	}
+	return n;
+}
+
 void bwa_shm_final(enum bwa_shm_init_mode mode) {
 	int locked;
 	
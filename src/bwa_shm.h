@@ -241,6 +241,7 @@ void bwa_shm_complete(enum bwa_shm_init_mode mode);
 void bwa_shm_final(enum bwa_shm_init_mode mode);
 
 int use_mmap(int m);
+int bwa_shm_components(const char **name, int *on, int max);
 int __bwa_shm_load_file(const char *prefix, const char *postfix, int m, void **ret_ptr);
 
 #endif /* USE_SHM */
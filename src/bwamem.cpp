@@ -41,6 +41,11 @@
 #include "FMI_search.h"
 #include "memcpy_bwamem.h"
 #include "bwa_shm.h"
+#include "simd_dispatch.h"
+#include "read_cache.h"
+#include "perfctr.h"
+#include "readtrace.h"
+#include "capture.h"
 
 #ifdef PERFECT_MATCH
 /* implemented in perfect_map.cpp */
@@ -403,13 +408,14 @@ static int test_and_merge(const mem_opt_t *opt, int64_t l_pac, mem_chain_t *c,
 			int pm = c->m;		  
 			c->m <<= 1;
 			if (pm == SEEDS_PER_CHAIN) {  // re-new memory
-				if ((auxSeedBuf = (mem_seed_t *) calloc(c->m, sizeof(mem_seed_t))) == NULL) { fprintf(stderr, "ERROR: out of memory auxSeedBuf\n"); exit(1); }
+				auxSeedBuf = (mem_seed_t *) mem_arena_alloc(mem_arena_cur, c->m * sizeof(mem_seed_t));
 				memcpy_bwamem((char*) (auxSeedBuf), c->m * sizeof(mem_seed_t), c->seeds, c->n * sizeof(mem_seed_t), __FILE__, __LINE__);
 				c->seeds = auxSeedBuf;
-				tprof[PE13][tid]++;
+				TPROF_ADD(PE13, tid, 1);
 			} else {  // new memory
 				// fprintf(stderr, "[%0.4d] re-allocing old seed, m: %d\n", tid, c->m);
-				if ((auxSeedBuf = (mem_seed_t *) realloc(c->seeds, c->m * sizeof(mem_seed_t))) == NULL) { fprintf(stderr, "ERROR: out of memory auxSeedBuf\n"); exit(1); }
+				auxSeedBuf = (mem_seed_t *) mem_arena_realloc(mem_arena_cur, c->seeds, pm * sizeof(mem_seed_t),
+															  c->m * sizeof(mem_seed_t));
 				c->seeds = auxSeedBuf;
 			}
 			memset_s((char*) (c->seeds + c->n), (c->m - c->n) * sizeof(mem_seed_t), 0);
@@ -420,15 +426,48 @@ static int test_and_merge(const mem_opt_t *opt, int64_t l_pac, mem_chain_t *c,
 	return 0; // request to add a new chain
 }
 
-int mem_seed_sw(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac,
-				int l_query, const uint8_t *query, const mem_seed_t *s)
+/* Sorted-array chainer. The chains of a short read are few, so an array kept
+ * sorted by pos (binary search, memmove on insertion) is cheaper than the
+ * B-tree, which callocs a node for every few chains. The seeds still arrive in
+ * SMEM order, as test_and_merge() depends on it. A read whose chains would
+ * share a start position goes back to the B-tree: the order it keeps among
+ * equal keys depends on its node layout, and the chains must come out exactly
+ * as its traversal emits them. */
+#define MEM_CHAIN_ARR_MAX_LEN   512   // longest read chained in an array
+#define MEM_CHAIN_ARR_MAX_HITS  1024  // most seed hits of a read chained in an array
+
+// index of the last chain with pos <= p, -1 if none
+static inline int64_t mem_chain_arr_lower(const mem_chain_v *c, int64_t p)
 {
-	int qb, qe, rid;
+	int64_t lo = 0, hi = c->n;
+	while (lo < hi) {
+		int64_t mid = (lo + hi) >> 1;
+		if (c->a[mid].pos <= p) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo - 1;
+}
+
+static inline void mem_chain_arr_insert(mem_chain_v *c, int64_t i, const mem_chain_t *x)
+{
+	if (c->n == c->m) {
+		c->m = c->m? c->m << 1 : 16;
+		c->a = (mem_chain_t *) realloc(c->a, c->m * sizeof(mem_chain_t));
+		assert(c->a != NULL);
+	}
+	memmove(&c->a[i + 1], &c->a[i], (c->n - i) * sizeof(mem_chain_t));
+	c->a[i] = *x;
+	++c->n;
+}
+
+// window of the SW around seed s, 0 if the seed needs no SW
+static inline int mem_seed_sw_win(const bntseq_t *bns, int l_query, const mem_seed_t *s,
+								  int *_qb, int *_qe, int64_t *_rb, int64_t *_re, int64_t *_mid)
+{
+	int qb, qe;
 	int64_t rb, re, mid, l_pac = bns->l_pac;
-	uint8_t *rseq = 0;
-	kswr_t x;
 
-	if (s->len >= MEM_SHORT_LEN) return -1; // the seed is longer than the max-extend; no need to do SW
+	if (s->len >= MEM_SHORT_LEN) return 0; // the seed is longer than the max-extend; no need to do SW
 	qb = s->qbeg, qe = s->qbeg + s->len;
 	rb = s->rbeg, re = s->rbeg + s->len;
 	mid = (rb + re) >> 1;
@@ -440,7 +479,20 @@ int mem_seed_sw(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac,
 		if (mid < l_pac) re = l_pac;
 		else rb = l_pac;
 	}
-	if (qe - qb >= MEM_SHORT_LEN || re - rb >= MEM_SHORT_LEN) return -1; // the seed seems good enough; no need to do SW
+	if (qe - qb >= MEM_SHORT_LEN || re - rb >= MEM_SHORT_LEN) return 0; // the seed seems good enough; no need to do SW
+	*_qb = qb, *_qe = qe, *_rb = rb, *_re = re, *_mid = mid;
+	return 1;
+}
+
+int mem_seed_sw(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac,
+				int l_query, const uint8_t *query, const mem_seed_t *s)
+{
+	int qb, qe, rid;
+	int64_t rb, re, mid;
+	uint8_t *rseq = 0;
+	kswr_t x;
+
+	if (!mem_seed_sw_win(bns, l_query, s, &qb, &qe, &rb, &re, &mid)) return -1;
 
 	rseq = bns_fetch_seq(bns, pac, &rb, mid, &re, &rid);
 	x = ksw_align2(qe - qb, (uint8_t*)query + qb, re - rb, rseq, 5, opt->mat, opt->o_del, opt->e_del, opt->o_ins, opt->e_ins, KSW_XSTART, 0);
@@ -525,6 +577,125 @@ void mem_flt_chained_seeds(const mem_opt_t *opt, const bntseq_t *bns, const uint
 	}
 }
 
+/* mem_flt_chained_seeds() on the chains of nseq reads at once: the seed SWs of the whole
+ * slice go through the inter-sequence kswv u8 kernel, as mate rescue does in
+ * mem_sam_pe_batch(); lanes that saturate are redone by ksw_align2(). */
+void mem_flt_chained_seeds_batch(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac,
+								 bseq1_t *seq_, int nseq, mem_chain_v *chain_ar,
+								 mem_cache *mmc, int tid)
+{
+	int i, j, k, l;
+	if (!kswv_dispatch_batched()) {
+		for (l = 0; l < nseq; l++)
+			mem_flt_chained_seeds(opt, bns, pac, seq_, chain_ar[l].n, chain_ar[l].a);
+		return;
+	}
+
+	kvec_t(SeqPair) pv = {0, 0, 0};
+	kvec_t(mem_seed_t*) sv = {0, 0, 0};
+	kvec_t(uint8_t) ref = {0, 0, 0}, qer = {0, 0, 0};
+	int32_t maxRefLen = 0, maxQerLen = 0;
+
+	// 1. the SW of each seed that needs one, into the pair buffers
+	for (l = 0; l < nseq; l++)
+	{
+		mem_chain_v *chn = &chain_ar[l];
+		for (i = 0; i < chn->n; ++i)
+		{
+			mem_chain_t *c = &chn->a[i];
+			const uint8_t *query = (uint8_t*) seq_[c->seqid].seq;
+			int l_query = seq_[c->seqid].l_seq;
+			double min_l = opt->min_chain_weight?
+				MEM_HSP_COEF * opt->min_chain_weight : MEM_MINSC_COEF * log(l_query);
+			if (min_l > MEM_SEEDSW_COEF * l_query) continue;
+
+			for (j = 0; j < c->n; ++j)
+			{
+				mem_seed_t *s = &c->seeds[j];
+				int qb, qe, rid;
+				int64_t rb, re, mid;
+				s->score = -1;
+				if (!mem_seed_sw_win(bns, l_query, s, &qb, &qe, &rb, &re, &mid)) continue;
+
+				uint8_t *rseq = bns_fetch_seq(bns, pac, &rb, mid, &re, &rid);
+				SeqPair sp;
+				memset(&sp, 0, sizeof(SeqPair));
+				sp.idr = ref.n, sp.idq = qer.n;
+				sp.len1 = re - rb, sp.len2 = qe - qb;
+				sp.id = sp.regid = pv.n;
+				if (ref.n + sp.len1 > ref.m) kv_resize(uint8_t, ref, (ref.n + sp.len1) << 1);
+				memcpy(ref.a + ref.n, rseq, sp.len1); ref.n += sp.len1;
+				if (qer.n + sp.len2 > qer.m) kv_resize(uint8_t, qer, (qer.n + sp.len2) << 1);
+				memcpy(qer.a + qer.n, query + qb, sp.len2); qer.n += sp.len2;
+				free(rseq);
+				maxRefLen = max_(maxRefLen, sp.len1);
+				maxQerLen = max_(maxQerLen, sp.len2);
+				kv_push(SeqPair, pv, sp);
+				kv_push(mem_seed_t*, sv, s);
+			}
+		}
+	}
+
+	// 2. scores, the kernels pad the last group of lanes
+	if (pv.n > 0)
+	{
+		int64_t n = pv.n;
+		kv_resize(SeqPair, pv, n + SIMD_WIDTH8_MAX);
+		kswr_t *aln = (kswr_t *) _mm_malloc((n + SIMD_WIDTH8_MAX) * sizeof(kswr_t), 64);
+		assert(aln != NULL);
+		// one kswv per thread, rebuilt only when a slice has a longer window
+		if (mmc->seedsw[tid] == NULL || maxRefLen > mmc->seedsw_ref[tid] ||
+			maxQerLen > mmc->seedsw_qer[tid])
+		{
+			delete mmc->seedsw[tid];
+			mmc->seedsw_ref[tid] = max_(maxRefLen, MAX_SEQ_LEN_REF_SAM);
+			mmc->seedsw_qer[tid] = max_(maxQerLen, MAX_SEQ_LEN_QER_SAM);
+			mmc->seedsw[tid] = new kswv(opt->o_del, opt->e_del, opt->o_ins, opt->e_ins, opt->a,
+										-1*opt->b, 1, mmc->seedsw_ref[tid], mmc->seedsw_qer[tid]);
+		}
+		mmc->seedsw[tid]->getScores8(pv.a, ref.a, qer.a, aln, n, 1, 0);
+
+		for (k = 0; k < n; k++)
+		{
+			SeqPair *sp = &pv.a[k];
+			if (aln[k].score == 255) { // saturated
+				kswr_t x = ksw_align2(sp->len2, qer.a + sp->idq, sp->len1, ref.a + sp->idr, 5, opt->mat,
+									  opt->o_del, opt->e_del, opt->o_ins, opt->e_ins, 0, 0);
+				aln[k].score = x.score;
+			}
+			sv.a[k]->score = aln[k].score;
+		}
+		_mm_free(aln);
+	}
+	free(pv.a); free(sv.a); free(ref.a); free(qer.a);
+
+	// 3. filtering, as in mem_flt_chained_seeds()
+	for (l = 0; l < nseq; l++)
+	{
+		mem_chain_v *chn = &chain_ar[l];
+		for (i = 0; i < chn->n; ++i)
+		{
+			mem_chain_t *c = &chn->a[i];
+			int l_query = seq_[c->seqid].l_seq;
+			double min_l = opt->min_chain_weight?
+				MEM_HSP_COEF * opt->min_chain_weight : MEM_MINSC_COEF * log(l_query);
+			int min_HSP_score = (int)(opt->a * min_l + .499);
+			if (min_l > MEM_SEEDSW_COEF * l_query) continue;
+
+			for (j = k = 0; j < c->n; ++j)
+			{
+				mem_seed_t *s = &c->seeds[j];
+				if (s->score < 0 || s->score >= min_HSP_score)
+				{
+					s->score = s->score < 0? s->len * opt->a : s->score;
+					c->seeds[k++] = *s;
+				}
+			}
+			c->n = k;
+		}
+	}
+}
+
 int mem_chain_flt(const mem_opt_t *opt, int n_chn_, mem_chain_t *a_, int tid)
 {
 	int i, k, n_numc = 0;
@@ -538,8 +709,8 @@ int mem_chain_flt(const mem_opt_t *opt, int n_chn_, mem_chain_t *a_, int tid)
 		if (c->w < opt->min_chain_weight)
 		{
 			if (c->m > SEEDS_PER_CHAIN) {
-				tprof[PE11][tid] ++;
-				free(c->seeds);
+				TPROF_ADD(PE11, tid, 1);
+				mem_arena_free(mem_arena_cur, c->seeds);
 			}
 			//free(c->seeds);
 		}
@@ -630,8 +801,8 @@ int mem_chain_flt(const mem_opt_t *opt, int n_chn_, mem_chain_t *a_, int tid)
 			if (c->kept == 0)
 			{
 				if (c->m > SEEDS_PER_CHAIN) {
-					tprof[PE11][tid] ++;
-					free(c->seeds);
+					TPROF_ADD(PE11, tid, 1);
+					mem_arena_free(mem_arena_cur, c->seeds);
 				}
 				//free(c->seeds);
 			}
@@ -815,7 +986,7 @@ void mem_chain_seeds(FMI_search *fmi, const mem_opt_t *opt,
 	// filter seq at early stage than this!, shifted to collect!!!
 	// if (len < opt->min_seed_len) return chain; // if the query is shorter than the seed length, no match
 	
-	uint64_t tim = __rdtsc();
+	uint64_t tim = TPROF_TSC();
 	for (int l=0; l<nseq && pos < num_smem - 1; l++)
 	{
 		// addition, FIX FIX FIX!!!!! THIS!!!!
@@ -826,9 +997,9 @@ void mem_chain_seeds(FMI_search *fmi, const mem_opt_t *opt,
 		if (seq_[l].l_seq < opt->min_seed_len) continue;
 		assert(matchArray[smem_ptr].rid == l);
 
-		kbtree_t(chn) *tree;
-		tree = kb_init(chn, KB_DEFAULT_SIZE + 8); // +8, due to addition of counters in chain
+		kbtree_t(chn) *tree = 0;
 		mem_chain_v *chain = &chain_ar[l];
+		int64_t n_hit = 0;
 		size = 0;
 			
 		b = e = l_rep = 0;
@@ -839,11 +1010,14 @@ void mem_chain_seeds(FMI_search *fmi, const mem_opt_t *opt,
 			pos ++;
 			SMEM *p = &matchArray[pos];
 			int sb = p->m, se = p->n + 1;
+			n_hit += p->s < opt->max_occ? p->s : opt->max_occ;
 			if (p->s <= opt->max_occ) continue;
 			if (sb > e) l_rep += e - b, b = sb, e = se;
 			else e = e > se? e : se;
 		} while (pos < num_smem - 1 && matchArray[pos].rid == matchArray[pos + 1].rid);
 		l_rep += e - b;
+		int n_smem = pos - smem_ptr + 1;
+		uint64_t tim_rd = rtrace? __rdtsc() : 0;
 
 		// bwt_sa
 		// assert(pos - smem_ptr + 1 < 6000);
@@ -857,11 +1031,19 @@ void mem_chain_seeds(FMI_search *fmi, const mem_opt_t *opt,
 		}
 		int64_t id = 0, cnt_ = 0, mypos = 0;
 		#if SA_COMPRESSION
-		uint64_t tim = __rdtsc();
+		uint64_t tim = TPROF_TSC();
 		fmi->get_sa_entries_prefetch(&matchArray[smem_ptr], sa_coord, &cnt_,
 									 pos - smem_ptr + 1, opt->max_occ, tid, id);  // sa compressed prefetch
-		tprof[MEM_SA][tid] += __rdtsc() - tim;
+		TPROF_ADD(MEM_SA, tid, __rdtsc() - tim);
 		#endif
+
+		int use_arr = seq_[l].l_seq <= MEM_CHAIN_ARR_MAX_LEN && n_hit <= MEM_CHAIN_ARR_MAX_HITS;
+		int64_t seedBufCount0 = seedBufCount;
+		uint64_t tim_chn = TPROF_TSC();
+	chain_retry:
+		if (!use_arr) tree = kb_init(chn, KB_DEFAULT_SIZE + 8); // +8, due to addition of counters in chain
+		chain->n = 0, num[l] = 0, mypos = 0;
+		seedBufCount = seedBufCount0;
 		
 		for (i = smem_ptr; i <= pos; i++)
 		{
@@ -873,9 +1055,9 @@ void mem_chain_seeds(FMI_search *fmi, const mem_opt_t *opt,
 
 			int cnt = 0;
 			#if !SA_COMPRESSION
-			uint64_t tim = __rdtsc();
+			uint64_t tim = TPROF_TSC();
 			fmi->get_sa_entries(p, sa_coord, &cnt, 1, opt->max_occ);
-			tprof[MEM_SA][tid] += __rdtsc() - tim;
+			TPROF_ADD(MEM_SA, tid, __rdtsc() - tim);
 			#endif
 			
 			cnt = 0;			
@@ -902,7 +1084,18 @@ void mem_chain_seeds(FMI_search *fmi, const mem_opt_t *opt,
 				// forward-reverse boundary; TODO: split the seed;
 				// don't discard it!!!
 				if (rid < 0) continue; 
-				if (kb_size(tree))
+				if (use_arr)
+				{
+					int64_t j = mem_chain_arr_lower(chain, tmp.pos);
+					lower = j >= 0? &chain->a[j] : 0;
+					if (!lower || !test_and_merge(opt, l_pac, lower, &s, rid, tid))
+						to_add = 1;
+					if (to_add && lower && lower->pos == tmp.pos) {
+						use_arr = 0;
+						goto chain_retry;
+					}
+				}
+				else if (kb_size(tree))
 				{
 					kb_intervalp(chn, tree, &tmp, &lower, &upper); // find the closest chain
 
@@ -918,9 +1111,8 @@ void mem_chain_seeds(FMI_search *fmi, const mem_opt_t *opt,
 					if((seedBufCount + tmp.m) > seedBufSize)
 					{
 						tmp.m += 1;
-						tmp.seeds = (mem_seed_t *)calloc (tmp.m, sizeof(mem_seed_t));
-						assert(tmp.seeds != NULL);
-						tprof[PE13][tid]++;
+						tmp.seeds = (mem_seed_t *) mem_arena_alloc(mem_arena_cur, tmp.m * sizeof(mem_seed_t));
+						TPROF_ADD(PE13, tid, 1);
 					}
 					else {
 						tmp.seeds = seedBuf + seedBufCount;
@@ -931,29 +1123,36 @@ void mem_chain_seeds(FMI_search *fmi, const mem_opt_t *opt,
 					tmp.rid = rid;
 					tmp.seqid = l;
 					tmp.is_alt = !!bns->anns[rid].is_alt;
-					kb_putp(chn, tree, &tmp);
+					if (use_arr) mem_chain_arr_insert(chain, lower? lower - chain->a + 1 : 0, &tmp);
+					else kb_putp(chn, tree, &tmp);
 					num[l]++;
 				}
 			}
 		} // seeds
 
 		smem_ptr = pos + 1;	 
-		size = kb_size(tree);
-		// tprof[PE21][0] += kb_size(tree) * sizeof(mem_chain_t);
+		if (!use_arr) {
+			size = kb_size(tree);
+			// tprof[PE21][0] += kb_size(tree) * sizeof(mem_chain_t);
 		
-		kv_resize(mem_chain_t, *chain, size);
+			kv_resize(mem_chain_t, *chain, size);
 
 #define traverse_func(p_) (chain->a[chain->n++] = *(p_))
-		__kb_traverse(mem_chain_t, tree, traverse_func);
+			__kb_traverse(mem_chain_t, tree, traverse_func);
 #undef traverse_func
+			kb_destroy(chn, tree);	  
+		}
+		TPROF_ADD(CHAINING, tid, __rdtsc() - tim_chn);
 
 		for (i = 0; i < chain->n; ++i)
 			chain->a[i].frac_rep = (float)l_rep / seq_[l].l_seq;
-
-		kb_destroy(chn, tree);	  
-		
+		if (rtrace) {
+			read_trace_t *r = &rtrace[seq_[l].id];
+			r->t[RT_CHAIN] += __rdtsc() - tim_rd;
+			r->n_smem = n_smem, r->n_hit = n_hit;
+		}
 	} // iterations over input reads
-	tprof[MEM_SA_BLOCK][tid] += __rdtsc() - tim;
+	TPROF_ADD(MEM_SA_BLOCK, tid, __rdtsc() - tim);
 
 	_mm_free(sa_coord);
 }
@@ -973,19 +1172,28 @@ void mem_chain_new(const mem_opt_t *opt,
 {
 	int i, b = 0, e = 0, l_rep = 0;
 	int64_t l_pac = bns->l_pac;
-	kbtree_t(chn) *tree;
+	kbtree_t(chn) *tree = 0;
+	int64_t n_hit = 0;
 
 	if (len < opt->min_seed_len) return; // if the query is shorter than the seed length, no match
-	tree = kb_init(chn, KB_DEFAULT_SIZE + 8); // +8, due to addition of counters in chain
 	for (i = 0, b = e = l_rep = 0; i < smems->n; ++i) { // compute frac_rep
 		mem_t *p = &smems->a[i];
 		int sb = p->start, se = p->end;
+		n_hit += p->hitcount < opt->max_occ? p->hitcount : opt->max_occ;
 		if (p->hitcount <= opt->max_occ) continue;
 		if (sb > e) l_rep += e - b, b = sb, e = se;
 		else e = e > se? e : se;
 	}
 	l_rep += e - b;
 
+	int use_arr = len <= MEM_CHAIN_ARR_MAX_LEN && n_hit <= MEM_CHAIN_ARR_MAX_HITS;
+	int64_t seedBufCount0 = seedBufCount;
+	uint64_t tim = __rdtsc();
+chain_retry:
+	if (!use_arr) tree = kb_init(chn, KB_DEFAULT_SIZE + 8); // +8, due to addition of counters in chain
+	chain->n = 0;
+	seedBufCount = seedBufCount0;
+
 	for (i = 0; i < smems->n; ++i) {
 		mem_t *p = &smems->a[i];
 		int step, count, slen = p->end - p->start; // seed length
@@ -1011,7 +1219,15 @@ void mem_chain_new(const mem_opt_t *opt,
 			// printf("[SEED],%d,%d,%ld\n", s.qbeg, s.qbeg + s.len, s.rbeg);
 			rid = bns_intv2rid(bns, s.rbeg, s.rbeg + s.len);
 			if (rid < 0) continue; // bridging multiple reference sequences or the forward-reverse boundary; TODO: split the seed; don't discard it!!!
-			if (kb_size(tree)) {
+			if (use_arr) {
+				int64_t j = mem_chain_arr_lower(chain, tmp.pos);
+				lower = j >= 0? &chain->a[j] : 0;
+				if (!lower || !test_and_merge(opt, l_pac, lower, &s, rid, tid)) to_add = 1;
+				if (to_add && lower && lower->pos == tmp.pos) {
+					use_arr = 0;
+					goto chain_retry;
+				}
+			} else if (kb_size(tree)) {
 				kb_intervalp(chn, tree, &tmp, &lower, &upper); // find the closest chain
 				if (!lower || !test_and_merge(opt, l_pac, lower, &s, rid, tid)) to_add = 1;
 			} else to_add = 1;
@@ -1019,9 +1235,8 @@ void mem_chain_new(const mem_opt_t *opt,
 				tmp.n = 1; tmp.m = SEEDS_PER_CHAIN;
 				if ((seedBufCount + tmp.m) > seedBufSize) {
 					tmp.m += 1;
-					tmp.seeds = (mem_seed_t *)calloc (tmp.m, sizeof(mem_seed_t));
-					assert(tmp.seeds != NULL);
-					tprof[PE13][tid]++;
+					tmp.seeds = (mem_seed_t *) mem_arena_calloc(mem_arena_cur, tmp.m, sizeof(mem_seed_t));
+					TPROF_ADD(PE13, tid, 1);
 				}
 				else {
 					tmp.seeds = seedBuf + seedBufCount;
@@ -1032,21 +1247,24 @@ void mem_chain_new(const mem_opt_t *opt,
 				tmp.rid = rid;
 				tmp.seqid = seqid;
 				tmp.is_alt = !!bns->anns[rid].is_alt;
-				kb_putp(chn, tree, &tmp);
+				if (use_arr) mem_chain_arr_insert(chain, lower? lower - chain->a + 1 : 0, &tmp);
+				else kb_putp(chn, tree, &tmp);
 			}
 		}
 		// kv_destroy(p->hits);
 	}   
-	kv_resize(mem_chain_t, *chain, kb_size(tree));
+	if (!use_arr) {
+		kv_resize(mem_chain_t, *chain, kb_size(tree));
 
-	#define traverse_func(p_) (chain->a[chain->n++] = *(p_))
-	__kb_traverse(mem_chain_t, tree, traverse_func);
-	#undef traverse_func
+		#define traverse_func(p_) (chain->a[chain->n++] = *(p_))
+		__kb_traverse(mem_chain_t, tree, traverse_func);
+		#undef traverse_func
+		kb_destroy(chn, tree);
+	}
+	TPROF_ADD(CHAINING, tid, __rdtsc() - tim);
 
 	for (i = 0; i < chain->n; ++i) chain->a[i].frac_rep = (float)l_rep / len;
 	if (bwa_verbose >= 4) printf("* fraction of repetitive seeds: %.3f\n", (float)l_rep / len);
-
-	kb_destroy(chn, tree);
 }
 
 int mem_kernel1_core_ert(FMI_search *fmi,
@@ -1059,6 +1277,7 @@ int mem_kernel1_core_ert(FMI_search *fmi,
 						 uint8_t* ref_string,
 						 mem_v* smems,
 						 u64v* hits,
+						 mem_cache *mmc,
 						 int tid)
 {
 	const bntseq_t *bns = fmi->idx->bns;
@@ -1098,7 +1317,7 @@ int mem_kernel1_core_ert(FMI_search *fmi,
 #else
 		ret = find_perfect_match_entry(fmi->perfect_table, &seq_[l], len);
 #endif
-		pprof[tid][ret]++;
+		PPROF_INC(tid, ret);
 		if (ret == FIND_PERFECT_FW_MATCHED || ret == FIND_PERFECT_RC_MATCHED) {
 			n_pm_seq++;
 			is_pm[l] = 1;
@@ -1107,13 +1326,13 @@ int mem_kernel1_core_ert(FMI_search *fmi,
 		}
 	}
 
-	tprof[DO_PERFECT_MATCH][tid] += __rdtsc() - tim; 
+	TPROF_ADD(DO_PERFECT_MATCH, tid, __rdtsc() - tim); 
 	if (n_pm_seq == nseq) {
 		tim = __rdtsc();
 		//All sequences in a chunk are perfect-matched
 		for (int l=0; l<nseq; l++)
 			kv_init(chain_ar[l]);
-		tprof[MEM_BWT][tid] += __rdtsc() - tim;
+		TPROF_ADD(MEM_BWT, tid, __rdtsc() - tim);
 		return 1;
 	}
 #endif
@@ -1127,6 +1346,7 @@ int mem_kernel1_core_ert(FMI_search *fmi,
 			continue;
 		}
 #endif
+		uint64_t tim_rd = rtrace? __rdtsc() : 0;
 		smems->n = 0;
 		char *seq = seq_[l].seq;
 		int len = seq_[l].l_seq;
@@ -1192,6 +1412,7 @@ int mem_kernel1_core_ert(FMI_search *fmi,
 
 		ks_introsort(mem_smem_sort_lt, smems->n, smems->a);
 
+		uint64_t tim_chn = rtrace? __rdtsc() : 0;
 		kv_init(chain_ar[l]);
 		mem_chain_new(opt, bns, len, (uint8_t*)seq, 
 					  smems, &chain_ar[l], l, 
@@ -1200,9 +1421,14 @@ int mem_kernel1_core_ert(FMI_search *fmi,
 					  tid);
 		chn = &chain_ar[l];
 		chn->n = mem_chain_flt(opt, chn->n, chn->a, tid);
-		mem_flt_chained_seeds(opt, bns, pac, seq_, chn->n, chn->a);
+		if (rtrace) { // the whole ERT seeding is per read
+			read_trace_t *r = &rtrace[seq_[l].id];
+			r->t[RT_SMEM] += tim_chn - tim_rd, r->t[RT_CHAIN] += __rdtsc() - tim_chn;
+			r->n_smem = smems->n, r->n_hit = hits->n;
+		}
 	}
-	tprof[MEM_BWT][tid] += __rdtsc() - tim;
+	mem_flt_chained_seeds_batch(opt, bns, pac, seq_, nseq, chain_ar, mmc, tid);
+	TPROF_ADD(MEM_BWT, tid, __rdtsc() - tim);
 	return 1;
 }
 
@@ -1255,7 +1481,7 @@ int mem_kernel1_core(FMI_search *fmi,
 #else
 		ret = find_perfect_match_entry(fmi->perfect_table, &seq_[l], len);
 #endif
-		pprof[tid][ret]++;
+		PPROF_INC(tid, ret);
 		if (ret == FIND_PERFECT_FW_MATCHED || ret == FIND_PERFECT_RC_MATCHED) {
 			n_pm_seq++;
 			is_pm[l] = 1;
@@ -1271,13 +1497,13 @@ int mem_kernel1_core(FMI_search *fmi,
 		tot_len += len;
 	}
 
-	tprof[DO_PERFECT_MATCH][tid] += __rdtsc() - tim; 
+	TPROF_ADD(DO_PERFECT_MATCH, tid, __rdtsc() - tim); 
 	if (tot_len == 0) {
 		//All sequences in a chunk are perfect-matched
 		tim = __rdtsc();
 		for (int l=0; l<nseq; l++)
 			kv_init(chain_ar[l]);
-		tprof[MEM_BWT][tid] += __rdtsc() - tim;
+		TPROF_ADD(MEM_BWT, tid, __rdtsc() - tim);
 		return 1;
 	}
 #endif
@@ -1316,6 +1542,7 @@ int mem_kernel1_core(FMI_search *fmi,
 	int64_t  *wsize_mem   = &mmc->wsize_mem[tid];
 	
 	tim = __rdtsc();	
+	PERFCTR_BEG(tid, pc);
 	/********************** Kernel 1: FM+SMEMs *************************/
 	printf_(VER, "6. Calling mem_collect_smem.., tid: %d\n", tid);
 	mem_collect_smem(fmi, opt,
@@ -1333,11 +1560,15 @@ int mem_kernel1_core(FMI_search *fmi,
 		assert(num_smem < *wsize_mem);
 	}
 	printf_(VER, "6. Done! mem_collect_smem, num_smem: %ld\n", num_smem);
-	tprof[MEM_COLLECT][tid] += __rdtsc() - tim; 
+	uint64_t tim_smem = __rdtsc() - tim;
+	TPROF_ADD(MEM_COLLECT, tid, tim_smem); 
+	PERFCTR_END(tid, PC_SMEM, pc);
+	if (capture_on) capture_smem(seq_, nseq, matchArray, num_smem);
 
 
 	/********************* Kernel 1.1: SA2REF **********************/
 	printf_(VER, "6.1. Calling mem_chain..\n");
+	PERFCTR_BEG(tid, pc_sal);
 	mem_chain_seeds(fmi, opt, fmi->idx->bns,
 					seq_, nseq, tid,
 					chain_ar,
@@ -1345,6 +1576,8 @@ int mem_kernel1_core(FMI_search *fmi,
 					seedBufSize,
 					matchArray,
 					num_smem);
+	PERFCTR_END(tid, PC_SAL, pc_sal);
+	if (rtrace) rtrace_share(seq_, nseq, RT_SMEM, tim_smem); // by the SMEM counts of mem_chain_seeds()
 	
 	printf_(VER, "5. Done mem_chain..\n");
 	// tprof[MEM_CHAIN][tid] += __rdtsc() - tim;
@@ -1365,17 +1598,12 @@ int mem_kernel1_core(FMI_search *fmi,
 
 	
 	printf_(VER, "8. Calling mem_flt_chained_seeds..\n");
-	for (int l=0; l<nseq; l++) {
-		/* perfect machted sequences will be filtered out since chn->n == 0. */
-#if defined(PERFECT_MATCH) && !defined(DO_NORMAL)
-		if (is_pm[l]) continue;
-#endif
-		chn = &chain_ar[l];
-		mem_flt_chained_seeds(opt, fmi->idx->bns, fmi->idx->pac, seq_, chn->n, chn->a);
-	}
+	/* perfect machted sequences will be filtered out since chn->n == 0. */
+	mem_flt_chained_seeds_batch(opt, fmi->idx->bns, fmi->idx->pac, seq_, nseq, chain_ar,
+								mmc, tid);
 	printf_(VER, "8. Done mem_flt_chained_seeds..\n");
 	// tprof[MEM_ALN_M2][tid] += __rdtsc() - tim;
-	tprof[MEM_BWT][tid] += __rdtsc() - tim;
+	TPROF_ADD(MEM_BWT, tid, __rdtsc() - tim);
 
 
 	return 1;
@@ -1408,6 +1636,13 @@ int mem_kernel2_core(FMI_search *fmi,
 	if (all_pm != 0) return 1;
 #endif
 	/****************** Kernel 2: B-SWA *********************/
+	if (rtrace) {
+		for (int l=0; l<nseq; l++) {
+			read_trace_t *r = &rtrace[seq_[l].id];
+			r->n_chain = chain_ar[l].n, r->n_seed = 0;
+			for (i = 0; i < chain_ar[l].n; ++i) r->n_seed += chain_ar[l].a[i].n;
+		}
+	}
 	uint64_t tim = __rdtsc();
 	printf_(VER, "9. Calling mem_chain2aln...\n");
 	mem_chain2aln_across_reads_V2(opt,
@@ -1422,7 +1657,9 @@ int mem_kernel2_core(FMI_search *fmi,
 								  tid);
 
 	printf_(VER, "9. Done mem_chain2aln...\n\n");
-	tprof[MEM_ALN2][tid] += __rdtsc() - tim;
+	tim = __rdtsc() - tim;
+	TPROF_ADD(MEM_ALN2, tid, tim);
+	if (rtrace) rtrace_share(seq_, nseq, RT_EXT, tim);
 
 	// tim = __rdtsc();
 	for (int l=0; l<nseq; l++) {
@@ -1435,10 +1672,10 @@ int mem_kernel2_core(FMI_search *fmi,
 			mem_chain_t chn = chain->a[i];
 			if (chn.m > SEEDS_PER_CHAIN)
 			{
-				tprof[PE11][tid] ++;
-				free(chn.seeds);
+				TPROF_ADD(PE11, tid, 1);
+				mem_arena_free(mem_arena_cur, chn.seeds);
 			}
-			tprof[PE12][tid]++;
+			TPROF_ADD(PE12, tid, 1);
 		}
 		free(chain_ar[l].a);
 	}
@@ -1482,6 +1719,8 @@ int mem_kernel2_core(FMI_search *fmi,
 		}
 	}
 	// tprof[POST_SWA][tid] += __rdtsc() - tim;
+	if (rtrace)
+		for (int l=0; l<nseq; l++) rtrace[seq_[l].id].n_reg = regs[l].n;
 	
 	return 1;
 }
@@ -1489,6 +1728,8 @@ int mem_kernel2_core(FMI_search *fmi,
 static void worker_aln(void *data, long seq_id, long batch_size, int tid)
 {
 	worker_t *w = (worker_t*) data;
+	mem_arena_bind(&w->arena[tid]);
+	PERFCTR_BEG(tid, pc);
 	
 	printf_(VER, "11. Calling mem_kernel2_core..\n");   
 	mem_kernel2_core(w->fmi, w->opt, 
@@ -1500,6 +1741,7 @@ static void worker_aln(void *data, long seq_id, long batch_size, int tid)
 					 w->ref_string,
 					 tid);
 	printf_(VER, "11. Done mem_kernel2_core....\n");
+	PERFCTR_END(tid, PC_ALN, pc);
 
 }
 
@@ -1507,6 +1749,8 @@ static void worker_aln(void *data, long seq_id, long batch_size, int tid)
 static void worker_bwt(void *data, long seq_id, long batch_size, int tid)
 {
 	worker_t *w = (worker_t*) data;
+	mem_arena_bind(&w->arena[tid]);
+	PERFCTR_BEG(tid, pc);
 	printf_(VER, "4. Calling mem_kernel1_core..%ld %d\n", seq_id, tid);
 	int seedBufSz = w->seedBufSize;
 
@@ -1526,6 +1770,7 @@ static void worker_bwt(void *data, long seq_id, long batch_size, int tid)
 							 w->ref_string,
 							 w->smems + (tid * MAX_LINE_LEN),
 							 w->hits_ar + (tid * MAX_LINE_LEN), 
+							 &(w->mmc),
 							 tid);
 	}
 	else {
@@ -1540,6 +1785,7 @@ static void worker_bwt(void *data, long seq_id, long batch_size, int tid)
 	}
 
 	printf_(VER, "4. Done mem_kernel1_core....\n");
+	PERFCTR_END(tid, PC_BWT, pc);
 }
 
 int64_t sort_classify(mem_cache *mmc, int64_t pcnt, int tid)
@@ -1665,118 +1911,185 @@ static void show_perfect_and_reg(const mem_opt_t *opt, perfect_table_t *pt,
 	}
 }
 #endif
-static void worker_sam(void *data, long seqid, long batch_size, int tid)
+static void worker_sam_pe(worker_t *w, long seqid, long batch_size, int tid)
 {
-	worker_t *w = (worker_t*) data;
-	
-	if (w->opt->flag & MEM_F_PE)
-	{
-		int64_t pcnt = 0;
-		int start = seqid;
-		int end = seqid + batch_size;
-		int pos = start >> 1;
+	int start = seqid;
+	int end = seqid + batch_size;
+	int pos = start >> 1;
 
-#if (((!__AVX512BW__) && (!__AVX2__)) || ((!__AVX512BW__) && (__AVX2__))) 
 #ifdef PERFECT_MATCH
-		int ret;
+	int ret;
 #endif
 #ifdef OPT_RW
-		kstring_t samstr = {0, 0, 0};
-		ks_resize(&samstr, 1024 * batch_size);
+	kstring_t samstr = {0, 0, 0};
+	ks_resize(&samstr, 1024 * batch_size);
 #endif
-		for (int i=start; i< end; i+=2)
-		{
+	for (int i=start; i< end; i+=2)
+	{
 #ifdef PERFECT_MATCH
-			if (w->seqs[i].perfect.exist) {
-				ret = mem_perfect2reg(w->opt, w->fmi->perfect_table,
-								w->fmi->idx->bns,
-								&w->seqs[i], &w->regs[i]);
-				pprof2[tid][ret]++;
-			}
-			if (w->seqs[i+1].perfect.exist) {
-				ret = mem_perfect2reg(w->opt, w->fmi->perfect_table,
-								w->fmi->idx->bns,
-								&w->seqs[i+1], &w->regs[i+1]);
-				pprof2[tid][ret]++;
-			}
+		if (w->seqs[i].perfect.exist) {
+			ret = mem_perfect2reg(w->opt, w->fmi->perfect_table,
+							w->fmi->idx->bns,
+							&w->seqs[i], &w->regs[i]);
+			PPROF2_INC(tid, ret);
+		}
+		if (w->seqs[i+1].perfect.exist) {
+			ret = mem_perfect2reg(w->opt, w->fmi->perfect_table,
+							w->fmi->idx->bns,
+							&w->seqs[i+1], &w->regs[i+1]);
+			PPROF2_INC(tid, ret);
+		}
 #endif
 #ifdef OPT_RW
-			mem_sam_pe_cont(w->opt, w->fmi->idx->bns,
-					   w->fmi->idx->pac, w->pes,
-					   (w->n_processed >> 1) + pos++,   // check!
-					   &w->seqs[i], &w->regs[i], 
-					   w->useErt, &samstr);
+		mem_sam_pe_cont(w->opt, w->fmi->idx->bns,
+				   w->fmi->idx->pac, w->pes,
+				   (w->n_processed >> 1) + pos++,   // check!
+				   &w->seqs[i], &w->regs[i], 
+				   w->useErt, &samstr);
 #else
-			// orig mem_sam_pe() function
-			mem_sam_pe(w->opt, w->fmi->idx->bns,
-					   w->fmi->idx->pac, w->pes,
-					   (w->n_processed >> 1) + pos++,   // check!
-					   &w->seqs[i],
-					   &w->regs[i],
-					   w->useErt);
+		// orig mem_sam_pe() function
+		mem_sam_pe(w->opt, w->fmi->idx->bns,
+				   w->fmi->idx->pac, w->pes,
+				   (w->n_processed >> 1) + pos++,   // check!
+				   &w->seqs[i],
+				   &w->regs[i],
+				   w->useErt);
 #endif		
-			free(w->regs[i].a);
-			free(w->regs[i+1].a);
-		}
+		mem_arena_free(mem_arena_cur, w->regs[i].a);
+		mem_arena_free(mem_arena_cur, w->regs[i+1].a);
+	}
 #ifdef OPT_RW
-		w->seqs[start].sam = samstr.s;
+	w->seqs[start].sam = samstr.s;
 #endif
-#else   // re-structured
-		// pre-processing
-		// uint64_t tim = __rdtsc();
-		int32_t maxRefLen = 0, maxQerLen = 0;
-		int32_t gcnt = 0;
-		for (int i=start; i< end; i+=2)
-		{
-			mem_sam_pe_batch_pre(w->opt, w->fmi->idx->bns,
-								 w->fmi->idx->pac, w->pes,
-								 (w->n_processed >> 1) + pos++,   // check!
-								 &w->seqs[i],
-								 &w->regs[i],
-								 &w->mmc, 
-								 pcnt, gcnt,
-								 maxRefLen,
-								 maxQerLen,
-								 tid);
+}
+
+// re-structured PE path: mate rescue of the whole batch goes through the
+// inter-sequence kswv kernels
+static void worker_sam_pe_batch(worker_t *w, long seqid, long batch_size, int tid)
+{
+	int64_t pcnt = 0;
+	int start = seqid;
+	int end = seqid + batch_size;
+	int pos = start >> 1;
+#ifdef PERFECT_MATCH
+	int ret;
+#endif
+
+	// pre-processing
+	// uint64_t tim = __rdtsc();
+	int32_t maxRefLen = 0, maxQerLen = 0;
+	int32_t gcnt = 0;
+	for (int i=start; i< end; i+=2)
+	{
+#ifdef PERFECT_MATCH
+		for (int j=i; j<i+2; j++) {
+			if (w->seqs[j].perfect.exist) {
+				ret = mem_perfect2reg(w->opt, w->fmi->perfect_table,
+								w->fmi->idx->bns,
+								&w->seqs[j], &w->regs[j]);
+				PPROF2_INC(tid, ret);
+			}
 		}
-		
-		// tprof[SAM1][tid] += __rdtsc() - tim;
-		int64_t pcnt8 = sort_classify(&w->mmc, pcnt, tid);
+#endif
+		mem_sam_pe_batch_pre(w->opt, w->fmi->idx->bns,
+							 w->fmi->idx->pac, w->pes,
+							 (w->n_processed >> 1) + pos++,   // check!
+							 &w->seqs[i],
+							 &w->regs[i],
+							 &w->mmc, 
+							 pcnt, gcnt,
+							 maxRefLen,
+							 maxQerLen,
+							 tid);
+	}
+	
+	// tprof[SAM1][tid] += __rdtsc() - tim;
+	int64_t pcnt8 = sort_classify(&w->mmc, pcnt, tid);
 
-		kswr_t *aln = (kswr_t *) _mm_malloc ((pcnt + SIMD_WIDTH8) * sizeof(kswr_t), 64);
-		assert(aln != NULL);
+	kswr_t *aln = (kswr_t *) _mm_malloc ((pcnt + SIMD_WIDTH8_MAX) * sizeof(kswr_t), 64);
+	assert(aln != NULL);
 
-		// processing
-		mem_sam_pe_batch(w->opt, &w->mmc, pcnt, pcnt8, aln, maxRefLen, maxQerLen, tid);	 
+	// processing
+	mem_sam_pe_batch(w->opt, &w->mmc, pcnt, pcnt8, aln, maxRefLen, maxQerLen, tid);	 
 
-		// post-processing
-		// tim = __rdtsc();
-		gcnt = 0;
-		pos = start >> 1;
-		kswr_t *myaln = aln;
-		for (int i=start; i< end; i+=2)
-		{
-			mem_sam_pe_batch_post(w->opt, w->fmi->idx->bns,
-								  w->fmi->idx->pac, w->pes,
-								  (w->n_processed >> 1) + pos++,   // check!
-								  &w->seqs[i],
-								  &w->regs[i],
-								  &myaln,
-								  &w->mmc,
-								  gcnt,
-								  tid,
-								  w->useErt);
-
-			free(w->regs[i].a);
-			free(w->regs[i+1].a);
-		}
-		//tprof[SAM3][tid] += __rdtsc() - tim;	  
-		_mm_free(aln);  // kswr_t
-#endif
+	// post-processing
+	// tim = __rdtsc();
+	gcnt = 0;
+	pos = start >> 1;
+	kswr_t *myaln = aln;
+	int *n_pri = (int *) malloc(batch_size * sizeof(int));
+	assert(n_pri != NULL);
+	mem_cigar_v cv = {0, 0, 0};
+	for (int i=start; i< end; i+=2)
+	{
+		mem_sam_pe_batch_post(w->opt, w->fmi->idx->bns,
+							  w->fmi->idx->pac, w->pes,
+							  (w->n_processed >> 1) + pos++,   // check!
+							  &w->seqs[i],
+							  &w->regs[i],
+							  &myaln,
+							  &w->mmc,
+							  gcnt,
+							  tid,
+							  w->useErt,
+							  &n_pri[i - start]);
+		mem_reg2aln_pre(w->opt, &w->seqs[i], &w->regs[i], &cv);
+		mem_reg2aln_pre(w->opt, &w->seqs[i+1], &w->regs[i+1], &cv);
+	}
+	_mm_free(aln);  // kswr_t
+
+	// CIGARs of the batch, then SAM output
+	mem_reg2aln_batch(w->opt, w->fmi->idx->bns, w->fmi->idx->pac, &cv);
+	pos = start >> 1;
+	for (int i=start; i< end; i+=2)
+	{
+		mem_sam_pe_batch_sam(w->opt, w->fmi->idx->bns,
+							 w->fmi->idx->pac, w->pes,
+							 (w->n_processed >> 1) + pos++,
+							 &w->seqs[i],
+							 &w->regs[i],
+							 &n_pri[i - start]);
+
+		mem_arena_free(mem_arena_cur, w->regs[i].a);
+		mem_arena_free(mem_arena_cur, w->regs[i+1].a);
+	}
+	mem_reg2aln_batch_free(&cv);
+	free(n_pri);
+	//tprof[SAM3][tid] += __rdtsc() - tim;	  
+}
+
+static void worker_sam(void *data, long seqid, long batch_size, int tid)
+{
+	worker_t *w = (worker_t*) data;
+	mem_arena_bind(&w->arena[tid]);
+	PERFCTR_BEG(tid, pc);
+	uint64_t tim = __rdtsc();
+	
+	if (w->opt->flag & MEM_F_PE)
+	{
+		if (kswv_dispatch_batched())
+			worker_sam_pe_batch(w, seqid, batch_size, tid);
+		else
+			worker_sam_pe(w, seqid, batch_size, tid);
 	}
 	else
 	{
 		int ret;
+		mem_cigar_v cv = {0, 0, 0};
+		for (int i=seqid; i<seqid + batch_size; i++)
+		{
+#if defined(PERFECT_MATCH) && !defined(DO_NORMAL)
+			if (w->seqs[i].perfect.exist) continue;
+#endif
+			mem_mark_primary_se(w->opt, w->regs[i].n,
+								w->regs[i].a,
+								w->n_processed + i);
+#if V17  // Feature from v0.7.17 of orig. bwa-mem
+			if (w->opt->flag & MEM_F_PRIMARY5) mem_reorder_primary5(w->opt->T, &w->regs[i]);			
+#endif
+			mem_reg2aln_pre(w->opt, &w->seqs[i], &w->regs[i], &cv);
+		}
+		mem_reg2aln_batch(w->opt, w->fmi->idx->bns, w->fmi->idx->pac, &cv);
 #ifdef OPT_RW
 		kstring_t samstr = {0, 0, 0};
 		ks_resize(&samstr, 1024 * batch_size);
@@ -1792,7 +2105,7 @@ static void worker_sam(void *data, long seqid, long batch_size, int tid)
 				show_perfect_and_reg(w->opt, w->fmi->perfect_table, w->fmi->idx->bns, w->fmi->idx->pac, &w->seqs[i], &w->regs[i]);
 #endif
 				ret = mem_perfect2sam_cont(w->opt, w->fmi->perfect_table, w->fmi->idx->bns, w->fmi->idx->pac, &w->seqs[i], &samstr);
-				pprof2[tid][ret]++;
+				PPROF2_INC(tid, ret);
 #ifndef DO_NORMAL
 				continue;
 #endif
@@ -1804,12 +2117,6 @@ static void worker_sam(void *data, long seqid, long batch_size, int tid)
 				
 #ifdef PRINT_PERFECT_AND_REG
 			sam_temp = samstr.s + samstr.l;
-#endif
-			mem_mark_primary_se(w->opt, w->regs[i].n,
-								w->regs[i].a,
-								w->n_processed + i);
-#if V17  // Feature from v0.7.17 of orig. bwa-mem
-			if (w->opt->flag & MEM_F_PRIMARY5) mem_reorder_primary5(w->opt->T, &w->regs[i]);			
 #endif
 			mem_reg2sam_cont(w->opt, w->fmi->idx->bns, w->fmi->idx->pac, &w->seqs[i],
 						&w->regs[i], 0, 0, &samstr);
@@ -1817,7 +2124,7 @@ static void worker_sam(void *data, long seqid, long batch_size, int tid)
 			if (w->seqs[i].perfect.exist)
 			printf("[show_reg] sam_original: %s\n", sam_temp);
 #endif
-			free(w->regs[i].a);
+			mem_arena_free(mem_arena_cur, w->regs[i].a);
 		}
 
 		w->seqs[seqid].sam = samstr.s;
@@ -1827,24 +2134,33 @@ static void worker_sam(void *data, long seqid, long batch_size, int tid)
 #ifdef PERFECT_MATCH
 			if (w->seqs[i].perfect.exist) {
 				ret = mem_perfect2sam(w->opt, w->fmi->perfect_table, w->fmi->idx->bns, w->fmi->idx->pac, &w->seqs[i]);
-				pprof2[tid][ret]++;
+				PPROF2_INC(tid, ret);
 #ifndef DO_NORMAL
 				continue;
 #endif
 			}
-#endif
-			mem_mark_primary_se(w->opt, w->regs[i].n,
-								w->regs[i].a,
-								w->n_processed + i);
-#if V17  // Feature from v0.7.17 of orig. bwa-mem
-			if (w->opt->flag & MEM_F_PRIMARY5) mem_reorder_primary5(w->opt->T, &w->regs[i]);			
 #endif
 			mem_reg2sam(w->opt, w->fmi->idx->bns, w->fmi->idx->pac, &w->seqs[i],
 						&w->regs[i], 0, 0);
-			free(w->regs[i].a);
+			mem_arena_free(mem_arena_cur, w->regs[i].a);
 		}
 #endif /* !OPT_RW */
+		mem_reg2aln_batch_free(&cv);
 	}
+	if (rtrace) rtrace_share(w->seqs + seqid, batch_size, RT_SAM, __rdtsc() - tim);
+	PERFCTR_END(tid, PC_SAM, pc);
+}
+
+/* Extension and SAM generation of a piece in one pass; used once the insert
+ * size distribution is known from earlier chunks. The insert sizes of this
+ * piece are collected before mate rescue touches the regions. */
+static void worker_aln_sam(void *data, long seq_id, long batch_size, int tid)
+{
+	worker_t *w = (worker_t*) data;
+	worker_aln(data, seq_id, batch_size, tid);
+	mem_pestat_collect(w->opt, w->fmi->idx->bns->l_pac, batch_size, w->regs + seq_id,
+					   &w->peacc->tv[tid]);
+	worker_sam(data, seq_id, batch_size, tid);
 }
 
 void mem_process_seqs(mem_opt_t *opt,
@@ -1862,18 +2178,46 @@ void mem_process_seqs(mem_opt_t *opt,
 	w.opt = opt;
 	w.seqs = seqs; w.n_processed = n_processed;
 	w.pes = &pes[0];
+	rtrace_chunk_beg(n, seqs);
 
 	//int n_ = (opt->flag & MEM_F_PE) ? n : n;   // this requires n%2==0
 	int n_ = n;
+	bseq1_t *aln_seqs = 0;
 	
+	// with a running estimator that has seen data, pair against it and skip the barrier
+	mem_pestat_acc_t *acc = (opt->flag & MEM_F_PE) && !pes0? w.peacc : 0;
+	int fused = 0;
+	if (acc && acc->n_chunk > 0) {
+		mem_pestat_acc_est(opt, acc, pes);
+		fused = !w.rcache; // the cache merges regions back before pairing
+	}
+
 	uint64_t tim = __rdtsc();   
+	if (w.rcache) { // only the reads not seen before go through seeding and extension
+		n_ = read_cache_split(w.rcache, &w, n, seqs, &aln_seqs);
+		w.seqs = aln_seqs;
+	}
 	fprintf(stderr, "[0000] 1. Calling kt_for - worker_bwt\n");
 	
 	kt_for(worker_bwt, &w, n_); // SMEMs (+SAL)
 
+	if (fused) {
+		fprintf(stderr, "[0000] 2. Calling kt_for - worker_aln_sam\n");
+		kt_for(worker_aln_sam, &w, n_); // BSW + SAM
+		for (int l = 0; l < w.nthreads; l++)
+			mem_pestat_acc_merge(acc, &acc->tv[l]);
+		++acc->n_chunk;
+		tprof[WORKER10][0] += __rdtsc() - tim;
+		goto chunk_done;
+	}
+
 	fprintf(stderr, "[0000] 2. Calling kt_for - worker_aln\n");
 	
 	kt_for(worker_aln, &w, n_); // BSW
+	if (w.rcache) {
+		read_cache_merge(w.rcache, &w, n, seqs, aln_seqs, n_);
+		w.seqs = seqs, n_ = n;
+	}
 	tprof[WORKER10][0] += __rdtsc() - tim;	  
 
 
@@ -1882,12 +2226,17 @@ void mem_process_seqs(mem_opt_t *opt,
 		if (pes0)
 			memcpy_bwamem(pes, 4 * sizeof(mem_pestat_t), pes0, 4 * sizeof(mem_pestat_t), __FILE__, __LINE__); // if pes0 != NULL, set the insert-size
 														 // distribution as pes0
-		else {
+		else if (acc == 0 || acc->n_chunk == 0) {
 			fprintf(stderr, "[0000] Inferring insert size distribution of PE reads from data, "
 					"l_pac: %ld, n: %d\n", fmi->idx->bns->l_pac, n);
 			mem_pestat(opt, fmi->idx->bns->l_pac, n, w.regs, pes); // otherwise, infer the insert size
 														 // distribution from data
 		}
+		if (acc) { // warm up (or keep feeding) the running estimator
+			mem_pestat_collect(opt, fmi->idx->bns->l_pac, n, w.regs, &acc->tv[0]);
+			mem_pestat_acc_merge(acc, &acc->tv[0]);
+			++acc->n_chunk;
+		}
 	}
 	
 	tim = __rdtsc();
@@ -1896,6 +2245,12 @@ void mem_process_seqs(mem_opt_t *opt,
 	kt_for(worker_sam, &w,  n_);   // SAM   
 	tprof[WORKER20][0] += __rdtsc() - tim;
 
+chunk_done:
+	// the regions and chain seeds of this chunk are dead now
+	for (int l = 0; l < w.nthreads; l++)
+		mem_arena_reset(&w.arena[l]);
+	rtrace_chunk_end(n_processed, n, seqs, opt->flag & MEM_F_PE);
+
 	fprintf(stderr, "\t[0000][ M::%s] Processed %d reads in %.3f "
 			"CPU sec, %.3f real sec\n",
 			__func__, n, cputime() - ctime, realtime() - rtime);
@@ -2530,6 +2885,131 @@ void mem_aln2sam(const mem_opt_t *opt, const bntseq_t *bns, kstring_t *str,
 	kputc('\n', str);
 }
 
+/* Batched CIGAR generation: mem_reg2aln_pre() collects the regions mem_reg2sam()
+ * and mem_gen_alt() will turn into alignments, mem_reg2aln_batch() runs their
+ * global alignments through the inter-sequence ksw_global2_batch() and makes
+ * them visible to mem_reg2aln() of this thread; anything not found there
+ * (e.g. after the pairing changed the primary) goes through bwa_gen_cigar2(). */
+static __thread mem_cigar_v *mem_cigar_cur = 0;
+
+static inline int mem_cigar_cmp(const mem_cigar_t *a, const mem_cigar_t *b)
+{
+	if (a->seq != b->seq) return a->seq < b->seq? -1 : 1;
+	if (a->rb != b->rb) return a->rb < b->rb? -1 : 1;
+	if (a->re != b->re) return a->re < b->re? -1 : 1;
+	if (a->qb != b->qb) return a->qb < b->qb? -1 : 1;
+	if (a->qe != b->qe) return a->qe < b->qe? -1 : 1;
+	return a->w < b->w? -1 : a->w > b->w;
+}
+#define mem_cigar_lt(a, b) (mem_cigar_cmp(&(a), &(b)) < 0)
+KSORT_INIT(mem_cigar, mem_cigar_t, mem_cigar_lt)
+
+void mem_reg2aln_pre(const mem_opt_t *opt, const bseq1_t *s, const mem_alnreg_v *a, mem_cigar_v *cv)
+{
+	int k, i;
+	char *use;
+
+	if (a->n == 0) return;
+	use = (char*) calloc(a->n, 1);
+	assert(use != NULL);
+	if (!(opt->flag & MEM_F_ALL))
+		mem_gen_alt_mark(opt, a, use);
+	for (k = 0; k < a->n; ++k) { // same selection as mem_reg2sam()
+		const mem_alnreg_t *p = &a->a[k];
+		if (p->score < opt->T) continue;
+		if (p->secondary >= 0 && (p->is_alt || !(opt->flag&MEM_F_ALL))) continue;
+		if (p->secondary >= 0 && p->secondary < INT_MAX && p->score < a->a[p->secondary].score * opt->drop_ratio) continue;
+		use[k] = 1;
+	}
+	for (k = 0; k < a->n; ++k) {
+		const mem_alnreg_t *ar = &a->a[k];
+		mem_cigar_t *q;
+		int w2, tmp;
+		if (!use[k] || ar->rb < 0 || ar->re < 0) continue;
+		tmp = infer_bw(ar->qe - ar->qb, ar->re - ar->rb, ar->truesc, opt->a, opt->o_del, opt->e_del);
+		w2  = infer_bw(ar->qe - ar->qb, ar->re - ar->rb, ar->truesc, opt->a, opt->o_ins, opt->e_ins);
+		w2 = w2 > tmp? w2 : tmp;
+		if (w2 > opt->w) w2 = w2 < ar->w? w2 : ar->w;
+		w2 = w2 < opt->w<<2? w2 : opt->w<<2;
+		q = kv_pushp(mem_cigar_t, *cv);
+		q->seq = s->seq;
+		q->qb = ar->qb, q->qe = ar->qe, q->w = w2;
+		q->rb = ar->rb, q->re = ar->re;
+		q->c.l_query = ar->qe - ar->qb;
+		q->c.w = w2;
+		q->c.rb = ar->rb, q->c.re = ar->re;
+		q->c.query = (uint8_t*) malloc(q->c.l_query);
+		assert(q->c.query != NULL);
+		for (i = 0; i < q->c.l_query; ++i) // nt4 encoding, as in mem_reg2aln()
+			q->c.query[i] = s->seq[ar->qb + i] < 5? s->seq[ar->qb + i] : nst_nt4_table[(int)s->seq[ar->qb + i]];
+		q->c.cigar = 0;
+	}
+	free(use);
+}
+
+void mem_reg2aln_batch(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac, mem_cigar_v *cv)
+{
+	size_t i, j;
+	bwa_cigar_t *c;
+
+	if (cv->n > 1) { // sort and drop duplicates so that mem_cigar_take() can bisect
+		ks_introsort(mem_cigar, cv->n, cv->a);
+		for (i = j = 1; i < cv->n; ++i) {
+			if (mem_cigar_cmp(&cv->a[i], &cv->a[j-1]) == 0) free(cv->a[i].c.query);
+			else cv->a[j++] = cv->a[i];
+		}
+		cv->n = j;
+	}
+	c = (bwa_cigar_t*) malloc(cv->n * sizeof(bwa_cigar_t));
+	assert(cv->n == 0 || c != NULL);
+	for (i = 0; i < cv->n; ++i) c[i] = cv->a[i].c;
+	bwa_gen_cigar2_batch(opt->mat, opt->o_del, opt->e_del, opt->o_ins, opt->e_ins, bns->l_pac, pac, cv->n, c);
+	for (i = 0; i < cv->n; ++i) {
+		free(c[i].query); c[i].query = 0;
+		cv->a[i].c = c[i];
+	}
+	free(c);
+	mem_cigar_cur = cv;
+}
+
+void mem_reg2aln_batch_free(mem_cigar_v *cv)
+{
+	size_t i;
+	for (i = 0; i < cv->n; ++i) {
+		free(cv->a[i].c.query);
+		free(cv->a[i].c.cigar);
+	}
+	free(cv->a);
+	cv->n = cv->m = 0; cv->a = 0;
+	if (mem_cigar_cur == cv) mem_cigar_cur = 0;
+}
+
+// a copy of the precomputed CIGAR+MD of bwa_gen_cigar2(), or NULL
+static uint32_t *mem_cigar_take(const char *seq, int qb, int qe, int64_t rb, int64_t re, int w, int *score, int *n_cigar, int *NM)
+{
+	mem_cigar_t key;
+	uint32_t *cigar;
+	size_t lo, hi, l;
+	const mem_cigar_t *p;
+
+	if (mem_cigar_cur == 0 || mem_cigar_cur->n == 0) return 0;
+	key.seq = seq, key.qb = qb, key.qe = qe, key.w = w, key.rb = rb, key.re = re;
+	for (lo = 0, hi = mem_cigar_cur->n; lo < hi;) {
+		size_t mid = (lo + hi) >> 1;
+		if (mem_cigar_cmp(&mem_cigar_cur->a[mid], &key) < 0) lo = mid + 1;
+		else hi = mid;
+	}
+	if (lo == mem_cigar_cur->n) return 0;
+	p = &mem_cigar_cur->a[lo];
+	if (mem_cigar_cmp(p, &key) != 0 || p->c.cigar == 0) return 0;
+	l = p->c.n_cigar * 4 + strlen((char*)(p->c.cigar + p->c.n_cigar)) + 1;
+	cigar = (uint32_t*) malloc(l);
+	assert(cigar != NULL);
+	memcpy_bwamem(cigar, l, p->c.cigar, l, __FILE__, __LINE__);
+	*score = p->c.score, *n_cigar = p->c.n_cigar, *NM = p->c.NM;
+	return cigar;
+}
+
 mem_aln_t mem_reg2aln(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac, int l_query, const char *query_, const mem_alnreg_t *ar)
 {
 	mem_aln_t a;
@@ -2559,7 +3039,9 @@ mem_aln_t mem_reg2aln(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *
 	do {
 		free(a.cigar);
 		w2 = w2 < opt->w<<2? w2 : opt->w<<2;
-		a.cigar = bwa_gen_cigar2(opt->mat, opt->o_del, opt->e_del, opt->o_ins, opt->e_ins, w2, bns->l_pac, pac, qe - qb, (uint8_t*)&query[qb], rb, re, &score, &a.n_cigar, &NM);
+		a.cigar = i == 0? mem_cigar_take(query_, qb, qe, rb, re, w2, &score, &a.n_cigar, &NM) : 0;
+		if (a.cigar == 0)
+			a.cigar = bwa_gen_cigar2(opt->mat, opt->o_del, opt->e_del, opt->o_ins, opt->e_ins, w2, bns->l_pac, pac, qe - qb, (uint8_t*)&query[qb], rb, re, &score, &a.n_cigar, &NM);
 		if (bwa_verbose >= 4) fprintf(stderr, "* Final alignment: w2=%d, global_sc=%d, local_sc=%d\n", w2, score, ar->truesc);
 		if (score == last_sc || w2 == opt->w<<2) break; // it is possible that global alignment and local alignment give different scores
 		last_sc = score;
@@ -2807,6 +3289,28 @@ inline void sortPairsLen(SeqPair *pairArray, int32_t count, SeqPair *tempArray,
 /* Restructured BSW parent function */
 #define FAC 8
 #define PFD 2
+
+// 1 if the query and reference flanks are identical and free of ambiguous
+// bases. The extension of such a flank is then the gap-free diagonal: the
+// banded SW would end-to-end extend it to h0 + n*a with qle = tle = n.
+static inline int mem_flank_exact(const uint8_t *q, const uint8_t *r, int n)
+{
+	int i = 0;
+#if __SSE2__
+	const __m128i three = _mm_set1_epi8(3);
+	for (; i + 16 <= n; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i*) (q + i));
+		__m128i b = _mm_loadu_si128((const __m128i*) (r + i));
+		__m128i x = _mm_or_si128(_mm_xor_si128(a, b), _mm_cmpgt_epi8(a, three));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_setzero_si128())) != 0xFFFF) return 0;
+	}
+#endif
+	for (; i < n; ++i)
+		if (q[i] != r[i] || q[i] > 3) return 0;
+	return 1;
+}
+
+typedef struct { int32_t seqid, regid, len; } mem_flank_t;
 void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
 								   const uint8_t *pac, bseq1_t *seq_, int nseq,
 								   mem_chain_v* chain_ar, mem_alnreg_v *av_v,
@@ -2844,6 +3348,9 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
 	uint32_t *srtgg = (uint32_t*) malloc(nseq * SEEDS_PER_READ * fac * sizeof(uint32_t));
 
 	int spos = 0;
+	int64_t n_exact = 0; // flanks taken without DP
+	kvec_t(mem_flank_t) flank; // exact right flanks, scored after the left extension
+	kv_init(flank);
 
 	// uint64_t timUP = __rdtsc();
 	for (int l=0; l<nseq; l++)
@@ -2874,7 +3381,7 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
 		for (int j=0; j<chn->n; j++) {
 			c = &chn->a[j]; av->m += c->n;
 		}
-		av->a = (mem_alnreg_t*)calloc(av->m, sizeof(mem_alnreg_t));
+		av->a = (mem_alnreg_t*) mem_arena_calloc(mem_arena_cur, av->m, sizeof(mem_alnreg_t));
 
 		// aln mem allocation ends
 		for (int j=0; j<chn->n; j++)
@@ -2969,11 +3476,20 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
 				a->c = c; //ptr
 				a->rb = a->qb = a->re = a->qe = H0_;
 				
-				tprof[PE19][tid] ++;
+				TPROF_ADD(PE19, tid, 1);
 				
 				int flag = 0;
 				std::pair<int, int> pr;
-				if (s->qbeg)  // left extension
+				int64_t lt = s->rbeg - rmax[0];
+				if (s->qbeg && s->qbeg <= lt &&
+					mem_flank_exact(query, rseq + lt - s->qbeg, s->qbeg))
+				{
+					// exact left flank, no DP
+					a->score = a->truesc = (s->len + s->qbeg) * opt->a;
+					a->qb = 0, a->rb = s->rbeg - s->qbeg;
+					++n_exact;
+				}
+				else if (s->qbeg)  // left extension
 				{
 					SeqPair sp;
 					sp.h0 = s->len * opt->a;
@@ -3071,7 +3587,21 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
 					a->score = a->truesc = s->len * opt->a, a->qb = 0, a->rb = s->rbeg;
 				}
 
-				if (s->qbeg + s->len != l_query)  // right extension
+				int rx = 0;
+				{
+					int64_t qe = s->qbeg + s->len, re = s->rbeg + s->len - rmax[0];
+					int len2 = l_query - qe;
+					if (len2 && len2 <= rmax[1] - rmax[0] - re &&
+						mem_flank_exact(query + qe, rseq + re, len2))
+					{
+						// exact right flank, no DP
+						mem_flank_t *f = kv_pushp(mem_flank_t, flank);
+						f->seqid = c->seqid, f->regid = av->n - 1, f->len = len2;
+						rx = len2;
+						++n_exact;
+					}
+				}
+				if (s->qbeg + s->len + rx != l_query)  // right extension
 				{
 					int64_t qe = s->qbeg + s->len;
 					int64_t re = s->rbeg + s->len - rmax[0];
@@ -3145,7 +3675,7 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
 						mmc->seqBufRightRef[tid*CACHE_LINE] = seqBufRightRef = seqBufRef_;			  
 					}
 					
-					tprof[PE23][tid] += sp.len1 + sp.len2;
+					TPROF_ADD(PE23, tid, sp.len1 + sp.len2);
 
 					uint8_t *qs = seqBufRightQer + sp.idq;
 					uint8_t *rs = seqBufRightRef + sp.idr;
@@ -3171,7 +3701,7 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
 				}
 				else
 				{
-					a->qe = l_query, a->re = s->rbeg + s->len;
+					a->qe = l_query, a->re = s->rbeg + s->len + rx;
 					// seedcov business, this "if" block should be redundant, check and remove.
 					if (a->rb != H0_ && a->qb != H0_)
 					{
@@ -3221,17 +3751,31 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
 	SeqPair *pair_ar_aux = seqPairArrayAux;
 	int nump = numPairsLeft1;
 
-	// scalar
+	// scalar, 32-bit lanes in vector builds
 	for ( i=0; i<MAX_BAND_TRY; i++)
 	{
 		int32_t w = opt->w << i;
 		// uint64_t tim = __rdtsc();
-		bswLeft.scalarBandedSWAWrapper(pair_ar,
+		int n_wf = 0;
+		if (opt->flag & MEM_F_WFA) // finished pairs first, those left to DP after them
+			n_wf = bswLeft.wavefrontSWAWrapper(pair_ar, seqBufLeftRef, seqBufLeftQer, nump, nthreads, w,
+												 opt->flag & MEM_F_WFA_CHECK);
+#if ((!__AVX512BW__) && (!__AVX2__) && (!__SSE2__))
+		bswLeft.scalarBandedSWAWrapper(pair_ar + n_wf,
 									   seqBufLeftRef,
 									   seqBufLeftQer,
-									   nump,
+									   nump - n_wf,
 									   nthreads,
 									   w);
+#else
+		bswLeft.getScores32(pair_ar + n_wf,
+							seqBufLeftRef,
+							seqBufLeftQer,
+							nump - n_wf,
+							nthreads,
+							w);
+		if (capture_on) capture_bsw(32, CAP_LEFT, pair_ar + n_wf, nump - n_wf, seqBufLeftRef, seqBufLeftQer, w);
+#endif
 		// tprof[PE5][0] += nump;
 		// tprof[PE6][0] ++;
 		// tprof[MEM_ALN2_B][tid] += __rdtsc() - tim;
@@ -3293,17 +3837,22 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
 #if ((!__AVX512BW__) && (!__AVX2__) && (!__SSE2__))
 		bswLeft.scalarBandedSWAWrapper(pair_ar, seqBufLeftRef, seqBufLeftQer, nump, nthreads, w);
 #else
-		sortPairsLen(pair_ar, nump, seqPairArrayAux, hist);
-		bswLeft.getScores16(pair_ar,
+		int n_wf = 0;
+		if (opt->flag & MEM_F_WFA) // finished pairs first, those left to DP after them
+			n_wf = bswLeft.wavefrontSWAWrapper(pair_ar, seqBufLeftRef, seqBufLeftQer, nump, nthreads, w,
+												 opt->flag & MEM_F_WFA_CHECK);
+		sortPairsLen(pair_ar + n_wf, nump - n_wf, seqPairArrayAux, hist);
+		bswLeft.getScores16(pair_ar + n_wf,
 							seqBufLeftRef,
 							seqBufLeftQer,
-							nump,
+							nump - n_wf,
 							nthreads,
 							w);
+		if (capture_on) capture_bsw(16, CAP_LEFT, pair_ar + n_wf, nump - n_wf, seqBufLeftRef, seqBufLeftQer, w);
 #endif
 		
-		tprof[PE5][0] += nump;
-		tprof[PE6][0] ++;			   
+		TPROF_ADD(PE5, tid, nump);
+		TPROF_ADD(PE6, tid, 1);			   
 		// tprof[MEM_ALN2_B][tid] += __rdtsc() - tim;
 
 		int num = 0;
@@ -3362,17 +3911,22 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
 #if ((!__AVX512BW__) && (!__AVX2__) && (!__SSE2__))
 		bswLeft.scalarBandedSWAWrapper(pair_ar, seqBufLeftRef, seqBufLeftQer, nump, nthreads, w);
 #else
-		sortPairsLen(pair_ar, nump, seqPairArrayAux, hist);
-		bswLeft.getScores8(pair_ar,
+		int n_wf = 0;
+		if (opt->flag & MEM_F_WFA) // finished pairs first, those left to DP after them
+			n_wf = bswLeft.wavefrontSWAWrapper(pair_ar, seqBufLeftRef, seqBufLeftQer, nump, nthreads, w,
+												 opt->flag & MEM_F_WFA_CHECK);
+		sortPairsLen(pair_ar + n_wf, nump - n_wf, seqPairArrayAux, hist);
+		bswLeft.getScores8(pair_ar + n_wf,
 						   seqBufLeftRef,
 						   seqBufLeftQer,
-						   nump,
+						   nump - n_wf,
 						   nthreads,
 						   w);
+		if (capture_on) capture_bsw(8, CAP_LEFT, pair_ar + n_wf, nump - n_wf, seqBufLeftRef, seqBufLeftQer, w);
 #endif  
 		
-		tprof[PE1][0] += nump;
-		tprof[PE2][0] ++;
+		TPROF_ADD(PE1, tid, nump);
+		TPROF_ADD(PE2, tid, 1);
 		// tprof[MEM_ALN2_D][tid] += __rdtsc() - tim;
 
 		int num = 0;
@@ -3419,6 +3973,13 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
 
 	// tprof[CLEFT][tid] += __rdtsc() - timL;
 
+	for (size_t l=0; l<flank.n; l++) {
+		mem_alnreg_t *a = &(av_v[flank.a[l].seqid].a[flank.a[l].regid]);
+		a->score += flank.a[l].len * opt->a;
+		a->truesc += flank.a[l].len * opt->a;
+	}
+	kv_destroy(flank);
+
 	// uint64_t timR = __rdtsc();
 	// **********************************************************
 	// Right, scalar
@@ -3442,12 +4003,26 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
 	{
 		int32_t w = opt->w << i;
 		// tim = __rdtsc();	  
-		bswRight.scalarBandedSWAWrapper(pair_ar,
+		int n_wf = 0;
+		if (opt->flag & MEM_F_WFA) // finished pairs first, those left to DP after them
+			n_wf = bswRight.wavefrontSWAWrapper(pair_ar, seqBufRightRef, seqBufRightQer, nump, nthreads, w,
+												 opt->flag & MEM_F_WFA_CHECK);
+#if ((!__AVX512BW__) && (!__AVX2__) && (!__SSE2__))
+		bswRight.scalarBandedSWAWrapper(pair_ar + n_wf,
 						seqBufRightRef,
 						seqBufRightQer,
-						nump,
+						nump - n_wf,
 						nthreads,
 						w);
+#else
+		bswRight.getScores32(pair_ar + n_wf,
+							 seqBufRightRef,
+							 seqBufRightQer,
+							 nump - n_wf,
+							 nthreads,
+							 w);
+		if (capture_on) capture_bsw(32, CAP_RIGHT, pair_ar + n_wf, nump - n_wf, seqBufRightRef, seqBufRightQer, w);
+#endif
 		// tprof[PE7][0] += nump;
 		// tprof[PE8][0] ++;
 		// tprof[MEM_ALN2_C][tid] += __rdtsc() - tim;
@@ -3506,17 +4081,22 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
 #if ((!__AVX512BW__) && (!__AVX2__) && (!__SSE2__))
 		bswRight.scalarBandedSWAWrapper(pair_ar, seqBufRightRef, seqBufRightQer, nump, nthreads, w);
 #else
-		sortPairsLen(pair_ar, nump, seqPairArrayAux, hist);
-		bswRight.getScores16(pair_ar,
+		int n_wf = 0;
+		if (opt->flag & MEM_F_WFA) // finished pairs first, those left to DP after them
+			n_wf = bswRight.wavefrontSWAWrapper(pair_ar, seqBufRightRef, seqBufRightQer, nump, nthreads, w,
+												 opt->flag & MEM_F_WFA_CHECK);
+		sortPairsLen(pair_ar + n_wf, nump - n_wf, seqPairArrayAux, hist);
+		bswRight.getScores16(pair_ar + n_wf,
 							 seqBufRightRef,
 							 seqBufRightQer,
-							 nump,
+							 nump - n_wf,
 							 nthreads,
 							 w);
+		if (capture_on) capture_bsw(16, CAP_RIGHT, pair_ar + n_wf, nump - n_wf, seqBufRightRef, seqBufRightQer, w);
 #endif
 
-		tprof[PE7][0] += nump;
-		tprof[PE8][0] ++;
+		TPROF_ADD(PE7, tid, nump);
+		TPROF_ADD(PE8, tid, 1);
 		// tprof[MEM_ALN2_C][tid] += __rdtsc() - tim;
 		
 		int num = 0;
@@ -3577,17 +4157,22 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
 #if ((!__AVX512BW__) && (!__AVX2__) && (!__SSE2__))
 		bswRight.scalarBandedSWAWrapper(pair_ar, seqBufRightRef, seqBufRightQer, nump, nthreads, w); 
 #else
-		sortPairsLen(pair_ar, nump, seqPairArrayAux, hist);
-		bswRight.getScores8(pair_ar,
+		int n_wf = 0;
+		if (opt->flag & MEM_F_WFA) // finished pairs first, those left to DP after them
+			n_wf = bswRight.wavefrontSWAWrapper(pair_ar, seqBufRightRef, seqBufRightQer, nump, nthreads, w,
+												 opt->flag & MEM_F_WFA_CHECK);
+		sortPairsLen(pair_ar + n_wf, nump - n_wf, seqPairArrayAux, hist);
+		bswRight.getScores8(pair_ar + n_wf,
 							seqBufRightRef,
 							seqBufRightQer,
-							nump,
+							nump - n_wf,
 							nthreads,
 							w);
+		if (capture_on) capture_bsw(8, CAP_RIGHT, pair_ar + n_wf, nump - n_wf, seqBufRightRef, seqBufRightQer, w);
 #endif  
 			
-		tprof[PE3][0] += nump;
-		tprof[PE4][0] ++;
+		TPROF_ADD(PE3, tid, nump);
+		TPROF_ADD(PE4, tid, 1);
 		// tprof[MEM_ALN2_E][tid] += __rdtsc() - tim;
 		int num = 0;
 
@@ -3643,6 +4228,13 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
 				numPairsLeft, numPairsRight);
 		exit(EXIT_FAILURE);
 	}
+	__sync_fetch_and_add(&mem_stats.n_exact_flanks, n_exact);
+	if (opt->flag & MEM_F_WFA) { // counted whatever the profiling switch: wfa-check reports them
+		__sync_fetch_and_add(&mem_stats.n_wfa, bswLeft.wfa_pairs + bswRight.wfa_pairs);
+		__sync_fetch_and_add(&mem_stats.n_wfa_dp, bswLeft.wfa_dp + bswRight.wfa_dp);
+		__sync_fetch_and_add(&mem_stats.n_wfa_diff, bswLeft.wfa_diff + bswRight.wfa_diff);
+	}
+
 	/* Discard seeds and hence their alignemnts */
 
 	lim_g[0] = 0;
@@ -3735,7 +4327,7 @@ void mem_chain2aln_across_reads_V2(const mem_opt_t *opt, const bntseq_t *bns,
 						mem_alnreg_t *ar = &(av_v[l].a[s->aln]);
 						ar->qb = ar->qe = -1;		 // purge the alingment
 						srt2[k] = UINT_MAX;
-						tprof[PE18][tid]++;
+						TPROF_ADD(PE18, tid, 1);
 						continue;
 					}
 				}				
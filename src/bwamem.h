@@ -58,6 +58,7 @@
 #include "kvec.h"
 #include "ksort.h"
 #include "utils.h"
+#include "arena.h"
 #include "macro.h"
 #include "profiling.h"
 #include "FMI_search.h"
@@ -80,6 +81,8 @@ typedef struct __smem_i smem_i;
 #define MEM_F_PRIMARY5  0x800
 #define MEM_F_KEEP_SUPP_MAPQ 0x1000
 #define MEM_F_XB        0x2000
+#define MEM_F_WFA       0x4000  // wavefront seed extension instead of banded DP
+#define MEM_F_WFA_CHECK 0x8000  // ... also run banded DP, keep its result and count differences
 
 // V17
 #define MEM_F_PRIMARY5  0x800
@@ -121,6 +124,7 @@ typedef struct mem_opt_t {
     int max_matesw;         // perform maximally max_matesw rounds of mate-SW for each end
     int max_XA_hits, max_XA_hits_alt; // if there are max_hits or fewer, output them all
     int8_t mat[25];         // scoring matrix; mat[0] == 0 if unset
+    int64_t rcache_size;    // cache alignments of up to this many distinct read sequences; 0 to disable
 } mem_opt_t;
 
 
@@ -175,6 +179,15 @@ typedef struct mem_alnreg_t {
 
 typedef struct { size_t n, m; mem_alnreg_t *a; } mem_alnreg_v;
 
+typedef struct { // CIGAR of one region generated ahead of mem_reg2aln()
+    const char *seq; // query it belongs to
+    int qb, qe, w;
+    int64_t rb, re;
+    bwa_cigar_t c;
+} mem_cigar_t;
+
+typedef struct { size_t n, m; mem_cigar_t *a; } mem_cigar_v;
+
 typedef struct {
     int low, high;   // lower and upper bounds within which a read pair is considered to be properly paired
     int failed;      // non-zero if the orientation is not supported by sufficient data
@@ -220,6 +233,9 @@ typedef struct
     int32_t *lim[MAX_THREADS];
     int16_t *query_pos_ar[MAX_THREADS];
     uint8_t *enc_qdb[MAX_THREADS];
+
+    kswv *seedsw[MAX_THREADS];  // mem_flt_chained_seeds_batch(), grown on demand
+    int32_t seedsw_ref[MAX_THREADS], seedsw_qer[MAX_THREADS];
     
     int64_t wsize_mem[MAX_THREADS];
 } mem_cache;
@@ -250,6 +266,9 @@ typedef struct worker_t {
     int16_t           nthreads;
     int32_t           nreads;
     FMI_search       *fmi;  
+    struct read_cache_s *rcache; // duplicate-read cache; NULL if disabled
+    struct mem_pestat_acc_s *peacc; // running insert-size estimator; NULL for per-chunk estimation
+    mem_arena_t      *arena;  // per thread, reset after each chunk
 } worker_t;
 
 
@@ -287,6 +306,13 @@ void mem_reorder_primary5(int T, mem_alnreg_v *a);
 
 char **mem_gen_alt(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac,
                    const mem_alnreg_v *a, int l_query, const char *query); // ONLY work after mem_mark_primary_se()
+void mem_gen_alt_mark(const mem_opt_t *opt, const mem_alnreg_v *a, char *use);
+
+void mem_reg2aln_pre(const mem_opt_t *opt, const bseq1_t *s, const mem_alnreg_v *a,
+                     mem_cigar_v *cv);
+void mem_reg2aln_batch(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac,
+                       mem_cigar_v *cv);
+void mem_reg2aln_batch_free(mem_cigar_v *cv);
 void mem_aln2sam(const mem_opt_t *opt, const bntseq_t *bns, kstring_t *str, bseq1_t *s,
                  int n, const mem_aln_t *list, int which, const mem_aln_t *m_);
 
@@ -309,6 +335,7 @@ int mem_kernel1_core_ert(FMI_search *fmi, const mem_opt_t *opt,
                          uint8_t* ref_string,
                          mem_v* smems,
                          u64v* hits,
+                         mem_cache *mmc,
                          int tid);
 
 void* _mm_realloc(void *ptr, int64_t csize, int64_t nsize, int16_t dsize);
@@ -338,7 +365,12 @@ int mem_sam_pe_batch_post(const mem_opt_t *opt, const bntseq_t *bns,
                           const uint8_t *pac, const mem_pestat_t pes[4],
                           uint64_t id, bseq1_t s[2], mem_alnreg_v a[2],
                           kswr_t **myaln, mem_cache *mmc,
-                          int32_t &gcnt, int tid, int useErt);
+                          int32_t &gcnt, int tid, int useErt, int n_pri[2]);
+
+void mem_sam_pe_batch_sam(const mem_opt_t *opt, const bntseq_t *bns,
+                          const uint8_t *pac, const mem_pestat_t pes[4],
+                          uint64_t id, bseq1_t s[2], mem_alnreg_v a[2],
+                          int n_pri[2]);
 
 int mem_matesw_batch_post_orig(const mem_opt_t *opt, const bntseq_t *bns,
 						  const uint8_t *pac, const mem_pestat_t pes[4],
@@ -428,4 +460,25 @@ void mem_pestat(const mem_opt_t *opt, int64_t l_pac, int n, const mem_alnreg_v *
 
 void mem_reorder_primary5(int T, mem_alnreg_v *a);
 
+/* Running insert-size estimator (-z stream). Histograms are accumulated
+ * across chunks; once one chunk (or a persisted prior) has been seen, the
+ * next chunk is paired with the estimate of everything before it, so
+ * extension and SAM generation of a chunk run as one pass with no
+ * chunk-wide pestat barrier in between. */
+typedef struct mem_pestat_acc_s {
+    int       max_ins;   // histograms cover insert sizes [0,max_ins]
+    uint64_t *hist[4];   // FF, FR, RF, RR
+    uint64_t  cnt[4];
+    int       n_chunk;   // number of chunks (or priors) merged
+    int       nthreads;
+    uint64_v *tv;        // per thread (dir<<32|isize) collected in the fused pass
+    char     *fn, *lib;  // prior file and library it is stored under; fn may be NULL
+} mem_pestat_acc_t;
+
+mem_pestat_acc_t *mem_pestat_acc_init(const mem_opt_t *opt, int nthreads, const char *fn, const char *lib);
+int mem_pestat_acc_destroy(mem_pestat_acc_t *acc); // also saves the prior file if any; <0 if that failed
+void mem_pestat_collect(const mem_opt_t *opt, int64_t l_pac, int n, const mem_alnreg_v *regs, uint64_v *v);
+void mem_pestat_acc_merge(mem_pestat_acc_t *acc, uint64_v *v);
+void mem_pestat_acc_est(const mem_opt_t *opt, const mem_pestat_acc_t *acc, mem_pestat_t pes[4]);
+
 #endif
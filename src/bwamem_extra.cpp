@@ -181,3 +181,28 @@ end_gen_alt:
 	free(has_alt); free(cnt); free(aln); free(str.s);
 	return XA;
 }
+
+// Flag in use[] the regions mem_gen_alt() would call mem_reg2aln() on
+void mem_gen_alt_mark(const mem_opt_t *opt, const mem_alnreg_v *a, char *use)
+{
+	int i, r, *cnt;
+	char *has_alt;
+
+	cnt = (int *) calloc(a->n, sizeof(int));
+	assert(cnt != NULL);
+	has_alt = (char *) calloc(a->n, 1);
+	assert(has_alt != NULL);
+	for (i = 0; i < a->n; ++i) {
+		r = get_pri_idx(opt->XA_drop_ratio, a->a, i);
+		if (r >= 0) {
+			++cnt[r];
+			if (a->a[i].is_alt) has_alt[r] = 1;
+		}
+	}
+	for (i = 0; i < a->n; ++i) {
+		if ((r = get_pri_idx(opt->XA_drop_ratio, a->a, i)) < 0) continue;
+		if (cnt[r] > opt->max_XA_hits_alt || (!has_alt[r] && cnt[r] > opt->max_XA_hits)) continue;
+		use[i] = 1;
+	}
+	free(has_alt); free(cnt);
+}
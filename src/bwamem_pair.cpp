@@ -86,6 +86,19 @@ static int cal_sub(const mem_opt_t *opt, mem_alnreg_v *r)
     return j < r->n? r->a[j].score : opt->min_seed_len * opt->a;
 }
 
+// orientation of a pair of unique hits on the same chromosome; -1 if the pair is unusable for pestat
+static inline int mem_pair_isize(const mem_opt_t *opt, int64_t l_pac,
+                                 const mem_alnreg_v *r0, const mem_alnreg_v *r1, int64_t *is)
+{
+    int dir;
+    if (r0->n == 0 || r1->n == 0) return -1;
+    if (cal_sub(opt, (mem_alnreg_v*)r0) > MIN_RATIO * r0->a[0].score) return -1;
+    if (cal_sub(opt, (mem_alnreg_v*)r1) > MIN_RATIO * r1->a[0].score) return -1;
+    if (r0->a[0].rid != r1->a[0].rid) return -1; // not on the same chr
+    dir = mem_infer_dir(l_pac, r0->a[0].rb, r1->a[0].rb, is);
+    return *is && *is <= opt->max_ins? dir : -1;
+}
+
 void mem_pestat(const mem_opt_t *opt, int64_t l_pac, int n,
                 const mem_alnreg_v *regs, mem_pestat_t pes[4])
 {
@@ -98,15 +111,8 @@ void mem_pestat(const mem_opt_t *opt, int64_t l_pac, int n,
     for (i = 0; i < n>>1; ++i) {
         int dir;
         int64_t is;
-        mem_alnreg_v *r[2];
-        r[0] = (mem_alnreg_v*)&regs[i<<1|0];
-        r[1] = (mem_alnreg_v*)&regs[i<<1|1];
-        if (r[0]->n == 0 || r[1]->n == 0) continue;
-        if (cal_sub(opt, r[0]) > MIN_RATIO * r[0]->a[0].score) continue;
-        if (cal_sub(opt, r[1]) > MIN_RATIO * r[1]->a[0].score) continue;
-        if (r[0]->a[0].rid != r[1]->a[0].rid) continue; // not on the same chr
-        dir = mem_infer_dir(l_pac, r[0]->a[0].rb, r[1]->a[0].rb, &is);
-        if (is && is <= opt->max_ins) kv_push(uint64_t, isize[dir], is);
+        dir = mem_pair_isize(opt, l_pac, &regs[i<<1|0], &regs[i<<1|1], &is);
+        if (dir >= 0) kv_push(uint64_t, isize[dir], is);
     }
     if (bwa_verbose >= 3) fprintf(stderr, "[0000][PE] # candidate unique pairs for (FF, FR, RF, RR): (%ld, %ld, %ld, %ld)\n", isize[0].n, isize[1].n, isize[2].n, isize[3].n);
     for (d = 0; d < 4; ++d) { // TODO: this block is nearly identical to the one in bwtsw2_pair.c. It would be better to merge these two.
@@ -155,6 +161,176 @@ void mem_pestat(const mem_opt_t *opt, int64_t l_pac, int n,
         }
 }
 
+/*********************************
+ * Running insert-size estimator *
+ *********************************/
+
+// prior file: one "LIB<tab>DIR<tab>ISIZE<tab>COUNT" line per non-empty histogram bin
+static void mem_pestat_acc_load(mem_pestat_acc_t *acc)
+{
+    FILE *fp;
+    char lib[1024], dir[3];
+    long is;
+    unsigned long long c;
+    int d, n = 0;
+    if ((fp = fopen(acc->fn, "r")) == 0) return; // no prior yet
+    while (fscanf(fp, "%1023s %2s %ld %llu", lib, dir, &is, &c) == 4) {
+        if (strcmp(lib, acc->lib) != 0) continue;
+        if (strlen(dir) != 2 || (dir[0] != 'F' && dir[0] != 'R') || (dir[1] != 'F' && dir[1] != 'R')) {
+            fprintf(stderr, "[W::%s] skipped a line with malformed orientation '%s' in '%s'\n", __func__, dir, acc->fn);
+            continue;
+        }
+        if (is <= 0 || is > acc->max_ins) continue;
+        d = (dir[0] == 'R') << 1 | (dir[1] == 'R');
+        acc->hist[d][is] += c, acc->cnt[d] += c, ++n;
+    }
+    fclose(fp);
+    if (n) ++acc->n_chunk;
+    if (bwa_verbose >= 3)
+        fprintf(stderr, "[M::%s] loaded insert-size prior of library '%s' from '%s': (%ld, %ld, %ld, %ld) pairs\n",
+                __func__, acc->lib, acc->fn, acc->cnt[0], acc->cnt[1], acc->cnt[2], acc->cnt[3]);
+}
+
+// rewrite the prior file: other libraries are kept, this one is replaced by the merged histograms
+static int mem_pestat_acc_save(const mem_pestat_acc_t *acc)
+{
+    FILE *fp;
+    kstring_t str = {0, 0, 0};
+    char *line = 0, *tmp;
+    size_t m = 0;
+    int d, l = strlen(acc->lib);
+    if ((fp = fopen(acc->fn, "r")) != 0) {
+        while (getline(&line, &m, fp) > 0)
+            if (strncmp(line, acc->lib, l) != 0 || (line[l] != '\t' && line[l] != ' '))
+                kputs(line, &str);
+        free(line);
+        fclose(fp);
+    }
+    for (d = 0; d < 4; ++d)
+        for (int is = 1; is <= acc->max_ins; ++is)
+            if (acc->hist[d][is])
+                ksprintf(&str, "%s\t%c%c\t%d\t%lu\n", acc->lib, "FR"[d>>1&1], "FR"[d&1], is, acc->hist[d][is]);
+    tmp = (char*)malloc(strlen(acc->fn) + 5);
+    assert(tmp != NULL);
+    sprintf(tmp, "%s.tmp", acc->fn);
+    if ((fp = fopen(tmp, "w")) == 0 || (str.l && fwrite(str.s, 1, str.l, fp) != str.l) || fclose(fp) != 0 || rename(tmp, acc->fn) != 0) {
+        fprintf(stderr, "[E::%s] failed to write insert-size prior '%s'\n", __func__, acc->fn);
+        free(tmp); free(str.s);
+        return -1;
+    }
+    free(tmp); free(str.s);
+    return 0;
+}
+
+mem_pestat_acc_t *mem_pestat_acc_init(const mem_opt_t *opt, int nthreads, const char *fn, const char *lib)
+{
+    mem_pestat_acc_t *acc = (mem_pestat_acc_t*) calloc(1, sizeof(mem_pestat_acc_t));
+    assert(acc != NULL);
+    acc->max_ins = opt->max_ins;
+    for (int d = 0; d < 4; ++d) {
+        acc->hist[d] = (uint64_t*) calloc(acc->max_ins + 1, sizeof(uint64_t));
+        assert(acc->hist[d] != NULL);
+    }
+    acc->nthreads = nthreads;
+    acc->tv = (uint64_v*) calloc(nthreads, sizeof(uint64_v));
+    assert(acc->tv != NULL);
+    acc->lib = strdup(lib && *lib? lib : "*");
+    if (fn) {
+        acc->fn = strdup(fn);
+        mem_pestat_acc_load(acc);
+    }
+    return acc;
+}
+
+int mem_pestat_acc_destroy(mem_pestat_acc_t *acc)
+{
+    int ret = 0;
+    if (acc == 0) return 0;
+    if (acc->fn) ret = mem_pestat_acc_save(acc);
+    for (int d = 0; d < 4; ++d) free(acc->hist[d]);
+    for (int i = 0; i < acc->nthreads; ++i) free(acc->tv[i].a);
+    free(acc->tv); free(acc->fn); free(acc->lib);
+    free(acc);
+    return ret;
+}
+
+void mem_pestat_collect(const mem_opt_t *opt, int64_t l_pac, int n, const mem_alnreg_v *regs, uint64_v *v)
+{
+    for (int i = 0; i < n>>1; ++i) {
+        int64_t is;
+        int dir = mem_pair_isize(opt, l_pac, &regs[i<<1|0], &regs[i<<1|1], &is);
+        if (dir >= 0) kv_push(uint64_t, *v, (uint64_t)dir<<32 | is);
+    }
+}
+
+void mem_pestat_acc_merge(mem_pestat_acc_t *acc, uint64_v *v)
+{
+    for (size_t i = 0; i < v->n; ++i) {
+        int d = v->a[i]>>32, is = (uint32_t)v->a[i];
+        ++acc->hist[d][is], ++acc->cnt[d];
+    }
+    v->n = 0;
+}
+
+// k-th smallest insert size of orientation $d
+static inline int acc_kth(const mem_pestat_acc_t *acc, int d, uint64_t k)
+{
+    uint64_t c = 0;
+    int is;
+    for (is = 1; is < acc->max_ins; ++is)
+        if ((c += acc->hist[d][is]) > k) break;
+    return is;
+}
+
+// the rules of mem_pestat() applied to the accumulated histograms
+void mem_pestat_acc_est(const mem_opt_t *opt, const mem_pestat_acc_t *acc, mem_pestat_t pes[4])
+{
+    int d, is;
+    uint64_t max;
+    memset_s(pes, 4 * sizeof(mem_pestat_t), 0);
+    if (bwa_verbose >= 3) fprintf(stderr, "[0000][PE] # accumulated unique pairs for (FF, FR, RF, RR): (%ld, %ld, %ld, %ld)\n", acc->cnt[0], acc->cnt[1], acc->cnt[2], acc->cnt[3]);
+    for (d = 0; d < 4; ++d) {
+        mem_pestat_t *r = &pes[d];
+        const uint64_t *h = acc->hist[d];
+        uint64_t n = acc->cnt[d], x;
+        int p25, p50, p75;
+        if (n < MIN_DIR_CNT) {
+            if (bwa_verbose >= 3) fprintf(stderr, "[0000][PE] skip orientation %c%c as there are not enough pairs\n", "FR"[d>>1&1], "FR"[d&1]);
+            r->failed = 1;
+            continue;
+        }
+        p25 = acc_kth(acc, d, (uint64_t)(.25 * n + .499));
+        p50 = acc_kth(acc, d, (uint64_t)(.50 * n + .499));
+        p75 = acc_kth(acc, d, (uint64_t)(.75 * n + .499));
+        r->low  = (int)(p25 - OUTLIER_BOUND * (p75 - p25) + .499);
+        if (r->low < 1) r->low = 1;
+        r->high = (int)(p75 + OUTLIER_BOUND * (p75 - p25) + .499);
+        if (r->high > acc->max_ins) r->high = acc->max_ins;
+        for (is = r->low, x = 0, r->avg = 0; is <= r->high; ++is)
+            r->avg += (double)is * h[is], x += h[is];
+        assert(x != 0);
+        r->avg /= x;
+        for (is = r->low, r->std = 0; is <= r->high; ++is)
+            r->std += (is - r->avg) * (is - r->avg) * h[is];
+        r->std = sqrt(r->std / x);
+        r->low  = (int)(p25 - MAPPING_BOUND * (p75 - p25) + .499);
+        r->high = (int)(p75 + MAPPING_BOUND * (p75 - p25) + .499);
+        if (r->low  > r->avg - MAX_STDDEV * r->std) r->low  = (int)(r->avg - MAX_STDDEV * r->std + .499);
+        if (r->high < r->avg + MAX_STDDEV * r->std) r->high = (int)(r->avg + MAX_STDDEV * r->std + .499);
+        if (r->low < 1) r->low = 1;
+        if (bwa_verbose >= 3)
+            fprintf(stderr, "[0000][PE] %c%c: (25, 50, 75) percentile: (%d, %d, %d), mean and std.dev: (%.2f, %.2f), proper pairs: (%d, %d)\n",
+                    "FR"[d>>1&1], "FR"[d&1], p25, p50, p75, r->avg, r->std, r->low, r->high);
+    }
+    for (d = 0, max = 0; d < 4; ++d)
+        max = max > acc->cnt[d]? max : acc->cnt[d];
+    for (d = 0; d < 4; ++d)
+        if (pes[d].failed == 0 && acc->cnt[d] < max * MIN_DIR_RATIO) {
+            pes[d].failed = 1;
+            if (bwa_verbose >= 3) fprintf(stderr, "[0000][PE] skip orientation %c%c\n", "FR"[d>>1&1], "FR"[d&1]);
+        }
+}
+
 int mem_matesw(const mem_opt_t *opt, const bntseq_t *bns,
                const uint8_t *pac, const mem_pestat_t pes[4],
                const mem_alnreg_t *a, int l_ms, const uint8_t *ms,
@@ -231,7 +407,7 @@ int mem_matesw(const mem_opt_t *opt, const bntseq_t *bns,
                 b.secondary = -1;
                 b.seedcov = (b.re - b.rb < b.qe - b.qb? b.re - b.rb : b.qe - b.qb) >> 1;
 
-                kv_push(mem_alnreg_t, *ma, b); // make room for a new element
+                ka_push(mem_arena_cur, mem_alnreg_t, *ma, b); // make room for a new element
                 int resort = 0;
                 // move b s.t. ma is sorted
                 for (i = 0; i < ma->n - 1; ++i) { // find the insertion point
@@ -262,7 +438,6 @@ int mem_matesw(const mem_opt_t *opt, const bntseq_t *bns,
                     for (i = ma->n - 1; i > tmp; --i) ma->a[i] = ma->a[i-1];
                     ma->a[i] = b;
                 }
-                tprof[PE26][0] ++;
             }
             ++n;
         }
@@ -345,14 +520,13 @@ int mem_matesw_orig(const mem_opt_t *opt, const bntseq_t *bns,
                 b.secondary = -1;
                 b.seedcov = (b.re - b.rb < b.qe - b.qb? b.re - b.rb : b.qe - b.qb) >> 1;
 
-                kv_push(mem_alnreg_t, *ma, b); // make room for a new element
+                ka_push(mem_arena_cur, mem_alnreg_t, *ma, b); // make room for a new element
                 // move b s.t. ma is sorted
                 for (i = 0; i < ma->n - 1; ++i) // find the insertion point
                     if (ma->a[i].score < b.score) break;
                 tmp = i;
                 for (i = ma->n - 1; i > tmp; --i) ma->a[i] = ma->a[i-1];
                 ma->a[i] = b;
-                tprof[PE26][0] ++;
             }
             ++n;
         }
@@ -915,12 +1089,12 @@ int mem_sam_pe_batch(const mem_opt_t *opt, mem_cache *mmc,
     for (int i=0; i<pcnt-pcnt8; i++)
         seqPairArray[pcnt + MAX_LINE_LEN - 1 - i] = seqPairArray[pcnt-i-1];
     
-#if __AVX512BW__    
+#if KSWV_BATCH
     pwsw->getScores8(seqPairArray, seqBufRef, seqBufQer, aln, pcnt8, nthreads, 0);
     pwsw->getScores16(seqPairArray + pcnt8 + MAX_LINE_LEN, seqBufRef, seqBufQer,
                       aln, pcnt-pcnt8, nthreads, 0);
 #else
-    fprintf(stderr, "Error: This should not have happened!! \nPlease look in to AVX512 macros\n");
+    fprintf(stderr, "Error: This should not have happened!! \nPlease look in to KSWV_BATCH macros\n");
     exit(EXIT_FAILURE);
 #endif
 
@@ -964,11 +1138,11 @@ int mem_sam_pe_batch(const mem_opt_t *opt, mem_cache *mmc,
     int pcnt2 = pos;
     assert(pos8 + pos16 == pcnt2);
 
-#if __AVX512BW__
+#if KSWV_BATCH
     pwsw->getScores16(seqPairArray + pos8, seqBufRef, seqBufQer, aln, pos16, nthreads, 1);
     pwsw->getScores8(seqPairArray, seqBufRef, seqBufQer, aln, pos8, nthreads, 1);
 #else
-    fprintf(stderr, "Error: This should not have happened!! \nPlease look in to AVX512 macros\n");
+    fprintf(stderr, "Error: This should not have happened!! \nPlease look in to KSWV_BATCH macros\n");
     exit(EXIT_FAILURE);
 #endif
     
@@ -982,14 +1156,9 @@ int mem_sam_pe_batch_post(const mem_opt_t *opt, const bntseq_t *bns,
                           const uint8_t *pac, const mem_pestat_t pes[4],
                           uint64_t id, bseq1_t s[2], mem_alnreg_v a[2],
                           kswr_t **myaln, mem_cache *mmc, 
-                          int32_t &gcnt, int tid, int useErt)
+                          int32_t &gcnt, int tid, int useErt, int n_pri[2])
 {
     extern int mem_mark_primary_se(const mem_opt_t *opt, int n, mem_alnreg_t *a, int64_t id);
-    extern int mem_approx_mapq_se(const mem_opt_t *opt, const mem_alnreg_t *a);
-    extern void mem_reg2sam(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac,
-                            bseq1_t *s, mem_alnreg_v *a, int extra_flag, const mem_aln_t *m);
-    extern char **mem_gen_alt(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac,
-                              const mem_alnreg_v *a, int l_query, const char *query);
     extern void sort_alnreg_re(int n, mem_alnreg_t* a);
     extern void sort_alnreg_score(int n, mem_alnreg_t* a);
     extern int mem_sort_dedup_patch(const mem_opt_t *opt, const bntseq_t *bns,
@@ -997,16 +1166,9 @@ int mem_sam_pe_batch_post(const mem_opt_t *opt, const bntseq_t *bns,
 
     int32_t *gar = (int32_t*) mmc->seqPairArrayAux[tid];
     
-    int n = 0, i, j, z[2], o, subo, n_sub, extra_flag = 1, n_pri[2], n_aa[2];
-    kstring_t str;
-    mem_aln_t h[2], g[2], aa[2][2];
+    int n = 0, i, j;
     // int tid = omp_get_thread_num();
     
-    str.l = str.m = 0; str.s = 0;
-    memset_s(h, sizeof(mem_aln_t) * 2, 0);
-    memset_s(g, sizeof(mem_aln_t) * 2, 0);
-    n_aa[0] = n_aa[1] = 0;
-    
     if (!(opt->flag & MEM_F_NO_RESCUE)) { // then perform SW for the best alignment
         mem_alnreg_v b[2];
         kv_init(b[0]); kv_init(b[1]);
@@ -1062,6 +1224,30 @@ int mem_sam_pe_batch_post(const mem_opt_t *opt, const bntseq_t *bns,
         mem_reorder_primary5(opt->T, &a[1]);
     }
     #endif
+    return n;
+}
+
+// SAM output of a pair after mem_sam_pe_batch_post(); kept apart so that the
+// CIGARs of the whole batch can be generated in between (mem_reg2aln_batch())
+void mem_sam_pe_batch_sam(const mem_opt_t *opt, const bntseq_t *bns,
+                          const uint8_t *pac, const mem_pestat_t pes[4],
+                          uint64_t id, bseq1_t s[2], mem_alnreg_v a[2],
+                          int n_pri[2])
+{
+    extern int mem_approx_mapq_se(const mem_opt_t *opt, const mem_alnreg_t *a);
+    extern void mem_reg2sam(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac,
+                            bseq1_t *s, mem_alnreg_v *a, int extra_flag, const mem_aln_t *m);
+    extern char **mem_gen_alt(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac,
+                              const mem_alnreg_v *a, int l_query, const char *query);
+
+    int i, j, z[2], o, subo, n_sub, extra_flag = 1, n_aa[2];
+    kstring_t str;
+    mem_aln_t h[2], g[2], aa[2][2];
+    
+    str.l = str.m = 0; str.s = 0;
+    memset_s(h, sizeof(mem_aln_t) * 2, 0);
+    memset_s(g, sizeof(mem_aln_t) * 2, 0);
+    n_aa[0] = n_aa[1] = 0;
     
     if (opt->flag&MEM_F_NOPAIRING) goto no_pairing;
 
@@ -1160,7 +1346,7 @@ int mem_sam_pe_batch_post(const mem_opt_t *opt, const bntseq_t *bns,
             free(XA[i]);
         }
     } else goto no_pairing;
-    return n;
+    return;
 
 no_pairing:
     for (i = 0; i < 2; ++i) {
@@ -1186,7 +1372,7 @@ no_pairing:
                   s[0].name, s[1].name);
     
     free(h[0].cigar); free(h[1].cigar);
-    return n;
+    return;
 }
 
 
@@ -1449,7 +1635,7 @@ int mem_matesw_batch_post_ert(const mem_opt_t *opt, const bntseq_t *bns,
                 b.secondary = -1;
                 b.seedcov = (b.re - b.rb < b.qe - b.qb? b.re - b.rb : b.qe - b.qb) >> 1;
 
-                kv_push(mem_alnreg_t, *ma, b); // make room for a new element
+                ka_push(mem_arena_cur, mem_alnreg_t, *ma, b); // make room for a new element
                 int resort = 0;
                 // move b s.t. ma is sorted
                 for (i = 0; i < ma->n - 1; ++i) { // find the insertion point
@@ -1580,7 +1766,7 @@ int mem_matesw_batch_post(const mem_opt_t *opt, const bntseq_t *bns,
                 b.secondary = -1;
                 b.seedcov = (b.re - b.rb < b.qe - b.qb? b.re - b.rb : b.qe - b.qb) >> 1;
 
-                kv_push(mem_alnreg_t, *ma, b); // make room for a new element
+                ka_push(mem_arena_cur, mem_alnreg_t, *ma, b); // make room for a new element
 
                 // move b s.t. ma is sorted
                 for (i = 0; i < ma->n - 1; ++i) // find the insertion point
@@ -1589,7 +1775,6 @@ int mem_matesw_batch_post(const mem_opt_t *opt, const bntseq_t *bns,
                 for (i = ma->n - 1; i > tmp; --i) ma->a[i] = ma->a[i-1];
                 ma->a[i] = b;
 
-                tprof[PE26][0] ++;
             }
             ++n;
         }
@@ -241,6 +241,7 @@ int bwa_index(int argc, char *argv[]) // the "index" command
 				else if (strcmp(optarg, "is") == 0) algo_type = BWTALGO_IS;
 				else if (strcmp(optarg, "mem2") == 0) algo_type = BWTALGO_MEM2;
 				else if (strcmp(optarg, "ert") == 0) algo_type = BWTALGO_MLTS;
+				else if (strcmp(optarg, "psa") == 0) algo_type = BWTALGO_PSA;
 				else { if (prefix) free(prefix); err_fatal(__func__, "unknown algorithm: '%s'.", optarg); }
 				break;
 			case 'p': prefix = strdup(optarg); break;
@@ -256,14 +257,15 @@ int bwa_index(int argc, char *argv[]) // the "index" command
 	if (optind + 1 > argc) {
 		fprintf(stderr, "\n");
 		fprintf(stderr, "Usage:   bwa-mem2 index [options] <in.fasta>\n\n");
-		fprintf(stderr, "Options: -a STR    BWT construction algorithm: bwtsw, is, rb2, mem2 or ert\n");
+		fprintf(stderr, "Options: -a STR    BWT construction algorithm: bwtsw, is, rb2, mem2, psa or ert\n");
 		fprintf(stderr, "         -p STR    prefix of the index [same as fasta name]\n");
-		fprintf(stderr, "         -t INT    number of threads for ERT index building [%d]\n", num_threads);
+		fprintf(stderr, "         -t INT    number of threads for ERT index building and for -a psa [%d]\n", num_threads);
 		fprintf(stderr, "         -6        index files named as <in.fasta>.64.* instead of <in.fasta>.* \n");
 		fprintf(stderr, "\n");
 		fprintf(stderr,	"Warning: `-a bwtsw' does not work for short genomes, while `-a is' and\n");
 		fprintf(stderr, "         `-a div' do not work not for long genomes.\n\n");
-		fprintf(stderr, "         `-a ert' to build ERT index.\n\n");
+		fprintf(stderr, "         `-a ert' to build ERT index.\n");
+		fprintf(stderr, "         `-a psa' builds the mem2 index with suffixes sorted in parallel (experimental).\n\n");
 		if (prefix) {
 			free(prefix);
 		}
@@ -304,8 +306,8 @@ int bwa_index(int argc, char *argv[]) // the "index" command
 		build_binaryRef(prefix);
 		bwa_idx_destroy(bid);
 	}
-	else if (algo_type == BWTALGO_MEM2) {
-		bwa_idx_build_mem2(argv[optind], prefix);
+	else if (algo_type == BWTALGO_MEM2 || algo_type == BWTALGO_PSA) {
+		bwa_idx_build_mem2(argv[optind], prefix, algo_type == BWTALGO_PSA? num_threads : 0);
 	}
 	else {
 		bwa_idx_build(argv[optind], prefix, algo_type, block_size);
@@ -314,7 +316,7 @@ int bwa_index(int argc, char *argv[]) // the "index" command
 	return 0;
 }
 
-int bwa_idx_build_mem2(const char *fa, const char *prefix)
+int bwa_idx_build_mem2(const char *fa, const char *prefix, int psa_threads)
 {
 	extern void bwa_pac_rev_core(const char *fn, const char *fn_rev);
 
@@ -329,7 +331,7 @@ int bwa_idx_build_mem2(const char *fa, const char *prefix)
 		fprintf(stderr, "%.2f sec\n", (float)(clock() - t) / CLOCKS_PER_SEC);
 		err_gzclose(fp);
         FMI_search *fmi = new FMI_search(prefix);
-        fmi->build_index();
+        fmi->build_index(psa_threads);
         delete fmi;
 	}
 	return 0;
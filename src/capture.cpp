@@ -0,0 +1,318 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM-SCALE (Memory-Scalable Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2022 Electronics and Telecommunications Research Institute (ETRI), Changdae Kim.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   Contacts: Changdae Kim <cdkim@etri.re.kr>
+
+** This software builds upon BWA-MEM2, and includes several performance optimization techniques.
+   For BWA-MEM2, refer to the follows.
+
+   BWA-MEM2 (Sequence alignment using Burrows-Wheeler Transform)
+   Copyright ⓒ 2019 Intel Corporation, Heng Li
+   The MIT License
+   Website: https://github.com/bwa-mem2/bwa-mem2
+
+*****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "capture.h"
+#include "kstring.h"
+
+#define CAP_MAGIC "BWAMCAP1"
+#define CAP_F_PERFECT 0x1
+
+int capture_on = 0;
+
+static gzFile cap_fp;
+static const char *cap_fn;
+static int cap_every;
+static uint64_t cap_calls[2];  // SMEM batches and BSW calls seen
+static int64_t cap_n[2], cap_bytes;
+static pthread_mutex_t cap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline void cap_put(kstring_t *s, const void *p, size_t l)
+{
+	kputsn((const char *) p, l, s);
+}
+
+static inline void cap_put32(kstring_t *s, int32_t x) { cap_put(s, &x, 4); }
+static inline void cap_put64(kstring_t *s, int64_t x) { cap_put(s, &x, 8); }
+
+static void cap_write(kstring_t *s, int64_t *cnt) // cnt NULL for the header
+{
+	pthread_mutex_lock(&cap_lock);
+	if (cap_fp && capture_on) {
+		if (gzwrite(cap_fp, s->s, s->l) != (int) s->l) {
+			fprintf(stderr, "[W::%s] fail to write to %s; capture stopped\n", __func__, cap_fn);
+			capture_on = 0;
+		} else {
+			if (cnt) ++*cnt;
+			cap_bytes += s->l;
+		}
+	}
+	pthread_mutex_unlock(&cap_lock);
+	free(s->s);
+}
+
+// one in cap_every calls of the kind, the first included
+static inline int cap_sample(int kind)
+{
+	return __sync_fetch_and_add(&cap_calls[kind], 1) % cap_every == 0;
+}
+
+int capture_init(const char *fn, int every, const mem_opt_t *opt, const char *prefix)
+{
+	kstring_t s = {0, 0, 0};
+	int flags = 0;
+
+#ifdef PERFECT_MATCH
+	flags |= CAP_F_PERFECT;
+#endif
+	if (fn == NULL) return 0;
+	if ((cap_fp = gzopen(fn, "wb")) == NULL) {
+		fprintf(stderr, "[E::%s] fail to open file '%s' for writing\n", __func__, fn);
+		return -1;
+	}
+	cap_fn = fn, cap_every = every > 0? every : CAP_EVERY;
+	cap_calls[0] = cap_calls[1] = 0, cap_n[0] = cap_n[1] = cap_bytes = 0;
+	cap_put(&s, CAP_MAGIC, 8);
+	cap_put32(&s, opt->a), cap_put32(&s, opt->b);
+	cap_put32(&s, opt->o_del), cap_put32(&s, opt->e_del);
+	cap_put32(&s, opt->o_ins), cap_put32(&s, opt->e_ins);
+	cap_put32(&s, opt->zdrop), cap_put32(&s, opt->pen_clip5), cap_put32(&s, opt->pen_clip3);
+	cap_put32(&s, opt->w), cap_put32(&s, opt->min_seed_len), cap_put32(&s, opt->split_width);
+	cap_put32(&s, opt->max_occ), cap_put32(&s, flags);
+	cap_put(&s, &opt->split_factor, sizeof(float));
+	cap_put64(&s, opt->max_mem_intv);
+	cap_put32(&s, strlen(prefix)), cap_put(&s, prefix, strlen(prefix));
+	capture_on = 1;
+	cap_write(&s, NULL);
+	return capture_on? 0 : -1;
+}
+
+void capture_bsw(int bits, int side, const SeqPair *p, int n, const uint8_t *ref,
+				 const uint8_t *qer, int32_t w)
+{
+	kstring_t s = {0, 0, 0};
+	int64_t l_ref = 0, l_qer = 0;
+	int i;
+
+	if (n <= 0 || !cap_sample(1)) return;
+	for (i = 0; i < n; ++i) l_ref += p[i].len1, l_qer += p[i].len2;
+	ks_resize(&s, 24 + n * 36 + l_ref + l_qer);
+	kputc(CAP_BSW, &s), kputc(bits, &s), kputc(side, &s);
+	cap_put32(&s, w), cap_put32(&s, n), cap_put64(&s, l_ref), cap_put64(&s, l_qer);
+	for (i = 0; i < n; ++i)
+		cap_put32(&s, p[i].len1), cap_put32(&s, p[i].len2), cap_put32(&s, p[i].h0);
+	for (i = 0; i < n; ++i) cap_put(&s, ref + p[i].idr, p[i].len1);
+	for (i = 0; i < n; ++i) cap_put(&s, qer + p[i].idq, p[i].len2);
+	for (i = 0; i < n; ++i) {
+		cap_put32(&s, p[i].score), cap_put32(&s, p[i].tle), cap_put32(&s, p[i].gtle);
+		cap_put32(&s, p[i].qle), cap_put32(&s, p[i].gscore), cap_put32(&s, p[i].max_off);
+	}
+	cap_write(&s, &cap_n[1]);
+}
+
+void capture_smem(const bseq1_t *seqs, int nseq, const SMEM *a, int64_t n)
+{
+	kstring_t s = {0, 0, 0};
+	int64_t i;
+	int l;
+
+	if (nseq <= 0 || !cap_sample(0)) return;
+	kputc(CAP_SMEM, &s), cap_put32(&s, nseq);
+	for (l = 0; l < nseq; ++l) {
+#ifdef PERFECT_MATCH
+		kputc(seqs[l].perfect.exist != 0, &s);
+#else
+		kputc(0, &s);
+#endif
+		cap_put32(&s, seqs[l].l_seq);
+	}
+	for (l = 0; l < nseq; ++l) cap_put(&s, seqs[l].seq, seqs[l].l_seq);
+	cap_put64(&s, n);
+	for (i = 0; i < n; ++i) {
+		cap_put32(&s, a[i].rid), cap_put32(&s, a[i].m), cap_put32(&s, a[i].n);
+		cap_put64(&s, a[i].k), cap_put64(&s, a[i].l), cap_put64(&s, a[i].s);
+	}
+	cap_write(&s, &cap_n[0]);
+}
+
+int capture_close(void)
+{
+	int ret = 0;
+
+	if (cap_fp == NULL) return 0;
+	capture_on = 0;
+	if (gzputc(cap_fp, CAP_END) < 0 || gzclose(cap_fp) != Z_OK) {
+		fprintf(stderr, "[E::%s] fail to write to %s\n", __func__, cap_fn);
+		ret = -1;
+	} else if (bwa_verbose >= 3)
+		fprintf(stderr, "[M::%s] %ld of %lu SMEM batches and %ld of %lu banded DP calls captured to %s, %.1f MB before compression\n",
+				__func__, (long) cap_n[0], (unsigned long) cap_calls[0], (long) cap_n[1],
+				(unsigned long) cap_calls[1], cap_fn, cap_bytes / 1e6);
+	cap_fp = NULL;
+	return ret;
+}
+
+/**********
+ * Reader *
+ **********/
+
+static inline int cap_get(gzFile fp, void *p, size_t l)
+{
+	return l == 0 || gzread(fp, p, l) == (int) l;
+}
+
+static inline int cap_get32(gzFile fp, int32_t *x) { return cap_get(fp, x, 4); }
+static inline int cap_get64(gzFile fp, int64_t *x) { return cap_get(fp, x, 8); }
+
+gzFile capture_open(const char *fn, capture_hdr_t *h)
+{
+	gzFile fp;
+	char magic[8];
+	int32_t x[14], l;
+
+	memset(h, 0, sizeof(*h));
+	if ((fp = gzopen(fn, "rb")) == NULL) {
+		fprintf(stderr, "[E::%s] fail to open file '%s'\n", __func__, fn);
+		return NULL;
+	}
+	if (!cap_get(fp, magic, 8) || memcmp(magic, CAP_MAGIC, 8) != 0
+		|| !cap_get(fp, x, sizeof(x)) || !cap_get(fp, &h->split_factor, sizeof(float))
+		|| !cap_get64(fp, &h->max_mem_intv) || !cap_get32(fp, &l) || l < 0) {
+		fprintf(stderr, "[E::%s] %s is not a kernel capture\n", __func__, fn);
+		gzclose(fp);
+		return NULL;
+	}
+	h->a = x[0], h->b = x[1], h->o_del = x[2], h->e_del = x[3], h->o_ins = x[4], h->e_ins = x[5];
+	h->zdrop = x[6], h->pen_clip5 = x[7], h->pen_clip3 = x[8];
+	h->w = x[9], h->min_seed_len = x[10], h->split_width = x[11], h->max_occ = x[12];
+	h->perfect = !!(x[13] & CAP_F_PERFECT);
+	h->prefix = (char *) calloc(l + 1, 1);
+	assert(h->prefix != NULL);
+	if (!cap_get(fp, h->prefix, l)) {
+		fprintf(stderr, "[E::%s] %s is truncated\n", __func__, fn);
+		free(h->prefix);
+		gzclose(fp);
+		return NULL;
+	}
+	return fp;
+}
+
+static int cap_read_bsw(gzFile fp, capture_rec_t *r)
+{
+	uint8_t c[2];
+	int32_t *x;
+	int i;
+
+	if (!cap_get(fp, c, 2) || !cap_get32(fp, &r->w) || !cap_get32(fp, &r->n)
+		|| !cap_get64(fp, &r->l_ref) || !cap_get64(fp, &r->l_qer) || r->n < 0)
+		return -1;
+	r->bits = c[0], r->side = c[1];
+	r->pairs = (SeqPair *) calloc(r->n + 1, sizeof(SeqPair));
+	x = (int32_t *) malloc((r->n * 6 + 1) * sizeof(int32_t));
+	// the kernels read past the last sequence
+	r->ref = (uint8_t *) calloc(r->l_ref + MAX_LINE_LEN, 1);
+	r->qer = (uint8_t *) calloc(r->l_qer + MAX_LINE_LEN, 1);
+	assert(r->pairs && x && r->ref && r->qer);
+	if (!cap_get(fp, x, r->n * 12)) goto fail;
+	for (i = 0; i < r->n; ++i) {
+		SeqPair *p = &r->pairs[i];
+		p->len1 = x[i*3], p->len2 = x[i*3+1], p->h0 = x[i*3+2];
+		p->idr = i? p[-1].idr + p[-1].len1 : 0;
+		p->idq = i? p[-1].idq + p[-1].len2 : 0;
+		p->id = p->regid = i;
+	}
+	if (!cap_get(fp, r->ref, r->l_ref) || !cap_get(fp, r->qer, r->l_qer)) goto fail;
+	if (!cap_get(fp, x, r->n * 24)) goto fail;
+	for (i = 0; i < r->n; ++i) {
+		SeqPair *p = &r->pairs[i];
+		const int32_t *y = &x[i*6];
+		p->score = y[0], p->tle = y[1], p->gtle = y[2], p->qle = y[3], p->gscore = y[4], p->max_off = y[5];
+	}
+	free(x);
+	return 1;
+fail:
+	free(x);
+	return -1;
+}
+
+static int cap_read_smem(gzFile fp, capture_rec_t *r)
+{
+	int64_t i, tot = 0;
+	int l;
+
+	if (!cap_get32(fp, &r->nseq) || r->nseq < 0) return -1;
+	r->l_seq = (int32_t *) malloc((r->nseq + 1) * sizeof(int32_t));
+	r->perfect = (uint8_t *) malloc(r->nseq + 1);
+	assert(r->l_seq && r->perfect);
+	for (l = 0; l < r->nseq; ++l) {
+		if (!cap_get(fp, &r->perfect[l], 1) || !cap_get32(fp, &r->l_seq[l])) return -1;
+		tot += r->l_seq[l];
+	}
+	r->seq = (uint8_t *) malloc(tot + 1);
+	assert(r->seq != NULL);
+	if (!cap_get(fp, r->seq, tot) || !cap_get64(fp, &r->n_smem) || r->n_smem < 0) return -1;
+	r->smem = (SMEM *) calloc(r->n_smem + 1, sizeof(SMEM));
+	assert(r->smem != NULL);
+	for (i = 0; i < r->n_smem; ++i) {
+		SMEM *p = &r->smem[i];
+		int32_t x[3];
+		if (!cap_get(fp, x, 12) || !cap_get64(fp, &p->k) || !cap_get64(fp, &p->l)
+			|| !cap_get64(fp, &p->s))
+			return -1;
+		p->rid = x[0], p->m = x[1], p->n = x[2];
+	}
+	return 1;
+}
+
+int capture_read(gzFile fp, capture_rec_t *r)
+{
+	int c = gzgetc(fp), ret;
+
+	memset(r, 0, sizeof(*r));
+	if (c == CAP_END) return r->type = CAP_END, 0;
+	r->type = c;
+	if (c == CAP_BSW) ret = cap_read_bsw(fp, r);
+	else if (c == CAP_SMEM) ret = cap_read_smem(fp, r);
+	else ret = -1;
+	if (ret < 0) {
+		fprintf(stderr, "[E::%s] truncated or corrupted capture record\n", __func__);
+		capture_rec_free(r);
+	}
+	return ret;
+}
+
+void capture_rec_free(capture_rec_t *r)
+{
+	free(r->pairs); free(r->ref); free(r->qer);
+	free(r->l_seq); free(r->perfect); free(r->seq); free(r->smem);
+	memset(r, 0, sizeof(*r));
+}
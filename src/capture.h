@@ -0,0 +1,99 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM-SCALE (Memory-Scalable Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2022 Electronics and Telecommunications Research Institute (ETRI), Changdae Kim.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   Contacts: Changdae Kim <cdkim@etri.re.kr>
+
+** This software builds upon BWA-MEM2, and includes several performance optimization techniques.
+   For BWA-MEM2, refer to the follows.
+
+   BWA-MEM2 (Sequence alignment using Burrows-Wheeler Transform)
+   Copyright ⓒ 2019 Intel Corporation, Heng Li
+   The MIT License
+   Website: https://github.com/bwa-mem2/bwa-mem2
+
+*****************************************************************************************/
+
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include <stdint.h>
+#include <zlib.h>
+#include "bwamem.h"
+#include "FMI_search.h"
+
+/*
+ * Kernel input capture (--capture FILE[,N]) and its reader for replay
+ * (bwa-mem2.bench -R FILE).
+ * One in N calls of each captured kernel is written to a gzip'd file: the
+ * SMEM search of a batch of reads (mem_collect_smem(): the reads in nt4 and
+ * the SMEMs found) and the vector banded DP of a band try (getScores8/16/32 of
+ * mem_kernel2_core(): the pairs with their sequences, and the scores the
+ * kernel gave them). The header keeps the options the kernels depend on, so a
+ * replay needs nothing but the file and, for the SMEM records, the index.
+ */
+
+#define CAP_EVERY 16 // default N
+
+enum { CAP_END = 'E', CAP_BSW = 'B', CAP_SMEM = 'S' };
+enum { CAP_LEFT, CAP_RIGHT };
+
+typedef struct {
+	int a, b, o_del, e_del, o_ins, e_ins, zdrop, pen_clip5, pen_clip3;
+	int w, min_seed_len, split_width, max_occ;
+	float split_factor;
+	int64_t max_mem_intv;
+	int perfect;  // built with PERFECT_MATCH: reads flagged as perfect matches are not searched
+	char *prefix; // index prefix of the run
+} capture_hdr_t;
+
+typedef struct {
+	int type; // CAP_*, CAP_END at the end of the file
+	// CAP_BSW: pairs with idr/idq into ref/qer and the scores recorded
+	int bits, side, w, n;
+	SeqPair *pairs;
+	uint8_t *ref, *qer;
+	int64_t l_ref, l_qer;
+	// CAP_SMEM: reads in nt4 concatenated, and their SMEMs
+	int nseq;
+	int32_t *l_seq;
+	uint8_t *perfect, *seq;
+	int64_t n_smem;
+	SMEM *smem;
+} capture_rec_t;
+
+extern int capture_on;
+
+int capture_init(const char *fn, int every, const mem_opt_t *opt, const char *prefix);
+void capture_bsw(int bits, int side, const SeqPair *p, int n, const uint8_t *ref,
+				 const uint8_t *qer, int32_t w);
+void capture_smem(const bseq1_t *seqs, int nseq, const SMEM *a, int64_t n);
+int capture_close(void);
+
+gzFile capture_open(const char *fn, capture_hdr_t *h);
+int capture_read(gzFile fp, capture_rec_t *r); // 1 if a record was read, 0 at the end, -1 on error
+void capture_rec_free(capture_rec_t *r);
+
+#endif
@@ -41,8 +41,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sstream>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <time.h>
 #include "fastmap.h"
 #include "FMI_search.h"
+#include "read_cache.h"
+#include "perfctr.h"
+#include "readtrace.h"
+#include "capture.h"
 #include <errno.h>
 #ifdef PERFECT_MATCH
 #include "perfect.h"
@@ -122,6 +129,35 @@ int HTStatus()
     return ht;
 }
 
+/* Per-thread arenas for the alignment regions and chain seeds of a chunk */
+static void memoryAllocArena(worker_t &w, int32_t nthreads, int no)
+{
+    w.arena = (mem_arena_t *) malloc(nthreads * sizeof(mem_arena_t));
+    assert(w.arena != NULL);
+    for (int l=0; l<nthreads; l++)
+        mem_arena_init(&w.arena[l], MEM_ARENA_BLK_SIZE);
+
+    int64_t allocMem = mem_stats.mem_arena = MEM_ARENA_BLK_SIZE;
+    fprintf(stderr, "%d. Memory pre-allocation for read arenas: %0.4lf MB = %0.4lf MB * %d threads\n",
+            no, allocMem*nthreads/1e6, allocMem/1e6, nthreads);
+}
+
+static void memoryFreeArena(worker_t &w, int32_t nthreads)
+{
+    size_t hwm = 0, max_hwm = 0, cap = 0;
+    int64_t n_blk = 0;
+    for (int l=0; l<nthreads; l++) {
+        mem_arena_t *ar = &w.arena[l];
+        hwm += ar->hwm, cap += ar->cap, n_blk += ar->n_blk;
+        if (ar->hwm > max_hwm) max_hwm = ar->hwm;
+        mem_arena_destroy(ar);
+    }
+    fprintf(stderr, "Read arenas high-water mark: %0.4lf MB (max %0.4lf MB per thread), "
+            "held: %0.4lf MB in %ld blocks\n", hwm/1e6, max_hwm/1e6, cap/1e6, (long) n_blk);
+    free(w.arena);
+    w.arena = NULL;
+}
+
 void memoryAllocErt(ktp_aux_t *aux, worker_t &w, int32_t nreads, int32_t nthreads) {
     mem_opt_t *opt = aux->opt;
     int32_t memSize = nreads;
@@ -143,6 +179,7 @@ void memoryAllocErt(ktp_aux_t *aux, worker_t &w, int32_t nreads, int32_t nthread
     int64_t allocMem = memSize * sizeof(mem_alnreg_v) +
         memSize * sizeof(mem_chain_v) +
         sizeof(mem_seed_t) * memSize * AVG_SEEDS_PER_READ;
+    mem_stats.mem_chain = allocMem;
     fprintf(stderr, "------------------------------------------\n");
     fprintf(stderr, "1. Memory pre-allocation for chaining: %0.4lf MB\n", allocMem/1e6);
 
@@ -173,6 +210,8 @@ void memoryAllocErt(ktp_aux_t *aux, worker_t &w, int32_t nreads, int32_t nthread
         w.mmc.seqPairArrayLeft128[l]  = (SeqPair *) malloc((wsize + MAX_LINE_LEN) * sizeof(SeqPair));
         w.mmc.seqPairArrayRight128[l] = (SeqPair *) malloc((wsize + MAX_LINE_LEN) * sizeof(SeqPair));
         w.mmc.wsize[l] = wsize;
+        w.mmc.seedsw[l] = NULL;
+        w.mmc.seedsw_ref[l] = w.mmc.seedsw_qer[l] = 0;
 
         assert(w.mmc.seqPairArrayAux[l] != NULL);
         assert(w.mmc.seqPairArrayLeft128[l] != NULL);
@@ -183,6 +222,7 @@ void memoryAllocErt(ktp_aux_t *aux, worker_t &w, int32_t nreads, int32_t nthread
     allocMem = (wsize * MAX_SEQ_LEN_REF * sizeof(int8_t) + MAX_LINE_LEN) * 2+
         (wsize * MAX_SEQ_LEN_QER * sizeof(int8_t) + MAX_LINE_LEN) * 2 +       
         (wsize + MAX_LINE_LEN) * sizeof(SeqPair) * 3;   
+    mem_stats.mem_bsw = allocMem;
     fprintf(stderr, "2. Memory pre-allocation for BSW: %0.4lf MB = %0.4lf MB * %d threads\n", 
 				allocMem*nthreads/1e6, allocMem/1e6, nthreads);
 
@@ -192,6 +232,7 @@ void memoryAllocErt(ktp_aux_t *aux, worker_t &w, int32_t nreads, int32_t nthread
     }
 
     allocMem = (BATCH_SIZE + 32) * sizeof(int32_t);
+    mem_stats.mem_bwt = allocMem;
     fprintf(stderr, "3. Memory pre-allocation for BWT: %0.4lf MB = %0.4lf MB * %d threads\n", allocMem*nthreads/1e6, allocMem/1e6, nthreads);
     fprintf(stderr, "------------------------------------------\n");
 
@@ -208,7 +249,9 @@ void memoryAllocErt(ktp_aux_t *aux, worker_t &w, int32_t nreads, int32_t nthread
         kv_init_base(uint64_t, w.hits_ar[i * MAX_LINE_LEN], MAX_HITS_PER_READ);
     }
 
+    mem_stats.mem_ert = allocMem;
     fprintf(stderr, "4. Memory pre-allocation for ERT: %0.4lf MB = %0.4lf MB * %d threads\n", allocMem*nthreads/1e6, allocMem/1e6, nthreads);
+    memoryAllocArena(w, nthreads, 5);
     fprintf(stderr, "------------------------------------------\n");
 
     w.useErt = 1;
@@ -239,6 +282,7 @@ void memoryAlloc(ktp_aux_t *aux, worker_t &w, int32_t nreads, int32_t nthreads)
     int64_t allocMem = memSize * sizeof(mem_alnreg_v) +
         memSize * sizeof(mem_chain_v) +
         sizeof(mem_seed_t) * memSize * AVG_SEEDS_PER_READ;
+    mem_stats.mem_chain = allocMem;
     fprintf(stderr, "------------------------------------------\n");
     fprintf(stderr, "1. Memory pre-allocation for Chaining: %0.4lf MB\n", allocMem/1e6);
 
@@ -270,6 +314,8 @@ void memoryAlloc(ktp_aux_t *aux, worker_t &w, int32_t nreads, int32_t nthreads)
         w.mmc.seqPairArrayLeft128[l]  = (SeqPair *) malloc((wsize + MAX_LINE_LEN) * sizeof(SeqPair));
         w.mmc.seqPairArrayRight128[l] = (SeqPair *) malloc((wsize + MAX_LINE_LEN) * sizeof(SeqPair));
         w.mmc.wsize[l] = wsize;
+        w.mmc.seedsw[l] = NULL;
+        w.mmc.seedsw_ref[l] = w.mmc.seedsw_qer[l] = 0;
 
         assert(w.mmc.seqPairArrayAux[l] != NULL);
         assert(w.mmc.seqPairArrayLeft128[l] != NULL);
@@ -280,6 +326,7 @@ void memoryAlloc(ktp_aux_t *aux, worker_t &w, int32_t nreads, int32_t nthreads)
     allocMem = (wsize * MAX_SEQ_LEN_REF * sizeof(int8_t) + MAX_LINE_LEN) * 2 +
         (wsize * MAX_SEQ_LEN_QER * sizeof(int8_t) + MAX_LINE_LEN)  * 2 +       
         (wsize + MAX_LINE_LEN) * sizeof(SeqPair) * 3;   
+    mem_stats.mem_bsw = allocMem;
     fprintf(stderr, "2. Memory pre-allocation for BSW: %0.4lf MB = %0.4lf MB * %d threads\n", 
 				allocMem*nthreads/1e6, allocMem/1e6, nthreads);
 
@@ -299,11 +346,91 @@ void memoryAlloc(ktp_aux_t *aux, worker_t &w, int32_t nreads, int32_t nthreads)
 				BATCH_MUL * BATCH_SIZE * readLen *sizeof(int16_t) +
 				BATCH_MUL * BATCH_SIZE * readLen *sizeof(int32_t) +
 				(BATCH_SIZE + 32) * sizeof(int32_t);
+    mem_stats.mem_bwt = allocMem;
+    mem_stats.mem_ert = 0;
     fprintf(stderr, "3. Memory pre-allocation for BWT: %0.4lf MB = %0.4lf MB * %d threads\n", allocMem*nthreads/1e6, allocMem/1e6, nthreads);
+    memoryAllocArena(w, nthreads, 4);
     fprintf(stderr, "------------------------------------------\n");
 	w.useErt = 0;
 }
 
+/* The seed-SW kswv objects carry the scoring of the job that built them */
+static void memoryFreeSeedSW(worker_t &w, int32_t nthreads)
+{
+    for (int l=0; l<nthreads; l++) {
+        delete w.mmc.seedsw[l];
+        w.mmc.seedsw[l] = NULL;
+        w.mmc.seedsw_ref[l] = w.mmc.seedsw_qer[l] = 0;
+    }
+}
+
+static void memoryFree(worker_t &w, int32_t nthreads)
+{
+    memoryFreeArena(w, nthreads);
+    memoryFreeSeedSW(w, nthreads);
+    free(w.chain_ar);
+    free(w.regs);
+    free(w.seedBuf);
+    
+    for(int l=0; l<nthreads; l++) {
+        _mm_free(w.mmc.seqBufLeftRef[l*CACHE_LINE]);
+        _mm_free(w.mmc.seqBufRightRef[l*CACHE_LINE]);
+        _mm_free(w.mmc.seqBufLeftQer[l*CACHE_LINE]);
+        _mm_free(w.mmc.seqBufRightQer[l*CACHE_LINE]);
+    }
+
+    for(int l=0; l<nthreads; l++) {
+        free(w.mmc.seqPairArrayAux[l]);
+        free(w.mmc.seqPairArrayLeft128[l]);
+        free(w.mmc.seqPairArrayRight128[l]);
+    }
+
+    if (w.useErt) {
+        for (int i = 0 ; i < nthreads; ++i) {
+            kv_destroy(w.smems[i * MAX_LINE_LEN]);
+            kv_destroy(w.hits_ar[i * MAX_LINE_LEN]);
+            _mm_free(w.mmc.lim[i]);
+        }
+        free(w.smems);
+        free(w.hits_ar);
+    }
+    else {
+        for(int l=0; l<nthreads; l++) {
+            _mm_free(w.mmc.matchArray[l]);
+            free(w.mmc.min_intv_ar[l]);
+            free(w.mmc.query_pos_ar[l]);
+            free(w.mmc.enc_qdb[l]);
+            free(w.mmc.rid[l]);
+            _mm_free(w.mmc.lim[l]);
+        }
+	}
+}
+
+// bytes the records of the first input take in a FASTQ/FASTA file; every $step-th read is from it
+static int64_t bseq_input_bytes(int n, const bseq1_t *seqs, int step)
+{
+    int64_t l = 0;
+    for (int i = 0; i < n; i += step) {
+        const bseq1_t *s = &seqs[i];
+        l += strlen(s->name) + (s->comment? strlen(s->comment) + 1 : 0) + s->l_seq + 3;
+        if (s->qual) l += s->l_seq + 3;
+    }
+    return l;
+}
+
+static void bseq_free_chunk(int n, bseq1_t *seqs)
+{
+    for (int i = 0; i < n; ++i) {
+#ifdef OPT_RW
+        free(seqs[i].strbuf);
+#else
+        free(seqs[i].name); free(seqs[i].comment);
+        free(seqs[i].seq); free(seqs[i].qual);
+#endif
+    }
+    free(seqs);
+}
+
 ktp_data_t *kt_pipeline(void *shared, int step, void *data, mem_opt_t *opt, worker_t &w)
 {
     ktp_aux_t *aux = (ktp_aux_t*) shared;
@@ -318,10 +445,28 @@ ktp_data_t *kt_pipeline(void *shared, int step, void *data, mem_opt_t *opt, work
 
         /* Read "reads" from input file (fread) */
         int64_t sz = 0;
-        ret->seqs = bseq_read_orig(aux->task_size,
-                                   &ret->n_seqs,
-                                   aux->ks, aux->ks2,
-                                   &sz);
+        for (;;) {
+            // --shard: a chunk belongs to the shard whose range holds the input offset it starts at
+            int64_t off = aux->shard_off;
+            ret->seqs = bseq_read_orig(aux->task_size,
+                                       &ret->n_seqs,
+                                       aux->ks, aux->ks2,
+                                       &sz);
+            if (aux->shard_n == 0 || ret->seqs == 0) break;
+            aux->shard_off += bseq_input_bytes(ret->n_seqs, ret->seqs, aux->ks2? 2 : 1);
+            if (off >= aux->shard_hi) { // the next shard's; this one is done
+                bseq_free_chunk(ret->n_seqs, ret->seqs);
+                ret->seqs = 0;
+                break;
+            }
+            if (off >= aux->shard_lo) {
+                aux->shard_nseq += ret->n_seqs;
+                break;
+            }
+            // an earlier shard's chunk: only count its reads, before any chunk of this one is processed
+            aux->n_processed += ret->n_seqs;
+            bseq_free_chunk(ret->n_seqs, ret->seqs);
+        }
 
         tprof[READ_IO][0] += __rdtsc() - tim;
         
@@ -364,6 +509,7 @@ ktp_data_t *kt_pipeline(void *shared, int step, void *data, mem_opt_t *opt, work
 				ret->n_seqs * sizeof(mem_chain_v) +
 				sizeof(mem_seed_t) * ret->n_seqs * AVG_SEEDS_PER_READ;
             fprintf(stderr, "[0000] Memory re-allocation for Chaining (%d => %d): %0.4lf MB\n", w.nreads, ret->n_seqs, allocMem/1e6);
+            mem_stats.mem_chain = allocMem;
             w.nreads = ret->n_seqs;
             free(w.regs); free(w.chain_ar); free(w.seedBuf);
             w.regs = (mem_alnreg_v *) calloc(w.nreads, sizeof(mem_alnreg_v));
@@ -424,6 +570,11 @@ ktp_data_t *kt_pipeline(void *shared, int step, void *data, mem_opt_t *opt, work
                              w);
         }               
         tprof[MEM_PROCESS2][0] += __rdtsc() - tim;
+        // here rather than in step 2, which may still run when the next chunk enters step 1
+        aux->n_processed += ret->n_seqs;
+        mem_stats.n_chunks++;
+        mem_stats.n_reads += ret->n_seqs;
+        for (int i = 0; i < ret->n_seqs; ++i) mem_stats.n_bases += ret->seqs[i].l_seq;
                 
         return ret;
     }           
@@ -431,7 +582,6 @@ ktp_data_t *kt_pipeline(void *shared, int step, void *data, mem_opt_t *opt, work
     else if (step == 2)
     {
 		double rtime = realtime();
-        aux->n_processed += ret->n_seqs;
         uint64_t tim = __rdtsc();
         
 		for (int i = 0; i < ret->n_seqs; ++i)
@@ -488,6 +638,7 @@ static void *ktp_worker(void *data)
             pthread_ret = pthread_cond_wait(&p->cv, &p->mutex);
             assert(pthread_ret == 0);
         }
+        w->busy = 1, w->t_beg = __rdtsc();
         pthread_ret = pthread_mutex_unlock(&p->mutex);
         assert(pthread_ret == 0);
 
@@ -497,6 +648,7 @@ static void *ktp_worker(void *data)
         // update step and let other workers know
         pthread_ret = pthread_mutex_lock(&p->mutex);
         assert(pthread_ret == 0);
+        w->busy = 0, p->busy[w->step] += __rdtsc() - w->t_beg;
         w->step = w->step == p->n_steps - 1 || w->data? (w->step + 1) % p->n_steps : p->n_steps;
 
         if (w->step == 0) w->index = p->index++;
@@ -508,6 +660,114 @@ static void *ktp_worker(void *data)
     pthread_exit(0);
 }
 
+/*** --metrics: a progress snapshot rewritten every few seconds ***/
+typedef struct {
+    ktp_t *pl;
+    const char *fn;
+    int interval;       // seconds
+    int stop;
+    pthread_mutex_t mutex;
+    pthread_cond_t cv;
+    double t_beg, t_last;
+    int64_t n_last;
+    uint64_t busy_last[4];
+} metrics_t;
+
+static long metrics_rss_kb()
+{
+    long size, rss = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp == NULL) return 0;
+    if (fscanf(fp, "%ld %ld", &size, &rss) != 2) rss = 0;
+    fclose(fp);
+    return rss * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/* Written to FILE.tmp and renamed, so a reader never sees a partial one */
+static void metrics_write(metrics_t *m, int done)
+{
+    ktp_t *p = m->pl;
+    int n_steps = p->n_steps, n_wait[4] = {0}, i, j;
+    uint64_t busy[4], now = __rdtsc();
+    double t = realtime(), dt = t - m->t_last;
+    int64_t n_reads = __atomic_load_n(&mem_stats.n_reads, __ATOMIC_RELAXED);
+    int64_t n_bases = __atomic_load_n(&mem_stats.n_bases, __ATOMIC_RELAXED);
+    kstring_t str = {0, 0, 0};
+
+    if (done) { // the rates and occupancy of the last snapshot cover the whole run
+        m->t_last = m->t_beg, m->n_last = 0;
+        memset(m->busy_last, 0, sizeof(m->busy_last));
+        dt = t - m->t_beg;
+    }
+    ksprintf(&str, "{\n  \"done\": %s,\n  \"elapsed_sec\": %.1f,\n", done? "true" : "false", t - m->t_beg);
+    ksprintf(&str, "  \"chunks\": %ld,\n  \"reads\": %ld,\n  \"bases\": %ld,\n",
+             (long) __atomic_load_n(&mem_stats.n_chunks, __ATOMIC_RELAXED), (long) n_reads, (long) n_bases);
+    ksprintf(&str, "  \"reads_per_sec\": %.1f,\n  \"reads_per_sec_avg\": %.1f,\n",
+             dt > 0? (n_reads - m->n_last) / dt : 0., t > m->t_beg? n_reads / (t - m->t_beg) : 0.);
+
+    // pipeline: what each worker does, how many wait to enter each step, and the share of time in each step
+    pthread_mutex_lock(&p->mutex);
+    for (j = 0; j < n_steps; ++j) busy[j] = p->busy[j];
+    ksprintf(&str, "  \"pipeline\": {\n    \"workers\": [");
+    for (i = 0; i < p->n_workers; ++i) {
+        ktp_worker_t *w = &p->workers[i];
+        const char *state = w->step >= n_steps? "done" : w->busy? "run" : "wait";
+        if (w->step < n_steps && w->busy) busy[w->step] += now - w->t_beg;
+        else if (w->step < n_steps) ++n_wait[w->step];
+        ksprintf(&str, "%s{\"step\": %d, \"state\": \"%s\"}", i? ", " : "", w->step < n_steps? w->step : -1, state);
+    }
+    pthread_mutex_unlock(&p->mutex);
+    ksprintf(&str, "],\n    \"queue\": [");
+    for (j = 0; j < n_steps; ++j) ksprintf(&str, "%s%d", j? ", " : "", n_wait[j]);
+    ksprintf(&str, "],\n    \"occupancy\": [");
+    for (j = 0; j < n_steps; ++j) {
+        ksprintf(&str, "%s%.3f", j? ", " : "", dt > 0? (busy[j] - m->busy_last[j]) * 1.0 / proc_freq / dt : 0.);
+        m->busy_last[j] = busy[j];
+    }
+    ksprintf(&str, "]\n  },\n");
+
+#ifdef PERFECT_MATCH
+    {
+        uint64_t tot = 0, hit = 0;
+        for (i = 0; i < LIM_C; ++i) {
+            for (j = 0; j < NUM_PPROF_ENTRY; ++j) tot += __atomic_load_n(&tprof_th[i].pprof[j], __ATOMIC_RELAXED);
+            hit += __atomic_load_n(&tprof_th[i].pprof2[0], __ATOMIC_RELAXED) +
+                   __atomic_load_n(&tprof_th[i].pprof2[1], __ATOMIC_RELAXED);
+        }
+        ksprintf(&str, "  \"emf\": {\"total\": %lu, \"hit\": %lu, \"hit_rate\": %.4f},\n",
+                 tot, hit, tot? hit * 1.0 / tot : 0.);
+    }
+#else
+    ksprintf(&str, "  \"emf\": null,\n");
+#endif
+    ksprintf(&str, "  \"rss_kb\": %ld\n}\n", metrics_rss_kb());
+    m->t_last = t, m->n_last = n_reads;
+
+    char *tmp = (char*) malloc(strlen(m->fn) + 5);
+    assert(tmp != NULL);
+    sprintf(tmp, "%s.tmp", m->fn);
+    FILE *fp;
+    if ((fp = fopen(tmp, "w")) == 0 || fwrite(str.s, 1, str.l, fp) != str.l || fclose(fp) != 0 || rename(tmp, m->fn) != 0)
+        fprintf(stderr, "[W::%s] failed to write metrics to '%s'\n", __func__, m->fn);
+    free(tmp);
+    free(str.s);
+}
+
+static void *metrics_worker(void *data)
+{
+    metrics_t *m = (metrics_t*) data;
+    pthread_mutex_lock(&m->mutex);
+    while (!m->stop) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += m->interval;
+        if (pthread_cond_timedwait(&m->cv, &m->mutex, &ts) == ETIMEDOUT && !m->stop)
+            metrics_write(m, 0);
+    }
+    pthread_mutex_unlock(&m->mutex);
+    return 0;
+}
+
 /* TODO: change ert_idx_prefix to (int) useErt */
 static int process(void *shared, gzFile gfp, gzFile gfp2, int pipe_threads)
 {
@@ -612,11 +872,24 @@ static int process(void *shared, gzFile gfp, gzFile gfp2, int pipe_threads)
     int32_t nreads = aux->actual_chunk_size / hint_readLen + 10;
     
 	/* All memory allocation */
-    if (aux->useErt) {
-        memoryAllocErt(aux, w, nreads, nthreads);
+    if (mem_resident && mem_resident->w && mem_resident->w_nreads == nreads &&
+        mem_resident->w_nthreads == nthreads && mem_resident->w->useErt == aux->useErt) {
+        w = *mem_resident->w; // same shape as the previous job of 'serve'
+        memoryFreeSeedSW(w, nthreads); // the scoring may differ
+        fprintf(stderr, "* Reusing the worker buffers of the previous job\n");
     }
     else {
-        memoryAlloc(aux, w, nreads, nthreads);
+        if (mem_resident && mem_resident->w) {
+            memoryFree(*mem_resident->w, mem_resident->w_nthreads);
+            free(mem_resident->w);
+            mem_resident->w = NULL;
+        }
+        if (aux->useErt) {
+            memoryAllocErt(aux, w, nreads, nthreads);
+        }
+        else {
+            memoryAlloc(aux, w, nreads, nthreads);
+        }
     }
     fprintf(stderr, "* Threads used (compute): %d\n", nthreads);
     
@@ -627,6 +900,9 @@ static int process(void *shared, gzFile gfp, gzFile gfp2, int pipe_threads)
    
     w.ref_string = aux->ref_string;
     w.fmi = aux->fmi;
+    w.rcache = opt->rcache_size > 0? read_cache_init(opt->rcache_size) : NULL;
+    w.peacc = aux->pestream && (opt->flag & MEM_F_PE) && aux->pes0 == 0?
+        mem_pestat_acc_init(opt, nthreads, aux->pestat_fn, bwa_rg_id) : NULL;
     w.nreads  = nreads;
     // w.memSize = nreads;
     
@@ -634,6 +910,7 @@ static int process(void *shared, gzFile gfp, gzFile gfp2, int pipe_threads)
     aux_.n_steps = n_steps;
     aux_.shared = aux;
     aux_.index = 0;
+    memset(aux_.busy, 0, sizeof(aux_.busy));
     int pthread_ret = pthread_mutex_init(&aux_.mutex, 0);
     assert(pthread_ret == 0);
     pthread_ret = pthread_cond_init(&aux_.cv, 0);
@@ -650,6 +927,7 @@ static int process(void *shared, gzFile gfp, gzFile gfp2, int pipe_threads)
         wr->i = i;
         wr->opt = opt;
         wr->w = &w;
+        wr->busy = 0;
     }
     
     pthread_t *ptid = (pthread_t *) calloc(p_nt, sizeof(pthread_t));
@@ -657,10 +935,32 @@ static int process(void *shared, gzFile gfp, gzFile gfp2, int pipe_threads)
     
     for (int i = 0; i < p_nt; ++i)
         pthread_create(&ptid[i], 0, ktp_worker, (void*) &aux_.workers[i]);
+
+    metrics_t met;
+    pthread_t met_tid;
+    if (aux->metrics_fn) {
+        memset(&met, 0, sizeof(met));
+        met.pl = &aux_, met.fn = aux->metrics_fn, met.interval = aux->metrics_sec;
+        met.t_beg = met.t_last = realtime();
+        pthread_mutex_init(&met.mutex, 0);
+        pthread_cond_init(&met.cv, 0);
+        pthread_create(&met_tid, 0, metrics_worker, &met);
+    }
     
     for (int i = 0; i < p_nt; ++i)
         pthread_join(ptid[i], 0);
 
+    if (aux->metrics_fn) {
+        pthread_mutex_lock(&met.mutex);
+        met.stop = 1;
+        pthread_cond_signal(&met.cv);
+        pthread_mutex_unlock(&met.mutex);
+        pthread_join(met_tid, 0);
+        metrics_write(&met, 1);
+        pthread_mutex_destroy(&met.mutex);
+        pthread_cond_destroy(&met.cv);
+    }
+
     pthread_ret = pthread_mutex_destroy(&aux_.mutex);
     assert(pthread_ret == 0);
     pthread_ret = pthread_cond_destroy(&aux_.cv);
@@ -673,44 +973,19 @@ static int process(void *shared, gzFile gfp, gzFile gfp2, int pipe_threads)
     fprintf(stderr, "[0000] Computation ends..\n");
     
     /* Dealloc memory allcoated in the header section */    
-    free(w.chain_ar);
-    free(w.regs);
-    free(w.seedBuf);
-    
-    for(int l=0; l<nthreads; l++) {
-        _mm_free(w.mmc.seqBufLeftRef[l*CACHE_LINE]);
-        _mm_free(w.mmc.seqBufRightRef[l*CACHE_LINE]);
-        _mm_free(w.mmc.seqBufLeftQer[l*CACHE_LINE]);
-        _mm_free(w.mmc.seqBufRightQer[l*CACHE_LINE]);
-    }
-
-    for(int l=0; l<nthreads; l++) {
-        free(w.mmc.seqPairArrayAux[l]);
-        free(w.mmc.seqPairArrayLeft128[l]);
-        free(w.mmc.seqPairArrayRight128[l]);
-    }
-
-    if (aux->useErt) {
-        for (int i = 0 ; i < nthreads; ++i) {
-            kv_destroy(w.smems[i * MAX_LINE_LEN]);
-            kv_destroy(w.hits_ar[i * MAX_LINE_LEN]);
-            _mm_free(w.mmc.lim[i]);
+    read_cache_destroy(w.rcache);
+    int ret = mem_pestat_acc_destroy(w.peacc);
+    if (mem_resident) { // keep the buffers warm for the next job
+        if (mem_resident->w == NULL) {
+            mem_resident->w = (worker_t*) malloc(sizeof(worker_t));
+            assert(mem_resident->w != NULL);
         }
-        free(w.smems);
-        free(w.hits_ar);
+        *mem_resident->w = w;
+        mem_resident->w_nreads = nreads, mem_resident->w_nthreads = nthreads;
     }
-    else {
-        for(int l=0; l<nthreads; l++) {
-            _mm_free(w.mmc.matchArray[l]);
-            free(w.mmc.min_intv_ar[l]);
-            free(w.mmc.query_pos_ar[l]);
-            free(w.mmc.enc_qdb[l]);
-            free(w.mmc.rid[l]);
-            _mm_free(w.mmc.lim[l]);
-        }
-	}
+    else memoryFree(w, nthreads);
 
-    return 0;
+    return ret;
 }
 
 static void update_a(mem_opt_t *opt, const mem_opt_t *opt0)
@@ -870,6 +1145,8 @@ static void usage(const mem_opt_t *opt)
     fprintf(stderr, "    -k INT        minimum seed length [%d]\n", opt->min_seed_len);
     fprintf(stderr, "    -w INT        band width for banded alignment [%d]\n", opt->w);
     fprintf(stderr, "    -d INT        off-diagonal X-dropoff [%d]\n", opt->zdrop);
+    fprintf(stderr, "    -e STR        seed extension engine: bsw (banded DP), wfa (wavefront) or wfa-check\n");
+    fprintf(stderr, "                  (wavefront checked against banded DP, DP results kept) [bsw]\n");
     fprintf(stderr, "    -r FLOAT      look for internal seeds inside a seed longer than {-k} * FLOAT [%g]\n", opt->split_factor);
     fprintf(stderr, "    -y INT        seed occurrence for the 3rd round seeding [%ld]\n", (long)opt->max_mem_intv);
     fprintf(stderr, "    -c INT        skip seeds with more than INT occurrences [%d]\n", opt->max_occ);
@@ -897,6 +1174,7 @@ static void usage(const mem_opt_t *opt)
     fprintf(stderr, "   -5            for split alignment, take the alignment with the smallest coordinate as primary\n");
     fprintf(stderr, "   -q            don't modify mapQ of supplementary alignments\n");
     fprintf(stderr, "   -K INT        process INT input bases in each batch regardless of nThreads (for reproducibility) []\n");    
+    fprintf(stderr, "   -u INT        reuse alignments of reads whose sequence was seen among the last INT distinct reads (0 to disable) [%ld]\n", (long) opt->rcache_size);
     fprintf(stderr, "   -v INT        verbose level: 1=error, 2=warning, 3=message, 4+=debugging [%d]\n", bwa_verbose);
     fprintf(stderr, "   -T INT        minimum score to output [%d]\n", opt->T);
     fprintf(stderr, "   -h INT[,INT]  if there are <INT hits with score >80%% of the max score, output all in XA [%d,%d]\n", opt->max_XA_hits, opt->max_XA_hits_alt);
@@ -909,16 +1187,197 @@ static void usage(const mem_opt_t *opt)
     fprintf(stderr, "                 specify the mean, standard deviation (10%% of the mean if absent), max\n");
     fprintf(stderr, "                 (4 sigma from the mean if absent) and min of the insert size distribution.\n");
     fprintf(stderr, "                 FR orientation only. [inferred]\n");
+    fprintf(stderr, "   -z STR[,FILE] insert size inference: 'chunk' per chunk, or 'stream' accumulated across\n");
+    fprintf(stderr, "                 chunks and used for the next chunk; priors per read group kept in FILE [chunk]\n");
+    fprintf(stderr, "   --shard INT/INT\n");
+    fprintf(stderr, "                 only align the i-th of N byte ranges of the (uncompressed or gzip) input;\n");
+    fprintf(stderr, "                 'bwa-mem2 merge' joins the N outputs into the output of a single run\n");
+    fprintf(stderr, "   --stats-json FILE\n");
+    fprintf(stderr, "                 write the runtime profile (stage times, throughput, exact match filter,\n");
+    fprintf(stderr, "                 pre-allocation and shm state) to FILE as JSON\n");
+    fprintf(stderr, "   --perf-counters\n");
+    fprintf(stderr, "                 count cycles, instructions, LLC/dTLB misses and stalls per thread in\n");
+    fprintf(stderr, "                 SMEM, SA lookup, BSW and SAM and report them with the runtime profile\n");
+    fprintf(stderr, "   --slow-reads K[,FILE]\n");
+    fprintf(stderr, "                 time every read and report the K slowest with their stage times and SMEM,\n");
+    fprintf(stderr, "                 SA hit, chain, seed and region counts; write them to FILE as FASTQ (paired\n");
+    fprintf(stderr, "                 reads interleaved with their mates, to re-run with -p)\n");
+    fprintf(stderr, "   --metrics FILE[,SEC]\n");
+    fprintf(stderr, "                 every SEC seconds [10], replace FILE with a JSON progress snapshot: reads\n");
+    fprintf(stderr, "                 done, reads/s, pipeline stage occupancy and queues, exact match hit rate, RSS\n");
+    fprintf(stderr, "   --capture FILE[,N]\n");
+    fprintf(stderr, "                 write the inputs and outputs of one in N [%d] SMEM searches and banded DP\n", CAP_EVERY);
+    fprintf(stderr, "                 kernel calls to FILE, to replay with 'bwa-mem2.bench -R FILE'\n");
     fprintf(stderr, "   -Z            Use ERT index for seeding\n");
     fprintf(stderr, "Note: Please read the man page for detailed description of the command line and options.\n");
 }
 
+/* -l INT, shared by 'mem' and 'serve' */
+static void mem_opt_l(int p, int *pt_seed_len)
+{
+#if defined(PERFECT_MATCH) || defined(USE_SHM)
+	if (p > 0) {
+#ifdef PERFECT_MATCH
+		*pt_seed_len = p;
+#endif
+#ifdef USE_SHM
+		hint_readLen = p;
+#endif
+	} 
+#ifdef PERFECT_MATCH
+	else if (p == 0) {
+		*pt_seed_len = PT_SEED_LEN_AUTO_TABLE;
+	}
+#endif
+#endif
+}
+
+/* Attach (shm) or load the FM-index or ERT, the reference string and the perfect table */
+static void mem_index_load(const char *prefix, int *useErt, int pt_seed_len,
+                           FMI_search **fmi, uint8_t **ref_string)
+{
+	uint64_t beg, end;
+#ifdef USE_SHM
+	bwa_shm_init(prefix, useErt, pt_seed_len, BWA_SHM_INIT_READ);
+#endif
+    beg = __rdtsc();
+    
+    fprintf(stderr, "* Ref file: %s\n", prefix);
+    *fmi = new FMI_search(prefix);
+    if (!*useErt) {
+        (*fmi)->load_index();
+    }
+    else {
+        (*fmi)->load_index_other_elements(BWA_IDX_BNS | BWA_IDX_PAC);
+		(*fmi)->load_ert_index();
+    }
+	(*fmi)->useErt = *useErt;
+	
+	end = __rdtsc();
+    tprof[FMI][0] += end - beg;
+    
+    // reading ref string from the file
+    beg = __rdtsc();
+    fprintf(stderr, "* Reading reference genome..\n");
+	load_ref_string(prefix, ref_string); 
+
+    end  = __rdtsc();
+    tprof[REF_IO][0] += end - beg;
+    
+	fprintf(stderr, "* Done reading reference genome !!\n\n");
+		
+#ifdef PERFECT_MATCH
+	if (pt_seed_len != PT_SEED_LEN_NO_TABLE) {
+		beg = __rdtsc();
+		load_perfect_table(prefix, pt_seed_len, ref_string, *fmi);
+		end = __rdtsc();
+		tprof[PERFECT_TABLE_READ][0] = end - beg;
+	}
+#endif
+#ifdef USE_SHM
+	bwa_shm_complete(BWA_SHM_INIT_READ);
+#endif
+}
+
+static void mem_index_free(FMI_search *fmi, uint8_t *ref_string)
+{
+	if (ref_string) {
+#ifdef USE_SHM
+		if (bwa_shm_unmap(BWA_SHM_REF))
+#endif
+			_mm_free(ref_string);
+	}
+    if (fmi) delete(fmi); 
+
+#ifdef PERFECT_MATCH
+	free_perfect_table();
+#endif
+#ifdef USE_SHM
+	bwa_shm_final(BWA_SHM_INIT_READ);
+#endif
+}
+
+/* Uncompressed size of a --shard input: the file size, unless it is gzip or
+ * BGZF, which is read through once. Shards skip what precedes their range by
+ * parsing it anyway: chunk boundaries, n_processed and the per-chunk insert
+ * size estimate all depend on every record before, so seeking cannot give
+ * the output of a single run. */
+static int64_t shard_input_size(const char *fn, int64_t st_size)
+{
+    gzFile fp = gzopen(fn, "r");
+    int64_t size = 0;
+    int n;
+    if (fp == 0) {
+        fprintf(stderr, "[E::%s] fail to open file `%s'.\n", __func__, fn);
+        exit(EXIT_FAILURE);
+    }
+    if (gzdirect(fp)) size = st_size;
+    else {
+        uint8_t *buf = (uint8_t*) malloc(1<<20);
+        assert(buf != NULL);
+        while ((n = gzread(fp, buf, 1<<20)) > 0) size += n;
+        free(buf);
+    }
+    gzclose(fp);
+    return size;
+}
+
+mem_resident_t *mem_resident = NULL;
+
+// $prefix with its directory made absolute, so that jobs from any directory compare equal
+static char *mem_prefix_abs(const char *prefix)
+{
+    const char *base = strrchr(prefix, '/');
+    char *dir = base? strndup(prefix, base - prefix + 1) : strdup(".");
+    char *abs_dir = realpath(dir, NULL), *ret;
+    base = base? base + 1 : prefix;
+    if (abs_dir == NULL) ret = strdup(prefix);
+    else {
+        ret = (char*) malloc(strlen(abs_dir) + strlen(base) + 2);
+        assert(ret != NULL);
+        sprintf(ret, "%s/%s", abs_dir, base);
+    }
+    free(dir); free(abs_dir);
+    return ret;
+}
+
+mem_resident_t *mem_resident_load(const char *prefix, int useErt, int l)
+{
+    mem_resident_t *r = (mem_resident_t*) calloc(1, sizeof(mem_resident_t));
+    assert(r != NULL);
+#ifdef PERFECT_MATCH
+    r->pt_seed_len0 = r->pt_seed_len = PT_SEED_LEN_NO_TABLE;
+#endif
+    if (l >= 0) mem_opt_l(l, &r->pt_seed_len);
+    r->read_len = hint_readLen;
+    r->prefix = mem_prefix_abs(prefix);
+    mem_index_load(prefix, &useErt, r->pt_seed_len, &r->fmi, &r->ref_string);
+    r->useErt = useErt;
+    r->is_alt = (uint8_t*) malloc(r->fmi->idx->bns->n_seqs + 1);
+    assert(r->is_alt != NULL);
+    for (int i = 0; i < r->fmi->idx->bns->n_seqs; ++i)
+        r->is_alt[i] = r->fmi->idx->bns->anns[i].is_alt;
+    return r;
+}
+
+void mem_resident_free(mem_resident_t *r)
+{
+    if (r == NULL) return;
+    if (r->w) {
+        memoryFree(*r->w, r->w_nthreads);
+        free(r->w);
+    }
+    mem_index_free(r->fmi, r->ref_string);
+    free(r->is_alt); free(r->prefix);
+    free(r);
+}
+
 int main_mem(int argc, char *argv[])
 {
     int          i, c, ignore_alt = 0, n_mt_io = 2;
     int          fixed_chunk_size          = -1;
     char        *p, *rg_line               = 0, *hdr_line = 0;
-    const char  *mode                      = 0;
+    const char  *mode                      = 0, *stats_fn = 0;
 #ifdef USE_SHM
     int useErt = -1; /* if undefined, use bwa_shm's */
 #else
@@ -926,20 +1385,32 @@ int main_mem(int argc, char *argv[])
 #endif
     
     mem_opt_t    *opt, opt0;
-    gzFile        fp, fp2 = 0;
+    gzFile        fp = 0, fp2 = 0;
     void         *ko = 0, *ko2 = 0;
     int           fd, fd2;
     mem_pestat_t  pes[4];
     ktp_aux_t     aux;
     bool          is_o    = 0;
-    uint8_t      *ref_string;
+    uint8_t      *ref_string = 0;
 #ifdef PERFECT_MATCH
 	int perfect_table_seed_len = PT_SEED_LEN_NO_TABLE;
+#else
+	int perfect_table_seed_len = 0; /* not used */
 #endif
-	int retval = 0;
+	const int    useErt_dflt = useErt;
+	int retval = 0, nthreads, perf_counters = 0, slow_k = 0;
+	const char *slow_fn = 0, *cap_fn = 0;
+	int cap_every = CAP_EVERY;
 	uint64_t beg, end;
 
     memset_s(&aux, sizeof(ktp_aux_t), 0);
+    // the pre-allocation sizes stay: they describe buffers a resident server may reuse
+    mem_stats.n_chunks = mem_stats.n_reads = mem_stats.n_bases = 0;
+    mem_stats.n_exact_flanks = mem_stats.n_wfa = mem_stats.n_wfa_dp = mem_stats.n_wfa_diff = 0;
+    read_cache_reset_stats();
+#ifdef USE_SHM
+    if (mem_resident) hint_readLen = mem_resident->read_len; // undo -l of the previous job
+#endif
     memset_s(pes, 4 * sizeof(mem_pestat_t), 0);
     for (i = 0; i < 4; ++i) pes[i].failed = 1;
     
@@ -949,7 +1420,16 @@ int main_mem(int argc, char *argv[])
     memset_s(&opt0, sizeof(mem_opt_t), 0);
     /* Parse input arguments */
     // comment: added option '5' in the list
-    while ((c = getopt(argc, argv, "5i:qpaMCSPVYjk:c:v:s:r:t:R:A:B:O:E:U:w:L:d:T:Q:D:m:I:N:W:x:G:h:y:K:X:H:o:f:l:bZ:")) >= 0)
+    static struct option long_opts[] = {
+        { "shard", required_argument, 0, 300 },
+        { "stats-json", required_argument, 0, 301 },
+        { "metrics", required_argument, 0, 302 },
+        { "perf-counters", no_argument, 0, 303 },
+        { "slow-reads", required_argument, 0, 304 },
+        { "capture", required_argument, 0, 305 },
+        { 0, 0, 0, 0 }
+    };
+    while ((c = getopt_long(argc, argv, "5i:qpaMCSPVYjk:c:v:s:r:t:R:A:B:O:E:U:w:L:d:T:Q:D:m:I:N:W:x:G:h:y:K:X:H:o:f:l:bZ:u:e:z:", long_opts, 0)) >= 0)
     {
         if (c == 'k') opt->min_seed_len = atoi(optarg), opt0.min_seed_len = 1;
 		else if (c == 'b') opt_bwa_shm_map_touch = 1;
@@ -963,32 +1443,15 @@ int main_mem(int argc, char *argv[])
             opt->pen_unpaired = atoi(optarg), opt0.pen_unpaired = 1, assert(opt->pen_unpaired >= INT_MIN && opt->pen_unpaired <= INT_MAX);
         else if (c == 't')
             opt->n_threads = atoi(optarg), opt->n_threads = opt->n_threads > 1? opt->n_threads : 1, assert(opt->n_threads >= INT_MIN && opt->n_threads <= INT_MAX);
-		else if (c == 'l')
-		{
-#if defined(PERFECT_MATCH) || defined(USE_SHM)
-			int p = atoi(optarg);
-			if (p > 0) {
-#ifdef PERFECT_MATCH
-				perfect_table_seed_len = p;
-#endif
-#ifdef USE_SHM
-				hint_readLen = p;
-#endif
-			} 
-#ifdef PERFECT_MATCH
-			else if (p == 0) {
-				perfect_table_seed_len = PT_SEED_LEN_AUTO_TABLE;
-			}
-#endif
-#endif
-		}
+		else if (c == 'l') mem_opt_l(atoi(optarg), &perfect_table_seed_len);
         else if (c == 'o' || c == 'f')
         {
             is_o = 1;
             aux.fp = fopen(optarg, "w");
             if (aux.fp == NULL) {
                 fprintf(stderr, "Error: can't open %s input file\n", optarg);
-                exit(EXIT_FAILURE);
+                retval = EXIT_FAILURE;
+                goto out;
             }
             /*fclose(aux.fp);*/
         }
@@ -1020,6 +1483,69 @@ int main_mem(int argc, char *argv[])
             opt->max_mem_intv = atol(optarg), opt0.max_mem_intv = 1;
         else if (c == 'C') aux.copy_comment = 1;
         else if (c == 'K') fixed_chunk_size = atoi(optarg);
+        else if (c == 'e') {
+            if (strcmp(optarg, "bsw") == 0) opt->flag &= ~(MEM_F_WFA | MEM_F_WFA_CHECK);
+            else if (strcmp(optarg, "wfa") == 0) opt->flag |= MEM_F_WFA, opt->flag &= ~MEM_F_WFA_CHECK;
+            else if (strcmp(optarg, "wfa-check") == 0) opt->flag |= MEM_F_WFA | MEM_F_WFA_CHECK;
+            else {
+                fprintf(stderr, "[E::%s] unknown extension engine '%s'\n", __func__, optarg);
+                retval = EXIT_FAILURE;
+                goto out;
+            }
+        }
+        else if (c == 'z') {
+            char *q = strchr(optarg, ',');
+            if (q) *q++ = 0;
+            if (strcmp(optarg, "chunk") == 0 && q == 0) aux.pestream = 0;
+            else if (strcmp(optarg, "stream") == 0) aux.pestream = 1, aux.pestat_fn = q && *q? q : 0;
+            else {
+                fprintf(stderr, "[E::%s] unknown insert size inference mode '%s'\n", __func__, optarg);
+                retval = EXIT_FAILURE;
+                goto out;
+            }
+        }
+        else if (c == 300) {
+            if (sscanf(optarg, "%d/%d", &aux.shard_i, &aux.shard_n) != 2 ||
+                aux.shard_n < 1 || aux.shard_i < 0 || aux.shard_i >= aux.shard_n) {
+                fprintf(stderr, "[E::%s] --shard takes i/N with 0 <= i < N\n", __func__);
+                retval = EXIT_FAILURE;
+                goto out;
+            }
+        }
+        else if (c == 301) stats_fn = optarg;
+        else if (c == 303) perf_counters = 1;
+        else if (c == 304) { // K[,FILE]
+            slow_k = strtol(optarg, &p, 10);
+            if (*p == ',' && p[1]) slow_fn = p + 1;
+            else if (*p) slow_k = 0;
+            if (slow_k < 1) {
+                fprintf(stderr, "[E::%s] --slow-reads takes K[,FILE] with K >= 1\n", __func__);
+                retval = EXIT_FAILURE;
+                goto out;
+            }
+        }
+        else if (c == 305) { // FILE[,N]
+            char *q = strrchr(optarg, ',');
+            if (q && isdigit(q[1])) *q = 0, cap_every = atoi(q + 1);
+            if (cap_every < 1 || *optarg == 0) {
+                fprintf(stderr, "[E::%s] --capture takes FILE[,N] with N >= 1\n", __func__);
+                retval = EXIT_FAILURE;
+                goto out;
+            }
+            cap_fn = optarg;
+        }
+        else if (c == 302) { // FILE[,SEC]
+            char *q = strrchr(optarg, ',');
+            aux.metrics_sec = 10;
+            if (q && isdigit(q[1])) *q = 0, aux.metrics_sec = atoi(q + 1);
+            if (aux.metrics_sec < 1 || *optarg == 0) {
+                fprintf(stderr, "[E::%s] --metrics takes FILE[,SEC] with SEC >= 1\n", __func__);
+                retval = EXIT_FAILURE;
+                goto out;
+            }
+            aux.metrics_fn = optarg;
+        }
+        else if (c == 'u') opt->rcache_size = atol(optarg), opt->rcache_size = opt->rcache_size > 0? opt->rcache_size : 0;
         else if (c == 'X') opt->mask_level = atof(optarg);
         else if (c == 'h')
         {
@@ -1116,6 +1642,7 @@ int main_mem(int argc, char *argv[])
     {
         hdr_line = bwa_insert_header(rg_line, hdr_line);
         free(rg_line);
+        rg_line = 0;
     }
 
     if (opt->n_threads < 1) opt->n_threads = 1;
@@ -1168,70 +1695,55 @@ int main_mem(int argc, char *argv[])
         }
     } else update_a(opt, &opt0);
 
-#if defined(PERFECT_MATCH) && (__AVX512BW__)
-	if (perfect_table_seed_len != PT_SEED_LEN_NO_TABLE && (opt->flag & MEM_F_PE || optind + 2 < argc)) {
-		fprintf(stderr, "[ERROR] when arch=avx512, perfect match cannot be used with paired-end input yet.\n");
-		retval = EXIT_FAILURE;
-		goto out;
-	}
-#endif
-#ifdef USE_SHM
-	bwa_shm_init(argv[optind], &useErt, perfect_table_seed_len, BWA_SHM_INIT_READ);
-#endif
-    
     /* Matrix for SWA */
     bwa_fill_scmat(opt->a, opt->b, opt->mat);
-    
-    /* Load bwt2/FMI index */
-    beg = __rdtsc();
-    
-    fprintf(stderr, "* Ref file: %s\n", argv[optind]);
-	aux.useErt = useErt;
-    if (!useErt) {
-        aux.fmi = new FMI_search(argv[optind]);
-        aux.fmi->load_index();
-    }
-    else {
-        aux.fmi = new FMI_search(argv[optind]);
-        aux.fmi->load_index_other_elements(BWA_IDX_BNS | BWA_IDX_PAC);
-		aux.fmi->load_ert_index();
+
+    perfctr_on = 0;
+    if (perf_counters) perfctr_init(); // warns and stays off where counting is not permitted
+    rtrace_init(slow_k, slow_fn);
+    if (cap_fn) {
+        char *prefix = mem_prefix_abs(argv[optind]); // for the replay to find the index
+        int ret = capture_init(cap_fn, cap_every, opt, prefix);
+        free(prefix);
+        if (ret < 0) {
+            retval = EXIT_FAILURE;
+            goto out;
+        }
     }
-	aux.fmi->useErt = useErt;
-	
-	end = __rdtsc();
-    tprof[FMI][0] += end - beg;
     
-    // reading ref string from the file
-    beg = __rdtsc();
-    fprintf(stderr, "* Reading reference genome..\n");
-	load_ref_string(argv[optind], &ref_string); 
+#ifdef PERFECT_MATCH
+	memset(pprof, 0, sizeof(uint64_t) * LIM_C * NUM_PPROF_ENTRY);
+	memset(pprof2, 0, sizeof(uint64_t) * LIM_C * 2);
+#endif
+    /* Load bwt2/FMI index, or take the one kept by 'serve' */
+    if (mem_resident) {
+        char *prefix = mem_prefix_abs(argv[optind]);
+        if (strcmp(prefix, mem_resident->prefix) != 0 ||
+            (useErt != useErt_dflt && useErt != mem_resident->useErt) ||
+            (perfect_table_seed_len != mem_resident->pt_seed_len0 &&
+             perfect_table_seed_len != mem_resident->pt_seed_len)) {
+            fprintf(stderr, "[E::%s] the server holds index '%s'; the job asks for '%s' or different -Z/-l\n",
+                    __func__, mem_resident->prefix, prefix);
+            free(prefix);
+            retval = EXIT_FAILURE;
+            goto out;
+        }
+        free(prefix);
+        fprintf(stderr, "* Ref file: %s (resident)\n", argv[optind]);
+        aux.fmi = mem_resident->fmi;
+        useErt = mem_resident->useErt;
+        ref_string = mem_resident->ref_string;
+        for (i = 0; i < aux.fmi->idx->bns->n_seqs; ++i)
+            aux.fmi->idx->bns->anns[i].is_alt = mem_resident->is_alt[i];
+    }
+    else mem_index_load(argv[optind], &useErt, perfect_table_seed_len, &aux.fmi, &ref_string);
+	aux.useErt = useErt;
    	aux.ref_string = ref_string;
-
-    end  = __rdtsc();
-    tprof[REF_IO][0] += end - beg;
-    
-	fprintf(stderr, "* Done reading reference genome !!\n\n");
     
     if (ignore_alt) {
         for (i = 0; i < aux.fmi->idx->bns->n_seqs; ++i)
             aux.fmi->idx->bns->anns[i].is_alt = 0;
 	}
-		
-#ifdef PERFECT_MATCH
-	memset(pprof, 0, sizeof(uint64_t) * LIM_C * NUM_PPROF_ENTRY);
-	memset(pprof2, 0, sizeof(uint64_t) * LIM_C * 2);
-	if (perfect_table_seed_len != PT_SEED_LEN_NO_TABLE) {
-		beg = __rdtsc();
-		uint8_t **reference;
-		reference = &ref_string;
-		load_perfect_table(argv[optind], perfect_table_seed_len, reference, aux.fmi);
-		end = __rdtsc();
-		tprof[PERFECT_TABLE_READ][0] = end - beg;
-	}
-#endif
-#ifdef USE_SHM
-	bwa_shm_complete(BWA_SHM_INIT_READ);
-#endif
 
     /* READS file operations */
     ko = kopen(argv[optind + 1], &fd);
@@ -1240,6 +1752,25 @@ int main_mem(int argc, char *argv[])
 		retval = EXIT_FAILURE;
 		goto out;
     }
+    if (aux.shard_n) {
+        struct stat st;
+        // both depend on every chunk before the current one, which a shard does not align
+        if (aux.pestream || opt->rcache_size > 0) {
+            fprintf(stderr, "[E::%s] --shard does not work with -z stream or -u\n", __func__);
+            retval = EXIT_FAILURE;
+            goto out;
+        }
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            fprintf(stderr, "[E::%s] --shard needs a regular input file\n", __func__);
+            retval = EXIT_FAILURE;
+            goto out;
+        }
+        int64_t size = shard_input_size(argv[optind + 1], st.st_size);
+        aux.shard_lo = size * aux.shard_i / aux.shard_n;
+        aux.shard_hi = aux.shard_i + 1 < aux.shard_n? size * (aux.shard_i + 1) / aux.shard_n : INT64_MAX;
+        fprintf(stderr, "* Shard %d/%d: chunks starting in [%ld, %ld) of the %ld bytes of %s\n", aux.shard_i, aux.shard_n,
+                (long)aux.shard_lo, (long)(aux.shard_i + 1 < aux.shard_n? aux.shard_hi : size), (long)size, argv[optind + 1]);
+    }
     // fp = gzopen(argv[optind + 1], "r");
     fp = gzdopen(fd, "r");
     aux.ks = kseq_init(fp);
@@ -1269,6 +1800,7 @@ int main_mem(int argc, char *argv[])
     }
 
     bwa_print_sam_hdr(aux.fmi->idx->bns, hdr_line, aux.fp);
+    if (aux.shard_n) fprintf(aux.fp, "@CO\tshard:%d/%d\n", aux.shard_i, aux.shard_n); // checked and dropped by 'merge'
 
     if (fixed_chunk_size > 0)
         aux.task_size = fixed_chunk_size;
@@ -1281,18 +1813,24 @@ int main_mem(int argc, char *argv[])
     beg = __rdtsc();
 
     /* Relay process function */
-    process(&aux, fp, fp2, n_mt_io);
+    if (process(&aux, fp, fp2, n_mt_io) != 0) retval = EXIT_FAILURE;
+    if (aux.shard_n && aux.shard_nseq == 0) // no chunk starts in its range: fewer chunks (-K) than shards
+        fprintf(stderr, "[W::%s] shard %d/%d received no reads; the input has fewer chunks than shards\n",
+                __func__, aux.shard_i, aux.shard_n);
    
    	end = __rdtsc();
     tprof[PROCESS][0] += end - beg;
 
-    // free memory
+out:
 #ifdef USE_SHM
-	if (bwa_shm_unmap(BWA_SHM_REF))
+    mem_stats.shm_mode = bwa_shm_mode;
+    mem_stats.shm_hugetlb = bwa_shm_hugetlb_flags();
+    mem_stats.n_shm = bwa_shm_components(mem_stats.shm_name, mem_stats.shm_on, NUM_STATS_SHM);
+#else
+    mem_stats.shm_mode = -1;
 #endif
-    	_mm_free(ref_string);
-
-out:
+    nthreads = opt->n_threads;
+	if (rg_line) free(rg_line); // an option after -R failed
 	if (hdr_line) free(hdr_line);
     if (opt) free(opt);
     if (aux.ks) kseq_destroy(aux.ks);   
@@ -1307,18 +1845,17 @@ out:
     if (is_o && aux.fp) fclose(aux.fp);
 
     // new bwt/FMI
-    if (aux.fmi) delete(aux.fmi); 
-
-#ifdef PERFECT_MATCH
-	free_perfect_table();
-#endif
-#ifdef USE_SHM
-	bwa_shm_final(BWA_SHM_INIT_READ);
-#endif
+    if (!mem_resident) mem_index_free(aux.fmi, ref_string);
 
     /* Display runtime profiling stats */
     tprof[MEM][0] = __rdtsc() - tprof[MEM][0];
-    display_stats(aux.opt->n_threads);
+    tprof_merge();
+    display_stats(nthreads);
+    if (stats_fn && !display_stats_json(stats_fn, nthreads) && retval == 0)
+        retval = EXIT_FAILURE;
+    if (!rtrace_dump() && retval == 0) retval = EXIT_FAILURE;
+    if (capture_close() < 0 && retval == 0) retval = EXIT_FAILURE;
+    rtrace_destroy();
     
     return retval;
 }
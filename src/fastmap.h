@@ -65,6 +65,14 @@ typedef struct {
 	kseq_t *ks, *ks2;
 	mem_opt_t *opt;
 	mem_pestat_t *pes0;
+	int pestream;           // -z stream: running insert-size estimation across chunks
+	const char *pestat_fn;  // ... with priors kept in this file; may be NULL
+	int shard_i, shard_n;   // --shard i/N; shard_n == 0 without sharding
+	int64_t shard_lo, shard_hi; // ... runs the chunks starting in [shard_lo,shard_hi) of the first input
+	int64_t shard_off;      // (uncompressed) bytes of the first input read so far
+	int64_t shard_nseq;     // reads of this shard read so far
+	const char *metrics_fn; // --metrics FILE[,SEC]: progress snapshot, NULL if off
+	int metrics_sec;
 	int64_t n_processed;
 	int copy_comment;
 	int64_t my_ntasks;
@@ -88,8 +96,25 @@ void *kopen(const char *fn, int *_fd);
 int kclose(void *a);
 int main_mem(int argc, char *argv[]);
 
-#ifdef PERFECT_MATCH
+/* Index and worker buffers kept across jobs by 'serve'. While mem_resident
+ * is set, main_mem() aligns against this index instead of loading one, and
+ * process() reuses the buffers of the previous job when the shape matches. */
+typedef struct {
+	char *prefix;
+	int useErt;
+	int pt_seed_len, pt_seed_len0; // perfect table loaded; and what a job without -l asks for
+	int read_len;                  // hint_readLen set by -l of serve
+	FMI_search *fmi;
+	uint8_t *ref_string;
+	uint8_t *is_alt;               // ALT flags as loaded, restored before each job (-j)
+	worker_t *w;                   // buffers of the last job; NULL before the first one
+	int32_t w_nreads, w_nthreads;
+} mem_resident_t;
+
+extern mem_resident_t *mem_resident;
+mem_resident_t *mem_resident_load(const char *prefix, int useErt, int l); // l: value of -l, <0 if absent
+void mem_resident_free(mem_resident_t *r);
+
 void load_ref_string(const char *prefix, uint8_t **ret_ptr);
-#endif
 
 #endif
@@ -26,6 +26,7 @@
 #define __AC_KSW_H
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <emmintrin.h>
 
 #define KSW_XBYTE  0x10000
@@ -51,6 +52,19 @@ typedef struct {
 
 const kswr_t g_defr = { 0, -1, -1, -1, -1, -1, -1 };
 
+// append len x op to a CIGAR, merging it with the last operation when they are the same
+static inline uint32_t *ksw_push_cigar(int *n_cigar, int *m_cigar, uint32_t *cigar, int op, int len)
+{
+	if (*n_cigar == 0 || (uint32_t) op != (cigar[(*n_cigar) - 1]&0xf)) {
+		if (*n_cigar == *m_cigar) {
+			*m_cigar = *m_cigar? (*m_cigar)<<1 : 4;
+			cigar = (uint32_t *) realloc(cigar, (*m_cigar) << 2);
+		}
+		cigar[(*n_cigar)++] = len<<4 | op;
+	} else cigar[(*n_cigar)-1] += len<<4;
+	return cigar;
+}
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -0,0 +1,339 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM-SCALE (Memory-Scalable Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2022 Electronics and Telecommunications Research Institute (ETRI), Changdae Kim.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   Contacts: Changdae Kim <cdkim@etri.re.kr>
+
+** This software builds upon BWA-MEM2, and includes several performance optimization techniques.
+   For BWA-MEM2, refer to the follows.
+
+   BWA-MEM2 (Sequence alignment using Burrows-Wheeler Transform)
+   Copyright ⓒ 2019 Intel Corporation, Heng Li
+   The MIT License
+   Website: https://github.com/bwa-mem2/bwa-mem2
+
+*****************************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "kswg.h"
+#include "ksw.h"
+#include "ksort.h"
+#if (__AVX512BW__ || __AVX2__)
+#include <immintrin.h>
+#elif __SSE4_1__
+#include <smmintrin.h>
+#endif
+#ifdef SIMD_DISPATCH
+#include "simd_dispatch.h"
+#endif
+
+#define MINUS_INF -0x40000000
+
+/*
+ * Lanes hold 32-bit scores, so the arithmetic (and every tie in the
+ * traceback directions) is exactly that of ksw_global2(). Masks are
+ * __mmask16 with AVX-512 and all-ones/all-zeros lanes otherwise.
+ */
+#if __AVX512BW__
+#define KSWG_LANES       16
+#define VEC              __m512i
+#define MSK              __mmask16
+#define V_LOAD(p)        _mm512_load_si512((__m512i *)(p))
+#define V_STORE(p, v)    _mm512_store_si512((__m512i *)(p), v)
+#define V_SET1           _mm512_set1_epi32
+#define V_ADD            _mm512_add_epi32
+#define V_SUB            _mm512_sub_epi32
+#define V_MAX            _mm512_max_epi32
+#define V_MIN            _mm512_min_epi32
+#define V_OR             _mm512_or_si512
+#define V_CMPGT          _mm512_cmpgt_epi32_mask
+#define V_CMPEQ          _mm512_cmpeq_epi32_mask
+#define V_BLEND(a, b, m) _mm512_mask_blend_epi32(m, a, b)
+#define M_AND(a, b)      ((MSK) ((a) & (b)))
+#define M_ANDNOT(a, b)   ((MSK) (~(a) & (b)))
+#define M_SEL(m, v)      _mm512_maskz_mov_epi32(m, v)
+// 32-entry score table lookup
+#define V_LUT(idx)       _mm512_permutex2var_epi32(tblLo, idx, tblHi)
+#define V_STORE_D(p, d)  _mm_storeu_si128((__m128i *)(p), _mm512_cvtepi32_epi8(d))
+#elif __AVX2__
+#define KSWG_LANES       8
+#define VEC              __m256i
+#define MSK              __m256i
+#define V_LOAD(p)        _mm256_load_si256((__m256i *)(p))
+#define V_STORE(p, v)    _mm256_store_si256((__m256i *)(p), v)
+#define V_SET1           _mm256_set1_epi32
+#define V_ADD            _mm256_add_epi32
+#define V_SUB            _mm256_sub_epi32
+#define V_MAX            _mm256_max_epi32
+#define V_MIN            _mm256_min_epi32
+#define V_OR             _mm256_or_si256
+#define V_CMPGT          _mm256_cmpgt_epi32
+#define V_CMPEQ          _mm256_cmpeq_epi32
+#define V_BLEND(a, b, m) _mm256_blendv_epi8(a, b, m)
+#define M_AND            _mm256_and_si256
+#define M_ANDNOT         _mm256_andnot_si256
+#define M_SEL(m, v)      _mm256_and_si256(m, v)
+// two 16-entry byte shuffles, picked by bit 4 of the index, then sign-extended
+#define V_LUT(idx)       _mm256_srai_epi32(_mm256_slli_epi32(                          \
+                             _mm256_blendv_epi8(_mm256_shuffle_epi8(tblLo, idx),       \
+                                                _mm256_shuffle_epi8(tblHi, idx),       \
+                                                _mm256_slli_epi32(idx, 3)), 24), 24)
+#define V_STORE_D(p, d)  _mm_storel_epi64((__m128i *)(p), _mm256_castsi256_si128(      \
+                             _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(d, pack8), \
+                                                         pack32)))
+#elif __SSE4_1__
+#define KSWG_LANES       4
+#define VEC              __m128i
+#define MSK              __m128i
+#define V_LOAD(p)        _mm_load_si128((__m128i *)(p))
+#define V_STORE(p, v)    _mm_store_si128((__m128i *)(p), v)
+#define V_SET1           _mm_set1_epi32
+#define V_ADD            _mm_add_epi32
+#define V_SUB            _mm_sub_epi32
+#define V_MAX            _mm_max_epi32
+#define V_MIN            _mm_min_epi32
+#define V_OR             _mm_or_si128
+#define V_CMPGT          _mm_cmpgt_epi32
+#define V_CMPEQ          _mm_cmpeq_epi32
+#define V_BLEND(a, b, m) _mm_blendv_epi8(a, b, m)
+#define M_AND            _mm_and_si128
+#define M_ANDNOT         _mm_andnot_si128
+#define M_SEL(m, v)      _mm_and_si128(m, v)
+#define V_LUT(idx)       _mm_srai_epi32(_mm_slli_epi32(                                \
+                             _mm_blendv_epi8(_mm_shuffle_epi8(tblLo, idx),             \
+                                             _mm_shuffle_epi8(tblHi, idx),             \
+                                             _mm_slli_epi32(idx, 3)), 24), 24)
+#define V_STORE_D(p, d)  *(int32_t *)(p) = _mm_cvtsi128_si32(_mm_shuffle_epi8(d, pack8))
+#endif
+
+typedef struct {
+	int32_t *qs, *ts;        // query bases and target bases (times m), lane-interleaved
+	int32_t *eh_h, *eh_e;    // one DP row, lane-interleaved
+	uint8_t *z;              // traceback directions
+	size_t m_q, m_t, m_z;
+} kswg_buf_t;
+
+#ifdef KSWG_LANES
+static void *kswg_grow(void *p, size_t *m, size_t n)
+{
+	if (n <= *m) return p;
+	_mm_free(p);
+	*m = n;
+	p = _mm_malloc(n, 64);
+	assert(p != NULL);
+	return p;
+}
+
+// one group of up to KSWG_LANES pairs; same recurrences and traceback as ksw_global2()
+static void kswg_lanes(int nl, kswg_job_t **job, int m, const int8_t *mat, int o_del,
+					   int e_del, int o_ins, int e_ins, kswg_buf_t *buf)
+{
+	const int L = KSWG_LANES;
+	int32_t qlen[KSWG_LANES] __attribute__((aligned(64)));
+	int32_t tlen[KSWG_LANES] __attribute__((aligned(64)));
+	int32_t wl[KSWG_LANES] __attribute__((aligned(64)));
+	int32_t h1a[KSWG_LANES] __attribute__((aligned(64)));
+	int32_t enda[KSWG_LANES] __attribute__((aligned(64)));
+	int i, j, l, Q = 0, T = 0, W = 0, n_col;
+	int oe_del = o_del + e_del, oe_ins = o_ins + e_ins;
+
+	for (l = 0; l < L; ++l) {
+		qlen[l] = l < nl? job[l]->qlen : 0;
+		tlen[l] = l < nl? job[l]->tlen : 0;
+		wl[l]   = l < nl? job[l]->w : 0;
+		Q = Q > qlen[l]? Q : qlen[l];
+		T = T > tlen[l]? T : tlen[l];
+		W = W > wl[l]? W : wl[l];
+	}
+	n_col = Q < 2*W+1? Q : 2*W+1;
+
+	buf->qs   = (int32_t *) kswg_grow(buf->qs, &buf->m_q, (size_t)(Q + 1) * L * 4 * 3);
+	buf->eh_h = buf->qs + (size_t)(Q + 1) * L;
+	buf->eh_e = buf->eh_h + (size_t)(Q + 1) * L;
+	buf->ts   = (int32_t *) kswg_grow(buf->ts, &buf->m_t, (size_t)T * L * 4);
+	buf->z    = (uint8_t *) kswg_grow(buf->z, &buf->m_z, (size_t)T * n_col * L + 16);
+	int32_t *qs = buf->qs, *ts = buf->ts, *eh_h = buf->eh_h, *eh_e = buf->eh_e;
+	uint8_t *z = buf->z;
+
+	// lane-interleaved sequences and the first row
+	for (l = 0; l < L; ++l) {
+		const uint8_t *q = l < nl? job[l]->query : 0, *t = l < nl? job[l]->target : 0;
+		for (j = 0; j < Q; ++j) qs[j*L + l] = j < qlen[l]? q[j] : 0;
+		for (i = 0; i < T; ++i) ts[i*L + l] = i < tlen[l]? t[i] * m : 0;
+		eh_h[l] = 0; eh_e[l] = MINUS_INF;
+		for (j = 1; j <= qlen[l] && j <= wl[l]; ++j)
+			eh_h[j*L + l] = -(o_ins + e_ins * j), eh_e[j*L + l] = MINUS_INF;
+		for (; j <= Q; ++j) eh_h[j*L + l] = eh_e[j*L + l] = MINUS_INF;
+	}
+
+	int8_t tbl[32] = {0};
+	for (i = 0; i < m * m; ++i) tbl[i] = mat[i];
+#if __AVX512BW__
+	int32_t tbl32[32] __attribute__((aligned(64)));
+	for (i = 0; i < 32; ++i) tbl32[i] = tbl[i];
+	VEC tblLo = V_LOAD(tbl32), tblHi = V_LOAD(tbl32 + 16);
+#else
+	int8_t lo8[KSWG_LANES * 4] __attribute__((aligned(64)));
+	int8_t hi8[KSWG_LANES * 4] __attribute__((aligned(64)));
+	int8_t pk8[KSWG_LANES * 4] __attribute__((aligned(64)));
+	for (i = 0; i < L * 4; ++i) {
+		lo8[i] = tbl[i & 15], hi8[i] = tbl[16 + (i & 15)];
+		pk8[i] = (i & 15) < 4? (i & 3) * 4 : -1; // bytes 0, 4, 8, 12 of each 128-bit lane
+	}
+	VEC tblLo = V_LOAD(lo8), tblHi = V_LOAD(hi8), pack8 = V_LOAD(pk8);
+#if __AVX2__
+	VEC pack32 = _mm256_setr_epi32(0, 4, 1, 2, 3, 5, 6, 7);
+#endif
+#endif
+
+	VEC zero = V_SET1(0), one = V_SET1(1), two = V_SET1(2), four = V_SET1(4);
+	VEC thirtytwo = V_SET1(32), minf = V_SET1(MINUS_INF);
+	VEC qlenv = V_LOAD(qlen), tlenv = V_LOAD(tlen), wv = V_LOAD(wl);
+	VEC oe_delv = V_SET1(oe_del), e_delv = V_SET1(e_del);
+	VEC oe_insv = V_SET1(oe_ins), e_insv = V_SET1(e_ins);
+
+	for (i = 0; i < T; ++i) {
+		VEC iv = V_SET1(i);
+		MSK rowm = V_CMPGT(tlenv, iv);
+		VEC begv = V_MAX(V_SUB(iv, wv), zero);
+		VEC endv = V_MIN(V_ADD(V_ADD(iv, wv), one), qlenv);
+		VEC f = minf;
+		VEC h1 = V_BLEND(minf, V_SET1(-(o_del + e_del * (i + 1))), V_CMPEQ(begv, zero));
+		VEC tv = V_LOAD(ts + i*L);
+		int beg = i > W? i - W : 0, end = i + W + 1 < Q? i + W + 1 : Q;
+		uint8_t *zi = z + ((size_t)i * n_col - beg) * L;
+		VEC jv = V_SET1(beg);
+		for (j = beg; j < end; ++j) {
+			MSK act = M_ANDNOT(V_CMPGT(begv, jv), M_AND(rowm, V_CMPGT(endv, jv)));
+			VEC h = V_LOAD(eh_h + j*L), e = V_LOAD(eh_e + j*L), t, d;
+			VEC mv = V_ADD(h, V_LUT(V_ADD(tv, V_LOAD(qs + j*L))));
+			V_STORE(eh_h + j*L, V_BLEND(h, h1, act));
+			d = M_SEL(V_CMPGT(e, mv), one);             // d = m >= e? 0 : 1
+			h = V_MAX(mv, e);
+			d = V_BLEND(d, two, V_CMPGT(f, h));         // d = h >= f? d : 2
+			h = V_MAX(h, f);
+			h1 = V_BLEND(h1, h, act);
+			t = V_SUB(mv, oe_delv);
+			VEC e1 = V_SUB(e, e_delv);
+			d = V_OR(d, M_SEL(V_CMPGT(e1, t), four));
+			V_STORE(eh_e + j*L, V_BLEND(e, V_MAX(e1, t), act));
+			t = V_SUB(mv, oe_insv);
+			VEC f1 = V_SUB(f, e_insv);
+			d = V_OR(d, M_SEL(V_CMPGT(f1, t), thirtytwo));
+			f = V_BLEND(f, V_MAX(f1, t), act);
+			V_STORE_D(zi + j*L, d);
+			jv = V_ADD(jv, one);
+		}
+		V_STORE(h1a, h1);
+		V_STORE(enda, endv);
+		for (l = 0; l < nl; ++l)
+			if (i < tlen[l])
+				eh_h[enda[l]*L + l] = h1a[l], eh_e[enda[l]*L + l] = MINUS_INF;
+	}
+
+	for (l = 0; l < nl; ++l) { // backtrack
+		int n_cigar = 0, m_cigar = 0, which = 0, k, w = wl[l];
+		uint32_t *cigar = 0, tmp;
+		job[l]->score = eh_h[qlen[l]*L + l];
+		i = tlen[l] - 1; k = (i + w + 1 < qlen[l]? i + w + 1 : qlen[l]) - 1;
+		while (i >= 0 && k >= 0) {
+			which = z[((size_t)i * n_col + (k - (i > W? i - W : 0))) * L + l] >> (which<<1) & 3;
+			if (which == 0)      cigar = ksw_push_cigar(&n_cigar, &m_cigar, cigar, 0, 1), --i, --k;
+			else if (which == 1) cigar = ksw_push_cigar(&n_cigar, &m_cigar, cigar, 2, 1), --i;
+			else                 cigar = ksw_push_cigar(&n_cigar, &m_cigar, cigar, 1, 1), --k;
+		}
+		if (i >= 0) cigar = ksw_push_cigar(&n_cigar, &m_cigar, cigar, 2, i + 1);
+		if (k >= 0) cigar = ksw_push_cigar(&n_cigar, &m_cigar, cigar, 1, k + 1);
+		for (i = 0; i < n_cigar>>1; ++i) // reverse CIGAR
+			tmp = cigar[i], cigar[i] = cigar[n_cigar-1-i], cigar[n_cigar-1-i] = tmp;
+		job[l]->n_cigar = n_cigar, job[l]->cigar = cigar;
+	}
+}
+
+#define kswg_key_lt(a, b) ((a) < (b))
+namespace { // every ISA copy of this file carries its own
+KSORT_INIT(kswg, uint64_t, kswg_key_lt)
+}
+#endif // KSWG_LANES
+
+void ksw_global2_batch(int n, kswg_job_t *job, int m, const int8_t *mat,
+					   int o_del, int e_del, int o_ins, int e_ins)
+{
+	int i;
+#if defined(SIMD_DISPATCH) && !defined(SIMD_DISPATCH_SUFFIX)
+	const kswg_ops_t *ops = kswg_dispatch_ops();
+	if (ops) {
+		ops->global_batch(n, job, m, mat, o_del, e_del, o_ins, e_ins);
+		return;
+	}
+#endif
+#ifdef KSWG_LANES
+	// group pairs of similar sizes into the lanes; the large ones stay scalar
+	uint64_t *key = (uint64_t *) malloc((size_t)n * sizeof(uint64_t));
+	kswg_job_t *lane[KSWG_LANES];
+	kswg_buf_t buf;
+	int n_key = 0;
+	assert(key != NULL && m * m <= 32);
+	memset(&buf, 0, sizeof(kswg_buf_t));
+	for (i = 0; i < n; ++i) {
+		kswg_job_t *p = &job[i];
+		int n_col = p->qlen < 2*p->w+1? p->qlen : 2*p->w+1;
+		if ((int64_t)p->tlen * n_col > KSWG_MAX_CELLS) {
+			p->score = ksw_global2(p->qlen, p->query, p->tlen, p->target, m, mat, o_del,
+								   e_del, o_ins, e_ins, p->w, &p->n_cigar, &p->cigar);
+			continue;
+		}
+		key[n_key++] = (uint64_t)p->tlen << 44 | (uint64_t)p->qlen << 24 | i;
+	}
+	ks_introsort(kswg, n_key, key);
+	for (i = 0; i < n_key; i += KSWG_LANES) {
+		int l, nl = n_key - i < KSWG_LANES? n_key - i : KSWG_LANES;
+		for (l = 0; l < nl; ++l) lane[l] = &job[key[i + l] & 0xffffff];
+		kswg_lanes(nl, lane, m, mat, o_del, e_del, o_ins, e_ins, &buf);
+	}
+	_mm_free(buf.qs); _mm_free(buf.ts); _mm_free(buf.z);
+	free(key);
+#else
+	for (i = 0; i < n; ++i) {
+		kswg_job_t *p = &job[i];
+		p->score = ksw_global2(p->qlen, p->query, p->tlen, p->target, m, mat, o_del,
+							   e_del, o_ins, e_ins, p->w, &p->n_cigar, &p->cigar);
+	}
+#endif
+}
+
+#ifdef SIMD_DISPATCH_SUFFIX
+extern const kswg_ops_t SIMD_PASTE(kswg_ops_, SIMD_DISPATCH_SUFFIX);
+const kswg_ops_t SIMD_PASTE(kswg_ops_, SIMD_DISPATCH_SUFFIX) = {
+#if __AVX512BW__
+	SIMD_ISA_AVX512BW,
+#else
+	SIMD_ISA_AVX2,
+#endif
+	ksw_global2_batch
+};
+#endif
@@ -0,0 +1,85 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM-SCALE (Memory-Scalable Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2022 Electronics and Telecommunications Research Institute (ETRI), Changdae Kim.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   Contacts: Changdae Kim <cdkim@etri.re.kr>
+
+** This software builds upon BWA-MEM2, and includes several performance optimization techniques.
+   For BWA-MEM2, refer to the follows.
+
+   BWA-MEM2 (Sequence alignment using Burrows-Wheeler Transform)
+   Copyright ⓒ 2019 Intel Corporation, Heng Li
+   The MIT License
+   Website: https://github.com/bwa-mem2/bwa-mem2
+
+*****************************************************************************************/
+
+#ifndef _KSWG_H_
+#define _KSWG_H_
+
+#include <stdint.h>
+#include "macro.h"
+
+/*
+ * Inter-sequence banded global alignment (CIGAR generation).
+ * ksw_global2_batch() aligns many (query, target) pairs at once, one pair per
+ * 32-bit SIMD lane, and keeps 1 byte of traceback direction per cell and lane.
+ * Scores and CIGARs are identical to those of ksw_global2().
+ */
+
+// pairs with more DP cells than this go through the scalar ksw_global2()
+#define KSWG_MAX_CELLS (1 << 20)
+
+typedef struct {
+	int qlen, tlen, w;       // in: lengths and band width, as for ksw_global2()
+	const uint8_t *query;    // in: query, 0 <= query[i] < m
+	const uint8_t *target;   // in: target, 0 <= target[i] < m
+	int score;               // out: global alignment score
+	int n_cigar;             // out: number of CIGAR operations
+	uint32_t *cigar;         // out: BAM-encoded CIGAR; free() by the caller
+} kswg_job_t;
+
+#ifdef SIMD_DISPATCH_SUFFIX
+#define ksw_global2_batch SIMD_PASTE(ksw_global2_batch_, SIMD_DISPATCH_SUFFIX)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	/**
+	 * Banded global alignment of n pairs; m*m must not exceed 32
+	 *
+	 * Parameters m, mat, o_del, e_del, o_ins and e_ins are the same as for
+	 * ksw_global2(); the CIGAR of every pair is always generated.
+	 */
+	void ksw_global2_batch(int n, kswg_job_t *job, int m, const int8_t *mat,
+						   int o_del, int e_del, int o_ins, int e_ins);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -32,6 +32,9 @@ Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@i
 #include <unistd.h>
 #include "kswv.h"
 #include "limits.h"
+#ifdef SIMD_DISPATCH
+#include "simd_dispatch.h"
+#endif
 
 
 // ------------------------------------------------------------------------------------
@@ -151,16 +154,39 @@ kswv::kswv(const int o_del, const int e_del, const int o_ins,
     H8_1 = (uint8_t*) H16_1;
     H8_max = (uint8_t*) H16_max;
     rowMax8 = (uint8_t*) rowMax16;
+
+#ifdef SIMD_DISPATCH
+    isaOps = NULL; isaImpl = NULL;
+#ifndef SIMD_DISPATCH_SUFFIX
+    isaOps = kswv_dispatch_ops();
+    if (isaOps)
+        isaImpl = isaOps->create(o_del, e_del, o_ins, e_ins, w_match, w_mismatch,
+                                 numThreads, maxRefLen, maxQerLen);
+#endif
+#endif
 }
 
 // destructor 
 kswv::~kswv() {
     _mm_free(F16); _mm_free(H16_0); _mm_free(H16_max); _mm_free(H16_1);
     _mm_free(rowMax16);
+#ifdef SIMD_DISPATCH
+    if (isaImpl) isaOps->destroy(isaImpl);
+#endif
 }
 
-
+#if KSWV_BATCH
 #if __AVX512BW__
+#define KSWV_U8 kswv512_u8
+#define KSWV_16 kswv512_16
+#elif __AVX2__
+#define KSWV_U8 kswv256_u8
+#define KSWV_16 kswv256_16
+#else
+#define KSWV_U8 kswv128_u8
+#define KSWV_16 kswv128_16
+#endif
+
 void kswv::getScores8(SeqPair *pairArray,
                       uint8_t *seqBufRef,
                       uint8_t *seqBufQer,
@@ -169,6 +195,13 @@ void kswv::getScores8(SeqPair *pairArray,
                       uint16_t numThreads,
                       int phase)
 {
+#ifdef SIMD_DISPATCH
+    if (isaImpl) {
+        isaOps->getScores8(isaImpl, pairArray, seqBufRef, seqBufQer, aln,
+                           numPairs, numThreads, phase);
+        return;
+    }
+#endif
     kswvBatchWrapper8(pairArray, seqBufRef, seqBufQer, aln,
                       numPairs, numThreads, phase);
 }
@@ -318,7 +351,7 @@ void kswv::kswvBatchWrapper8(SeqPair *pairArray,
                 }
             }
 
-            kswv512_u8(mySeq1SoA, mySeq2SoA,
+            KSWV_U8(mySeq1SoA, mySeq2SoA,
                        maxLen1, maxLen2,
                        pairArray + i,
                        aln, i,
@@ -369,6 +402,7 @@ void kswv::kswvBatchWrapper8(SeqPair *pairArray,
     return;
 }
 
+#if __AVX512BW__
 int kswv::kswv512_u8(uint8_t seq1SoA[],
                      uint8_t seq2SoA[],
                      int16_t nrow,
@@ -708,6 +742,7 @@ int kswv::kswv512_u8(uint8_t seq1SoA[],
 
     return 1;   
 }
+#endif // __AVX512BW__
 
 /*********************************** Vectorized Code 16 bit *****************************/
 /// 16 bit lanes
@@ -719,6 +754,13 @@ void kswv::getScores16(SeqPair *pairArray,
                        uint16_t numThreads,
                        int phase)
 {
+#ifdef SIMD_DISPATCH
+    if (isaImpl) {
+        isaOps->getScores16(isaImpl, pairArray, seqBufRef, seqBufQer, aln,
+                            numPairs, numThreads, phase);
+        return;
+    }
+#endif
     kswvBatchWrapper16(pairArray, seqBufRef, seqBufQer, aln,
                        numPairs, numThreads, phase);
 }
@@ -882,7 +924,7 @@ void kswv::kswvBatchWrapper16(SeqPair *pairArray,
                 }
             }
 
-            kswv512_16(mySeq1SoA, mySeq2SoA,
+            KSWV_16(mySeq1SoA, mySeq2SoA,
                        maxLen1, maxLen2,
                        pairArray + i,
                        aln, i,
@@ -931,6 +973,7 @@ void kswv::kswvBatchWrapper16(SeqPair *pairArray,
     return; 
 }
 
+#if __AVX512BW__
 int kswv::kswv512_16(int16_t seq1SoA[],
                      int16_t seq2SoA[],
                      int16_t nrow,
@@ -1216,8 +1259,683 @@ int kswv::kswv512_16(int16_t seq1SoA[],
     }
     return 1;
 }
+#endif // __AVX512BW__
+
+#if (!__AVX512BW__)
+/************************ 256-bit and 128-bit inter-sequence kernels ********************/
+// Same DP as kswv512_u8/kswv512_16 above. AVX-512 mask registers become
+// all-ones/all-zeros lane masks and mask_blend(k, a, b) becomes blendv(a, b, k).
+#if __AVX2__
+#define VEC              __m256i
+#define V_LOAD(p)        _mm256_load_si256((__m256i *)(p))
+#define V_STORE(p, v)    _mm256_store_si256((__m256i *)(p), v)
+#define V_ZERO()         _mm256_setzero_si256()
+#define V_SET1_8(x)      _mm256_set1_epi8(x)
+#define V_SET1_16(x)     _mm256_set1_epi16(x)
+#define V_XOR            _mm256_xor_si256
+#define V_OR             _mm256_or_si256
+#define V_AND            _mm256_and_si256
+#define V_ANDNOT         _mm256_andnot_si256
+#define V_SHUFFLE8       _mm256_shuffle_epi8
+#define V_BLEND          _mm256_blendv_epi8
+#define V_CMPEQ8         _mm256_cmpeq_epi8
+#define V_CMPGT16        _mm256_cmpgt_epi16
+#define V_ADD8           _mm256_add_epi8
+#define V_ADDS_U8        _mm256_adds_epu8
+#define V_SUBS_U8        _mm256_subs_epu8
+#define V_MAX_U8         _mm256_max_epu8
+#define V_ADD16          _mm256_add_epi16
+#define V_SUB16          _mm256_sub_epi16
+#define V_MAX16          _mm256_max_epi16
+#define V_SLLI16         _mm256_slli_epi16
+#define V_SRAI16         _mm256_srai_epi16
+#define V_MOVEMASK8      _mm256_movemask_epi8
+// byte lane mask -> word lane masks of lanes [0, SIMD_WIDTH16) and [SIMD_WIDTH16, SIMD_WIDTH8)
+#define V_MASK_LO16(m)   _mm256_cvtepi8_epi16(_mm256_castsi256_si128(m))
+#define V_MASK_HI16(m)   _mm256_cvtepi8_epi16(_mm256_extracti128_si256(m, 1))
+// word lane masks -> byte lane mask
+#define V_PACK16(lo, hi) _mm256_permute4x64_epi64(_mm256_packs_epi16(lo, hi), 0xD8)
+#else
+#define VEC              __m128i
+#define V_LOAD(p)        _mm_load_si128((__m128i *)(p))
+#define V_STORE(p, v)    _mm_store_si128((__m128i *)(p), v)
+#define V_ZERO()         _mm_setzero_si128()
+#define V_SET1_8(x)      _mm_set1_epi8(x)
+#define V_SET1_16(x)     _mm_set1_epi16(x)
+#define V_XOR            _mm_xor_si128
+#define V_OR             _mm_or_si128
+#define V_AND            _mm_and_si128
+#define V_ANDNOT         _mm_andnot_si128
+#define V_SHUFFLE8       _mm_shuffle_epi8
+#define V_BLEND          _mm_blendv_epi8
+#define V_CMPEQ8         _mm_cmpeq_epi8
+#define V_CMPGT16        _mm_cmpgt_epi16
+#define V_ADD8           _mm_add_epi8
+#define V_ADDS_U8        _mm_adds_epu8
+#define V_SUBS_U8        _mm_subs_epu8
+#define V_MAX_U8         _mm_max_epu8
+#define V_ADD16          _mm_add_epi16
+#define V_SUB16          _mm_sub_epi16
+#define V_MAX16          _mm_max_epi16
+#define V_SLLI16         _mm_slli_epi16
+#define V_SRAI16         _mm_srai_epi16
+#define V_MOVEMASK8      _mm_movemask_epi8
+#define V_MASK_LO16(m)   _mm_cvtepi8_epi16(m)
+#define V_MASK_HI16(m)   _mm_cvtepi8_epi16(_mm_srli_si128(m, 8))
+#define V_PACK16(lo, hi) _mm_packs_epi16(lo, hi)
+#endif
+
+#define V_NOT(a)         V_XOR(a, V_CMPEQ8(a, a))
+#define V_CMPGT_U8(a, b) V_NOT(V_CMPEQ8(V_MAX_U8(a, b), b))
+#define V_CMPGE_U8(a, b) V_CMPEQ8(V_MAX_U8(a, b), a)
+#define V_CMPGE16(a, b)  V_NOT(V_CMPGT16(b, a))
+
+#define MAIN_SAM_CODE8_VEC(s1, s2, h00, h11, e11, f11, f21)            \
+    {                                                                   \
+        VEC sbt11, xor11, or11;                                         \
+        xor11 = V_XOR(s1, s2);                                          \
+        sbt11 = V_SHUFFLE8(permSftv, xor11);                            \
+        VEC cmpq = V_CMPEQ8(s2, fivev);                                 \
+        sbt11 = V_BLEND(sbt11, sftv, cmpq);                             \
+        or11 =  V_OR(s1, s2);                                           \
+        VEC m11 = V_ADDS_U8(h00, sbt11);                                \
+        m11 = V_BLEND(m11, zerov, or11);                                \
+        m11 = V_SUBS_U8(m11, sftv);                                     \
+        h11 = V_MAX_U8(m11, e11);                                       \
+        h11 = V_MAX_U8(h11, f11);                                       \
+        VEC imax11 = V_MAX_U8(imaxv, h11);                              \
+        iqev = V_BLEND(lv, iqev, V_CMPEQ8(imax11, imaxv));              \
+        imaxv = imax11;                                                 \
+        VEC gapE = V_SUBS_U8(h11, oe_insv);                             \
+        e11 = V_SUBS_U8(e11, e_insv);                                   \
+        e11 = V_MAX_U8(gapE, e11);                                      \
+        VEC gapD = V_SUBS_U8(h11, oe_delv);                             \
+        f21 = V_SUBS_U8(f11, e_delv);                                   \
+        f21 = V_MAX_U8(gapD, f21);                                      \
+    }
+
+// permutexvar_epi16 over the 32-entry score table: two 16-entry byte
+// shuffles selected by bit 4 of the index, then sign-extended to 16 bits
+#define MAIN_SAM_CODE16_VEC(s1, s2, h00, h11, e11, f11, f21)           \
+    {                                                                   \
+        VEC sbt11, xor11, or11, idx11;                                  \
+        xor11 = V_XOR(s1, s2);                                          \
+        idx11 = V_AND(xor11, idxv);                                     \
+        sbt11 = V_BLEND(V_SHUFFLE8(permLov, idx11),                     \
+                        V_SHUFFLE8(permHiv, idx11),                     \
+                        V_SLLI16(idx11, 3));                            \
+        sbt11 = V_SRAI16(V_SLLI16(sbt11, 8), 8);                        \
+        VEC m11 = V_ADD16(h00, sbt11);                                  \
+        or11 =  V_OR(s1, s2);                                           \
+        m11 = V_BLEND(m11, zerov, or11);                                \
+        h11 = V_MAX16(m11, e11);                                        \
+        h11 = V_MAX16(h11, f11);                                        \
+        h11 = V_MAX16(h11, zerov);                                      \
+        VEC cmp11 = V_CMPGT16(h11, imaxv);                              \
+        imaxv = V_MAX16(imaxv, h11);                                    \
+        iqev = V_BLEND(iqev, lv, cmp11);                                \
+        VEC gapE = V_SUB16(h11, oe_insv);                               \
+        e11 = V_SUB16(e11, e_insv);                                     \
+        e11 = V_MAX16(gapE, e11);                                       \
+        VEC gapD = V_SUB16(h11, oe_delv);                               \
+        f21 = V_SUB16(f11, e_delv);                                     \
+        f21 = V_MAX16(gapD, f21);                                       \
+    }
+
+int kswv::KSWV_U8(uint8_t seq1SoA[],
+                  uint8_t seq2SoA[],
+                  int16_t nrow,
+                  int16_t ncol,
+                  SeqPair *p,
+                  kswr_t *aln,
+                  int po_ind,
+                  uint16_t tid,
+                  int32_t numPairs,
+                  int phase)
+{
+    uint8_t minsc[SIMD_WIDTH8] __attribute__((aligned(64))) = {0};
+    uint8_t endsc[SIMD_WIDTH8] __attribute__((aligned(64))) = {0};
+    uint8_t minsc_a[SIMD_WIDTH8] __attribute__((aligned(64))) = {0};
+    uint8_t endsc_a[SIMD_WIDTH8] __attribute__((aligned(64))) = {0};
+
+    VEC zerov = V_ZERO();
+    VEC onev  = V_SET1_8(1);
+
+    int8_t temp[SIMD_WIDTH8] __attribute((aligned(64))) = {0};
+
+    uint8_t shift = 127, mdiff = 0, qmax_;
+    mdiff = max_(this->w_match, (int8_t) this->w_mismatch);
+    mdiff = max_(mdiff, (int8_t) this->w_ambig);
+    shift = min_(this->w_match, (int8_t) this->w_mismatch);
+    shift = min_((int8_t) shift, this->w_ambig);
+
+    qmax_ = mdiff;
+    shift = 256 - (uint8_t) shift;
+    mdiff += shift;
+    
+    temp[0] = this->w_match;                                   // states: 1. matches
+    temp[1] = temp[2] = temp[3] =  this->w_mismatch;           // 2. mis-matches
+    temp[4] = temp[5] = temp[6] = temp[7] =  this->w_ambig;    // 3. beyond boundary
+    temp[8] = temp[9] = temp[10] = temp[11] = this->w_ambig;   // 4. 0 - sse2 region
+    temp[12] = this->w_ambig;                                  // 5. ambig
+
+    for (int i=0; i<16; i++) // for shuffle_epi8
+        temp[i] += shift;
+
+    int pos = 0;
+    for (int i=16; i<SIMD_WIDTH8; i++) {
+        temp[i] = temp[pos++];
+        if (pos % 16 == 0) pos = 0;
+    }
+    
+    VEC permSftv = V_LOAD(temp);
+    VEC sftv = V_SET1_8(shift);
+    VEC cmaxv = V_SET1_8(255);
+    
+    int val = 0;
+    for (int i=0; i<SIMD_WIDTH8; i++)
+    {
+        int xtra = p[i].h0;
+        val = (xtra & KSW_XSUBO)? xtra & 0xffff : 0x10000;
+        if (val <= 255) {
+            minsc[i] = val;
+            minsc_a[i] = 0xFF;
+        }
+        // msc_mask;
+        val = (xtra & KSW_XSTOP)? xtra & 0xffff : 0x10000;
+        if (val <= 255) {
+            endsc[i] = val;
+            endsc_a[i] = 0xFF;
+        }
+    }
+
+    VEC minscv = V_LOAD(minsc);
+    VEC endscv = V_LOAD(endsc);
+    VEC minsc_msk_a = V_LOAD(minsc_a);
+    VEC endsc_msk_a = V_LOAD(endsc_a);
+       
+    VEC e_delv  = V_SET1_8(this->e_del);
+    VEC oe_delv = V_SET1_8(this->o_del + this->e_del);
+    VEC e_insv  = V_SET1_8(this->e_ins);
+    VEC oe_insv = V_SET1_8(this->o_ins + this->e_ins);
+    VEC fivev   = V_SET1_8(DUMMY5); // ambig mapping element
+    VEC gmaxv   = zerov;
+    VEC tev     = V_SET1_16(-1);
+    VEC tev_    = V_SET1_16(-1);
+    
+    VEC exit0 = V_CMPEQ8(zerov, zerov);
+
+    tid = 0;  // no threading for now !!
+    uint8_t *H0     = H8_0 + tid * SIMD_WIDTH8 * this->maxQerLen;
+    uint8_t *H1     = H8_1 + tid * SIMD_WIDTH8 * this->maxQerLen;
+    uint8_t *Hmax   = H8_max + tid * SIMD_WIDTH8 * this->maxQerLen;
+    uint8_t *F      = F8 + tid * SIMD_WIDTH8 * this->maxQerLen;
+    uint8_t *rowMax = rowMax8 + tid * SIMD_WIDTH8 * this->maxRefLen;
+    
+    for (int i=0; i <=ncol; i++)
+    {
+        V_STORE(H0 + i * SIMD_WIDTH8, zerov);
+        V_STORE(Hmax + i * SIMD_WIDTH8, zerov);
+        V_STORE(F + i * SIMD_WIDTH8, zerov);
+    }
+
+    VEC maxv = zerov, imaxv, pimaxv = zerov;
+    VEC maskv = zerov;
+    VEC minsc_msk = zerov;
+
+    VEC qev = zerov;
+    V_STORE(H0, zerov);
+    V_STORE(H1, zerov);
+
+    int i, limit = nrow;
+    for (i=0; i < nrow; i++)
+    {
+        VEC e11 = zerov;
+        VEC h00, h11, s1;
+        VEC iv = V_SET1_16(i);
+        int j ;
+        
+        s1 = V_LOAD(seq1SoA + (i + 0) * SIMD_WIDTH8);
+        imaxv = zerov;
+        VEC iqev = V_SET1_8(-1);
+
+        VEC lv = zerov;
+        for (j=0; j<ncol; j++)
+        {
+            VEC f11, s2, f21;
+            h00 = V_LOAD(H0 + j * SIMD_WIDTH8);  // check for col "0"
+            s2  = V_LOAD(seq2SoA + (j) * SIMD_WIDTH8);
+            f11 = V_LOAD(F + (j+1) * SIMD_WIDTH8);
+
+            MAIN_SAM_CODE8_VEC(s1, s2, h00, h11, e11, f11, f21);
+
+            V_STORE(H1 + (j + 1) * SIMD_WIDTH8, h11);  // check for col "0"
+            V_STORE(F + (j + 1)* SIMD_WIDTH8, f21);
+            lv = V_ADD8(lv, onev);
+        }
+
+        // Block I
+        if (i > 0)
+        {
+            VEC msk = V_OR(V_CMPGT_U8(imaxv, pimaxv), maskv);
+            pimaxv = V_BLEND(pimaxv, zerov, msk);
+            pimaxv = V_BLEND(zerov, pimaxv, minsc_msk);
+            pimaxv = V_BLEND(zerov, pimaxv, exit0);
+            
+            V_STORE(rowMax + (i-1)*SIMD_WIDTH8, pimaxv);
+            maskv = V_NOT(msk);
+        }
+        pimaxv = imaxv;
+        minsc_msk = V_AND(V_CMPGE_U8(imaxv, minscv), minsc_msk_a);
+
+        // Block II: gmax, te
+        VEC cmp0 = V_AND(V_CMPGT_U8(imaxv, gmaxv), exit0);
+        gmaxv = V_BLEND(gmaxv, imaxv, cmp0);
+        tev  = V_BLEND(tev, iv, V_MASK_LO16(cmp0));
+        tev_ = V_BLEND(tev_, iv, V_MASK_HI16(cmp0));
+        qev = V_BLEND(qev, iqev, cmp0);
+        
+        cmp0 = V_AND(V_CMPGE_U8(gmaxv, endscv), endsc_msk_a);
+        
+        VEC leftv = V_ADDS_U8(gmaxv, sftv);
+        VEC cmp2 = V_CMPGE_U8(leftv, cmaxv);
+
+        exit0 = V_ANDNOT(V_OR(cmp0, cmp2), exit0);
+        if (V_MOVEMASK8(exit0) == 0)
+        {
+            limit = i++;
+            break;
+        }       
+
+        uint8_t *S = H1; H1 = H0; H0 = S;
+    } // for nrow
+
+    pimaxv = V_BLEND(pimaxv, zerov, maskv);
+    pimaxv = V_BLEND(zerov, pimaxv, minsc_msk);
+    pimaxv = V_BLEND(zerov, pimaxv, exit0);
+    V_STORE(rowMax + (i-1) * SIMD_WIDTH8, pimaxv);
+
+    /******************* DP loop over *****************************/   
+    /**************** Partial output setting **********************/
+    uint8_t score[SIMD_WIDTH8] __attribute((aligned(64)));
+    int16_t te1[SIMD_WIDTH8] __attribute((aligned(64)));    
+    uint8_t qe[SIMD_WIDTH8] __attribute((aligned(64)));    
+    int16_t low[SIMD_WIDTH8] __attribute((aligned(64)));
+    int16_t high[SIMD_WIDTH8] __attribute((aligned(64)));
+    
+    V_STORE(score, gmaxv); 
+    V_STORE(te1, tev);
+    V_STORE(te1 + SIMD_WIDTH16, tev_);
+    V_STORE(qe, qev);
+
+    int live = 0;
+    for (int l=0; l<SIMD_WIDTH8 && (po_ind + l) < numPairs; l++) {
+        int ind = p[l].regid;    // index of corr. aln
+        if (phase) {
+            if (aln[ind].score == score[l]) {
+                aln[ind].tb = aln[ind].te - te1[l];
+                aln[ind].qb = aln[ind].qe - qe[l];
+            }
+        } else {
+            aln[ind].score = score[l] + shift < 255? score[l] : 255;
+            aln[ind].te = te1[l];
+            aln[ind].qe = qe[l];
+            if (aln[ind].score != 255) {
+                qe[l] = 1;
+                live ++;                
+            }
+            else qe[l] = 0;
+        }
+    }
+    
+    if (phase) return 1;
+    if (live == 0) return 1;
+
+    /*************** Score2 and te2 *******************/
+    int qmax = this->g_qmax;
+    int maxl = 0 , minh = nrow;
+    for (int i=0; i<SIMD_WIDTH8; i++)
+    {
+        int val = (score[i] + qmax - 1) / qmax;
+        low[i] = te1[i] - val;
+        high[i] = te1[i] + val;
+        if (qe[i]) {
+            maxl = maxl < low[i] ? low[i] : maxl;
+            minh = minh > high[i] ? high[i] : minh;
+        }
+    }
+
+    maxv = zerov;
+    tev = V_SET1_16(-1);
+    tev_ = V_SET1_16(-1);
+    VEC lowv = V_LOAD(low);
+    VEC highv = V_LOAD(high);
+    VEC lowv_ = V_LOAD(low + SIMD_WIDTH16);
+    VEC highv_ = V_LOAD(high + SIMD_WIDTH16);
 
-#endif // AVX512BW
+    VEC rmaxv;
+    for (int i=0; i< maxl; i++)
+    {
+        VEC iv = V_SET1_16(i);
+        rmaxv = V_LOAD(rowMax + i*SIMD_WIDTH8);
+        VEC mask1 = V_PACK16(V_CMPGT16(lowv, iv), V_CMPGT16(lowv_, iv));
+        VEC mask2 = V_AND(V_CMPGT_U8(rmaxv, maxv), mask1);
+        maxv = V_BLEND(maxv, rmaxv, mask2);
+        tev  = V_BLEND(tev, iv, V_MASK_LO16(mask2));
+        tev_ = V_BLEND(tev_, iv, V_MASK_HI16(mask2));
+    }   
+
+    int16_t rlen[SIMD_WIDTH8] __attribute((aligned(64)));
+    for (int i=0; i<SIMD_WIDTH8; i++) rlen[i] = p[i].len1;
+    VEC rlenv = V_LOAD(rlen);
+    VEC rlenv_ = V_LOAD(rlen + SIMD_WIDTH16);
+
+    for (int i=minh+1; i<limit; i++)
+    {
+        VEC iv = V_SET1_16(i);
+        rmaxv = V_LOAD(rowMax + i*SIMD_WIDTH8);
+        VEC mask1 = V_PACK16(V_CMPGT16(iv, highv), V_CMPGT16(iv, highv_));
+        VEC mask2 = V_AND(V_CMPGT_U8(rmaxv, maxv), mask1);
+        VEC mask1_ = V_PACK16(V_CMPGT16(rlenv, iv), V_CMPGT16(rlenv_, iv));
+        mask2 = V_AND(mask2, mask1_);
+        maxv = V_BLEND(maxv, rmaxv, mask2);
+        tev  = V_BLEND(tev, iv, V_MASK_LO16(mask2));
+        tev_ = V_BLEND(tev_, iv, V_MASK_HI16(mask2));
+    }
+    
+    int16_t temp4[SIMD_WIDTH8] __attribute((aligned(64)));
+    V_STORE(temp, maxv);
+    V_STORE(temp4, tev);
+    V_STORE(temp4 + SIMD_WIDTH16, tev_);
+    
+    for (int i=0; i<SIMD_WIDTH8  && (po_ind + i) < numPairs; i++)
+    {
+        int ind = p[i].regid;    // index of corr. aln
+        if (qe[i]) {
+            aln[ind].score2 = (temp[i] == 0? (int)-1: (uint8_t) temp[i]);
+            aln[ind].te2 = temp4[i];
+        } else {
+            aln[ind].score2 = -1;
+            aln[ind].te2 = -1;
+        }
+    }
+    return 1;   
+}
+
+int kswv::KSWV_16(int16_t seq1SoA[],
+                  int16_t seq2SoA[],
+                  int16_t nrow,
+                  int16_t ncol,
+                  SeqPair *p,
+                  kswr_t *aln,
+                  int po_ind,
+                  uint16_t tid,
+                  int32_t numPairs,
+                  int phase)
+{
+    int16_t minsc[SIMD_WIDTH16] __attribute((aligned(64))) = {0};
+    int16_t endsc[SIMD_WIDTH16] __attribute((aligned(64))) = {0};
+    int16_t minsc_a[SIMD_WIDTH16] __attribute((aligned(64))) = {0};
+    int16_t endsc_a[SIMD_WIDTH16] __attribute((aligned(64))) = {0};
+    int limit = nrow;
+    VEC zerov  = V_ZERO();
+    VEC onev   = V_SET1_16(1);
+    VEC minus1 = V_SET1_16(-1);
+    int16_t temp[32] = {0};
+    int8_t permLo[SIMD_WIDTH8] __attribute((aligned(64)));
+    int8_t permHi[SIMD_WIDTH8] __attribute((aligned(64)));
+    int16_t temp1[SIMD_WIDTH16] __attribute((aligned(64)));
+    int16_t temp2[SIMD_WIDTH16] __attribute((aligned(64)));
+
+    // query profile, we use xor operations on the strings
+    temp[0] = this->w_match;    // matching
+    temp[1]  = temp[2]  = temp[3]  =  this->w_mismatch;  // mis-matching    
+    temp[12] = temp[13] = temp[14] = temp[15] =  this->w_ambig;
+    temp[16] = temp[17] = temp[18] = temp[19] = this->w_ambig;
+    temp[31] = this->w_ambig;
+
+    for (int i=0; i<SIMD_WIDTH8; i++) {
+        permLo[i] = temp[i % 16];
+        permHi[i] = temp[16 + i % 16];
+    }
+    VEC permLov = V_LOAD(permLo);
+    VEC permHiv = V_LOAD(permHi);
+    VEC idxv    = V_SET1_16(0x1F);
+
+    int val = 0;
+    for (int i=0; i<SIMD_WIDTH16; i++) {
+        int xtra = p[i].h0;
+        val = (xtra & KSW_XSUBO)? xtra & 0xffff : 0x10000;
+        if (val <= SHRT_MAX) {
+            minsc[i] = val;
+            minsc_a[i] = -1;
+        }
+        // msc_mask;
+        val = (xtra & KSW_XSTOP)? xtra & 0xffff : 0x10000;
+        if (val <= SHRT_MAX) {
+            endsc[i] = val;
+            endsc_a[i] = -1;
+        }
+    }
+
+    VEC minscv = V_LOAD(minsc);
+    VEC endscv = V_LOAD(endsc);
+    VEC minsc_msk_a = V_LOAD(minsc_a);
+    VEC endsc_msk_a = V_LOAD(endsc_a);
+
+    VEC e_delv  = V_SET1_16(this->e_del);
+    VEC oe_delv = V_SET1_16(this->o_del + this->e_del);
+    VEC e_insv  = V_SET1_16(this->e_ins);
+    VEC oe_insv = V_SET1_16(this->o_ins + this->e_ins);
+    VEC gmaxv   = zerov;
+    VEC tev     = V_SET1_16(-1);
+    VEC exit0   = V_CMPEQ8(zerov, zerov);
+
+    tid = 0;  // no threading here.
+    int16_t *H0     = H16_0 + tid * SIMD_WIDTH16 * this->maxQerLen;
+    int16_t *H1     = H16_1 + tid * SIMD_WIDTH16 * this->maxQerLen;
+    int16_t *Hmax   = H16_max + tid * SIMD_WIDTH16 * this->maxQerLen;
+    int16_t *F      = F16 + tid * SIMD_WIDTH16 * this->maxQerLen;
+    int16_t *rowMax = rowMax16 + tid * SIMD_WIDTH16 * this->maxRefLen;
+
+    for (int i=ncol; i >= 0; i--) {
+        V_STORE(H0 + i * SIMD_WIDTH16, zerov);
+        V_STORE(Hmax + i * SIMD_WIDTH16, zerov);
+        V_STORE(F + i * SIMD_WIDTH16, zerov);
+    }
+
+    VEC maxv = zerov, imaxv, pimaxv = zerov;
+    VEC maskv = zerov;
+    VEC minsc_msk = zerov;
+
+    VEC qev = zerov;
+    V_STORE(H0, zerov);
+    V_STORE(H1, zerov);
+    VEC iv = zerov;
+    
+    int i;
+    for (i=0; i < nrow; i++)
+    {
+        VEC e11 = zerov;
+        VEC h00, h11, s1;
+        int j;
+
+        s1 = V_LOAD(seq1SoA + (i + 0) * SIMD_WIDTH16);
+        imaxv = zerov;
+        VEC iqev = V_SET1_16(-1);
+        VEC lv = zerov;
+        for (j=0; j<ncol; j++)
+        {
+            VEC f11, s2, f21;
+            h00 = V_LOAD(H0 + j * SIMD_WIDTH16);
+            s2  = V_LOAD(seq2SoA + (j) * SIMD_WIDTH16);
+            f11 = V_LOAD(F + (j+1) * SIMD_WIDTH16);
+
+            MAIN_SAM_CODE16_VEC(s1, s2, h00, h11, e11, f11, f21);
+
+            V_STORE(H1 + (j+1) * SIMD_WIDTH16, h11);
+            V_STORE(F + (j+1) * SIMD_WIDTH16, f21);
+            lv = V_ADD16(lv, onev);
+        }   /* Inner DP loop */
+
+        // Block I
+        if (i > 0) {
+            VEC msk = V_OR(V_CMPGT16(imaxv, pimaxv), maskv);
+            pimaxv = V_BLEND(pimaxv, minus1, msk);
+            pimaxv = V_BLEND(minus1, pimaxv, minsc_msk);
+            pimaxv = V_BLEND(minus1, pimaxv, exit0);
+            V_STORE(rowMax + (i-1)*SIMD_WIDTH16, pimaxv);
+            maskv = V_NOT(msk);
+        }
+        pimaxv = imaxv;
+        minsc_msk = V_AND(V_CMPGE16(imaxv, minscv), minsc_msk_a);
+
+        // Block II: gmax, te
+        VEC cmp0 = V_AND(V_CMPGT16(imaxv, gmaxv), exit0);
+        gmaxv = V_BLEND(gmaxv, imaxv, cmp0);
+        tev = V_BLEND(tev, iv, cmp0);
+        qev = V_BLEND(qev, iqev, cmp0);
+
+        cmp0 = V_AND(V_CMPGE16(gmaxv, endscv), endsc_msk_a);
+        exit0 = V_ANDNOT(cmp0, exit0);
+        if (V_MOVEMASK8(exit0) == 0) {
+            limit = i++;
+            break;
+        }
+
+        int16_t *S = H1; H1 = H0; H0 = S;
+        iv = V_ADD16(iv, onev);
+    } // for nrow
+
+    pimaxv = V_BLEND(pimaxv, minus1, maskv);
+    pimaxv = V_BLEND(minus1, pimaxv, minsc_msk);
+    pimaxv = V_BLEND(minus1, pimaxv, exit0);
+    V_STORE(rowMax + (i-1) * SIMD_WIDTH16, pimaxv);
+
+    /******************* DP loop over *****************************/
+    /*************** Partial output setting ***************/
+    int16_t score[SIMD_WIDTH16] __attribute((aligned(64)));
+    int16_t te[SIMD_WIDTH16] __attribute((aligned(64)));
+    int16_t qe[SIMD_WIDTH16] __attribute((aligned(64)));
+    int16_t low[SIMD_WIDTH16] __attribute((aligned(64)));
+    int16_t high[SIMD_WIDTH16] __attribute((aligned(64)));  
+    V_STORE(score, gmaxv); 
+    V_STORE(te, tev);
+    V_STORE(qe, qev);
+
+    for (int l=0; l<SIMD_WIDTH16 && (po_ind + l) < numPairs; l++) {
+        int ind = p[l].regid;    // index of corr. aln
+        if (phase) {
+            if (aln[ind].score == score[l]) {
+                aln[ind].tb = aln[ind].te - te[l];
+                aln[ind].qb = aln[ind].qe - qe[l];
+            }
+        } else {
+            aln[ind].score = score[l];
+            aln[ind].te = te[l];
+            aln[ind].qe = qe[l];
+        }
+    }
+    if (phase) return 1;
+
+    /*************** Score2 and te2 *******************/
+    int qmax = this->g_qmax;    
+    int maxl = 0 , minh = nrow;
+    for (int i=0; i<SIMD_WIDTH16; i++)
+    {
+        int val = (score[i] + qmax - 1) / qmax;
+        low[i] = te[i] - val;
+        high[i] = te[i] + val;
+        maxl = maxl < low[i] ? low[i] : maxl;
+        minh = minh > high[i] ? high[i] : minh;
+    }
+
+    maxv = V_SET1_16(-1);
+    tev = V_SET1_16(-1);
+    VEC lowv = V_LOAD(low);
+    VEC highv = V_LOAD(high);
+
+    VEC rmaxv;
+    for (int i=0; i< maxl; i++)
+    {
+        VEC iv = V_SET1_16(i);
+        rmaxv = V_LOAD(rowMax + i*SIMD_WIDTH16);
+        VEC mask1 = V_CMPGT16(lowv, iv);
+        VEC mask2 = V_AND(V_CMPGT16(rmaxv, maxv), mask1);
+        maxv = V_BLEND(maxv, rmaxv, mask2);
+        tev = V_BLEND(tev, iv, mask2);
+    }
+
+    int16_t rlen[SIMD_WIDTH16] __attribute((aligned(64)));
+    for (int i=0; i<SIMD_WIDTH16; i++) rlen[i] = p[i].len1;
+    VEC rlenv = V_LOAD(rlen);
+    
+    for (int i=minh+1; i<limit; i++)
+    {
+        VEC iv = V_SET1_16(i);
+        rmaxv = V_LOAD(rowMax + i*SIMD_WIDTH16);
+        VEC mask1 = V_CMPGT16(iv, highv);
+        VEC mask2 = V_AND(V_CMPGT16(rmaxv, maxv), mask1);
+        mask2 = V_AND(mask2, V_CMPGT16(rlenv, iv));
+        maxv = V_BLEND(maxv, rmaxv, mask2);
+        tev = V_BLEND(tev, iv, mask2);
+    }
+
+    V_STORE(temp1, maxv);
+    V_STORE(temp2, tev);
+
+    for (int i=0; i<SIMD_WIDTH16 && (po_ind + i) < numPairs; i++) {    
+        int ind = p[i].regid;    // index of corr. aln
+        aln[ind].score2 = temp1[i];
+        aln[ind].te2 = temp2[i];
+    }
+    return 1;
+}
+#endif // !__AVX512BW__
+#endif // KSWV_BATCH
+
+#ifdef SIMD_DISPATCH_SUFFIX
+/************************************************************************************/
+// Entry points of this ISA copy, picked up by the baseline kswv
+static void *kswv_create(int o_del, int e_del, int o_ins, int e_ins,
+                         int8_t w_match, int8_t w_mismatch, int numThreads,
+                         int32_t maxRefLen, int32_t maxQerLen)
+{
+    return new kswv(o_del, e_del, o_ins, e_ins, w_match, w_mismatch,
+                    numThreads, maxRefLen, maxQerLen);
+}
+
+static void kswv_destroy(void *ksw)
+{
+    delete (kswv *) ksw;
+}
+
+static void kswv_getScores8(void *ksw, SeqPair *pairArray, uint8_t *seqBufRef,
+                            uint8_t *seqBufQer, kswr_t *aln, int32_t numPairs,
+                            uint16_t numThreads, int phase)
+{
+    ((kswv *) ksw)->getScores8(pairArray, seqBufRef, seqBufQer, aln,
+                               numPairs, numThreads, phase);
+}
+
+static void kswv_getScores16(void *ksw, SeqPair *pairArray, uint8_t *seqBufRef,
+                             uint8_t *seqBufQer, kswr_t *aln, int32_t numPairs,
+                             uint16_t numThreads, int phase)
+{
+    ((kswv *) ksw)->getScores16(pairArray, seqBufRef, seqBufQer, aln,
+                                numPairs, numThreads, phase);
+}
+
+extern const kswv_ops_t SIMD_PASTE(kswv_ops_, SIMD_DISPATCH_SUFFIX);
+const kswv_ops_t SIMD_PASTE(kswv_ops_, SIMD_DISPATCH_SUFFIX) = {
+#if __AVX512BW__
+    SIMD_ISA_AVX512BW,
+#else
+    SIMD_ISA_AVX2,
+#endif
+    kswv_create, kswv_destroy, kswv_getScores8, kswv_getScores16
+};
+#endif
 
 
 
@@ -42,6 +42,13 @@ Authors: Vasimuddin Md <vasimuddin.md@intel.com>; Sanchit Misra <sanchit.misra@i
 #include <immintrin.h>
 #endif
 
+#ifdef SIMD_DISPATCH_SUFFIX
+#define kswv SIMD_PASTE(kswv_, SIMD_DISPATCH_SUFFIX)
+#endif
+
+// inter-sequence (batched) kernels: 512-bit, 256-bit and 128-bit vectors
+#define KSWV_BATCH (__AVX512BW__ || __AVX2__ || __SSE4_1__)
+
 #ifdef __GNUC__
 #define LIKELY(x) __builtin_expect((x),1)
 #define UNLIKELY(x) __builtin_expect((x),0)
@@ -159,7 +166,7 @@ public:
 	kswq_t* ksw_qinit(int size, int qlen, uint8_t *query, int m, const int8_t *mat);
 	
 private:
-#if __AVX512BW__
+#if KSWV_BATCH
 	void kswvBatchWrapper8(SeqPair *pairArray,
 						   uint8_t *seqBufRef,
 						   uint8_t *seqBufQer,
@@ -168,6 +175,16 @@ private:
 						   uint16_t numThreads,
 						   int phase);
 
+	void kswvBatchWrapper16(SeqPair *pairArray,
+							uint8_t *seqBufRef,
+							uint8_t *seqBufQer,
+							kswr_t* aln,
+							int32_t numPairs,
+							uint16_t numThreads,
+							int phase);
+#endif
+
+#if __AVX512BW__
 	int kswv512_u8(uint8_t seq1SoA[],
 				   uint8_t seq2SoA[],
 				   int16_t nrow,
@@ -178,14 +195,6 @@ private:
 				   uint16_t tid,
 				   int32_t numPairs,
 				   int phase);
-    
-	void kswvBatchWrapper16(SeqPair *pairArray,
-							uint8_t *seqBufRef,
-							uint8_t *seqBufQer,
-							kswr_t* aln,
-							int32_t numPairs,
-							uint16_t numThreads,
-							int phase);
 	
 	int kswv512_16(int16_t seq1SoA[],
                    int16_t seq2SoA[],
@@ -197,6 +206,50 @@ private:
                    uint16_t tid,
                    int32_t numPairs,
                    int phase);
+#elif __AVX2__
+	int kswv256_u8(uint8_t seq1SoA[],
+				   uint8_t seq2SoA[],
+				   int16_t nrow,
+				   int16_t ncol,
+				   SeqPair *p,
+				   kswr_t *aln,
+				   int po_ind,
+				   uint16_t tid,
+				   int32_t numPairs,
+				   int phase);
+
+	int kswv256_16(int16_t seq1SoA[],
+                   int16_t seq2SoA[],
+                   int16_t nrow,
+                   int16_t ncol,
+                   SeqPair *p,
+                   kswr_t* aln,
+                   int po_ind,
+                   uint16_t tid,
+                   int32_t numPairs,
+                   int phase);
+#elif __SSE4_1__
+	int kswv128_u8(uint8_t seq1SoA[],
+				   uint8_t seq2SoA[],
+				   int16_t nrow,
+				   int16_t ncol,
+				   SeqPair *p,
+				   kswr_t *aln,
+				   int po_ind,
+				   uint16_t tid,
+				   int32_t numPairs,
+				   int phase);
+
+	int kswv128_16(int16_t seq1SoA[],
+                   int16_t seq2SoA[],
+                   int16_t nrow,
+                   int16_t ncol,
+                   SeqPair *p,
+                   kswr_t* aln,
+                   int po_ind,
+                   uint16_t tid,
+                   int32_t numPairs,
+                   int phase);
 #endif
 	
 	kswr_t kswvScalar_u8(kswq_t *q, int tlen, const uint8_t *target,
@@ -232,6 +285,12 @@ private:
 	int64_t setupTicks;
 	int64_t swTicks;
 	int64_t sort2Ticks;
+
+#ifdef SIMD_DISPATCH
+	// kernels of the runtime-selected ISA, NULL if the ones compiled here are used
+	const struct kswv_ops_s *isaOps;
+	void *isaImpl;
+#endif
 };
 
 #endif
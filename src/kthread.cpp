@@ -30,6 +30,7 @@
 *****************************************************************************************/
 
 #include "kthread.h"
+#include "perfctr.h"
 #include <stdio.h>
 
 #if AFF && (__linux__)
@@ -56,6 +57,8 @@ static void *ktf_worker(void *data)
 	long i;
 	int tid = w->tid;
 
+	if (perfctr_on) perfctr_thread_open(tid);
+
 #if AFF && (__linux__)
 	//fprintf(stderr, "i: %d, CPU: %d\n", tid , sched_getcpu());
 #endif
@@ -73,6 +76,7 @@ static void *ktf_worker(void *data)
 		int ed = (i + 1) * BATCH_SIZE < w->t->n? (i + 1) * BATCH_SIZE : w->t->n;
 		w->t->func(w->t->data, st, ed-st, tid);
 	}
+	if (perfctr_on) perfctr_thread_close(tid);
 	pthread_exit(0);
 }
 
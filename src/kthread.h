@@ -53,6 +53,8 @@ typedef struct {
 	worker_t *w;
 	mem_opt_t *opt;
 	int i;
+	int busy;         // running (not waiting for) its step
+	uint64_t t_beg;   // __rdtsc() when it started the step
 } ktp_worker_t;
 
 typedef struct ktp_t {
@@ -63,6 +65,7 @@ typedef struct ktp_t {
 	ktp_worker_t *workers;
 	pthread_mutex_t mutex;
 	pthread_cond_t cv;
+	uint64_t busy[4]; // cycles spent in each step; busy, t_beg and this for --metrics
 } ktp_t;
 
 // ---------------
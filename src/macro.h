@@ -45,6 +45,8 @@
 #define __STR_AND_VAL(str, val) str #val
 #define STR_AND_VAL(str, val) __STR_AND_VAL(str, val) // the extra indirection is required.
 #define VER 0
+#define SIMD_PASTE_(a, b) a##b
+#define SIMD_PASTE(a, b) SIMD_PASTE_(a, b)
 #define printf_(x,y...)								\
 	{												\
 		if(x)										\
@@ -191,6 +193,7 @@
 #define PE24 110
 #define PE25 111
 #define PE26 112
+#define CHAINING 113
 #ifdef PERFECT_MATCH
 #define PERFECT_TABLE_READ 114
 #define DO_PERFECT_MATCH 115
@@ -56,19 +56,54 @@ int usage()
     fprintf(stderr, "  perfect-index create index for perfect match\n");
     fprintf(stderr, "  smem-table    create index for FM-index accelerator\n");
     fprintf(stderr, "  mem           alignment\n");
+    fprintf(stderr, "  serve         keep the index loaded and run mem jobs sent over a Unix socket\n");
+    fprintf(stderr, "  submit        send a mem job to a running server\n");
+    fprintf(stderr, "  merge         join the outputs of mem --shard into one\n");
+    fprintf(stderr, "  simulate      sample reads from the reference of an index for benchmarks\n");
+    fprintf(stderr, "  regress       compare the output and speed of mem against a baseline\n");
     fprintf(stderr, "  load-shm      load index on process shared memory\n");
     fprintf(stderr, "  remove-shm    remove index from process shared memory\n");
     fprintf(stderr, "  version       print version number\n");
     return 1;
 }
 
+static void print_mode()
+{
+    fprintf(stderr, "-----------------------------\n");
+#ifdef SIMD_DISPATCH
+    fprintf(stderr, "Executing in %s mode (runtime dispatch)!!\n",
+            simd_isa_name(simd_dispatch_init(getenv(SIMD_DISPATCH_ENV))));
+#else
+#if __AVX512BW__
+    fprintf(stderr, "Executing in AVX512 mode!!\n");
+#endif
+#if ((!__AVX512BW__) & (__AVX2__))
+    fprintf(stderr, "Executing in AVX2 mode!!\n");
+#endif
+#if ((!__AVX512BW__) && (!__AVX2__) && (__SSE2__))
+    fprintf(stderr, "Executing in SSE4.1 mode!!\n");
+#endif
+#if ((!__AVX512BW__) && (!__AVX2__) && (!__SSE2__))
+    fprintf(stderr, "Executing in Scalar mode!!\n");
+#endif
+#endif
+    fprintf(stderr, "-----------------------------\n");
+}
+
 int main(int argc, char* argv[])
 {
         
+    // neither needs the clock calibration below
+    if (argc >= 2 && strcmp(argv[1], "submit") == 0) return main_submit(argc-1, argv+1);
+    if (argc >= 2 && strcmp(argv[1], "merge") == 0) return main_merge(argc-1, argv+1);
+    if (argc >= 2 && strcmp(argv[1], "simulate") == 0) return main_simulate(argc-1, argv+1);
+    if (argc >= 2 && strcmp(argv[1], "regress") == 0) return main_regress(argc-1, argv+1);
+
     // ---------------------------------    
     uint64_t tim = __rdtsc();
     sleep(1);
     proc_freq = __rdtsc() - tim;
+    tprof_init();
 
     int ret = -1;
     if (argc < 2) return usage();
@@ -86,20 +121,7 @@ int main(int argc, char* argv[])
         kstring_t pg = {0,0,0};
         extern char *bwa_pg;
 
-        fprintf(stderr, "-----------------------------\n");
-#if __AVX512BW__
-        fprintf(stderr, "Executing in AVX512 mode!!\n");
-#endif
-#if ((!__AVX512BW__) & (__AVX2__))
-        fprintf(stderr, "Executing in AVX2 mode!!\n");
-#endif
-#if ((!__AVX512BW__) && (!__AVX2__) && (__SSE2__))
-        fprintf(stderr, "Executing in SSE4.1 mode!!\n");
-#endif
-#if ((!__AVX512BW__) && (!__AVX2__) && (!__SSE2__))
-        fprintf(stderr, "Executing in Scalar mode!!\n");
-#endif
-        fprintf(stderr, "-----------------------------\n");
+        print_mode();
 
         #if SA_COMPRESSION
         fprintf(stderr, "SA compression enable with xfactor (2^): %d !!!\n", SA_COMPX);
@@ -158,6 +180,11 @@ int main(int argc, char* argv[])
 		return ret;
 	}
 #endif
+    else if (strcmp(argv[1], "serve") == 0)
+    {
+        print_mode();
+        return main_serve(argc-1, argv+1);
+    }
     else if (strcmp(argv[1], "version") == 0)
     {
         puts(PACKAGE_VERSION);
@@ -47,8 +47,14 @@
 #include "bandedSWA.h"
 #include "profiling.h"
 #include "fastmap.h"
+#include "simd_dispatch.h"
 
 int bwa_index(int argc, char *argv[]);
+int main_serve(int argc, char *argv[]);
+int main_submit(int argc, char *argv[]);
+int main_merge(int argc, char *argv[]);
+int main_simulate(int argc, char *argv[]);
+int main_regress(int argc, char *argv[]);
 #ifdef PERFECT_MATCH
 int perfect_index(int argc, char *argv[]);
 int perfect_map(int argc, char *argv[]);
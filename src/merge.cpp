@@ -0,0 +1,117 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM-SCALE (Memory-Scalable Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2022 Electronics and Telecommunications Research Institute (ETRI), Changdae Kim.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   Contacts: Changdae Kim <cdkim@etri.re.kr>
+
+** This software builds upon BWA-MEM2, and includes several performance optimization techniques.
+   For BWA-MEM2, refer to the follows.
+
+   BWA-MEM2 (Sequence alignment using Burrows-Wheeler Transform)
+   Copyright ⓒ 2019 Intel Corporation, Heng Li
+   The MIT License
+   Website: https://github.com/bwa-mem2/bwa-mem2
+
+*****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kstring.h"
+#include "main.h"
+
+/* Joins the outputs of 'mem --shard i/N' for i = 0..N-1 into the output of
+ * the unsharded run: the header of shard 0 without the shard marker and the
+ * --shard argument of @PG, then the records of every shard in order. */
+
+static int merge_getline(FILE *fp, kstring_t *s)
+{
+	int c;
+	s->l = 0;
+	while ((c = getc(fp)) != EOF) {
+		kputc(c, s);
+		if (c == '\n') break;
+	}
+	return s->l > 0? 0 : -1;
+}
+
+// drop " --shard X" or " --shard=X" from the CL field of @PG
+static void merge_fix_pg(kstring_t *s)
+{
+	char *p = strstr(s->s, " --shard"), *q;
+	if (p == 0 || (p[8] != ' ' && p[8] != '=')) return;
+	q = p + 9;
+	while (*q && *q != ' ' && *q != '\t' && *q != '\n') ++q;
+	memmove(p, q, s->s + s->l + 1 - q);
+	s->l -= q - p;
+}
+
+int main_merge(int argc, char *argv[])
+{
+	kstring_t line = {0, 0, 0};
+	int i, n = argc - 1;
+
+	if (n < 1) {
+		fprintf(stderr, "Usage: bwa-mem2 merge <shard0.sam> <shard1.sam> ... > out.sam\n");
+		fprintf(stderr, "Joins the outputs of 'mem --shard i/N', given in order, into the output of a single run.\n");
+		return 1;
+	}
+	for (i = 0; i < n; ++i) {
+		FILE *fp = fopen(argv[i + 1], "r");
+		int si = -1, sn = -1, hdr = 1;
+		if (fp == 0) {
+			fprintf(stderr, "[E::%s] fail to open file `%s'.\n", __func__, argv[i + 1]);
+			return 1;
+		}
+		while (merge_getline(fp, &line) == 0) {
+			if (hdr && line.s[0] == '@') {
+				if (strncmp(line.s, "@CO\tshard:", 10) == 0) {
+					sscanf(line.s + 10, "%d/%d", &si, &sn);
+					continue;
+				}
+				if (i > 0) continue; // the header of shard 0 stands for all
+				if (strncmp(line.s, "@PG\t", 4) == 0) merge_fix_pg(&line);
+			} else if (hdr) {
+				hdr = 0;
+				if (si != i || sn != n) {
+					fprintf(stderr, "[E::%s] `%s' is shard %d/%d; expected shard %d/%d\n", __func__, argv[i + 1], si, sn, i, n);
+					return 1;
+				}
+			}
+			fwrite(line.s, 1, line.l, stdout);
+		}
+		if (hdr && (si != i || sn != n)) { // a shard without records
+			fprintf(stderr, "[E::%s] `%s' is shard %d/%d; expected shard %d/%d\n", __func__, argv[i + 1], si, sn, i, n);
+			return 1;
+		}
+		fclose(fp);
+	}
+	free(line.s);
+	if (fflush(stdout) != 0) {
+		fprintf(stderr, "[E::%s] failed to write the merged output\n", __func__);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,206 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM-SCALE (Memory-Scalable Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2022 Electronics and Telecommunications Research Institute (ETRI), Changdae Kim.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   Contacts: Changdae Kim <cdkim@etri.re.kr>
+
+** This software builds upon BWA-MEM2, and includes several performance optimization techniques.
+   For BWA-MEM2, refer to the follows.
+
+   BWA-MEM2 (Sequence alignment using Burrows-Wheeler Transform)
+   Copyright ⓒ 2019 Intel Corporation, Heng Li
+   The MIT License
+   Website: https://github.com/bwa-mem2/bwa-mem2
+
+*****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "perfctr.h"
+
+int perfctr_on = 0;
+perfctr_thread_t perfctr_th[LIM_C];
+
+static int pc_avail[PC_N_EVENTS];
+static const char *pc_stage_name[PC_N_STAGES] = { "bwt", "smem", "sal", "aln", "sam" };
+static const char *pc_event_name[PC_N_EVENTS] = { "cycles", "instructions", "llc_misses", "dtlb_misses", "stalled_cycles" };
+
+static void pc_attr(struct perf_event_attr *a, int e)
+{
+	memset(a, 0, sizeof(*a));
+	a->size = sizeof(*a);
+	a->type = PERF_TYPE_HARDWARE;
+	a->exclude_kernel = 1; // allowed with perf_event_paranoid 2
+	a->exclude_hv = 1;
+	switch (e) {
+	case PC_CYCLES:    a->config = PERF_COUNT_HW_CPU_CYCLES; break;
+	case PC_INSTR:     a->config = PERF_COUNT_HW_INSTRUCTIONS; break;
+	case PC_LLC_MISS:  a->config = PERF_COUNT_HW_CACHE_MISSES; break;
+	case PC_DTLB_MISS: a->type = PERF_TYPE_HW_CACHE;
+	                   a->config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+	                               (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	                   break;
+	case PC_STALL:     a->config = PERF_COUNT_HW_STALLED_CYCLES_BACKEND; break;
+	}
+	if (e == PC_CYCLES)
+		a->read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+}
+
+static int pc_open(int e, int group)
+{
+	struct perf_event_attr a;
+	pc_attr(&a, e);
+	return syscall(__NR_perf_event_open, &a, 0, -1, group, 0); // this thread, any CPU
+}
+
+/* Find out which events this thread may count. Returns 0, with the counters
+ * left off, when not even cycles can be counted. */
+int perfctr_init(void)
+{
+	int e, fd0, fd;
+
+	perfctr_on = 0;
+	memset(perfctr_th, 0, sizeof(perfctr_th));
+	if ((fd0 = pc_open(PC_CYCLES, -1)) < 0) {
+		int e = errno;
+		fprintf(stderr, "[W::%s] hardware counters are not available (%s%s); continuing without them\n", __func__, strerror(e),
+				e == EACCES || e == EPERM? ", see /proc/sys/kernel/perf_event_paranoid" : "");
+		return 0;
+	}
+	pc_avail[PC_CYCLES] = 1;
+	for (e = PC_CYCLES + 1; e < PC_N_EVENTS; ++e) {
+		pc_avail[e] = (fd = pc_open(e, fd0)) >= 0;
+		if (fd >= 0) close(fd);
+		else fprintf(stderr, "[W::%s] %s cannot be counted (%s)\n", __func__, pc_event_name[e], strerror(errno));
+	}
+	close(fd0);
+	perfctr_on = 1;
+	return 1;
+}
+
+void perfctr_thread_open(int tid)
+{
+	perfctr_thread_t *t = &perfctr_th[tid];
+	int e, n = 0;
+
+	for (e = 0; e < PC_N_EVENTS; ++e) t->fd[e] = -1, t->pos[e] = -1;
+	if ((t->fd[PC_CYCLES] = pc_open(PC_CYCLES, -1)) < 0) return;
+	t->pos[PC_CYCLES] = n++;
+	for (e = PC_CYCLES + 1; e < PC_N_EVENTS; ++e)
+		if (pc_avail[e] && (t->fd[e] = pc_open(e, t->fd[PC_CYCLES])) >= 0)
+			t->pos[e] = n++;
+}
+
+void perfctr_thread_close(int tid)
+{
+	perfctr_thread_t *t = &perfctr_th[tid];
+	for (int e = PC_N_EVENTS - 1; e >= 0; --e)
+		if (t->fd[e] >= 0) close(t->fd[e]), t->fd[e] = -1;
+}
+
+void perfctr_read(int tid, uint64_t b[PC_N_READ])
+{
+	perfctr_thread_t *t = &perfctr_th[tid];
+	uint64_t buf[3 + PC_N_EVENTS]; // nr, time enabled, time running, values
+
+	memset(b, 0, PC_N_READ * sizeof(uint64_t));
+	if (t->fd[PC_CYCLES] < 0 || read(t->fd[PC_CYCLES], buf, sizeof(buf)) < (ssize_t)(3 * sizeof(uint64_t)))
+		return;
+	for (int e = 0; e < PC_N_EVENTS; ++e)
+		if (t->pos[e] >= 0 && (uint64_t) t->pos[e] < buf[0]) b[e] = buf[3 + t->pos[e]];
+	b[PC_N_EVENTS] = buf[1], b[PC_N_EVENTS + 1] = buf[2];
+}
+
+void perfctr_add(int tid, int stage, const uint64_t b[PC_N_READ])
+{
+	uint64_t c[PC_N_READ];
+	perfctr_read(tid, c);
+	uint64_t en = c[PC_N_EVENTS] - b[PC_N_EVENTS], run = c[PC_N_EVENTS + 1] - b[PC_N_EVENTS + 1];
+	double scale = run > 0 && run < en? (double) en / run : 1.; // the group was multiplexed
+	for (int e = 0; e < PC_N_EVENTS; ++e)
+		perfctr_th[tid].v[stage][e] += (uint64_t)((c[e] - b[e]) * scale);
+}
+
+static void pc_sum(int s, int nthreads, uint64_t sum[PC_N_EVENTS], double *ipc_min, double *ipc_max)
+{
+	memset(sum, 0, PC_N_EVENTS * sizeof(uint64_t));
+	*ipc_min = 1e9, *ipc_max = 0;
+	for (int i = 0; i < nthreads; ++i) {
+		const uint64_t *v = perfctr_th[i].v[s];
+		for (int e = 0; e < PC_N_EVENTS; ++e) sum[e] += v[e];
+		if (v[PC_CYCLES] == 0) continue;
+		double ipc = (double) v[PC_INSTR] / v[PC_CYCLES];
+		if (ipc < *ipc_min) *ipc_min = ipc;
+		if (ipc > *ipc_max) *ipc_max = ipc;
+	}
+	if (*ipc_min > *ipc_max) *ipc_min = 0;
+}
+
+void perfctr_print(FILE *fp, int nthreads)
+{
+	uint64_t sum[PC_N_EVENTS];
+	double lo, hi;
+
+	if (!perfctr_on) return;
+	fprintf(fp, "\n\tHardware counters (sum over threads; IPC min-max over threads):\n");
+	for (int s = 0; s < PC_N_STAGES; ++s) {
+		pc_sum(s, nthreads, sum, &lo, &hi);
+		double ki = sum[PC_INSTR] / 1e3;
+		fprintf(fp, "\t\t%-4s cycles: %.3e IPC: %.2f (%.2f-%.2f)", pc_stage_name[s], (double) sum[PC_CYCLES],
+				sum[PC_CYCLES]? (double) sum[PC_INSTR] / sum[PC_CYCLES] : 0., lo, hi);
+		if (pc_avail[PC_LLC_MISS]) fprintf(fp, " LLC-miss/kinstr: %.2f", ki > 0? sum[PC_LLC_MISS] / ki : 0.);
+		if (pc_avail[PC_DTLB_MISS]) fprintf(fp, " dTLB-miss/kinstr: %.2f", ki > 0? sum[PC_DTLB_MISS] / ki : 0.);
+		if (pc_avail[PC_STALL]) fprintf(fp, " stalled: %.1f%%", sum[PC_CYCLES]? 100. * sum[PC_STALL] / sum[PC_CYCLES] : 0.);
+		fputc('\n', fp);
+	}
+}
+
+void perfctr_json(FILE *fp, int nthreads)
+{
+	uint64_t sum[PC_N_EVENTS];
+	double lo, hi;
+
+	if (!perfctr_on) {
+		fprintf(fp, "null");
+		return;
+	}
+	fprintf(fp, "{\n");
+	for (int s = 0; s < PC_N_STAGES; ++s) {
+		pc_sum(s, nthreads, sum, &lo, &hi);
+		fprintf(fp, "    \"%s\": {", pc_stage_name[s]);
+		for (int e = 0; e < PC_N_EVENTS; ++e) {
+			if (pc_avail[e]) fprintf(fp, "\"%s\": %lu, ", pc_event_name[e], (unsigned long) sum[e]);
+			else fprintf(fp, "\"%s\": null, ", pc_event_name[e]);
+		}
+		fprintf(fp, "\"ipc\": %.3f, \"ipc_min\": %.3f, \"ipc_max\": %.3f}%s\n",
+				sum[PC_CYCLES]? (double) sum[PC_INSTR] / sum[PC_CYCLES] : 0., lo, hi, s + 1 < PC_N_STAGES? "," : "");
+	}
+	fprintf(fp, "  }");
+}
@@ -0,0 +1,82 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM-SCALE (Memory-Scalable Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2022 Electronics and Telecommunications Research Institute (ETRI), Changdae Kim.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   Contacts: Changdae Kim <cdkim@etri.re.kr>
+
+** This software builds upon BWA-MEM2, and includes several performance optimization techniques.
+   For BWA-MEM2, refer to the follows.
+
+   BWA-MEM2 (Sequence alignment using Burrows-Wheeler Transform)
+   Copyright ⓒ 2019 Intel Corporation, Heng Li
+   The MIT License
+   Website: https://github.com/bwa-mem2/bwa-mem2
+
+*****************************************************************************************/
+
+#ifndef _PERFCTR_H_
+#define _PERFCTR_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include "macro.h"
+
+/*
+ * Hardware performance counters (--perf-counters).
+ * Each kt_for worker thread opens one perf_event group on itself: cycles,
+ * instructions, LLC misses, dTLB load misses and stalled cycles. The kernels
+ * read the group around worker_bwt, worker_aln and worker_sam, and around the
+ * FM-index lookups in worker_bwt (SMEM search and SA lookup with chaining),
+ * and add the differences to the block of the thread and stage. Events the
+ * CPU or kernel do not offer are reported as null; if not even cycles can be
+ * counted (e.g. perf_event_paranoid), the counters stay off with a warning.
+ */
+
+enum { PC_CYCLES, PC_INSTR, PC_LLC_MISS, PC_DTLB_MISS, PC_STALL, PC_N_EVENTS };
+enum { PC_BWT, PC_SMEM, PC_SAL, PC_ALN, PC_SAM, PC_N_STAGES };
+
+#define PC_N_READ (PC_N_EVENTS + 2) // + time enabled and running, to scale multiplexed counts
+
+typedef struct {
+	int fd[PC_N_EVENTS];          // fd[PC_CYCLES] leads the group; -1 if not open
+	int pos[PC_N_EVENTS];         // position of each event in the group read, -1 if not available
+	uint64_t v[PC_N_STAGES][PC_N_EVENTS];
+} __attribute__((aligned(64))) perfctr_thread_t;
+
+extern int perfctr_on;
+extern perfctr_thread_t perfctr_th[LIM_C];
+
+int perfctr_init(void);
+void perfctr_thread_open(int tid);
+void perfctr_thread_close(int tid);
+void perfctr_read(int tid, uint64_t b[PC_N_READ]);
+void perfctr_add(int tid, int stage, const uint64_t b[PC_N_READ]);
+void perfctr_print(FILE *fp, int nthreads);
+void perfctr_json(FILE *fp, int nthreads);
+
+#define PERFCTR_BEG(tid, b) uint64_t b[PC_N_READ]; if (perfctr_on) perfctr_read(tid, b)
+#define PERFCTR_END(tid, stage, b) do { if (perfctr_on) perfctr_add(tid, stage, b); } while (0)
+
+#endif
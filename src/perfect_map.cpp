@@ -47,6 +47,7 @@
 #include "utils.h"
 #include "kstring.h"
 #include "kvec.h"
+#include "arena.h"
 #include <string>
 #include "bwa_shm.h"
 #include "safe_lib.h"
@@ -823,7 +824,7 @@ int mem_perfect2reg(const mem_opt_t *opt, perfect_table_t *pt, const bntseq_t *b
 
 	reg->n = av.n;
 	reg->m = av.n;
-	reg->a = (mem_alnreg_t *) calloc(av.n, sizeof(mem_alnreg_t)); 
+	reg->a = (mem_alnreg_t *) mem_arena_calloc(mem_arena_cur, av.n, sizeof(mem_alnreg_t));
 
 	for (i = 0; i < av.n; ++i) {
 		mem_aln_perfect_t *p = &av.a[i];
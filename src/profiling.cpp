@@ -37,10 +37,40 @@
 *****************************************************************************************/
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "macro.h"
 #include <stdint.h>
 #include <assert.h>
+#include <sys/resource.h>
 #include "profiling.h"
+#include "read_cache.h"
+#include "perfctr.h"
+#include "readtrace.h"
+
+mem_stats_t mem_stats;
+tprof_thread_t tprof_th[LIM_C];
+int tprof_on = TPROF;
+
+void tprof_init(void)
+{
+    const char *e = getenv(TPROF_ENV);
+    tprof_on = TPROF && !(e && strcmp(e, "0") == 0);
+}
+
+void tprof_merge(void)
+{
+    for (int i = 0; i < LIM_C; i++) {
+        tprof_thread_t *t = &tprof_th[i];
+        for (int s = 0; s < LIM_R; s++) tprof[s][i] += t->c[s];
+#ifdef PERFECT_MATCH
+        for (int j = 0; j < NUM_PPROF_ENTRY; j++) pprof[i][j] += t->pprof[j];
+        pprof2[i][0] += t->pprof2[0];
+        pprof2[i][1] += t->pprof2[1];
+#endif
+    }
+    memset(tprof_th, 0, sizeof(tprof_th));
+}
 
 int find_opt(uint64_t *a, int len, uint64_t *max, uint64_t *min, double *avg)
 {
@@ -89,7 +119,7 @@ int display_stats(int nthreads)
     uint64_t max, min;
     double avg;
 #ifdef PERFECT_MATCH
-	uint64_t sum_pprof[4];
+	uint64_t sum_pprof[NUM_PPROF_ENTRY];
 	uint64_t sum_pprof2[2];
 	uint64_t total_read = 0;
 #endif
@@ -109,6 +139,7 @@ int display_stats(int nthreads)
             sum_pprof2[1], ((float) sum_pprof2[1] * 100) / total_read,
             sum_pprof2[0] + sum_pprof2[1], ((float) (sum_pprof2[0] + sum_pprof2[1]) * 100) / total_read);
 #endif
+	read_cache_print_stats(stderr);
     fprintf(stderr, "Runtime profile:\n");
 
     fprintf(stderr, "\n\tTime taken for main_mem function: %0.2lf sec\n\n",
@@ -192,6 +223,10 @@ int display_stats(int nthreads)
     fprintf(stderr, "\t\tSMEM+CHAIN compute avg: %0.2lf, (%0.2lf, %0.2lf)\n",
             avg*1.0/proc_freq, max*1.0/proc_freq, min*1.0/proc_freq);
 
+    find_opt(tprof[CHAINING], nthreads, &max, &min, &avg);
+    fprintf(stderr, "\t\t\tChaining avg: %0.2lf, (%0.2lf, %0.2lf)\n",
+            avg*1.0/proc_freq, max*1.0/proc_freq, min*1.0/proc_freq);
+
 #if HIDE
     find_opt(tprof[MEM_COLLECT], nthreads, &max, &min, &avg);
     fprintf(stderr, "\t\tSMEM compute avg: %0.2lf, (%0.2lf, %0.2lf)\n",
@@ -216,6 +251,15 @@ int display_stats(int nthreads)
     find_opt(tprof[MEM_ALN2], nthreads, &max, &min, &avg);
     fprintf(stderr, "\t\tBSW time, avg: %0.2lf, (%0.2lf, %0.2lf)\n",
             avg*1.0/proc_freq, max*1.0/proc_freq, min*1.0/proc_freq);
+    {
+        fprintf(stderr, "\t\tBSW exact flanks (no DP): %ld\n", (long) mem_stats.n_exact_flanks);
+        if (mem_stats.n_wfa + mem_stats.n_wfa_dp > 0)
+            fprintf(stderr, "\t\tBSW wavefront extensions: %ld, DP fallbacks: %ld, "
+                    "differences from DP: %ld\n", (long) mem_stats.n_wfa, (long) mem_stats.n_wfa_dp,
+                    (long) mem_stats.n_wfa_diff);
+    }
+    perfctr_print(stderr, nthreads);
+    rtrace_print(stderr);
 
     #if HIDE
     int agg1 = 0, agg2 = 0, agg3 = 0;
@@ -305,3 +349,110 @@ int display_stats(int nthreads)
     return 1;
 }
 
+/* --stats-json: the numbers of display_stats() in one JSON object. Times are
+ * in seconds; "sec" is one wall-clock interval, while per-thread stages give
+ * the sum (CPU time spent in the stage) and the min/avg/max over threads. */
+static void json_sec(FILE *fp, const char *name, int idx, int last)
+{
+    fprintf(fp, "    \"%s\": {\"sec\": %.4f}%s\n", name, tprof[idx][0]*1.0/proc_freq, last? "" : ",");
+}
+
+static void json_threads(FILE *fp, const char *name, int idx, int nthreads, int last)
+{
+    uint64_t max, min, sum = 0;
+    double avg;
+    find_opt(tprof[idx], nthreads, &max, &min, &avg);
+    for (int i = 0; i < nthreads; i++) sum += tprof[idx][i];
+    fprintf(fp, "    \"%s\": {\"sum\": %.4f, \"min\": %.4f, \"avg\": %.4f, \"max\": %.4f}%s\n", name,
+            sum*1.0/proc_freq, min*1.0/proc_freq, avg/proc_freq, max*1.0/proc_freq, last? "" : ",");
+}
+
+int display_stats_json(const char *fn, int nthreads)
+{
+    FILE *fp = fopen(fn, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "[E::%s] fail to open file `%s'.\n", __func__, fn);
+        return 0;
+    }
+    mem_stats_t *st = &mem_stats;
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    double t_proc = tprof[PROCESS][0]*1.0/proc_freq;
+    int64_t rc[4];
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"threads\": %d,\n", nthreads);
+    fprintf(fp, "  \"cpu_mhz\": %.1f,\n", proc_freq*1.0/1e6);
+    fprintf(fp, "  \"wall_sec\": %.4f,\n", tprof[MEM][0]*1.0/proc_freq);
+    fprintf(fp, "  \"user_sec\": %.4f,\n", ru.ru_utime.tv_sec + ru.ru_utime.tv_usec*1e-6);
+    fprintf(fp, "  \"sys_sec\": %.4f,\n", ru.ru_stime.tv_sec + ru.ru_stime.tv_usec*1e-6);
+    fprintf(fp, "  \"max_rss_kb\": %ld,\n", (long) ru.ru_maxrss);
+    fprintf(fp, "  \"chunks\": %ld,\n", (long) st->n_chunks);
+    fprintf(fp, "  \"reads\": %ld,\n", (long) st->n_reads);
+    fprintf(fp, "  \"bases\": %ld,\n", (long) st->n_bases);
+    // over process(): index loading is left out, as it is in the time reported by stage
+    fprintf(fp, "  \"reads_per_sec\": %.1f,\n", t_proc > 0? st->n_reads / t_proc : 0.);
+    fprintf(fp, "  \"bases_per_sec\": %.1f,\n", t_proc > 0? st->n_bases / t_proc : 0.);
+
+    fprintf(fp, "  \"stages\": {\n");
+    json_sec(fp, "index_read", FMI, 0);
+    json_sec(fp, "ref_read", REF_IO, 0);
+#ifdef PERFECT_MATCH
+    json_sec(fp, "perfect_table_read", PERFECT_TABLE_READ, 0);
+#endif
+    json_sec(fp, "process", PROCESS, 0);
+    json_sec(fp, "read_io", READ_IO, 0);
+    json_sec(fp, "sam_io", SAM_IO, 0);
+    json_sec(fp, "mem_process_seqs", MEM_PROCESS2, 0);
+    json_sec(fp, "kernel", WORKER10, 0);
+    json_sec(fp, "worker_sam", WORKER20, 0);
+#ifdef PERFECT_MATCH
+    json_threads(fp, "perfect_match", DO_PERFECT_MATCH, nthreads, 0);
+#endif
+    json_threads(fp, "smem_chain", MEM_BWT, nthreads, 0);
+    json_threads(fp, "chaining", CHAINING, nthreads, 0);
+    json_threads(fp, "sal", MEM_SA_BLOCK, nthreads, 0);
+    json_threads(fp, "mem_sa", MEM_SA, nthreads, 0);
+    json_threads(fp, "bsw", MEM_ALN2, nthreads, 1);
+    fprintf(fp, "  },\n");
+
+    fprintf(fp, "  \"bsw\": {\"exact_flanks\": %ld, \"wavefront\": %ld, \"dp_fallback\": %ld, \"wavefront_diff\": %ld},\n",
+            (long) st->n_exact_flanks, (long) st->n_wfa, (long) st->n_wfa_dp, (long) st->n_wfa_diff);
+
+#ifdef PERFECT_MATCH
+    uint64_t sum_pprof[NUM_PPROF_ENTRY], sum_pprof2[2];
+    uint64_t total_read = collect_pprof(sum_pprof, sum_pprof2);
+    fprintf(fp, "  \"emf\": {\"total\": %lu, \"no_table\": %lu, \"with_N\": %lu, \"not_found\": %lu, "
+            "\"found_fw\": %lu, \"found_rc\": %lu, \"seed_only\": %lu, \"match_fw\": %lu, \"match_rc\": %lu},\n",
+            total_read, sum_pprof[0], sum_pprof[1], sum_pprof[2], sum_pprof[3], sum_pprof[4], sum_pprof[5],
+            sum_pprof2[0], sum_pprof2[1]);
+#else
+    fprintf(fp, "  \"emf\": null,\n");
+#endif
+    read_cache_get_stats(rc);
+    fprintf(fp, "  \"read_cache\": {\"hit\": %ld, \"dup\": %ld, \"aligned\": %ld, \"evicted\": %ld},\n",
+            (long) rc[0], (long) rc[1], (long) rc[2], (long) rc[3]);
+
+    fprintf(fp, "  \"prealloc_bytes\": {\"chaining\": %ld, \"bsw_per_thread\": %ld, \"bwt_per_thread\": %ld, "
+            "\"ert_per_thread\": %ld, \"arena_per_thread\": %ld},\n",
+            (long) st->mem_chain, (long) st->mem_bsw, (long) st->mem_bwt, (long) st->mem_ert, (long) st->mem_arena);
+    fprintf(fp, "  \"perf_counters\": ");
+    perfctr_json(fp, nthreads);
+    fprintf(fp, ",\n");
+    fprintf(fp, "  \"slow_reads\": ");
+    rtrace_json(fp);
+    fprintf(fp, ",\n");
+
+    if (st->shm_mode < 0) fprintf(fp, "  \"shm\": null\n");
+    else {
+        static const char *mode_str[] = { "matched", "disable", "renewal" };
+        fprintf(fp, "  \"shm\": {\"mode\": \"%s\", \"hugetlb\": %d, \"components\": {",
+                st->shm_mode < 3? mode_str[st->shm_mode] : "unknown", st->shm_hugetlb);
+        for (int m = 0; m < st->n_shm; m++)
+            fprintf(fp, "%s\"%s\": %s", m? ", " : "", st->shm_name[m], st->shm_on[m]? "true" : "false");
+        fprintf(fp, "}}\n");
+    }
+    fprintf(fp, "}\n");
+    fclose(fp);
+    return 1;
+}
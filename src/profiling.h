@@ -40,11 +40,65 @@
 #define _PROFILE_HPP
 
 #define NUM_PPROF_ENTRY 6
+#define NUM_STATS_SHM 16
+
+/* What --stats-json reports beyond tprof/pprof; filled in by main_mem */
+typedef struct {
+	int64_t n_chunks, n_reads, n_bases;  /* aligned by this job; --shard skips are not counted */
+	int64_t n_exact_flanks;              /* seed flanks extended without DP */
+	int64_t n_wfa, n_wfa_dp, n_wfa_diff;  /* -e wfa: wavefront extensions, DP fallbacks, wfa-check differences */
+	int64_t mem_chain;                    /* pre-allocation (bytes) for chaining, all threads */
+	int64_t mem_bsw, mem_bwt, mem_ert, mem_arena; /* pre-allocation (bytes) per thread */
+	int shm_mode;                         /* enum bwa_shm_mode, -1 without shm */
+	int shm_hugetlb;
+	int n_shm;                            /* index components, and whether each is mapped from shm */
+	const char *shm_name[NUM_STATS_SHM];
+	int shm_on[NUM_STATS_SHM];
+} mem_stats_t;
+extern mem_stats_t mem_stats;
 
 int display_stats(int );
+int display_stats_json(const char *fn, int nthreads);
 extern uint64_t proc_freq, tprof[LIM_R][LIM_C];
 #ifdef PERFECT_MATCH
 extern uint64_t pprof[LIM_C][NUM_PPROF_ENTRY];
 extern uint64_t pprof2[LIM_C][2];
 #endif
+
+/*** Per-thread counters ***/
+/* In tprof[STAGE][tid] the counters of eight neighbouring threads share a
+ * cache line. Worker threads count into their own cache-line aligned block
+ * instead; tprof_merge() adds the blocks into tprof/pprof/pprof2 (and clears
+ * them) before the stats are printed. 'make tprof=0' compiles the counting
+ * and its timestamps (TPROF_TSC) out of the kernels; BWA_MEM_TPROF=0 skips
+ * them at runtime. The exact match filter outcomes (pprof) are statistics,
+ * not timing, and are counted either way. */
+#ifndef TPROF
+#define TPROF 1
+#endif
+#define TPROF_ENV "BWA_MEM_TPROF"
+
+typedef struct {
+	uint64_t c[LIM_R];
+#ifdef PERFECT_MATCH
+	uint64_t pprof[NUM_PPROF_ENTRY];
+	uint64_t pprof2[2];
+#endif
+} __attribute__((aligned(64))) tprof_thread_t;
+
+extern tprof_thread_t tprof_th[LIM_C];
+extern int tprof_on;
+
+#if TPROF
+#define TPROF_ADD(s, tid, v) do { if (tprof_on) tprof_th[tid].c[s] += (v); } while (0)
+#define TPROF_TSC()          (tprof_on? __rdtsc() : 0)
+#else
+#define TPROF_ADD(s, tid, v) do { } while (0)
+#define TPROF_TSC()          0
+#endif
+#define PPROF_INC(tid, r)    do { tprof_th[tid].pprof[r]++; } while (0)
+#define PPROF2_INC(tid, r)   do { tprof_th[tid].pprof2[r]++; } while (0)
+
+void tprof_init(void);
+void tprof_merge(void);
 #endif
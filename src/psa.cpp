@@ -0,0 +1,363 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM-SCALE (Memory-Scalable Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2022 Electronics and Telecommunications Research Institute (ETRI), Changdae Kim.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   Contacts: Changdae Kim <cdkim@etri.re.kr>
+
+** This software builds upon BWA-MEM2, and includes several performance optimization techniques.
+   For BWA-MEM2, refer to the follows.
+
+   BWA-MEM2 (Sequence alignment using Burrows-Wheeler Transform)
+   Copyright ⓒ 2019 Intel Corporation, Heng Li
+   The MIT License
+   Website: https://github.com/bwa-mem2/bwa-mem2
+
+*****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <algorithm>
+#include "psa.h"
+#include "sais.h"
+#include "bwa.h"
+
+#define PSA_SEG (1<<20) // bases per counting and scattering task
+
+/* Difference cover modulo PSA_V: D = {0..R-1} + {R, 2R, ..., (R-1)R} with
+ * R*R = PSA_V, so that for any a, b some d < PSA_V puts both a+d and b+d in
+ * D (mod PSA_V). The suffixes starting in D, the sample, are ranked first;
+ * two suffixes are then ordered by at most d bases and the ranks at a+d, b+d. */
+#define PSA_V 256
+#define PSA_R 16
+
+typedef struct {
+	uint64_t *w;         // text, 32 bases per word from the top bits, zeros past the end
+	const uint8_t *s;
+	int64_t n;
+	int nthreads, k;     // k: bases of the bucket code
+	int sample;          // sorting the sample, by PSA_V bases
+	int64_t *cnt, *beg;  // bucket sizes and first rows
+	int64_t b0, b1;      // buckets of the pass
+	int64_t *cur, *buf;  // scatter cursors of the pass' buckets, and its rows
+	// difference cover sample
+	int16_t cls[PSA_V];  // class of i%PSA_V in D, -1 if not in D
+	int64_t cls_off[2 * PSA_R]; // first slot of each class
+	uint8_t *dtab;       // d for (a%PSA_V, b%PSA_V)
+	int64_t m;           // sample size
+	uint32_t *rank;      // names, then ranks of the sample, by slot
+	uint32_t n_name;
+	int64_t last;        // last sample suffix named, -1 for none
+} psa_t;
+
+typedef struct {
+	void (*fn)(void *data, int64_t i, int tid);
+	void *data;
+	int64_t n, next;
+} psa_for_t;
+
+typedef struct {
+	psa_for_t *f;
+	int tid;
+} psa_worker_t;
+
+static void *psa_worker(void *data)
+{
+	psa_worker_t *w = (psa_worker_t *) data;
+	int64_t i;
+	while ((i = __sync_fetch_and_add(&w->f->next, 1)) < w->f->n)
+		w->f->fn(w->f->data, i, w->tid);
+	return NULL;
+}
+
+void psa_for(int nthreads, void (*fn)(void *data, int64_t i, int tid), void *data, int64_t n)
+{
+	pthread_t *tid;
+	psa_worker_t *w;
+	psa_for_t f;
+	int i;
+
+	f.fn = fn, f.data = data, f.n = n, f.next = 0;
+	if (nthreads <= 1 || n <= 1) {
+		for (int64_t k = 0; k < n; ++k) fn(data, k, 0);
+		return;
+	}
+	tid = (pthread_t *) malloc(nthreads * sizeof(pthread_t));
+	w = (psa_worker_t *) malloc(nthreads * sizeof(psa_worker_t));
+	assert(tid != NULL && w != NULL);
+	for (i = 0; i < nthreads; ++i) {
+		w[i].f = &f, w[i].tid = i;
+		if (pthread_create(&tid[i], NULL, psa_worker, &w[i]) != 0) {
+			fprintf(stderr, "[E::%s] fail to create a thread\n", __func__);
+			exit(EXIT_FAILURE);
+		}
+	}
+	for (i = 0; i < nthreads; ++i) pthread_join(tid[i], NULL);
+	free(tid); free(w);
+}
+
+// 32 bases from p
+static inline uint64_t psa_word(const uint64_t *w, int64_t p)
+{
+	int o = (p & 31) << 1;
+	const uint64_t *x = w + (p >> 5);
+	return o? x[0] << o | x[1] >> (64 - o) : x[0];
+}
+
+static inline uint32_t psa_bucket(const uint64_t *w, int64_t p, int k)
+{
+	return psa_word(w, p) >> (64 - 2 * k);
+}
+
+/* Suffixes a != b sharing d bases, compared up to base d1: <0 or >0, 0 if
+ * their first d1 bases are equal and both go on past them. */
+static inline int psa_cmp(const uint64_t *w, int64_t n, int64_t a, int64_t b, int64_t d, int64_t d1)
+{
+	int64_t la, lb, l;
+	for (;;) {
+		la = n - a - d, lb = n - b - d;
+		if (la <= 0 || lb <= 0) return la < lb? -1 : 1; // the shorter one ended
+		if (d >= d1) return 0;
+		l = d1 - d < 32? d1 - d : 32;
+		l = l < la? l : la;
+		l = l < lb? l : lb;
+		uint64_t x = psa_word(w, a + d) >> (64 - 2 * l), y = psa_word(w, b + d) >> (64 - 2 * l);
+		if (x != y) return x < y? -1 : 1;
+		d += l;
+	}
+}
+
+static inline int64_t psa_slot(const psa_t *p, int64_t i)
+{
+	return p->cls_off[p->cls[i & (PSA_V - 1)]] + i / PSA_V;
+}
+
+struct psa_less {
+	const psa_t *p;
+	bool operator()(int64_t a, int64_t b) const
+	{ // the suffixes share k bases, or the shorter of them ends inside
+		int64_t d = p->dtab[(a & (PSA_V - 1)) * PSA_V + (b & (PSA_V - 1))];
+		int c = psa_cmp(p->w, p->n, a, b, p->k, d > p->k? d : p->k);
+		if (c) return c < 0;
+		return p->rank[psa_slot(p, a + d)] < p->rank[psa_slot(p, b + d)];
+	}
+};
+
+struct psa_less_sample {
+	const psa_t *p;
+	bool operator()(int64_t a, int64_t b) const
+	{
+		return psa_cmp(p->w, p->n, a, b, p->k, PSA_V) < 0;
+	}
+};
+
+static void psa_pack(void *data, int64_t i, int tid)
+{
+	psa_t *p = (psa_t *) data;
+	int64_t j, e = (i + 1) << 5 < p->n? (i + 1) << 5 : p->n;
+	uint64_t x = 0;
+	for (j = i << 5; j < e; ++j) x = x << 2 | p->s[j];
+	p->w[i] = x << ((32 - (e - (i << 5))) << 1);
+}
+
+static void psa_count(void *data, int64_t i, int tid)
+{
+	psa_t *p = (psa_t *) data;
+	int64_t j, e = (i + 1) * PSA_SEG < p->n? (i + 1) * PSA_SEG : p->n;
+	for (j = i * PSA_SEG; j < e; ++j)
+		if (!p->sample || p->cls[j & (PSA_V - 1)] >= 0)
+			__sync_fetch_and_add(&p->cnt[psa_bucket(p->w, j, p->k)], 1);
+}
+
+static void psa_scatter(void *data, int64_t i, int tid)
+{
+	psa_t *p = (psa_t *) data;
+	int64_t j, e = (i + 1) * PSA_SEG < p->n? (i + 1) * PSA_SEG : p->n;
+	for (j = i * PSA_SEG; j < e; ++j) {
+		if (p->sample && p->cls[j & (PSA_V - 1)] < 0) continue;
+		int64_t b = psa_bucket(p->w, j, p->k);
+		if (b >= p->b0 && b < p->b1)
+			p->buf[__sync_fetch_and_add(&p->cur[b - p->b0], 1)] = j;
+	}
+}
+
+static void psa_sort_bucket(void *data, int64_t i, int tid)
+{
+	psa_t *p = (psa_t *) data;
+	int64_t b = p->b0 + i, *a = p->buf + (p->beg[b] - p->beg[p->b0]);
+	if (p->cnt[b] < 2) return;
+	if (p->sample) {
+		psa_less_sample less = { p };
+		std::sort(a, a + p->cnt[b], less);
+	} else {
+		psa_less less = { p };
+		std::sort(a, a + p->cnt[b], less);
+	}
+}
+
+// names of the sample suffixes by their first PSA_V bases, in sorted order
+static void psa_name(void *data, int64_t row0, const int64_t *sa, int64_t n)
+{
+	psa_t *p = (psa_t *) data;
+	for (int64_t i = 0; i < n; ++i) {
+		if (p->last < 0 || psa_cmp(p->w, p->n, p->last, sa[i], 0, PSA_V) != 0) ++p->n_name;
+		p->rank[psa_slot(p, sa[i])] = p->n_name - 1;
+		p->last = sa[i];
+	}
+}
+
+static double psa_realtime(void)
+{
+	struct timeval tp;
+	gettimeofday(&tp, NULL);
+	return tp.tv_sec + tp.tv_usec * 1e-6;
+}
+
+/* Bucket the suffixes (the sample ones only with p->sample) and hand each
+ * pass of sorted rows over to fn; -1 if out of memory. */
+static int psa_passes(psa_t *p, int64_t n_suf, psa_pass_f fn, void *data)
+{
+	const int64_t nb = 1LL << (2 * p->k), n_seg = (p->n + PSA_SEG - 1) / PSA_SEG;
+	int64_t b, cap = n_suf / PSA_PASSES + 1, max_b = 0, n_pass = 0;
+
+	memset(p->cnt, 0, nb * sizeof(int64_t));
+	psa_for(p->nthreads, psa_count, p, n_seg);
+	for (b = 0, p->beg[0] = 0; b < nb; ++b) {
+		p->beg[b + 1] = p->beg[b] + p->cnt[b];
+		if (max_b < p->cnt[b]) max_b = p->cnt[b];
+	}
+	cap = cap > max_b? cap : max_b;
+	p->buf = (int64_t *) malloc(cap * sizeof(int64_t));
+	if (p->buf == NULL) {
+		fprintf(stderr, "[E::%s] out of memory for %ld rows\n", __func__, (long) cap);
+		return -1;
+	}
+	if (bwa_verbose >= 4)
+		fprintf(stderr, "[M::%s] %ld suffixes in %ld buckets of %d bases, the largest %ld\n",
+				__func__, (long) n_suf, (long) nb, p->k, (long) max_b);
+	for (p->b0 = 0; p->b0 < nb; p->b0 = p->b1) {
+		double t1 = psa_realtime();
+		for (p->b1 = p->b0; p->b1 < nb && p->beg[p->b1 + 1] - p->beg[p->b0] <= cap; ++p->b1);
+		for (b = p->b0; b < p->b1; ++b) p->cur[b - p->b0] = p->beg[b] - p->beg[p->b0];
+		psa_for(p->nthreads, psa_scatter, p, n_seg);
+		psa_for(p->nthreads, psa_sort_bucket, p, p->b1 - p->b0);
+		fn(data, p->beg[p->b0], p->buf, p->beg[p->b1] - p->beg[p->b0]);
+		++n_pass;
+		if (bwa_verbose >= 4)
+			fprintf(stderr, "[M::%s] pass %ld: rows %ld..%ld, %.2f sec\n", __func__, (long) n_pass,
+					(long) p->beg[p->b0], (long) p->beg[p->b1], psa_realtime() - t1);
+	}
+	free(p->buf);
+	p->buf = NULL;
+	return 0;
+}
+
+// reduced text of the names (class by class, in text order), suffix sorted into ranks
+template<typename index_type>
+static int psa_rank(psa_t *p)
+{
+	index_type *sa = (index_type *) malloc(p->m * sizeof(index_type));
+	if (sa == NULL) return -1;
+	saisxx((const uint32_t *) p->rank, sa, (index_type) p->m, (index_type) p->n_name);
+	for (int64_t i = 0; i < p->m; ++i) p->rank[sa[i]] = i;
+	free(sa);
+	return 0;
+}
+
+/* The last sample suffix of each class is the only one that ends within
+ * PSA_V bases, so it has a name of its own and the reduced suffixes never
+ * compare across classes. */
+static int psa_sort_sample(psa_t *p)
+{
+	int i, j, n_cls = 0;
+	int64_t d;
+
+	for (i = 0; i < PSA_V; ++i) p->cls[i] = -1;
+	for (i = 0; i < PSA_R; ++i) p->cls[i] = 1;
+	for (i = 1; i < PSA_R; ++i) p->cls[i * PSA_R] = 1;
+	for (i = 0, p->m = 0; i < PSA_V; ++i) {
+		if (p->cls[i] < 0) continue;
+		p->cls[i] = n_cls;
+		p->cls_off[n_cls++] = p->m;
+		p->m += i < p->n? (p->n - i + PSA_V - 1) / PSA_V : 0;
+	}
+	p->dtab = (uint8_t *) malloc(PSA_V * PSA_V);
+	p->rank = (uint32_t *) malloc(p->m * sizeof(uint32_t));
+	if (p->dtab == NULL || p->rank == NULL || p->m >= UINT32_MAX) {
+		fprintf(stderr, "[E::%s] out of memory for a sample of %ld suffixes\n", __func__, (long) p->m);
+		return -1;
+	}
+	for (i = 0; i < PSA_V; ++i)
+		for (j = 0; j < PSA_V; ++j) {
+			for (d = 0; p->cls[(i + d) % PSA_V] < 0 || p->cls[(j + d) % PSA_V] < 0; ++d);
+			assert(d < PSA_V);
+			p->dtab[i * PSA_V + j] = d;
+		}
+	p->sample = 1, p->n_name = 0, p->last = -1;
+	if (psa_passes(p, p->m, psa_name, p) < 0) return -1;
+	p->sample = 0;
+	if ((p->m < INT32_MAX? psa_rank<int32_t>(p) : psa_rank<int64_t>(p)) < 0) {
+		fprintf(stderr, "[E::%s] out of memory for ranking %ld sample suffixes\n", __func__, (long) p->m);
+		return -1;
+	}
+	return 0;
+}
+
+int psa_sort(const uint8_t *s, int64_t n, int nthreads, psa_pass_f fn, void *data)
+{
+	int64_t nb;
+	double t = psa_realtime();
+	int ret = -1;
+	psa_t p;
+
+	memset(&p, 0, sizeof(p));
+	p.s = s, p.n = n, p.nthreads = nthreads;
+	for (p.k = 1; p.k < PSA_K && 1LL << (2 * p.k + 6) < n; ++p.k); // ~64 suffixes per bucket
+	nb = 1LL << (2 * p.k);
+	p.w = (uint64_t *) calloc((n >> 5) + 2, sizeof(uint64_t));
+	p.cnt = (int64_t *) malloc(nb * sizeof(int64_t));
+	p.beg = (int64_t *) malloc((nb + 1) * sizeof(int64_t));
+	p.cur = (int64_t *) malloc(nb * sizeof(int64_t));
+	if (p.w == NULL || p.cnt == NULL || p.beg == NULL || p.cur == NULL) {
+		fprintf(stderr, "[E::%s] out of memory for the packed text and buckets\n", __func__);
+		goto end;
+	}
+	psa_for(nthreads, psa_pack, &p, (n + 31) >> 5);
+	if (psa_sort_sample(&p) < 0) goto end;
+	if (bwa_verbose >= 3)
+		fprintf(stderr, "[M::%s] ranked %ld sample suffixes (%u distinct by %d bases); %.2f sec\n",
+				__func__, (long) p.m, p.n_name, PSA_V, psa_realtime() - t);
+	if (psa_passes(&p, n, fn, data) < 0) goto end;
+	if (bwa_verbose >= 3)
+		fprintf(stderr, "[M::%s] sorted %ld suffixes in buckets of %d bases with %d threads; %.2f sec\n",
+				__func__, (long) n, p.k, nthreads, psa_realtime() - t);
+	ret = 0;
+end:
+	free(p.w); free(p.cnt); free(p.beg); free(p.cur); free(p.dtab); free(p.rank);
+	return ret;
+}
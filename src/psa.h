@@ -0,0 +1,70 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM-SCALE (Memory-Scalable Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2022 Electronics and Telecommunications Research Institute (ETRI), Changdae Kim.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   Contacts: Changdae Kim <cdkim@etri.re.kr>
+
+** This software builds upon BWA-MEM2, and includes several performance optimization techniques.
+   For BWA-MEM2, refer to the follows.
+
+   BWA-MEM2 (Sequence alignment using Burrows-Wheeler Transform)
+   Copyright ⓒ 2019 Intel Corporation, Heng Li
+   The MIT License
+   Website: https://github.com/bwa-mem2/bwa-mem2
+
+*****************************************************************************************/
+
+#ifndef _PSA_H_
+#define _PSA_H_
+
+#include <stdint.h>
+
+/*
+ * Parallel suffix sorting for 'index -a psa' (the default mem2 path is
+ * saisxx() of sais.h). Suffixes are put into buckets by their first
+ * k <= PSA_K bases (about 64 suffixes a bucket), each bucket then sorted by
+ * one thread comparing 32 bases at a time. Comparisons stop after at most 256
+ * bases: the suffixes at a difference cover sample of the positions (31 of
+ * every 256) are ranked beforehand, by their first 256 bases and then
+ * saisxx() on the names, so that long repeats cost no more than unique
+ * sequence. The buckets go in passes of consecutive SA rows that fit a buffer
+ * of about 1/PSA_PASSES of the text in 8-byte positions; each pass is handed
+ * over to fn in row order (rows of the suffix array of s, without the empty
+ * suffix), so that the caller keeps what it needs of the rows and the whole
+ * SA is never held.
+ */
+
+#define PSA_K      12
+#define PSA_PASSES 8
+
+// rows row0..row0+n-1 of the suffix array are sa[0..n); called from one thread at a time
+typedef void (*psa_pass_f)(void *data, int64_t row0, const int64_t *sa, int64_t n);
+
+int psa_sort(const uint8_t *s, int64_t n, int nthreads, psa_pass_f fn, void *data); // s in 0..3
+
+// fn(data, i, tid) for i < n on nthreads threads, items taken in turn
+void psa_for(int nthreads, void (*fn)(void *data, int64_t i, int tid), void *data, int64_t n);
+
+#endif
@@ -0,0 +1,338 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM-SCALE (Memory-Scalable Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2022 Electronics and Telecommunications Research Institute (ETRI), Changdae Kim.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   Contacts: Changdae Kim <cdkim@etri.re.kr>
+
+** This software builds upon BWA-MEM2, and includes several performance optimization techniques.
+   For BWA-MEM2, refer to the follows.
+
+   BWA-MEM2 (Sequence alignment using Burrows-Wheeler Transform)
+   Copyright ⓒ 2019 Intel Corporation, Heng Li
+   The MIT License
+   Website: https://github.com/bwa-mem2/bwa-mem2
+
+*****************************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "read_cache.h"
+#include "kthread.h"
+#include "khash.h"
+#include "utils.h"
+#include "bntseq.h"
+
+typedef struct rc_entry_s {
+	uint64_t key;
+	int l_seq;
+	uint8_t *seq;           // nt4
+	mem_alnreg_v a;
+#ifdef PERFECT_MATCH
+	bseq1_perfect_t perfect;
+#endif
+	struct rc_entry_s *prev, *next; // LRU list, most recent first
+} rc_entry_t;
+
+KHASH_MAP_INIT_INT64(rc, rc_entry_t*)
+
+typedef struct {
+	pthread_mutex_t lock;
+	khash_t(rc) *h;
+	rc_entry_t *head, *tail;
+	int64_t n, max;
+} __attribute__((aligned(64))) rc_shard_t;
+
+struct read_cache_s {
+	rc_shard_t shard[READ_CACHE_SHARDS];
+	/* per-chunk state of read_cache_split()/read_cache_merge() */
+	int m;
+	bseq1_t *seqs;
+	uint8_t *state;
+	int *src;               // READ_CACHE_DUP: index of the read it copies
+	uint64_t *key;
+	mem_alnreg_v *regs;
+	int *aln_idx;           // position in seqs of the k-th aligned read
+};
+
+static int64_t rc_n_hit, rc_n_dup, rc_n_miss, rc_n_evict;
+
+read_cache_t *read_cache_init(int64_t max_n)
+{
+	read_cache_t *rc = (read_cache_t*) calloc(1, sizeof(read_cache_t));
+	assert(rc != NULL);
+	for (int i = 0; i < READ_CACHE_SHARDS; ++i) {
+		rc_shard_t *p = &rc->shard[i];
+		pthread_mutex_init(&p->lock, 0);
+		p->h = kh_init(rc);
+		p->max = (max_n + READ_CACHE_SHARDS - 1) / READ_CACHE_SHARDS;
+	}
+	fprintf(stderr, "* Duplicate-read cache: up to %ld sequences\n", (long) max_n);
+	return rc;
+}
+
+static void rc_entry_free(rc_entry_t *e)
+{
+	free(e->seq); free(e->a.a); free(e);
+}
+
+void read_cache_destroy(read_cache_t *rc)
+{
+	if (rc == 0) return;
+	for (int i = 0; i < READ_CACHE_SHARDS; ++i) {
+		rc_shard_t *p = &rc->shard[i];
+		rc_entry_t *e, *t;
+		for (e = p->head; e; e = t) t = e->next, rc_entry_free(e);
+		kh_destroy(rc, p->h);
+		pthread_mutex_destroy(&p->lock);
+	}
+	free(rc->state); free(rc->src); free(rc->key);
+	free(rc->regs); free(rc->aln_idx);
+	free(rc);
+}
+
+uint64_t read_cache_key(const bseq1_t *s)
+{
+	const uint8_t *q = (const uint8_t*) s->seq;
+	uint64_t h = hash_64(s->l_seq), x;
+	int i;
+	for (i = 0; i + 8 <= s->l_seq; i += 8) {
+		memcpy(&x, q + i, 8);
+		h = hash_64(h ^ x);
+	}
+	for (x = 0; i < s->l_seq; ++i) x = x << 8 | q[i];
+	return hash_64(h ^ x);
+}
+
+static inline rc_shard_t *rc_shard(read_cache_t *rc, uint64_t key)
+{
+	return &rc->shard[key >> 58 & (READ_CACHE_SHARDS - 1)];
+}
+
+static inline void rc_unlink(rc_shard_t *p, rc_entry_t *e)
+{
+	if (e->prev) e->prev->next = e->next; else p->head = e->next;
+	if (e->next) e->next->prev = e->prev; else p->tail = e->prev;
+	e->prev = e->next = 0;
+}
+
+static inline void rc_push_front(rc_shard_t *p, rc_entry_t *e)
+{
+	e->prev = 0, e->next = p->head;
+	if (p->head) p->head->prev = e;
+	p->head = e;
+	if (p->tail == 0) p->tail = e;
+}
+
+// copies into the cache come from malloc (ar == 0), copies out of it from the
+// arena of the worker, as the regions of aligned reads do
+static inline void rc_copy_regs(mem_arena_t *ar, mem_alnreg_v *dst, const mem_alnreg_v *src)
+{
+	dst->n = dst->m = src->n;
+	dst->a = 0;
+	if (src->n) {
+		dst->a = (mem_alnreg_t*) mem_arena_alloc(ar, src->n * sizeof(mem_alnreg_t));
+		assert(dst->a != NULL);
+		memcpy(dst->a, src->a, src->n * sizeof(mem_alnreg_t));
+	}
+}
+
+int read_cache_get(read_cache_t *rc, bseq1_t *s, uint64_t key, mem_alnreg_v *a)
+{
+	rc_shard_t *p = rc_shard(rc, key);
+	rc_entry_t *e = 0;
+	khint_t k;
+
+	pthread_mutex_lock(&p->lock);
+	k = kh_get(rc, p->h, key);
+	if (k != kh_end(p->h)) {
+		e = kh_val(p->h, k);
+		if (e->l_seq != s->l_seq || memcmp(e->seq, s->seq, s->l_seq) != 0) e = 0; // hash collision
+	}
+	if (e) {
+		rc_unlink(p, e);
+		rc_push_front(p, e);
+		rc_copy_regs(mem_arena_cur, a, &e->a);
+#ifdef PERFECT_MATCH
+		s->perfect = e->perfect;
+#endif
+	}
+	pthread_mutex_unlock(&p->lock);
+	return e != 0;
+}
+
+void read_cache_put(read_cache_t *rc, const bseq1_t *s, uint64_t key, const mem_alnreg_v *a)
+{
+	rc_shard_t *p = rc_shard(rc, key);
+	rc_entry_t *e;
+	khint_t k;
+	int absent;
+
+	e = (rc_entry_t*) calloc(1, sizeof(rc_entry_t));
+	assert(e != NULL);
+	e->key = key, e->l_seq = s->l_seq;
+	e->seq = (uint8_t*) malloc(s->l_seq);
+	assert(e->seq != NULL);
+	memcpy(e->seq, s->seq, s->l_seq);
+	rc_copy_regs(0, &e->a, a);
+	for (size_t i = 0; i < e->a.n; ++i) e->a.a[i].c = 0; // the chain is gone after this chunk
+#ifdef PERFECT_MATCH
+	e->perfect = s->perfect;
+#endif
+
+	pthread_mutex_lock(&p->lock);
+	k = kh_put(rc, p->h, key, &absent);
+	if (!absent) { // hash collision or a concurrent insertion of the same read: keep the newest
+		rc_entry_t *old = kh_val(p->h, k);
+		rc_unlink(p, old);
+		rc_entry_free(old);
+		--p->n;
+	}
+	kh_val(p->h, k) = e;
+	rc_push_front(p, e);
+	if (++p->n > p->max) { // evict the least recently used
+		rc_entry_t *t = p->tail;
+		rc_unlink(p, t);
+		kh_del(rc, p->h, kh_get(rc, p->h, t->key));
+		rc_entry_free(t);
+		--p->n;
+		__sync_fetch_and_add(&rc_n_evict, 1);
+	}
+	pthread_mutex_unlock(&p->lock);
+}
+
+static void rc_worker_get(void *data, long seq_id, long batch_size, int tid)
+{
+	worker_t *w = (worker_t*) data;
+	read_cache_t *rc = w->rcache;
+	int64_t n_hit = 0;
+	mem_arena_bind(&w->arena[tid]);
+
+	for (long i = seq_id; i < seq_id + batch_size; ++i) {
+		bseq1_t *s = &rc->seqs[i];
+		for (int j = 0; j < s->l_seq; ++j) // convert to nt4, as mem_kernel1_core() does
+			s->seq[j] = s->seq[j] < 4? s->seq[j] : nst_nt4_table[(int)s->seq[j]];
+		rc->key[i] = read_cache_key(s);
+		rc->state[i] = read_cache_get(rc, s, rc->key[i], &rc->regs[i])? READ_CACHE_HIT : READ_CACHE_ALN;
+		n_hit += rc->state[i] == READ_CACHE_HIT;
+	}
+	__sync_fetch_and_add(&rc_n_hit, n_hit);
+}
+
+static void rc_worker_put(void *data, long seq_id, long batch_size, int tid)
+{
+	worker_t *w = (worker_t*) data;
+	read_cache_t *rc = w->rcache;
+	mem_arena_bind(&w->arena[tid]);
+
+	for (long i = seq_id; i < seq_id + batch_size; ++i) {
+		if (rc->state[i] == READ_CACHE_ALN) {
+			read_cache_put(rc, &rc->seqs[i], rc->key[i], &rc->regs[i]);
+		} else if (rc->state[i] == READ_CACHE_DUP) {
+			rc_copy_regs(mem_arena_cur, &rc->regs[i], &rc->regs[rc->src[i]]);
+#ifdef PERFECT_MATCH
+			rc->seqs[i].perfect = rc->seqs[rc->src[i]].perfect;
+#endif
+		}
+	}
+}
+
+int read_cache_split(read_cache_t *rc, worker_t *w, int n, bseq1_t *seqs, bseq1_t **aln_seqs)
+{
+	khash_t(rc) *h;
+	int i, n_aln = 0, n_dup = 0;
+
+	if (n > rc->m) {
+		rc->m = n;
+		rc->state = (uint8_t*) realloc(rc->state, n);
+		rc->src = (int*) realloc(rc->src, n * sizeof(int));
+		rc->key = (uint64_t*) realloc(rc->key, n * sizeof(uint64_t));
+		rc->regs = (mem_alnreg_v*) realloc(rc->regs, n * sizeof(mem_alnreg_v));
+		rc->aln_idx = (int*) realloc(rc->aln_idx, n * sizeof(int));
+		assert(rc->state && rc->src && rc->key && rc->regs && rc->aln_idx);
+	}
+	rc->seqs = seqs;
+	kt_for(rc_worker_get, w, n);
+
+	// the first copy of a sequence within the chunk is aligned, the others wait for it
+	h = kh_init(rc);
+	*aln_seqs = (bseq1_t*) malloc(n * sizeof(bseq1_t));
+	assert(*aln_seqs != NULL);
+	for (i = 0; i < n; ++i) {
+		khint_t k;
+		int absent;
+		if (rc->state[i] != READ_CACHE_ALN) continue;
+		k = kh_put(rc, h, rc->key[i], &absent);
+		if (!absent) {
+			int j = (int)(intptr_t) kh_val(h, k);
+			if (seqs[j].l_seq == seqs[i].l_seq && memcmp(seqs[j].seq, seqs[i].seq, seqs[i].l_seq) == 0) {
+				rc->state[i] = READ_CACHE_DUP, rc->src[i] = j;
+				++n_dup;
+				continue;
+			}
+		} else kh_val(h, k) = (rc_entry_t*)(intptr_t) i;
+		rc->aln_idx[n_aln] = i;
+		(*aln_seqs)[n_aln++] = seqs[i];
+	}
+	kh_destroy(rc, h);
+	__sync_fetch_and_add(&rc_n_dup, n_dup);
+	__sync_fetch_and_add(&rc_n_miss, n_aln);
+	return n_aln;
+}
+
+void read_cache_merge(read_cache_t *rc, worker_t *w, int n, bseq1_t *seqs, bseq1_t *aln_seqs, int n_aln)
+{
+	for (int k = 0; k < n_aln; ++k) {
+		int i = rc->aln_idx[k];
+		seqs[i] = aln_seqs[k]; // picks up the perfect-match result
+		rc->regs[i] = w->regs[k];
+	}
+	free(aln_seqs);
+	rc->seqs = seqs;
+	kt_for(rc_worker_put, w, n);
+	memcpy(w->regs, rc->regs, n * sizeof(mem_alnreg_v));
+}
+
+void read_cache_print_stats(FILE *fp)
+{
+	int64_t tot = rc_n_hit + rc_n_dup + rc_n_miss;
+	if (tot == 0) return;
+	fprintf(fp, "Duplicate-read cache: reads: %ld hit: %ld %.2f%% in-chunk dup: %ld %.2f%% "
+			"aligned: %ld %.2f%% evicted: %ld\n",
+			(long) tot, (long) rc_n_hit, 100.0 * rc_n_hit / tot,
+			(long) rc_n_dup, 100.0 * rc_n_dup / tot,
+			(long) rc_n_miss, 100.0 * rc_n_miss / tot, (long) rc_n_evict);
+}
+
+void read_cache_reset_stats(void)
+{
+	rc_n_hit = rc_n_dup = rc_n_miss = rc_n_evict = 0;
+}
+
+void read_cache_get_stats(int64_t st[4])
+{
+	st[0] = rc_n_hit, st[1] = rc_n_dup, st[2] = rc_n_miss, st[3] = rc_n_evict;
+}
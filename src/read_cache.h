@@ -0,0 +1,84 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM-SCALE (Memory-Scalable Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2022 Electronics and Telecommunications Research Institute (ETRI), Changdae Kim.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   Contacts: Changdae Kim <cdkim@etri.re.kr>
+
+** This software builds upon BWA-MEM2, and includes several performance optimization techniques.
+   For BWA-MEM2, refer to the follows.
+
+   BWA-MEM2 (Sequence alignment using Burrows-Wheeler Transform)
+   Copyright ⓒ 2019 Intel Corporation, Heng Li
+   The MIT License
+   Website: https://github.com/bwa-mem2/bwa-mem2
+
+*****************************************************************************************/
+
+#ifndef _READ_CACHE_H_
+#define _READ_CACHE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include "bwa.h"
+#include "bwamem.h"
+
+/*
+ * Alignment cache for duplicate reads (-u).
+ * Maps the nt4 sequence of a read to its mem_alnreg_v as produced by
+ * worker_aln (and, with PERFECT_MATCH, to its perfect-match result), so that
+ * byte-identical reads skip seeding, chaining and extension. Everything after
+ * that (primary marking, mate rescue, pairing, SAM) still runs per read, so
+ * the output does not depend on whether a read was a cache hit.
+ * The table is split into shards, each with its own lock and LRU list.
+ */
+
+#define READ_CACHE_SHARDS 64
+
+// state of a read in the current chunk
+#define READ_CACHE_ALN 0   // aligned normally
+#define READ_CACHE_HIT 1   // taken from the cache
+#define READ_CACHE_DUP 2   // same sequence as an earlier read of the chunk
+
+typedef struct read_cache_s read_cache_t;
+
+read_cache_t *read_cache_init(int64_t max_n);
+void read_cache_destroy(read_cache_t *rc);
+
+// both require s->seq in nt4; get() allocates a->a from mem_arena_cur
+int read_cache_get(read_cache_t *rc, bseq1_t *s, uint64_t key, mem_alnreg_v *a);
+void read_cache_put(read_cache_t *rc, const bseq1_t *s, uint64_t key, const mem_alnreg_v *a);
+uint64_t read_cache_key(const bseq1_t *s);
+
+/* Per-chunk bookkeeping for mem_process_seqs(): read_cache_split() runs the
+ * lookups and returns the reads that still need alignment; read_cache_merge()
+ * stores their results and puts the regions of all n reads back in order. */
+int read_cache_split(read_cache_t *rc, worker_t *w, int n, bseq1_t *seqs, bseq1_t **aln_seqs);
+void read_cache_merge(read_cache_t *rc, worker_t *w, int n, bseq1_t *seqs, bseq1_t *aln_seqs, int n_aln);
+
+void read_cache_print_stats(FILE *fp);
+void read_cache_get_stats(int64_t st[4]); // hit, in-chunk dup, aligned, evicted
+void read_cache_reset_stats(void);        // at the start of each 'mem' run
+
+#endif
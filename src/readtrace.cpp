@@ -0,0 +1,272 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM-SCALE (Memory-Scalable Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2022 Electronics and Telecommunications Research Institute (ETRI), Changdae Kim.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   Contacts: Changdae Kim <cdkim@etri.re.kr>
+
+** This software builds upon BWA-MEM2, and includes several performance optimization techniques.
+   For BWA-MEM2, refer to the follows.
+
+   BWA-MEM2 (Sequence alignment using Burrows-Wheeler Transform)
+   Copyright ⓒ 2019 Intel Corporation, Heng Li
+   The MIT License
+   Website: https://github.com/bwa-mem2/bwa-mem2
+
+*****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "readtrace.h"
+#include "profiling.h"
+
+typedef struct {
+	char *name, *seq, *qual; // seq in ACGTN; qual NULL for FASTA input
+	int l_seq;
+} rt_read_t;
+
+typedef struct {
+	read_trace_t r;
+	uint64_t tot;
+	int64_t idx;  // 0-based index of the read in the input
+	rt_read_t rd[2]; // the read and, for paired-end input, its mate
+} rt_ent_t;
+
+read_trace_t *rtrace = 0;
+
+static int rt_k, rt_n, rt_m, rt_is_pe;
+static read_trace_t *rt_chunk;
+static rt_ent_t *rt_top; // min-heap on tot
+static const char *rt_fn;
+static const char *rt_stage_name[RT_N_STAGES] = { "smem", "chain", "ext", "sam" };
+
+int rtrace_init(int k, const char *fn)
+{
+	rtrace_destroy();
+	if (k <= 0) return 0;
+	rt_k = k, rt_fn = fn;
+	rt_top = (rt_ent_t*) calloc(k, sizeof(rt_ent_t));
+	assert(rt_top != NULL);
+	return 1;
+}
+
+static void rt_read_free(rt_read_t *d)
+{
+	free(d->name); free(d->seq); free(d->qual);
+	memset(d, 0, sizeof(*d));
+}
+
+void rtrace_destroy(void)
+{
+	for (int i = 0; i < rt_n; ++i)
+		rt_read_free(&rt_top[i].rd[0]), rt_read_free(&rt_top[i].rd[1]);
+	free(rt_top); free(rt_chunk);
+	rt_top = 0, rt_chunk = rtrace = 0;
+	rt_k = rt_n = rt_m = rt_is_pe = 0;
+}
+
+void rtrace_chunk_beg(int n, const bseq1_t *seqs)
+{
+	rtrace = 0;
+	if (rt_k == 0) return;
+	for (int i = 0; i < n; ++i)
+		if (seqs[i].id != i) return; // the records are indexed by id; not the case for this reader
+	if (n > rt_m) {
+		rt_m = n;
+		rt_chunk = (read_trace_t*) realloc(rt_chunk, n * sizeof(read_trace_t));
+		assert(rt_chunk != NULL);
+	}
+	memset(rt_chunk, 0, n * sizeof(read_trace_t));
+	rtrace = rt_chunk;
+}
+
+static inline uint64_t rt_weight(const read_trace_t *r, int stage)
+{
+	return stage == RT_SMEM? r->n_smem : stage == RT_EXT? r->n_seed : 1 + r->n_reg;
+}
+
+void rtrace_share(const bseq1_t *seq, int n, int stage, uint64_t t)
+{
+	uint64_t sum = 0;
+	int l;
+	for (l = 0; l < n; ++l) sum += rt_weight(&rtrace[seq[l].id], stage);
+	if (sum == 0) return;
+	for (l = 0; l < n; ++l) {
+		read_trace_t *r = &rtrace[seq[l].id];
+		r->t[stage] += (uint64_t)((double) t * rt_weight(r, stage) / sum);
+	}
+}
+
+static void rt_read_copy(rt_read_t *d, const bseq1_t *s)
+{
+	rt_read_free(d);
+	d->l_seq = s->l_seq;
+	d->name = strdup(s->name);
+	d->seq = (char*) malloc(s->l_seq + 1);
+	assert(d->name != NULL && d->seq != NULL);
+	for (int i = 0; i < s->l_seq; ++i) { // step 1 left the sequence in nt4
+		uint8_t c = s->seq[i];
+		d->seq[i] = c < 5? "ACGTN"[c] : c;
+	}
+	d->seq[s->l_seq] = 0;
+	d->qual = s->qual? strdup(s->qual) : 0;
+}
+
+static void rt_sift_down(int i)
+{
+	for (;;) {
+		int j = 2 * i + 1, m = i;
+		if (j < rt_n && rt_top[j].tot < rt_top[m].tot) m = j;
+		if (j + 1 < rt_n && rt_top[j + 1].tot < rt_top[m].tot) m = j + 1;
+		if (m == i) break;
+		rt_ent_t t = rt_top[i]; rt_top[i] = rt_top[m]; rt_top[m] = t;
+		i = m;
+	}
+}
+
+/* Keep the reads of the chunk that are slower than the K-th slowest so far. */
+void rtrace_chunk_end(int64_t n_processed, int n, const bseq1_t *seqs, int is_pe)
+{
+	if (rtrace == 0) return;
+	rt_is_pe = is_pe;
+	for (int i = 0; i < n; ++i) {
+		const read_trace_t *r = &rtrace[i];
+		uint64_t tot = 0;
+		int s;
+		for (s = 0; s < RT_N_STAGES; ++s) tot += r->t[s];
+		if (tot == 0 || (rt_n == rt_k && tot <= rt_top[0].tot)) continue;
+		rt_ent_t *e;
+		if (rt_n < rt_k) { // push and sift up
+			int j = rt_n++;
+			for (; j > 0 && rt_top[(j - 1) / 2].tot > tot; j = (j - 1) / 2)
+				rt_top[j] = rt_top[(j - 1) / 2];
+			e = &rt_top[j];
+			memset(e->rd, 0, sizeof(e->rd));
+		} else e = &rt_top[0];
+		e->r = *r, e->tot = tot, e->idx = n_processed + i;
+		rt_read_copy(&e->rd[0], &seqs[i]);
+		if (is_pe && (i ^ 1) < n) rt_read_copy(&e->rd[1], &seqs[i ^ 1]);
+		else rt_read_free(&e->rd[1]);
+		if (e == &rt_top[0]) rt_sift_down(0);
+	}
+}
+
+static int rt_cmp_tot(const void *a, const void *b)
+{
+	const rt_ent_t *p = (const rt_ent_t*) a, *q = (const rt_ent_t*) b;
+	return p->tot < q->tot? 1 : p->tot > q->tot? -1 : (p->idx > q->idx) - (p->idx < q->idx);
+}
+
+static int rt_cmp_idx(const void *a, const void *b)
+{
+	const rt_ent_t *p = (const rt_ent_t*) a, *q = (const rt_ent_t*) b;
+	return (p->idx > q->idx) - (p->idx < q->idx);
+}
+
+static inline double rt_ms(uint64_t c) { return c * 1e3 / proc_freq; }
+
+void rtrace_print(FILE *fp)
+{
+	if (rt_k == 0) return;
+	qsort(rt_top, rt_n, sizeof(rt_ent_t), rt_cmp_tot); // the heap is not needed any more
+	fprintf(fp, "\n\tSlowest %d reads (ms; smem, ext and sam shared out of their batch):\n", rt_n);
+	fprintf(fp, "\t\t%-5s %-10s %8s %8s %8s %8s %8s %6s %8s %6s %6s %5s  %s\n", "rank", "index", "total",
+			"smem", "chain", "ext", "sam", "smems", "hits", "chains", "seeds", "regs", "name");
+	for (int i = 0; i < rt_n; ++i) {
+		const rt_ent_t *e = &rt_top[i];
+		fprintf(fp, "\t\t%-5d %-10ld %8.3f %8.3f %8.3f %8.3f %8.3f %6d %8ld %6d %6d %5d  %s\n", i + 1, (long) e->idx,
+				rt_ms(e->tot), rt_ms(e->r.t[RT_SMEM]), rt_ms(e->r.t[RT_CHAIN]), rt_ms(e->r.t[RT_EXT]),
+				rt_ms(e->r.t[RT_SAM]), e->r.n_smem, (long) e->r.n_hit, e->r.n_chain, e->r.n_seed, e->r.n_reg,
+				e->rd[0].name);
+	}
+}
+
+static void rt_json_str(FILE *fp, const char *s)
+{
+	fputc('"', fp);
+	for (; *s; ++s) {
+		if (*s == '"' || *s == '\\') fputc('\\', fp);
+		if ((unsigned char) *s >= 0x20) fputc(*s, fp);
+	}
+	fputc('"', fp);
+}
+
+void rtrace_json(FILE *fp)
+{
+	if (rt_k == 0) {
+		fprintf(fp, "null");
+		return;
+	}
+	qsort(rt_top, rt_n, sizeof(rt_ent_t), rt_cmp_tot);
+	fprintf(fp, "[");
+	for (int i = 0; i < rt_n; ++i) {
+		const rt_ent_t *e = &rt_top[i];
+		fprintf(fp, "%s\n    {\"name\": ", i? "," : "");
+		rt_json_str(fp, e->rd[0].name);
+		fprintf(fp, ", \"index\": %ld, \"ms\": {\"total\": %.3f", (long) e->idx, rt_ms(e->tot));
+		for (int s = 0; s < RT_N_STAGES; ++s)
+			fprintf(fp, ", \"%s\": %.3f", rt_stage_name[s], rt_ms(e->r.t[s]));
+		fprintf(fp, "}, \"smems\": %d, \"hits\": %ld, \"chains\": %d, \"seeds\": %d, \"regs\": %d}",
+				e->r.n_smem, (long) e->r.n_hit, e->r.n_chain, e->r.n_seed, e->r.n_reg);
+	}
+	fprintf(fp, "%s]", rt_n? "\n  " : "");
+}
+
+static void rt_write(FILE *fp, const rt_read_t *d)
+{
+	if (d->qual) fprintf(fp, "@%s\n%s\n+\n%s\n", d->name, d->seq, d->qual);
+	else fprintf(fp, ">%s\n%s\n", d->name, d->seq);
+}
+
+/* Write the kept reads to FILE in input order; paired-end reads go with their
+ * mates, interleaved, and a pair is written once. Returns 0 on failure. */
+int rtrace_dump(void)
+{
+	FILE *fp;
+	int64_t last = -1;
+
+	if (rt_k == 0 || rt_fn == 0) return 1;
+	if ((fp = fopen(rt_fn, "w")) == 0) {
+		fprintf(stderr, "[E::%s] can't open %s for writing\n", __func__, rt_fn);
+		return 0;
+	}
+	qsort(rt_top, rt_n, sizeof(rt_ent_t), rt_cmp_idx);
+	for (int i = 0; i < rt_n; ++i) {
+		const rt_ent_t *e = &rt_top[i];
+		if (!rt_is_pe) {
+			rt_write(fp, &e->rd[0]);
+			continue;
+		}
+		if (e->idx >> 1 == last) continue;
+		last = e->idx >> 1;
+		if (e->rd[1].name == 0) rt_write(fp, &e->rd[0]);
+		else rt_write(fp, &e->rd[e->idx & 1]), rt_write(fp, &e->rd[!(e->idx & 1)]);
+	}
+	fclose(fp);
+	fprintf(stderr, "[M::%s] wrote the %d slowest reads%s to %s\n", __func__, rt_n,
+			rt_is_pe? " with their mates" : "", rt_fn);
+	return 1;
+}
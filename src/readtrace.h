@@ -0,0 +1,77 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM-SCALE (Memory-Scalable Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2022 Electronics and Telecommunications Research Institute (ETRI), Changdae Kim.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   Contacts: Changdae Kim <cdkim@etri.re.kr>
+
+** This software builds upon BWA-MEM2, and includes several performance optimization techniques.
+   For BWA-MEM2, refer to the follows.
+
+   BWA-MEM2 (Sequence alignment using Burrows-Wheeler Transform)
+   Copyright ⓒ 2019 Intel Corporation, Heng Li
+   The MIT License
+   Website: https://github.com/bwa-mem2/bwa-mem2
+
+*****************************************************************************************/
+
+#ifndef _READTRACE_H_
+#define _READTRACE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include "bwa.h"
+
+/*
+ * Slow-read tracing (--slow-reads K[,FILE]).
+ * Every read of the chunk in step 1 gets a record, indexed by bseq1_t::id, with
+ * its cycles per stage and its seed, chain and extension counts. Stages that
+ * work read by read (SA lookup + chaining, and the whole seeding with ERT) are
+ * timed per read; the time of the batched stages (SMEM search, BSW, SAM) is
+ * shared among the reads of the batch by their work in it: SMEMs, chained
+ * seeds to extend and alignment regions. At the end of each chunk the K reads
+ * with the most cycles so far are kept, with their name, sequence and
+ * quality, to be reported at the end of the run and written to FILE.
+ */
+
+enum { RT_SMEM, RT_CHAIN, RT_EXT, RT_SAM, RT_N_STAGES };
+
+typedef struct {
+	uint64_t t[RT_N_STAGES]; // cycles
+	int32_t n_smem, n_chain, n_seed, n_reg;
+	int64_t n_hit;           // SA hits looked up, max_occ-capped
+} read_trace_t;
+
+extern read_trace_t *rtrace; // records of the chunk in step 1; NULL if tracing is off
+
+int rtrace_init(int k, const char *fn);
+void rtrace_chunk_beg(int n, const bseq1_t *seqs);
+void rtrace_chunk_end(int64_t n_processed, int n, const bseq1_t *seqs, int is_pe);
+void rtrace_share(const bseq1_t *seq, int n, int stage, uint64_t t);
+void rtrace_print(FILE *fp);
+void rtrace_json(FILE *fp);
+int rtrace_dump(void);
+void rtrace_destroy(void);
+
+#endif
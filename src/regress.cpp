@@ -0,0 +1,475 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM-SCALE (Memory-Scalable Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2022 Electronics and Telecommunications Research Institute (ETRI), Changdae Kim.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   Contacts: Changdae Kim <cdkim@etri.re.kr>
+
+** This software builds upon BWA-MEM2, and includes several performance optimization techniques.
+   For BWA-MEM2, refer to the follows.
+
+   BWA-MEM2 (Sequence alignment using Burrows-Wheeler Transform)
+   Copyright ⓒ 2019 Intel Corporation, Heng Li
+   The MIT License
+   Website: https://github.com/bwa-mem2/bwa-mem2
+
+*****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include "kstring.h"
+#include "kvec.h"
+#include "main.h"
+
+/* Runs 'mem' of a baseline and a candidate (two binaries, or one binary with
+ * two option sets) on the same reads and index, and checks that the candidate
+ * keeps both the output and the speed: SAM records are compared field by
+ * field, read name by read name, MAPQ, XS and XA being the fields known to
+ * differ for a few percent of the reads; stage times come from --stats-json,
+ * the fastest of the runs of each side taken. */
+
+#define RG_N_FIELDS 11
+#define RG_N_TAGS   65536
+
+static const char *rg_field_name[RG_N_FIELDS] = {
+	"QNAME", "FLAG", "RNAME", "POS", "MAPQ", "CIGAR", "RNEXT", "PNEXT", "TLEN", "SEQ", "QUAL"
+};
+
+// stages of --stats-json compared, with "sec" (wall-clock) or "sum" (over threads)
+static const char *rg_stage[] = {
+	"process", "read_io", "sam_io", "mem_process_seqs", "kernel", "worker_sam",
+	"perfect_match", "smem_chain", "chaining", "sal", "mem_sa", "bsw"
+};
+#define RG_N_STAGES (int) (sizeof(rg_stage) / sizeof(rg_stage[0]))
+
+typedef struct {
+	const char *bin, *opts;
+	double wall, stage[RG_N_STAGES]; // of the fastest run; stage < 0 if absent
+	double reads_per_sec;
+	int64_t reads;
+} rg_side_t;
+
+typedef kvec_t(char *) str_v;
+
+typedef struct {
+	FILE *fp;
+	char *line;
+	size_t m;
+	int has_line;
+} rg_sam_t;
+
+typedef struct {
+	int64_t n_names, n_same, n_tol, n_diff;
+	int64_t field[RG_N_FIELDS], *tag, n_count; // per field and tag: read names differing in it
+} rg_cmp_t;
+
+static void rg_quote(kstring_t *s, const char *p)
+{
+	kputc('\'', s);
+	for (; *p; ++p) {
+		if (*p == '\'') kputs("'\\''", s);
+		else kputc(*p, s);
+	}
+	kputc('\'', s);
+}
+
+static double rg_realtime(void)
+{
+	struct timeval tp;
+	gettimeofday(&tp, NULL);
+	return tp.tv_sec + tp.tv_usec * 1e-6;
+}
+
+static char *rg_slurp(const char *fn)
+{
+	FILE *fp = fopen(fn, "r");
+	kstring_t s = {0, 0, 0};
+	int c;
+	if (fp == NULL) return NULL;
+	while ((c = getc(fp)) != EOF) kputc(c, &s);
+	fclose(fp);
+	return s.s? s.s : strdup("");
+}
+
+// number of "field" of object "key" (the number of "key" if field is NULL), after from
+static double rg_json_num(const char *from, const char *key, const char *field)
+{
+	char k[64];
+	const char *p, *e;
+	snprintf(k, sizeof(k), "\"%s\":", key);
+	if ((p = strstr(from, k)) == NULL) return -1.;
+	p += strlen(k);
+	if (field) {
+		e = strchr(p, '}');
+		snprintf(k, sizeof(k), "\"%s\":", field);
+		if ((p = strstr(p, k)) == NULL || (e && p > e)) return -1.;
+		p += strlen(k);
+	}
+	while (*p == ' ') ++p;
+	return *p == 'n'? -1. : strtod(p, NULL); // null
+}
+
+/* One run of side s; its stage times kept if it is the fastest so far */
+static int rg_run(rg_side_t *s, const char *name, int run, int threads, int no_json, const char *dir,
+				  const char *idx, const char *in1, const char *in2)
+{
+	kstring_t cmd = {0, 0, 0}, fn = {0, 0, 0};
+	double t, stage[RG_N_STAGES];
+	char *js = NULL;
+	int i, ret;
+
+	ksprintf(&fn, "%s/%s.json", dir, name);
+	kputs("exec ", &cmd), rg_quote(&cmd, s->bin);
+	ksprintf(&cmd, " mem -t %d", threads);
+	if (!no_json) kputs(" --stats-json ", &cmd), rg_quote(&cmd, fn.s);
+	if (*s->opts) kputc(' ', &cmd), kputs(s->opts, &cmd);
+	kputc(' ', &cmd), rg_quote(&cmd, idx);
+	kputc(' ', &cmd), rg_quote(&cmd, in1);
+	if (in2) kputc(' ', &cmd), rg_quote(&cmd, in2);
+	ksprintf(&cmd, " > %s/%s.sam 2> %s/%s.log", dir, name, dir, name);
+	fprintf(stderr, "[M::%s] %s run %d: %s\n", __func__, name, run + 1, cmd.s);
+
+	t = rg_realtime();
+	ret = system(cmd.s);
+	t = rg_realtime() - t;
+	if (ret == -1 || !WIFEXITED(ret) || WEXITSTATUS(ret) != 0) {
+		fprintf(stderr, "[E::%s] the %s run failed; see %s/%s.log\n", __func__, name, dir, name);
+		free(cmd.s), free(fn.s);
+		return -1;
+	}
+	if (!no_json && (js = rg_slurp(fn.s)) == NULL) {
+		fprintf(stderr, "[E::%s] the %s run wrote no %s; use -W for binaries without --stats-json\n",
+				__func__, name, fn.s);
+		free(cmd.s), free(fn.s);
+		return -1;
+	}
+	if (js) {
+		const char *st = strstr(js, "\"stages\"");
+		for (i = 0; i < RG_N_STAGES; ++i) {
+			stage[i] = st? rg_json_num(st, rg_stage[i], "sec") : -1.;
+			if (stage[i] < 0. && st) stage[i] = rg_json_num(st, rg_stage[i], "sum");
+		}
+	} else for (i = 0; i < RG_N_STAGES; ++i) stage[i] = -1.;
+	// fastest by process time, or by wall-clock time without stats
+	if (run == 0 || (js? stage[0] < s->stage[0] : t < s->wall)) {
+		s->wall = t;
+		memcpy(s->stage, stage, sizeof(stage));
+		s->reads = js? (int64_t) rg_json_num(js, "reads", NULL) : -1;
+		s->reads_per_sec = js? rg_json_num(js, "reads_per_sec", NULL) : -1.;
+	}
+	free(js), free(cmd.s), free(fn.s);
+	return 0;
+}
+
+/*************
+ * SAM diffs *
+ *************/
+
+static int rg_getline(rg_sam_t *f)
+{
+	if (f->has_line) return f->has_line = 0, 0;
+	return getline(&f->line, &f->m, f->fp) < 0? -1 : 0;
+}
+
+static inline int rg_qname_eq(const char *a, const char *b)
+{
+	for (; *a && *a != '\t' && *a == *b; ++a, ++b);
+	return (*a == '\t' || *a == '\n' || *a == 0) && (*b == '\t' || *b == '\n' || *b == 0);
+}
+
+// header lines but @PG, then the records of the next read name
+static void rg_read_hdr(rg_sam_t *f, kstring_t *h)
+{
+	while (rg_getline(f) == 0) {
+		if (f->line[0] != '@') { f->has_line = 1; break; }
+		if (strncmp(f->line, "@PG\t", 4) != 0) kputs(f->line, h);
+	}
+}
+
+static void rg_read_group(rg_sam_t *f, str_v *g)
+{
+	size_t i;
+	for (i = 0; i < g->n; ++i) free(g->a[i]);
+	g->n = 0;
+	while (rg_getline(f) == 0) {
+		if (g->n && !rg_qname_eq(g->a[0], f->line)) { f->has_line = 1; break; }
+		kv_push(char *, *g, strdup(f->line));
+	}
+}
+
+static int rg_split(char *s, char **f, int max)
+{
+	int n = 0;
+	char *p = s;
+	size_t l = strlen(s);
+	if (l && s[l - 1] == '\n') s[l - 1] = 0;
+	while (n < max) {
+		f[n++] = p;
+		if ((p = strchr(p, '\t')) == NULL) break;
+		*p++ = 0;
+	}
+	return n;
+}
+
+static inline int rg_tag_key(const char *t) { return (uint8_t) t[0] << 8 | (uint8_t) t[1]; }
+
+static inline const char *rg_find_tag(char **f, int n, const char *t)
+{
+	for (int i = RG_N_FIELDS; i < n; ++i)
+		if (f[i][0] == t[0] && f[i][1] == t[1]) return f[i];
+	return NULL;
+}
+
+// 0 if the same, 1 if only MAPQ, XS or XA differ, 2 otherwise; differing fields and tags in d[]
+static int rg_cmp_line(char *a, char *b, uint8_t *d, uint8_t *dt, int *changed, int n_changed_max, int *n_changed)
+{
+	char *fa[256], *fb[256];
+	int na = rg_split(a, fa, 256), nb = rg_split(b, fb, 256), i, ret = 0;
+	for (i = 0; i < RG_N_FIELDS && i < na && i < nb; ++i)
+		if (strcmp(fa[i], fb[i]) != 0) {
+			d[i] = 1;
+			ret = ret > (i == 4? 1 : 2)? ret : (i == 4? 1 : 2);
+		}
+	if (na < RG_N_FIELDS || nb < RG_N_FIELDS) return 2;
+	for (int k = 0; k < 2; ++k) { // tags of a missing from or different in b, then of b missing from a
+		char **x = k? fb : fa, **y = k? fa : fb;
+		int nx = k? nb : na, ny = k? na : nb;
+		for (i = RG_N_FIELDS; i < nx; ++i) {
+			const char *t = rg_find_tag(y, ny, x[i]);
+			int key = rg_tag_key(x[i]), tol;
+			if (t && (k || strcmp(t, x[i]) == 0)) continue;
+			tol = strncmp(x[i], "XS", 2) == 0 || strncmp(x[i], "XA", 2) == 0;
+			ret = ret > (tol? 1 : 2)? ret : (tol? 1 : 2);
+			if (!dt[key] && *n_changed < n_changed_max) changed[(*n_changed)++] = key;
+			dt[key] = 1;
+		}
+	}
+	return ret;
+}
+
+static int rg_compare(const char *fn_a, const char *fn_b, rg_cmp_t *c, int show)
+{
+	rg_sam_t fa, fb;
+	kstring_t ha = {0, 0, 0}, hb = {0, 0, 0};
+	str_v ga = {0, 0, 0}, gb = {0, 0, 0};
+	uint8_t *dt = (uint8_t *) calloc(RG_N_TAGS, 1);
+	int changed[64], n_changed, i, ret = 0;
+
+	memset(&fa, 0, sizeof(fa)), memset(&fb, 0, sizeof(fb));
+	memset(c, 0, sizeof(*c));
+	c->tag = (int64_t *) calloc(RG_N_TAGS, sizeof(int64_t));
+	fa.fp = fopen(fn_a, "r"), fb.fp = fopen(fn_b, "r");
+	if (fa.fp == NULL || fb.fp == NULL) {
+		fprintf(stderr, "[E::%s] fail to open the outputs\n", __func__);
+		ret = -1;
+		goto end;
+	}
+	rg_read_hdr(&fa, &ha), rg_read_hdr(&fb, &hb);
+	if (ha.l != hb.l || (ha.l && strcmp(ha.s, hb.s) != 0)) {
+		fprintf(stderr, "[W::%s] the SAM headers differ (@PG aside)\n", __func__);
+		++c->n_diff;
+	}
+	for (;;) {
+		uint8_t d[RG_N_FIELDS];
+		int worst = 0;
+		rg_read_group(&fa, &ga), rg_read_group(&fb, &gb);
+		if (ga.n == 0 && gb.n == 0) break;
+		if (ga.n == 0 || gb.n == 0 || !rg_qname_eq(ga.a[0], gb.a[0])) {
+			fprintf(stderr, "[E::%s] the outputs are out of step at read %ld: %.*s vs %.*s\n", __func__,
+					(long) c->n_names + 1, ga.n? (int) strcspn(ga.a[0], "\t\n") : 5, ga.n? ga.a[0] : "(end)",
+					gb.n? (int) strcspn(gb.a[0], "\t\n") : 5, gb.n? gb.a[0] : "(end)");
+			ret = -1;
+			break;
+		}
+		++c->n_names;
+		memset(d, 0, sizeof(d));
+		n_changed = 0;
+		if (ga.n != gb.n) worst = 2;
+		for (i = 0; i < (int) ga.n && i < (int) gb.n; ++i) {
+			char *la = show && c->n_diff < show? strdup(ga.a[i]) : NULL, *lb = la? strdup(gb.a[i]) : NULL;
+			int r = rg_cmp_line(ga.a[i], gb.a[i], d, dt, changed, 64, &n_changed);
+			if (r == 2 && la) fprintf(stderr, "[W::%s] records differ:\n< %s> %s", __func__, la, lb);
+			free(la), free(lb);
+			worst = worst > r? worst : r;
+		}
+		for (i = 0; i < RG_N_FIELDS; ++i) c->field[i] += d[i];
+		for (i = 0; i < n_changed; ++i) c->tag[changed[i]]++, dt[changed[i]] = 0;
+		if (worst == 0) ++c->n_same;
+		else if (worst == 1) ++c->n_tol;
+		else ++c->n_diff;
+	}
+end:
+	for (i = 0; i < (int) ga.n; ++i) free(ga.a[i]);
+	for (i = 0; i < (int) gb.n; ++i) free(gb.a[i]);
+	kv_destroy(ga), kv_destroy(gb);
+	free(ha.s), free(hb.s), free(fa.line), free(fb.line), free(dt);
+	if (fa.fp) fclose(fa.fp);
+	if (fb.fp) fclose(fb.fp);
+	return ret;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: bwa-mem2 regress [options] <idxbase> <in1.fq> [in2.fq]\n");
+	fprintf(stderr, "Runs 'mem' of a baseline and a candidate on the reads and fails if the candidate changes\n");
+	fprintf(stderr, "the alignments beyond MAPQ, XS and XA, or is slower than the baseline.\n");
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "  -A STR    baseline binary [this binary]\n");
+	fprintf(stderr, "  -B STR    candidate binary [this binary]\n");
+	fprintf(stderr, "  -a STR    options of the baseline's mem, in one argument [none]\n");
+	fprintf(stderr, "  -b STR    options of the candidate's mem, in one argument [none]\n");
+	fprintf(stderr, "  -t INT    threads of both [4]\n");
+	fprintf(stderr, "  -r INT    runs of each, alternating; the fastest is compared [3]\n");
+	fprintf(stderr, "  -d FLOAT  max fraction of read names with MAPQ, XS or XA differences [0.03]\n");
+	fprintf(stderr, "  -D FLOAT  max fraction of read names with other differences [0]\n");
+	fprintf(stderr, "  -s FLOAT  max slowdown of the candidate's process time, 0.05 for 5%% [0.05]\n");
+	fprintf(stderr, "  -o DIR    keep the SAM, log and stats of the runs in DIR [a temporary directory]\n");
+	fprintf(stderr, "  -n INT    print the records of the first INT read names that differ [5]\n");
+	fprintf(stderr, "  -W        binaries without --stats-json: compare wall-clock times, index loading included\n");
+}
+
+int main_regress(int argc, char *argv[])
+{
+	rg_side_t side[2];
+	rg_cmp_t cmp;
+	char self[PATH_MAX], dir[PATH_MAX] = "", fa[PATH_MAX], fb[PATH_MAX];
+	const char *out_dir = NULL, *in2;
+	double max_tol = .03, max_diff = 0., max_slow = .05;
+	int threads = 4, runs = 3, show = 5, no_json = 0, c, r, i, fail = 0;
+	ssize_t l;
+
+	if ((l = readlink("/proc/self/exe", self, sizeof(self) - 1)) < 0) strcpy(self, "bwa-mem2");
+	else self[l] = 0;
+	memset(side, 0, sizeof(side));
+	side[0].bin = side[1].bin = self, side[0].opts = side[1].opts = "";
+	while ((c = getopt(argc, argv, "A:B:a:b:t:r:d:D:s:o:n:W")) >= 0) {
+		if (c == 'A') side[0].bin = optarg;
+		else if (c == 'B') side[1].bin = optarg;
+		else if (c == 'a') side[0].opts = optarg;
+		else if (c == 'b') side[1].opts = optarg;
+		else if (c == 't') threads = atoi(optarg);
+		else if (c == 'r') runs = atoi(optarg);
+		else if (c == 'd') max_tol = atof(optarg);
+		else if (c == 'D') max_diff = atof(optarg);
+		else if (c == 's') max_slow = atof(optarg);
+		else if (c == 'o') out_dir = optarg;
+		else if (c == 'n') show = atoi(optarg);
+		else if (c == 'W') no_json = 1;
+		else { usage(); return 1; }
+	}
+	if (optind + 2 > argc || optind + 3 < argc || threads < 1 || runs < 1) {
+		usage();
+		return 1;
+	}
+	in2 = optind + 2 < argc? argv[optind + 2] : NULL;
+	if (out_dir) {
+		snprintf(dir, sizeof(dir), "%s", out_dir);
+		mkdir(dir, 0777); // the runs fail on their output if it is not there
+	} else {
+		const char *t = getenv("TMPDIR");
+		snprintf(dir, sizeof(dir), "%s/bwa-regress.XXXXXX", t && *t? t : "/tmp");
+		if (mkdtemp(dir) == NULL) {
+			fprintf(stderr, "[E::%s] fail to create a directory in %s\n", __func__, t && *t? t : "/tmp");
+			return 1;
+		}
+	}
+
+	for (r = 0; r < runs; ++r)
+		for (i = 0; i < 2; ++i)
+			if (rg_run(&side[i], i? "candidate" : "baseline", r, threads, no_json, dir,
+					   argv[optind], argv[optind + 1], in2) < 0)
+				return 1;
+	snprintf(fa, sizeof(fa), "%s/baseline.sam", dir);
+	snprintf(fb, sizeof(fb), "%s/candidate.sam", dir);
+	if (rg_compare(fa, fb, &cmp, show) < 0) fail = 1;
+
+	// the report
+	printf("%-18s %12s %12s %9s\n", "stage (sec)", "baseline", "candidate", "delta");
+	printf("%-18s %12.3f %12.3f %+8.1f%%\n", "wall", side[0].wall, side[1].wall,
+		   (side[1].wall / side[0].wall - 1.) * 100.);
+	for (i = 0; i < RG_N_STAGES; ++i) {
+		double a = side[0].stage[i], b = side[1].stage[i];
+		if (a < 0. && b < 0.) continue;
+		if (a < 0. || b < 0.) printf("%-18s %12.3f %12.3f %9s\n", rg_stage[i], a, b, "-");
+		else if (a < .0005) printf("%-18s %12.3f %12.3f %9s\n", rg_stage[i], a, b, "-");
+		else printf("%-18s %12.3f %12.3f %+8.1f%%\n", rg_stage[i], a, b, (b / a - 1.) * 100.);
+	}
+	if (side[0].reads_per_sec > 0. && side[1].reads_per_sec > 0.)
+		printf("%-18s %12.1f %12.1f %+8.1f%%\n", "reads/sec", side[0].reads_per_sec, side[1].reads_per_sec,
+			   (side[1].reads_per_sec / side[0].reads_per_sec - 1.) * 100.);
+	printf("\nread names %ld: identical %ld, MAPQ/XS/XA only %ld (%.3f%%), other %ld (%.3f%%)\n",
+		   (long) cmp.n_names, (long) cmp.n_same, (long) cmp.n_tol,
+		   cmp.n_names? 100. * cmp.n_tol / cmp.n_names : 0., (long) cmp.n_diff,
+		   cmp.n_names? 100. * cmp.n_diff / cmp.n_names : 0.);
+	for (i = 0; i < RG_N_FIELDS; ++i)
+		if (cmp.field[i]) printf("  %-6s %ld\n", rg_field_name[i], (long) cmp.field[i]);
+	for (i = 0; i < RG_N_TAGS; ++i)
+		if (cmp.tag[i]) printf("  %c%c     %ld\n", i >> 8, i & 0xff, (long) cmp.tag[i]);
+	fflush(stdout);
+
+	// the gates
+	if (side[0].reads >= 0 && side[1].reads >= 0 && side[0].reads != side[1].reads) {
+		fprintf(stderr, "[E::%s] the runs read %ld and %ld reads\n", __func__, (long) side[0].reads, (long) side[1].reads);
+		fail = 1;
+	}
+	if (cmp.n_names && (double) cmp.n_tol / cmp.n_names > max_tol) {
+		fprintf(stderr, "[E::%s] %.3f%% of the read names differ in MAPQ/XS/XA; at most %.3f%% allowed\n",
+				__func__, 100. * cmp.n_tol / cmp.n_names, 100. * max_tol);
+		fail = 1;
+	}
+	if (cmp.n_diff > (cmp.n_names * max_diff)) {
+		fprintf(stderr, "[E::%s] %ld read names differ beyond MAPQ/XS/XA; at most %.3f%% allowed\n",
+				__func__, (long) cmp.n_diff, 100. * max_diff);
+		fail = 1;
+	}
+	{
+		double a = no_json? side[0].wall : side[0].stage[0], b = no_json? side[1].wall : side[1].stage[0];
+		if (a > 0. && b > a * (1. + max_slow)) {
+			fprintf(stderr, "[E::%s] the candidate is %.1f%% slower (%s %.3f vs %.3f sec); at most %.1f%% allowed\n",
+					__func__, (b / a - 1.) * 100., no_json? "wall" : "process", b, a, max_slow * 100.);
+			fail = 1;
+		}
+	}
+	free(cmp.tag);
+	if (out_dir == NULL) { // the scratch directory goes unless the gate failed
+		if (fail) fprintf(stderr, "[M::%s] the runs are kept in %s\n", __func__, dir);
+		else {
+			static const char *ext[] = { ".sam", ".log", ".json" };
+			char fn[PATH_MAX];
+			for (i = 0; i < 6; ++i) {
+				snprintf(fn, sizeof(fn), "%s/%s%s", dir, i & 1? "candidate" : "baseline", ext[i >> 1]);
+				unlink(fn);
+			}
+			rmdir(dir);
+		}
+	}
+	fprintf(stderr, "[M::%s] %s\n", __func__, fail? "FAILED" : "passed");
+	return fail;
+}
@@ -0,0 +1,345 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM-SCALE (Memory-Scalable Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2022 Electronics and Telecommunications Research Institute (ETRI), Changdae Kim.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   Contacts: Changdae Kim <cdkim@etri.re.kr>
+
+** This software builds upon BWA-MEM2, and includes several performance optimization techniques.
+   For BWA-MEM2, refer to the follows.
+
+   BWA-MEM2 (Sequence alignment using Burrows-Wheeler Transform)
+   Copyright ⓒ 2019 Intel Corporation, Heng Li
+   The MIT License
+   Website: https://github.com/bwa-mem2/bwa-mem2
+
+*****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "main.h"
+#include "kstring.h"
+#include "bwa.h"
+
+#ifndef PACKAGE_VERSION
+#define PACKAGE_VERSION "2.0"
+#endif
+
+/* A job is one 'mem' command line. The client connects to the Unix socket,
+ * passes its stdout and stderr descriptors (SCM_RIGHTS) with a serve_req_t,
+ * then sends $len bytes: its working directory, its argv[0] and the 'mem'
+ * arguments, each NUL-terminated. The server runs the job in its working
+ * directory with the client's stdout/stderr and replies with the int32 exit
+ * status. Jobs run one at a time against the resident index. */
+
+#define SERVE_MAGIC    0x314d454d  // "MEM1"
+#define SERVE_SOCK     "/tmp/bwa-mem2.sock"
+#define SERVE_MAX_REQ  (1<<20)
+
+typedef struct {
+	uint32_t magic, len;
+} serve_req_t;
+
+extern char *bwa_pg;
+extern int opt_bwa_shm_map_touch;
+static volatile sig_atomic_t serve_stop = 0;
+
+static void serve_on_signal(int sig) { serve_stop = 1; }
+
+static int serve_addr(const char *path, struct sockaddr_un *addr)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr->sun_path)) {
+		fprintf(stderr, "[E::%s] socket path '%s' is too long\n", __func__, path);
+		return -1;
+	}
+	strcpy(addr->sun_path, path);
+	return 0;
+}
+
+static int read_full(int fd, void *buf, size_t len)
+{
+	size_t n = 0;
+	while (n < len) {
+		ssize_t r = read(fd, (char*)buf + n, len - n);
+		if (r < 0 && errno == EINTR) continue;
+		if (r <= 0) return -1;
+		n += r;
+	}
+	return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t len)
+{
+	size_t n = 0;
+	while (n < len) {
+		ssize_t r = write(fd, (const char*)buf + n, len - n);
+		if (r < 0 && errno == EINTR) continue;
+		if (r <= 0) return -1;
+		n += r;
+	}
+	return 0;
+}
+
+/* run one job with the client's cwd, stdout and stderr */
+static int serve_job(int fd_out, int fd_err, char *req, uint32_t len)
+{
+	char *cwd = req, *prog, *p, **argv;
+	int argc = 0, ret, i;
+	int so, se, here;
+	kstring_t pg = {0, 0, 0};
+
+	// split the request: cwd, prog, args...
+	for (p = req; p < req + len; p += strlen(p) + 1) ++argc;
+	if (argc < 2) return EXIT_FAILURE;
+	prog = cwd + strlen(cwd) + 1;
+	argc -= 1; // "mem" takes the place of cwd+prog
+	argv = (char**) calloc(argc + 1, sizeof(char*));
+	assert(argv != NULL);
+	argv[0] = (char*)"mem";
+	for (i = 1, p = prog + strlen(prog) + 1; i < argc; ++i, p += strlen(p) + 1)
+		argv[i] = p;
+
+	fflush(stdout); fflush(stderr);
+	so = dup(1), se = dup(2), here = open(".", O_RDONLY);
+	dup2(fd_out, 1), dup2(fd_err, 2);
+	if (chdir(cwd) != 0) {
+		fprintf(stderr, "[E::%s] failed to enter '%s': %s\n", __func__, cwd, strerror(errno));
+		ret = EXIT_FAILURE;
+	} else {
+		// state a previous job may have left behind
+		optind = 0;
+		bwa_verbose = 3;
+		memset(bwa_rg_id, 0, sizeof(bwa_rg_id));
+		memset(tprof, 0, sizeof(tprof));
+		tprof[MEM][0] = __rdtsc();
+
+		ksprintf(&pg, "@PG\tID:bwa-mem2\tPN:bwa-mem2\tVN:%s\tCL:%s mem", PACKAGE_VERSION, prog);
+		for (i = 1; i < argc; ++i) ksprintf(&pg, " %s", argv[i]);
+		ksprintf(&pg, "\n");
+		bwa_pg = pg.s;
+		ret = main_mem(argc, argv);
+		free(bwa_pg);
+		bwa_pg = 0;
+	}
+	fflush(stdout); fflush(stderr);
+	dup2(so, 1), dup2(se, 2);
+	if (fchdir(here) != 0) {
+		fprintf(stderr, "[E::%s] failed to return to the serving directory\n", __func__);
+		exit(EXIT_FAILURE);
+	}
+	close(so), close(se), close(here);
+	free(argv);
+	return ret;
+}
+
+/* accept one connection and run its job; -1 if nothing was accepted */
+static int serve_one(int lfd, int64_t n_job)
+{
+	serve_req_t h;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cm;
+	char cbuf[CMSG_SPACE(2 * sizeof(int))];
+	int fd, fds[2] = {-1, -1}, status;
+	char *req;
+	double rtime;
+
+	if ((fd = accept(lfd, 0, 0)) < 0) return -1;
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &h, iov.iov_len = sizeof(h);
+	msg.msg_iov = &iov, msg.msg_iovlen = 1;
+	msg.msg_control = cbuf, msg.msg_controllen = sizeof(cbuf);
+	if (recvmsg(fd, &msg, MSG_WAITALL) != sizeof(h) || h.magic != SERVE_MAGIC || h.len > SERVE_MAX_REQ) {
+		fprintf(stderr, "[W::%s] dropped a malformed request\n", __func__);
+		close(fd);
+		return 0;
+	}
+	for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+		if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS && cm->cmsg_len == CMSG_LEN(2 * sizeof(int)))
+			memcpy(fds, CMSG_DATA(cm), 2 * sizeof(int));
+	req = (char*) malloc(h.len + 1);
+	assert(req != NULL);
+	req[h.len] = 0;
+	if (fds[0] < 0 || fds[1] < 0 || read_full(fd, req, h.len) < 0 || h.len == 0 || req[h.len - 1] != 0) {
+		fprintf(stderr, "[W::%s] dropped a malformed request\n", __func__);
+		status = EXIT_FAILURE;
+	} else {
+		rtime = realtime();
+		status = serve_job(fds[0], fds[1], req, h.len);
+		fprintf(stderr, "[M::%s] job %ld finished with status %d in %.3f sec\n", __func__, (long)n_job, status, realtime() - rtime);
+	}
+	write_full(fd, &status, sizeof(status)); // the client may be gone; nothing to do then
+	if (fds[0] >= 0) close(fds[0]);
+	if (fds[1] >= 0) close(fds[1]);
+	free(req);
+	close(fd);
+	return 0;
+}
+
+static int serve_usage()
+{
+	fprintf(stderr, "Usage: bwa-mem2 serve [options] <idxbase>\n");
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "   -s STR   Unix socket to accept jobs on [%s]\n", SERVE_SOCK);
+	fprintf(stderr, "   -Z INT   use ERT index for seeding (as in 'mem')\n");
+	fprintf(stderr, "   -l INT   perfect match table / read length hint (as in 'mem')\n");
+	fprintf(stderr, "   -b       touch the index pages when mapping shared memory\n");
+	fprintf(stderr, "Keeps <idxbase> and the worker buffers loaded and runs 'mem' jobs sent with\n");
+	fprintf(stderr, "   bwa-mem2 submit [-s STR] <mem options> <idxbase> <in1.fq> [in2.fq]\n");
+	fprintf(stderr, "one at a time. SIGINT or SIGTERM stops the server.\n");
+	return 1;
+}
+
+int main_serve(int argc, char *argv[])
+{
+	const char *path = SERVE_SOCK;
+	struct sockaddr_un addr;
+	struct sigaction sa;
+	int c, lfd, l = -1;
+	int64_t n_job = 0;
+#ifdef USE_SHM
+	int useErt = -1; /* if undefined, use bwa_shm's */
+#else
+	int useErt = DEFAULT_USE_ERT;
+#endif
+
+	while ((c = getopt(argc, argv, "s:Z:l:b")) >= 0) {
+		if (c == 's') path = optarg;
+		else if (c == 'Z') useErt = atoi(optarg)? 1 : 0;
+		else if (c == 'l') l = atoi(optarg);
+		else if (c == 'b') opt_bwa_shm_map_touch = 1;
+		else return serve_usage();
+	}
+	if (optind + 1 != argc) return serve_usage();
+	if (serve_addr(path, &addr) < 0) return 1;
+
+	lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (lfd < 0) {
+		fprintf(stderr, "[E::%s] socket: %s\n", __func__, strerror(errno));
+		return 1;
+	}
+	if (connect(lfd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+		fprintf(stderr, "[E::%s] another server is listening on '%s'\n", __func__, path);
+		close(lfd);
+		return 1;
+	}
+	unlink(path); // stale socket of a server that is gone
+	if (bind(lfd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(lfd, 64) < 0) {
+		fprintf(stderr, "[E::%s] failed to listen on '%s': %s\n", __func__, path, strerror(errno));
+		close(lfd);
+		return 1;
+	}
+
+	setvbuf(stdout, NULL, _IOFBF, 1<<16); // SAM goes to the clients, never to a terminal
+	mem_resident = mem_resident_load(argv[optind], useErt, l);
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = serve_on_signal; // no SA_RESTART: accept() returns on a signal
+	sigaction(SIGINT, &sa, 0);
+	sigaction(SIGTERM, &sa, 0);
+	signal(SIGPIPE, SIG_IGN);
+	fprintf(stderr, "[M::%s] serving '%s' on '%s'\n", __func__, argv[optind], path);
+
+	while (!serve_stop)
+		if (serve_one(lfd, n_job) == 0) ++n_job;
+		else if (errno != EINTR) {
+			fprintf(stderr, "[E::%s] accept: %s\n", __func__, strerror(errno));
+			break;
+		}
+
+	close(lfd);
+	unlink(path);
+	mem_resident_free(mem_resident);
+	mem_resident = NULL;
+	fprintf(stderr, "[M::%s] served %ld jobs\n", __func__, (long)n_job);
+	return 0;
+}
+
+int main_submit(int argc, char *argv[])
+{
+	const char *path = SERVE_SOCK;
+	struct sockaddr_un addr;
+	serve_req_t h;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cm;
+	char cbuf[CMSG_SPACE(2 * sizeof(int))];
+	int fd, fds[2] = {1, 2}, status, i = 1;
+	char *cwd;
+	kstring_t req = {0, 0, 0};
+
+	if (argc > 2 && strcmp(argv[1], "-s") == 0) path = argv[2], i = 3;
+	if (i >= argc) {
+		fprintf(stderr, "Usage: bwa-mem2 submit [-s STR] <mem options> <idxbase> <in1.fq> [in2.fq]\n");
+		fprintf(stderr, "Runs the 'mem' job on the server listening on STR [%s]; see 'serve'.\n", SERVE_SOCK);
+		return 1;
+	}
+	if (serve_addr(path, &addr) < 0) return 1;
+	if ((cwd = getcwd(0, 0)) == 0) {
+		fprintf(stderr, "[E::%s] getcwd: %s\n", __func__, strerror(errno));
+		return 1;
+	}
+	kputsn(cwd, strlen(cwd) + 1, &req);
+	kputsn(argv[-1], strlen(argv[-1]) + 1, &req); // main() passes argv+1: this is the program name, for @PG
+	for (; i < argc; ++i) kputsn(argv[i], strlen(argv[i]) + 1, &req);
+	free(cwd);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+		fprintf(stderr, "[E::%s] no server on '%s': %s\n", __func__, path, strerror(errno));
+		return 1;
+	}
+	fflush(stdout); fflush(stderr);
+	h.magic = SERVE_MAGIC, h.len = req.l;
+	memset(&msg, 0, sizeof(msg));
+	memset(cbuf, 0, sizeof(cbuf));
+	iov.iov_base = &h, iov.iov_len = sizeof(h);
+	msg.msg_iov = &iov, msg.msg_iovlen = 1;
+	msg.msg_control = cbuf, msg.msg_controllen = sizeof(cbuf);
+	cm = CMSG_FIRSTHDR(&msg);
+	cm->cmsg_level = SOL_SOCKET, cm->cmsg_type = SCM_RIGHTS;
+	cm->cmsg_len = CMSG_LEN(2 * sizeof(int));
+	memcpy(CMSG_DATA(cm), fds, 2 * sizeof(int));
+	if (sendmsg(fd, &msg, 0) != sizeof(h) || write_full(fd, req.s, req.l) < 0) {
+		fprintf(stderr, "[E::%s] failed to send the job: %s\n", __func__, strerror(errno));
+		return 1;
+	}
+	free(req.s);
+	if (read_full(fd, &status, sizeof(status)) < 0) {
+		fprintf(stderr, "[E::%s] the server dropped the job\n", __func__);
+		return 1;
+	}
+	close(fd);
+	return status;
+}
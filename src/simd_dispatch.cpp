@@ -0,0 +1,177 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM-SCALE (Memory-Scalable Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2022 Electronics and Telecommunications Research Institute (ETRI), Changdae Kim.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   Contacts: Changdae Kim <cdkim@etri.re.kr>
+
+** This software builds upon BWA-MEM2, and includes several performance optimization techniques.
+   For BWA-MEM2, refer to the follows.
+
+   BWA-MEM2 (Sequence alignment using Burrows-Wheeler Transform)
+   Copyright ⓒ 2019 Intel Corporation, Heng Li
+   The MIT License
+   Website: https://github.com/bwa-mem2/bwa-mem2
+
+*****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "simd_dispatch.h"
+
+static int g_simd_isa = -1;
+
+static const char *simd_isa_names[SIMD_ISA_NUM] = {
+	"scalar", "sse41", "avx2", "avx512bw"
+};
+
+// adapted from x86_simd() in runsimd.cpp
+static inline void simd_cpuidex(int cpuid[4], int func_id, int subfunc_id)
+{
+	__asm__ volatile ("cpuid"
+			: "=a" (cpuid[0]), "=b" (cpuid[1]), "=c" (cpuid[2]), "=d" (cpuid[3])
+			: "0" (func_id), "2" (subfunc_id));
+}
+
+static inline uint64_t simd_xgetbv(void)
+{
+	uint32_t eax, edx;
+	__asm__ volatile ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+	return ((uint64_t) edx << 32) | eax;
+}
+
+int simd_isa_detect(void)
+{
+	int cpuid[4], max_id, isa = SIMD_ISA_SCALAR;
+	uint64_t xcr0 = 0;
+
+	simd_cpuidex(cpuid, 0, 0);
+	max_id = cpuid[0];
+	if (max_id == 0) return isa;
+	simd_cpuidex(cpuid, 1, 0);
+	if (cpuid[2]>>19&1) isa = SIMD_ISA_SSE41;
+	if (cpuid[2]>>27&1) xcr0 = simd_xgetbv();          // OSXSAVE
+	if (max_id < 7 || (xcr0 & 0x6) != 0x6) return isa; // xmm/ymm state
+	simd_cpuidex(cpuid, 7, 0);
+	if (cpuid[1]>>5 &1) isa = SIMD_ISA_AVX2;
+	if ((cpuid[1]>>16&1) && (cpuid[1]>>30&1) && (xcr0 & 0xe0) == 0xe0)
+		isa = SIMD_ISA_AVX512BW;
+	return isa;
+}
+
+int simd_isa_compiled(void)
+{
+#if __AVX512BW__
+	return SIMD_ISA_AVX512BW;
+#elif __AVX2__
+	return SIMD_ISA_AVX2;
+#elif __SSE4_1__
+	return SIMD_ISA_SSE41;
+#else
+	return SIMD_ISA_SCALAR;
+#endif
+}
+
+const char *simd_isa_name(int isa)
+{
+	if (isa < 0 || isa >= SIMD_ISA_NUM) return "unknown";
+	return simd_isa_names[isa];
+}
+
+int simd_dispatch_init(const char *name)
+{
+	int isa = simd_isa_detect();
+
+	if (name && *name) {
+		int i;
+		for (i = 0; i < SIMD_ISA_NUM; i++)
+			if (strcmp(name, simd_isa_names[i]) == 0) break;
+		if (i == SIMD_ISA_NUM) {
+			fprintf(stderr, "[E::%s] unknown SIMD ISA '%s' (sse41, avx2 or avx512bw)\n",
+					__func__, name);
+			exit(EXIT_FAILURE);
+		}
+		if (i < isa) isa = i;
+	}
+#ifdef SIMD_DISPATCH
+	if (isa < simd_isa_compiled()) {
+		fprintf(stderr, "[E::%s] this binary needs at least %s, the cpu supports %s\n",
+				__func__, simd_isa_name(simd_isa_compiled()), simd_isa_name(isa));
+		exit(EXIT_FAILURE);
+	}
+#else
+	// without dispatch only the compiled kernels exist
+	isa = simd_isa_compiled();
+#endif
+	g_simd_isa = isa;
+	return isa;
+}
+
+int simd_dispatch_isa(void)
+{
+	if (g_simd_isa < 0) simd_dispatch_init(getenv(SIMD_DISPATCH_ENV));
+	return g_simd_isa;
+}
+
+const bsw_ops_t *bsw_dispatch_ops(void)
+{
+#ifdef SIMD_DISPATCH
+	switch (simd_dispatch_isa()) {
+	case SIMD_ISA_AVX512BW: return &bsw_ops_avx512bw;
+	case SIMD_ISA_AVX2:     return &bsw_ops_avx2;
+	default: break;
+	}
+#endif
+	return NULL;
+}
+
+const kswv_ops_t *kswv_dispatch_ops(void)
+{
+#ifdef SIMD_DISPATCH
+	switch (simd_dispatch_isa()) {
+	case SIMD_ISA_AVX512BW: return &kswv_ops_avx512bw;
+	case SIMD_ISA_AVX2:     return &kswv_ops_avx2;
+	default: break;
+	}
+#endif
+	return NULL;
+}
+
+const kswg_ops_t *kswg_dispatch_ops(void)
+{
+#ifdef SIMD_DISPATCH
+	switch (simd_dispatch_isa()) {
+	case SIMD_ISA_AVX512BW: return &kswg_ops_avx512bw;
+	case SIMD_ISA_AVX2:     return &kswg_ops_avx2;
+	default: break;
+	}
+#endif
+	return NULL;
+}
+
+int kswv_dispatch_batched(void)
+{
+	return kswv_dispatch_ops() != NULL || simd_isa_compiled() >= SIMD_ISA_SSE41;
+}
@@ -0,0 +1,128 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM-SCALE (Memory-Scalable Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2022 Electronics and Telecommunications Research Institute (ETRI), Changdae Kim.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   Contacts: Changdae Kim <cdkim@etri.re.kr>
+
+** This software builds upon BWA-MEM2, and includes several performance optimization techniques.
+   For BWA-MEM2, refer to the follows.
+
+   BWA-MEM2 (Sequence alignment using Burrows-Wheeler Transform)
+   Copyright ⓒ 2019 Intel Corporation, Heng Li
+   The MIT License
+   Website: https://github.com/bwa-mem2/bwa-mem2
+
+*****************************************************************************************/
+
+#ifndef SIMD_DISPATCH_HPP
+#define SIMD_DISPATCH_HPP
+
+#include <stdint.h>
+#include "bandedSWA.h"
+#include "ksw.h"
+#include "kswg.h"
+
+/*
+ * Runtime SIMD dispatch (arch=dispatch).
+ * bandedSWA.cpp, kswv.cpp and kswg.cpp are compiled once more per ISA with
+ * -DSIMD_DISPATCH_SUFFIX=<isa>, which renames their entry points to
+ * BandedPairWiseSW_<isa>/kswv_<isa>/ksw_global2_batch_<isa> and exports an
+ * ops table for each.
+ * The baseline (SSE4.1) classes forward getScores8/16/32 to the table of the
+ * ISA selected at startup. BWA_MEM_SIMD=sse41|avx2|avx512bw caps the
+ * selection, e.g. to run the AVX2 kernels on a throttling AVX-512 host.
+ */
+
+enum simd_isa {
+	SIMD_ISA_SCALAR = 0,
+	SIMD_ISA_SSE41,
+	SIMD_ISA_AVX2,
+	SIMD_ISA_AVX512BW,
+	SIMD_ISA_NUM
+};
+
+#define SIMD_DISPATCH_ENV "BWA_MEM_SIMD"
+
+typedef struct bsw_ops_s {
+	int isa;
+	void *(*create)(int o_del, int e_del, int o_ins, int e_ins, int zdrop,
+					int end_bonus, const int8_t *mat, int8_t w_match,
+					int8_t w_mismatch, int numThreads);
+	void (*destroy)(void *bsw);
+	void (*getScores8)(void *bsw, SeqPair *pairArray, uint8_t *seqBufRef,
+					   uint8_t *seqBufQer, int32_t numPairs,
+					   uint16_t numThreads, int32_t w);
+	void (*getScores16)(void *bsw, SeqPair *pairArray, uint8_t *seqBufRef,
+						uint8_t *seqBufQer, int32_t numPairs,
+						uint16_t numThreads, int32_t w);
+	void (*getScores32)(void *bsw, SeqPair *pairArray, uint8_t *seqBufRef,
+						uint8_t *seqBufQer, int32_t numPairs,
+						uint16_t numThreads, int32_t w);
+} bsw_ops_t;
+
+typedef struct kswv_ops_s {
+	int isa;
+	void *(*create)(int o_del, int e_del, int o_ins, int e_ins,
+					int8_t w_match, int8_t w_mismatch, int numThreads,
+					int32_t maxRefLen, int32_t maxQerLen);
+	void (*destroy)(void *ksw);
+	void (*getScores8)(void *ksw, SeqPair *pairArray, uint8_t *seqBufRef,
+					   uint8_t *seqBufQer, kswr_t *aln, int32_t numPairs,
+					   uint16_t numThreads, int phase);
+	void (*getScores16)(void *ksw, SeqPair *pairArray, uint8_t *seqBufRef,
+						uint8_t *seqBufQer, kswr_t *aln, int32_t numPairs,
+						uint16_t numThreads, int phase);
+} kswv_ops_t;
+
+typedef struct kswg_ops_s {
+	int isa;
+	void (*global_batch)(int n, kswg_job_t *job, int m, const int8_t *mat,
+						 int o_del, int e_del, int o_ins, int e_ins);
+} kswg_ops_t;
+
+#ifdef SIMD_DISPATCH
+extern const bsw_ops_t bsw_ops_avx2, bsw_ops_avx512bw;
+extern const kswv_ops_t kswv_ops_avx2, kswv_ops_avx512bw;
+extern const kswg_ops_t kswg_ops_avx2, kswg_ops_avx512bw;
+#endif
+
+/* ISA supported by the cpu (and the OS, for the upper ymm/zmm state) */
+int simd_isa_detect(void);
+/* ISA of the kernels compiled into the non-dispatched objects */
+int simd_isa_compiled(void);
+/* select the kernels to run; name (may be NULL) caps the detected ISA */
+int simd_dispatch_init(const char *name);
+/* ISA selected by simd_dispatch_init(), initialized on first use */
+int simd_dispatch_isa(void);
+const char *simd_isa_name(int isa);
+
+/* tables of the selected ISA, NULL when the baseline kernels are used */
+const bsw_ops_t *bsw_dispatch_ops(void);
+const kswv_ops_t *kswv_dispatch_ops(void);
+const kswg_ops_t *kswg_dispatch_ops(void);
+/* true when a batched (inter-sequence) kswv kernel is available */
+int kswv_dispatch_batched(void);
+
+#endif
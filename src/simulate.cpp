@@ -0,0 +1,280 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM-SCALE (Memory-Scalable Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2022 Electronics and Telecommunications Research Institute (ETRI), Changdae Kim.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   Contacts: Changdae Kim <cdkim@etri.re.kr>
+
+** This software builds upon BWA-MEM2, and includes several performance optimization techniques.
+   For BWA-MEM2, refer to the follows.
+
+   BWA-MEM2 (Sequence alignment using Burrows-Wheeler Transform)
+   Copyright ⓒ 2019 Intel Corporation, Heng Li
+   The MIT License
+   Website: https://github.com/bwa-mem2/bwa-mem2
+
+*****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <getopt.h>
+#include "main.h"
+#ifdef USE_SHM
+#include "bwa_shm.h"
+#endif
+
+/* Reads sampled from the .0123 reference of an index, for throughput runs
+ * that are the same on every node: fragments of a normal length distribution
+ * from both strands, away from reference gaps, with substitutions, indels of
+ * geometric length and Ns put in by drand48() of the given seed; a fraction
+ * of the fragments repeats one sampled before, as PCR duplicates do. The
+ * read name is <contig>_<start>_<end>_<strand of read 1>_<errors of read
+ * 1>:<errors of read 2>_<index>, start and end 1-based on the forward strand. */
+
+#define SIM_N_RECENT 65536 // fragments duplicates are drawn from
+
+typedef struct {
+	int64_t n;           // reads or pairs
+	int len, qual, is_se, max_ins;
+	double sub, indel, ext, n_rate, dup;
+	double ins_mean, ins_sd;
+} sim_opt_t;
+
+typedef struct {
+	int64_t beg;         // on the forward strand
+	int32_t len, rid;
+	int rev;             // read 1 from the reverse strand
+} sim_frag_t;
+
+static inline double sim_normal(void)
+{ // Box-Muller
+	double u = 1. - drand48(), v = drand48();
+	return sqrt(-2. * log(u)) * cos(2. * M_PI * v);
+}
+
+static int sim_frag(const sim_opt_t *o, const bntseq_t *bns, sim_frag_t *f)
+{
+	int tries;
+	for (tries = 0; tries < 1000; ++tries) {
+		int len = o->is_se? o->len : (int) (o->ins_mean + o->ins_sd * sim_normal() + .499);
+		int64_t pos;
+		int rid;
+		len = len > o->len? len : o->len;
+		len = len < o->max_ins? len : o->max_ins;
+		if (len > bns->l_pac) return -1;
+		pos = (int64_t) (drand48() * (bns->l_pac - len + 1));
+		rid = bns_pos2rid(bns, pos);
+		if (rid < 0 || pos + len > bns->anns[rid].offset + bns->anns[rid].len) continue;
+		if (bns_cnt_ambi(bns, pos, len, NULL) > 0) continue; // the random bases of a gap
+		f->beg = pos, f->len = len, f->rid = rid, f->rev = drand48() < .5;
+		return 0;
+	}
+	return -1;
+}
+
+/* One read from s[0..l_s) of a strand, its first base the fragment end; the
+ * read is in ACGTN with its errors and qualities, the number of errors returned. */
+static int sim_read(const sim_opt_t *o, const uint8_t *s, int64_t l_s, char *seq, char *qual)
+{
+	int64_t j = 0;
+	int i = 0, n_err = 0;
+	while (i < o->len) {
+		int c = j < l_s? s[j] : 4;
+		if (o->indel > 0. && drand48() < o->indel) {
+			int k, l = 1;
+			while (drand48() < o->ext) ++l;
+			++n_err;
+			if (drand48() < .5) { j += l; continue; } // deletion
+			for (k = 0; k < l && i < o->len; ++k)
+				seq[i] = "ACGT"[(int) (drand48() * 4)], qual[i++] = 33 + o->qual;
+			continue;
+		}
+		if (c < 4 && drand48() < o->sub) {
+			c = (c + 1 + (int) (drand48() * 3)) & 3;
+			++n_err;
+		}
+		seq[i] = "ACGTN"[c], qual[i] = 33 + (c < 4? o->qual : 2);
+		++i, ++j;
+	}
+	for (i = 0; i < o->len; ++i)
+		if (o->n_rate > 0. && drand48() < o->n_rate) seq[i] = 'N', qual[i] = 33 + 2;
+	seq[o->len] = qual[o->len] = 0;
+	return n_err;
+}
+
+static inline void sim_fastq(kstring_t *s, const char *name, int end, const char *seq, const char *qual)
+{
+	ksprintf(s, "@%s", name);
+	if (end) ksprintf(s, "/%d", end);
+	ksprintf(s, "\n%s\n+\n%s\n", seq, qual);
+}
+
+static FILE *sim_open(const char *fn)
+{
+	FILE *fp = fn? fopen(fn, "w") : stdout;
+	if (fp == NULL) {
+		fprintf(stderr, "[E::%s] fail to open file '%s' for writing\n", __func__, fn);
+		exit(EXIT_FAILURE);
+	}
+	return fp;
+}
+
+static void sim_write(FILE *fp, kstring_t *s)
+{
+	if (s->l && fwrite(s->s, 1, s->l, fp) != s->l) {
+		fprintf(stderr, "[E::%s] fail to write the reads\n", __func__);
+		exit(EXIT_FAILURE);
+	}
+	s->l = 0;
+}
+
+static void usage(const sim_opt_t *o)
+{
+	fprintf(stderr, "Usage: bwa-mem2 simulate [options] <idxbase> [<out1.fq> [<out2.fq>]]\n");
+	fprintf(stderr, "Samples reads from the .0123 reference of the index, to <out1.fq> and <out2.fq>, interleaved\n");
+	fprintf(stderr, "to <out1.fq> if <out2.fq> is absent, or to stdout for 'bwa-mem2 mem -p <idxbase> -'.\n");
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "  -N INT    number of read pairs, or reads with -S [%ld]\n", (long) o->n);
+	fprintf(stderr, "  -l INT    read length [%d]\n", o->len);
+	fprintf(stderr, "  -e FLOAT  substitution rate per base [%g]\n", o->sub);
+	fprintf(stderr, "  -i FLOAT  indel rate per base [%g]\n", o->indel);
+	fprintf(stderr, "  -x FLOAT  probability an indel extends by one more base [%g]\n", o->ext);
+	fprintf(stderr, "  -n FLOAT  rate of N bases [%g]\n", o->n_rate);
+	fprintf(stderr, "  -I FLOAT[,FLOAT]\n");
+	fprintf(stderr, "            mean and standard deviation of the insert size [%g,%g]\n", o->ins_mean, o->ins_sd);
+	fprintf(stderr, "  -D FLOAT  fraction of fragments that duplicate an earlier one [%g]\n", o->dup);
+	fprintf(stderr, "  -q INT    base quality [%d]\n", o->qual);
+	fprintf(stderr, "  -S        single-end reads\n");
+	fprintf(stderr, "  -s INT    random seed [11]\n");
+}
+
+int main_simulate(int argc, char *argv[])
+{
+	sim_opt_t o;
+	sim_frag_t *recent;
+	bntseq_t *bns;
+	uint8_t *ref = NULL;
+	kstring_t s1 = {0, 0, 0}, s2 = {0, 0, 0}, name = {0, 0, 0};
+	FILE *fp1, *fp2;
+	char *seq[2], *qual[2], *p;
+	long seed = 11;
+	int64_t i, n_recent = 0, n_dup = 0;
+	int c;
+
+	memset(&o, 0, sizeof(o));
+	o.n = 1000000, o.len = 150, o.qual = 30;
+	o.sub = .005, o.indel = .0005, o.ext = .3, o.n_rate = .0001;
+	o.ins_mean = 400., o.ins_sd = 50.;
+	while ((c = getopt(argc, argv, "N:l:e:i:x:n:I:D:q:Ss:")) >= 0) {
+		if (c == 'N') o.n = atol(optarg);
+		else if (c == 'l') o.len = atoi(optarg);
+		else if (c == 'e') o.sub = atof(optarg);
+		else if (c == 'i') o.indel = atof(optarg);
+		else if (c == 'x') o.ext = atof(optarg);
+		else if (c == 'n') o.n_rate = atof(optarg);
+		else if (c == 'I') {
+			o.ins_mean = strtod(optarg, &p);
+			if (*p == ',') o.ins_sd = strtod(p + 1, &p);
+		}
+		else if (c == 'D') o.dup = atof(optarg);
+		else if (c == 'q') o.qual = atoi(optarg);
+		else if (c == 'S') o.is_se = 1;
+		else if (c == 's') seed = atol(optarg);
+		else { usage(&o); return 1; }
+	}
+	if (optind + 1 > argc || optind + 3 < argc || o.n <= 0 || o.len <= 0 || o.qual < 0 || o.qual > 93
+		|| o.sub < 0. || o.indel < 0. || o.ext < 0. || o.ext >= 1. || o.n_rate < 0. || o.dup < 0.
+		|| o.dup >= 1. || o.ins_sd < 0. || (o.is_se && optind + 3 == argc)) {
+		usage(&o);
+		return 1;
+	}
+	o.max_ins = (int) (o.ins_mean + 6. * o.ins_sd) + o.len;
+
+	bns = bns_restore(argv[optind]);
+	load_ref_string(argv[optind], &ref);
+	fp1 = sim_open(optind + 1 < argc? argv[optind + 1] : NULL);
+	fp2 = optind + 2 < argc? sim_open(argv[optind + 2]) : fp1;
+	for (c = 0; c < 2; ++c) {
+		seq[c] = (char *) malloc(o.len + 1), qual[c] = (char *) malloc(o.len + 1);
+		assert(seq[c] && qual[c]);
+	}
+	recent = (sim_frag_t *) malloc(SIM_N_RECENT * sizeof(sim_frag_t));
+	assert(recent != NULL);
+	srand48(seed);
+
+	for (i = 0; i < o.n; ++i) {
+		sim_frag_t f;
+		int64_t l2 = bns->l_pac << 1, e, off, end;
+		int err[2] = {0, 0};
+		if (n_recent > 0 && o.dup > 0. && drand48() < o.dup) {
+			f = recent[(int64_t) (drand48() * (n_recent < SIM_N_RECENT? n_recent : SIM_N_RECENT))];
+			++n_dup;
+		} else {
+			if (sim_frag(&o, bns, &f) < 0) {
+				fprintf(stderr, "[E::%s] no room for a %d bp fragment off the gaps of the reference\n",
+						__func__, o.max_ins);
+				exit(EXIT_FAILURE);
+			}
+			recent[n_recent++ % SIM_N_RECENT] = f;
+		}
+		e = f.beg + f.len, off = bns->anns[f.rid].offset, end = off + bns->anns[f.rid].len;
+		// the forward strand from the fragment start up to the contig end, and the
+		// reverse complement, [2l_pac-e, 2l_pac-beg), from the fragment end up to the contig start
+		if (o.is_se)
+			err[0] = f.rev? sim_read(&o, ref + l2 - e, e - off, seq[0], qual[0])
+				: sim_read(&o, ref + f.beg, end - f.beg, seq[0], qual[0]);
+		else {
+			err[f.rev] = sim_read(&o, ref + f.beg, end - f.beg, seq[f.rev], qual[f.rev]);
+			err[!f.rev] = sim_read(&o, ref + l2 - e, e - off, seq[!f.rev], qual[!f.rev]);
+		}
+		name.l = 0;
+		ksprintf(&name, "%s_%ld_%ld_%c_%d:%d_%ld", bns->anns[f.rid].name, (long) (f.beg - off + 1),
+				 (long) (e - off), "+-"[f.rev], err[0], err[1], (long) i);
+		sim_fastq(&s1, name.s, o.is_se? 0 : 1, seq[0], qual[0]);
+		if (!o.is_se) sim_fastq(fp2 == fp1? &s1 : &s2, name.s, 2, seq[1], qual[1]);
+		if (s1.l >= 1<<20) sim_write(fp1, &s1);
+		if (s2.l >= 1<<20) sim_write(fp2, &s2);
+	}
+	sim_write(fp1, &s1), sim_write(fp2, &s2);
+	if (fflush(fp1) != 0 || fflush(fp2) != 0) {
+		fprintf(stderr, "[E::%s] fail to write the reads\n", __func__);
+		exit(EXIT_FAILURE);
+	}
+	if (fp2 != fp1) fclose(fp2);
+	if (fp1 != stdout) fclose(fp1);
+	fprintf(stderr, "[M::%s] %ld %s of %d bp, %ld duplicates, seed %ld\n", __func__, (long) o.n,
+			o.is_se? "reads" : "pairs", o.len, (long) n_dup, seed);
+
+	for (c = 0; c < 2; ++c) free(seq[c]), free(qual[c]);
+	free(recent); free(s1.s); free(s2.s); free(name.s);
+#ifdef USE_SHM
+	if (bwa_shm_unmap(BWA_SHM_REF))
+#endif
+		_mm_free(ref);
+	bns_destroy(bns);
+	return 0;
+}
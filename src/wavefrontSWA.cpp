@@ -0,0 +1,376 @@
+/*************************************************************************************
+                           The MIT License
+
+   BWA-MEM-SCALE (Memory-Scalable Sequence alignment using Burrows-Wheeler Transform),
+   Copyright (C) 2022 Electronics and Telecommunications Research Institute (ETRI), Changdae Kim.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+   EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+
+   Contacts: Changdae Kim <cdkim@etri.re.kr>
+
+** This software builds upon BWA-MEM2, and includes several performance optimization techniques.
+   For BWA-MEM2, refer to the follows.
+
+   BWA-MEM2 (Sequence alignment using Burrows-Wheeler Transform)
+   Copyright ⓒ 2019 Intel Corporation, Heng Li
+   The MIT License
+   Website: https://github.com/bwa-mem2/bwa-mem2
+
+*****************************************************************************************/
+
+#include <string.h>
+#include <limits.h>
+#include "bandedSWA.h"
+
+// ------------------------------------------------------------------------------------
+// Wavefront extension
+//
+// Scores are mapped to penalties (Eizenga & Paten): with match a, mismatch -b and gap
+// cost o+l*e, an alignment covering i target and j query bases has score
+//   S = h0 + (a*(i+j) - P) / 2,  P = X*2(a+b) + sum(2o + l*(2e+a)),
+// so the furthest-reaching point of each diagonal for penalty P is the best cell of
+// that diagonal. Wavefronts are computed in increasing P. As in scalarBandedSWA(), gaps
+// open only after a diagonal move, a state is alive while its score is positive and
+// diagonals are limited to the band. The row maxima seen along the way are replayed
+// through the row loop of scalarBandedSWA() so that z-drop, tie breaking and max_off
+// follow the DP kernels. Divergent pairs make the wavefronts as wide as the band and
+// are cheaper in the DP kernels: wavefrontSWA() returns -1 for them.
+// ------------------------------------------------------------------------------------
+#define WF_NEG (-(1<<29))
+#ifndef WF_MIN_MISMATCH
+#define WF_MIN_MISMATCH 3
+#endif
+#ifndef WF_BASES_PER_MISMATCH
+#define WF_BASES_PER_MISMATCH 50
+#endif
+
+typedef struct wavefront_s {
+    int lo, hi;             // diagonal range, empty if lo > hi
+    int32_t *M, *I, *D, *H; // offsets (target bases consumed), indexed by diagonal
+} wavefront_t;
+
+// number of matching bases from q[j], t[i]
+static inline int wf_extend(const uint8_t *q, int qlen, const uint8_t *t, int tlen, int j, int i)
+{
+    int i0 = i;
+    while (i + 8 <= tlen && j + 8 <= qlen) {
+        uint64_t x, y;
+        memcpy(&x, q + j, 8); memcpy(&y, t + i, 8);
+        if (x != y) return i - i0 + (__builtin_ctzll(x ^ y) >> 3);
+        i += 8, j += 8;
+    }
+    while (i < tlen && j < qlen && q[j] == t[i]) ++i, ++j;
+    return i - i0;
+}
+
+typedef struct {
+    int32_t *rowmax, *rowmj, *colend; // per DP row, 0 if no live cell seen
+    int qlen, a, h0;
+    int best, best_r, best_c;
+} wf_rows_t;
+
+static inline void wf_record(wf_rows_t *r, int i, int j, int sc)
+{
+    if (i < 1 || j < 1) return; // first row and column are not part of the row maxima
+    int row = i - 1, col = j - 1;
+    if (sc > r->rowmax[row] || (sc == r->rowmax[row] && col > r->rowmj[row]))
+        r->rowmax[row] = sc, r->rowmj[row] = col;
+    if (j == r->qlen && sc > r->colend[row]) r->colend[row] = sc;
+    if (sc > r->best || (sc == r->best && (row < r->best_r || (row == r->best_r && col > r->best_c))))
+        r->best = sc, r->best_r = row, r->best_c = col;
+}
+
+// record the run of matches on diagonal k from offset i0 to i1 with penalty s
+static inline void wf_record_run(wf_rows_t *r, int k, int i0, int i1, int s)
+{
+    for (int i = i0; i <= i1; ++i)
+        wf_record(r, i, i + k, r->h0 + (r->a * (2 * i + k) - s) / 2);
+}
+
+int BandedPairWiseSW::wavefrontSWA(int qlen, const uint8_t *query,
+                                   int tlen, const uint8_t *target,
+                                   int32_t w, int h0, int *_qle, int *_tle,
+                                   int *_gtle, int *_gscore,
+                                   int *_max_off)
+{
+    int a = mat[0], b = -mat[1];
+    int x = 2 * (a + b);
+    int oi = 2 * o_ins, ei = 2 * e_ins + a, od = 2 * o_del, ed = 2 * e_del + a;
+    int R, i, k, s, max_ins, max_del, kmin, kmax, last_active;
+    int max, max_i, max_j, max_ie, gscore, max_off;
+    wavefront_t *wf;
+    int32_t *buf;
+    wf_rows_t rw;
+
+    // adjust $w as scalarBandedSWA() does
+    max_ins = (int)((double)(qlen * a + end_bonus - o_ins) / e_ins + 1.);
+    max_ins = max_ins > 1? max_ins : 1;
+    w = w < max_ins? w : max_ins;
+    max_del = (int)((double)(qlen * a + end_bonus - o_del) / e_del + 1.);
+    max_del = max_del > 1? max_del : 1;
+    w = w < max_del? w : max_del;
+    kmin = -(w < tlen? w : tlen);
+    kmax = w < qlen? w : qlen;
+
+    // give up beyond WF_MIN_MISMATCH mismatches plus one per WF_BASES_PER_MISMATCH bases
+    int s_max = x * (WF_MIN_MISMATCH + qlen / WF_BASES_PER_MISMATCH);
+
+    R = x;
+    R = R > oi + ei? R : oi + ei;
+    R = R > od + ed? R : od + ed;
+    R += 1;
+    int KW = kmax - kmin + 1;
+    int64_t n_buf = (int64_t)R * 4 * KW + 3 * (int64_t)tlen;
+    if (R > wf_m_) {
+        wf_m_ = R;
+        wf_ = (wavefront_t *) realloc(wf_, R * sizeof(wavefront_t));
+        assert(wf_ != NULL);
+    }
+    if (n_buf > wf_buf_m_) { // contents need not be kept
+        wf_buf_m_ = n_buf + (n_buf >> 1);
+        free(wf_buf_);
+        wf_buf_ = (int32_t *) malloc(wf_buf_m_ * sizeof(int32_t));
+        assert(wf_buf_ != NULL);
+    }
+    wf = wf_, buf = wf_buf_;
+    for (i = 0; i < R; ++i) {
+        wf[i].lo = 1, wf[i].hi = 0;
+        wf[i].M = buf + (size_t)i * 4 * KW - kmin;
+        wf[i].I = wf[i].M + KW;
+        wf[i].D = wf[i].I + KW;
+        wf[i].H = wf[i].D + KW;
+    }
+    rw.rowmax = buf + (size_t)R * 4 * KW;
+    rw.rowmj = rw.rowmax + tlen;
+    rw.colend = rw.rowmj + tlen;
+    memset(rw.rowmax, 0, 3 * (size_t)tlen * sizeof(int32_t));
+    rw.qlen = qlen, rw.a = a, rw.h0 = h0;
+    rw.best = h0, rw.best_r = rw.best_c = -1;
+    int bestg = 0;
+
+    // P = 0: the exact match from the origin
+    {
+        int e = wf_extend(query, qlen, target, tlen, 0, 0);
+        wf[0].lo = wf[0].hi = 0;
+        wf[0].M[0] = wf[0].H[0] = e;
+        wf[0].I[0] = wf[0].D[0] = WF_NEG;
+        wf_record_run(&rw, 0, 1, e, 0);
+        last_active = 0;
+    }
+
+    for (s = 1; s - last_active <= R; ++s) {
+        wavefront_t *cur = &wf[s % R];
+        const wavefront_t *sx  = s >= x? &wf[(s - x) % R] : NULL;
+        const wavefront_t *soi = s >= oi + ei? &wf[(s - oi - ei) % R] : NULL;
+        const wavefront_t *sei = s >= ei? &wf[(s - ei) % R] : NULL;
+        const wavefront_t *sod = s >= od + ed? &wf[(s - od - ed) % R] : NULL;
+        const wavefront_t *sed = s >= ed? &wf[(s - ed) % R] : NULL;
+        int lo = INT_MAX, hi = INT_MIN, klo, khi;
+
+        if (sx && sx->lo <= sx->hi)    lo = min_(lo, sx->lo), hi = max_(hi, sx->hi);
+        if (soi && soi->lo <= soi->hi) lo = min_(lo, soi->lo + 1), hi = max_(hi, soi->hi + 1);
+        if (sei && sei->lo <= sei->hi) lo = min_(lo, sei->lo + 1), hi = max_(hi, sei->hi + 1);
+        if (sod && sod->lo <= sod->hi) lo = min_(lo, sod->lo - 1), hi = max_(hi, sod->hi - 1);
+        if (sed && sed->lo <= sed->hi) lo = min_(lo, sed->lo - 1), hi = max_(hi, sed->hi - 1);
+        lo = lo > kmin? lo : kmin;
+        hi = hi < kmax? hi : kmax;
+        cur->lo = lo, cur->hi = hi;
+        if (lo > hi) continue;
+
+        int32_t *M = cur->M, *I = cur->I, *D = cur->D, *X = cur->H;
+        for (k = lo; k <= hi; ++k) M[k] = I[k] = D[k] = X[k] = WF_NEG;
+
+        // gap open/extend and mismatch, one source at a time over its own range
+        if (soi && soi->lo <= soi->hi)
+            for (k = max_(lo, soi->lo + 1), khi = min_(hi, soi->hi + 1); k <= khi; ++k)
+                I[k] = max_(I[k], soi->M[k-1]);
+        if (sei && sei->lo <= sei->hi)
+            for (k = max_(lo, sei->lo + 1), khi = min_(hi, sei->hi + 1); k <= khi; ++k)
+                I[k] = max_(I[k], sei->I[k-1]);
+        if (sod && sod->lo <= sod->hi)
+            for (k = max_(lo, sod->lo - 1), khi = min_(hi, sod->hi - 1); k <= khi; ++k)
+                D[k] = max_(D[k], sod->M[k+1] + 1);
+        if (sed && sed->lo <= sed->hi)
+            for (k = max_(lo, sed->lo - 1), khi = min_(hi, sed->hi - 1); k <= khi; ++k)
+                D[k] = max_(D[k], sed->D[k+1] + 1);
+        if (sx && sx->lo <= sx->hi)
+            for (klo = max_(lo, sx->lo), khi = min_(hi, sx->hi), k = klo; k <= khi; ++k)
+                X[k] = sx->H[k] + 1;
+
+        // drop points outside the matrix or with a non-positive score
+        int thr = s - 2 * h0;
+        for (k = lo; k <= hi; ++k) {
+            int vi = I[k], vd = D[k], vx = X[k], lim = min_(tlen, qlen - k);
+            I[k] = (vi >= 0 && vi <= lim && a * (2 * vi + k) > thr)? vi : WF_NEG;
+            D[k] = (vd >= 0 && vd <= lim && a * (2 * vd + k) > thr)? vd : WF_NEG;
+            X[k] = (vx >= 0 && vx <= lim && a * (2 * vx + k) > thr)? vx : WF_NEG;
+        }
+
+        // extend along matches; X[] becomes H[]
+        int alive = 0;
+        for (k = lo; k <= hi; ++k) {
+            int vi = I[k], vd = D[k], vx = X[k];
+            int c = max_(vx, max_(vi, vd)), e, diag;
+            if (c < 0) { M[k] = X[k] = WF_NEG; continue; }
+            e = c + wf_extend(query, qlen, target, tlen, c + k, c);
+            if (vi >= 0 && vi != c) wf_record(&rw, vi, vi + k, h0 + (a * (2 * vi + k) - s) / 2);
+            if (vd >= 0 && vd != c) wf_record(&rw, vd, vd + k, h0 + (a * (2 * vd + k) - s) / 2);
+            wf_record_run(&rw, k, c, e, s);
+            if (c == vx || e > c) diag = e;
+            else { // a gap state with no match after it; it cannot open a new gap
+                diag = WF_NEG;
+                if (vx >= 0) {
+                    diag = vx + wf_extend(query, qlen, target, tlen, vx + k, vx);
+                    wf_record_run(&rw, k, vx, diag, s);
+                }
+                int vg = (c == vi)? vd : vi, eg;
+                if (vg >= 0 && (eg = vg + wf_extend(query, qlen, target, tlen, vg + k, vg)) > vg) {
+                    wf_record_run(&rw, k, vg, eg, s);
+                    diag = max_(diag, eg);
+                }
+            }
+            // prune diagonals that can neither beat the best cell nor the best end-to-end score
+            int sc = h0 + (a * (2 * e + k) - s) / 2, je = e + k;
+            int pot = sc + a * min_(qlen - je, tlen - e);
+            bestg = max_(bestg, je == qlen? sc : 0);
+            if (pot < rw.best && (pot <= rw.best - end_bonus || pot < bestg)) {
+                M[k] = I[k] = D[k] = X[k] = WF_NEG;
+                continue;
+            }
+            if (zdrop > 0 && rw.best_r >= 0 && e - 1 > rw.best_r) {
+                int di = (e - 1) - rw.best_r, dj = (je - 1) - rw.best_c;
+                int drop = di > dj? rw.best - sc - (di - dj) * e_del : rw.best - sc - (dj - di) * e_ins;
+                if (drop > zdrop) {
+                    M[k] = I[k] = D[k] = X[k] = WF_NEG;
+                    continue;
+                }
+            }
+            M[k] = diag, X[k] = e;
+            alive = 1;
+        }
+        if (alive && s > s_max) // too divergent for wavefronts to pay off
+            return -1;
+        if (alive) {
+            last_active = s;
+            while (X[lo] < 0) ++lo;
+            while (X[hi] < 0) --hi;
+            cur->lo = lo, cur->hi = hi;
+        } else cur->lo = 1, cur->hi = 0;
+    }
+
+    // replay the row loop of scalarBandedSWA() on the row maxima
+    max = h0, max_i = max_j = -1, max_ie = -1, gscore = -1, max_off = 0;
+    for (i = 0; i < tlen; ++i) {
+        if (rw.colend[i] > 0 && rw.colend[i] >= gscore)
+            gscore = rw.colend[i], max_ie = i;
+        int m = rw.rowmax[i], mj = rw.rowmj[i];
+        if (m == 0) continue; // nothing alive recorded in this row
+        if (m > max) {
+            max = m, max_i = i, max_j = mj;
+            max_off = max_off > abs(mj - i)? max_off : abs(mj - i);
+        } else if (zdrop > 0) {
+            if (i - max_i > mj - max_j) {
+                if (max - m - ((i - max_i) - (mj - max_j)) * e_del > zdrop) break;
+            } else {
+                if (max - m - ((mj - max_j) - (i - max_i)) * e_ins > zdrop) break;
+            }
+        }
+    }
+    if (_qle) *_qle = max_j + 1;
+    if (_tle) *_tle = max_i + 1;
+    if (_gtle) *_gtle = max_ie + 1;
+    if (_gscore) *_gscore = gscore;
+    if (_max_off) *_max_off = max_off;
+    return max;
+}
+
+// a pair can go to the wavefront kernel if it has no ambiguous base
+static inline int wf_pair_ok(const uint8_t *q, int qlen, const uint8_t *t, int tlen)
+{
+    uint8_t o = 0;
+    for (int i = 0; i < qlen; ++i) o |= q[i];
+    for (int i = 0; i < tlen; ++i) o |= t[i];
+    return o < 4;
+}
+
+// -------------------------------------------------------------
+// Wavefront extension, wrapper function
+// Pairs with ambiguous bases, a non-standard scoring matrix or too many differences
+// are left for the banded DP kernels at the end of seqPairArray; the number of pairs
+// finished here, which come first, is returned. The DP kernels may pad their batch
+// past the last pair, so the finished ones must not sit at the end. With check, the other pairs are also aligned by
+// scalarBandedSWA(), whose result is kept, and disagreements in what the caller
+// uses are counted in wfa_diff.
+//-------------------------------------------------------------
+int BandedPairWiseSW::wavefrontSWAWrapper(SeqPair *seqPairArray,
+                                          uint8_t *seqBufRef,
+                                          uint8_t *seqBufQer,
+                                          int numPairs,
+                                          int nthreads,
+                                          int32_t w,
+                                          int check)
+{
+    int std_mat = 1, n_wf = 0;
+    for (int i = 0; i < 4; ++i)
+        for (int j = 0; j < 4; ++j)
+            if (mat[i * m + j] != (i == j? mat[0] : mat[1])) std_mat = 0;
+    if (mat[0] <= 0 || mat[1] >= 0) std_mat = 0;
+
+    for (int i=0; i<numPairs; i++)
+    {
+        SeqPair *p = seqPairArray + i;
+        uint8_t *seq1 = seqBufRef + p->idr;
+        uint8_t *seq2 = seqBufQer + p->idq;
+        SeqPair r = *p;
+
+        if (!std_mat || p->h0 <= 0 || !wf_pair_ok(seq2, p->len2, seq1, p->len1) ||
+            (r.score = wavefrontSWA(p->len2, seq2, p->len1,
+                                    seq1, w, p->h0, &r.qle, &r.tle,
+                                    &r.gtle, &r.gscore, &r.max_off)) < 0)
+        {
+            wfa_dp++;
+            continue;
+        }
+        wfa_pairs++;
+        if (check) {
+            p->score = scalarBandedSWA(p->len2, seq2, p->len1,
+                                       seq1, w, p->h0, &p->qle, &p->tle,
+                                       &p->gtle, &p->gscore, &p->max_off);
+            int wg = r.gscore > 0 && r.gscore > r.score - end_bonus;
+            int pg = p->gscore > 0 && p->gscore > p->score - end_bonus;
+            int wo = r.max_off < (w >> 1) + (w >> 2), po = p->max_off < (w >> 1) + (w >> 2);
+            if (r.score != p->score || wg != pg || wo != po ||
+                (pg? (r.gscore != p->gscore || r.gtle != p->gtle) : (r.qle != p->qle || r.tle != p->tle))) {
+                wfa_diff++;
+#if MAXI
+                fprintf(stderr, "wfa %d (%d %d) %d %d %d, bsw %d (%d %d) %d %d %d\n",
+                        r.score, r.tle, r.qle, r.gscore, r.max_off, r.gtle,
+                        p->score, p->tle, p->qle, p->gscore, p->max_off, p->gtle);
+#endif
+            }
+        }
+        else *p = r;
+        r = *p;
+        *p = seqPairArray[n_wf];
+        seqPairArray[n_wf++] = r;
+    }
+    return n_wf;
+}